@@ -4,14 +4,14 @@
 #include "LogInfo.h"
 #include "NTPInfo.h"
 #include "WakeUpInfo.h"
+#include "ResourceLock.h"
+#include "SampleWindows.h"
+#include "SensorFilter.h"
+#include "History.h"
 
-class BaseSensorClass;
+#define SENSOR_SAMPLES 2    // Values per sensor kept for the rolling statistics
 
-typedef struct sensorInstanceStruct
-{
-    uint8_t id;
-    BaseSensorClass *instance;
-} SensorInstance;
+class BaseConfigInfoClass;
 
 class BaseSensorClass
 {
@@ -20,52 +20,17 @@ public:
      * Base Class Constructor
      * 
      * @param sectionName The sensor short name so we can identify the instance in logs
+     * @param singleThread True if the sensor must be read on core 1 and not by the core 0 workers
+     * @param firstSample The name of the first value kept for the rolling statistics, NULL for none
+     * @param secondSample The name of the second value, NULL for none
      */
-    BaseSensorClass(const char *sensorName, bool singleThread = false)
+    BaseSensorClass(const char *sensorName, bool singleThread = false, const char *firstSample = NULL,
+                    const char *secondSample = NULL)
     {
         strcpy(this->_name, sensorName);
-        _instance.instance = this;
-        _instance.id = 1;
         this->_singleThreadOnly = singleThread;
-    }
-
-    /**
-     * Static task function that is ran.  This will cast the parameters point to a struct 
-     * and run the instance taskToRun overridden function
-     * 
-     * @param parameters The parameters to be passed to the task
-     */
-    static void task(void *parameters)
-    {
-        auto pSensor = (struct sensorInstanceStruct *)parameters;
-        LogInfo.log(LOG_VERBOSE, "Initializing %s Task and is enabled %s", pSensor->instance->getName(),
-                    pSensor->instance->getIsEnabled() ? "Yes" : "No");
-        vTaskSuspend(pSensor->instance->getHandle());
-        for (;;)
-        {
-            WakeUp.suspendSleep();
-            if (pSensor->instance->getIsEnabled())
-            {
-                if (xSemaphoreTake(pSensor->instance->getSemaphore(), portMAX_DELAY))
-                {
-                    if (pSensor->instance->getIsConnected())
-                    {
-                        if (pSensor->instance->taskToRun())
-                        {
-                            pSensor->instance->setEpoch();
-                        }
-                    }
-                    xSemaphoreGive(pSensor->instance->getSemaphore());
-                }
-                else
-                {
-                    LogInfo.log(LOG_VERBOSE, "Could not get flag for %s", pSensor->instance->getName());
-                }
-            }
-            vTaskDelay(100);
-            WakeUp.resumeSleep();
-            vTaskSuspend(pSensor->instance->getHandle());
-        }
+        this->_sampleNames[0] = firstSample;
+        this->_sampleNames[1] = secondSample;
     }
 
     /**
@@ -78,9 +43,9 @@ public:
     /**
      * Virtual begin function will initialise the sensor
      * 
-     * @param flag The semaphore flag that will control the access to the hardware.
+     * @param lock The lock that controls the access to the hardware the sensor is on.
      */
-    virtual void begin(SemaphoreHandle_t flag) = 0;
+    virtual void begin(ResourceLock *lock) = 0;
 
     /**
      * Virtual the instance task to run and read the sensor data
@@ -96,6 +61,31 @@ public:
      */
     virtual const char *toString() = 0;
 
+    /**
+     * Virtual create a JSON element with the sensor's readings and statistics for the device twin
+     * 
+     * @param ob The ArduinoJson object that this element will be added to.
+     */
+    virtual void toJson(JsonObject ob) = 0;
+
+    /**
+     * Virtual create a JSON element with the sensor's readings for the telemetry, the same as the device twin
+     * unless the sensor overrides it
+     * 
+     * @param ob The ArduinoJson object that this element will be added to.
+     */
+    virtual void toTelemetry(JsonObject ob)
+    {
+        this->toJson(ob);
+    }
+
+    /**
+     * Virtual get the configuration section of the sensor, so it can be added to the configuration
+     * 
+     * @return The configuration section
+     */
+    virtual BaseConfigInfoClass *getConfig() = 0;
+
     /**
      * Virtual update the enabled flag and make the derived class update the configuration has changed flag
      * 
@@ -104,26 +94,12 @@ public:
     virtual void changeEnabled(bool flag) = 0;
 
     /**
-     * To kick off the task
+     * The sensor's settings have changed at runtime, they are applied before the next read so the sensor
+     * is never changed part way through a read
      */
-    void tick()
+    void reconfigure()
     {
-        if ((millis() - this->_last_read) > this->_sampleRate)
-        {
-            if (this->getIsConnected())
-            {
-                if (this->getSingleThreadFlag())
-                {
-                    WakeUp.suspendSleep();
-                    this->taskToRun();
-                    WakeUp.resumeSleep();
-                }
-                else if (this->getHandle() != NULL)
-                {
-                    vTaskResume(this->getHandle());
-                }
-            }
-        }
+        this->_reconfigure = true;
     }
 
     /**
@@ -157,29 +133,37 @@ public:
     }
 
     /**
-     * Get the internal task handle
+     * Get the milliseconds between reads
      * 
-     * @return The task handle
+     * @return The sample rate
      */
-    const TaskHandle_t getHandle()
+    const uint16_t getSampleRate()
     {
-        return this->_taskHandle;
+        return this->_sampleRate;
     }
 
     /**
-     * Get the semaphore flag
+     * Virtual get the milliseconds until the next read, the sample rate unless the sensor adapts it
      * 
-     * @return The semaphore flag
+     * @return The interval
      */
-    const SemaphoreHandle_t getSemaphore()
+    virtual uint32_t getInterval()
     {
-        return this->_semaphoreFlag;
+        return this->_sampleRate;
     }
 
     /**
-     * Update the timestamp to the current epoch time.
+     * Get the lock for the hardware the sensor is on
      * 
-     * @return The semaphore flag
+     * @return The resource lock
+     */
+    ResourceLock *getLock()
+    {
+        return this->_lock;
+    }
+
+    /**
+     * Update the timestamp to the current epoch time.
      */
     void setEpoch()
     {
@@ -187,7 +171,8 @@ public:
     }
 
     /**
-     * Get if Single Thread Mode Flag, sometime sensorsneed delaymicroseconds and this blocks and the watch dog triggers.
+     * Get if Single Thread Mode Flag, sometime sensors need delaymicroseconds and this blocks and the watch dog triggers,
+     * so these are read on core 1.
      * 
      * @return The single thread mode flag
      */
@@ -196,18 +181,81 @@ public:
         return this->_singleThreadOnly;
     }
 
+    /**
+     * Create a JSON element with the rolling statistics of each value
+     * 
+     * @param ob The ArduinoJson object that this element will be added to.
+     */
+    void statsToJson(JsonObject ob)
+    {
+        auto json = ob.createNestedObject("stats");
+        for (uint8_t i = 0; i < SENSOR_SAMPLES; i++)
+        {
+            if (this->_sampleNames[i] != NULL)
+            {
+                this->_samples[i].toJson(json, this->_sampleNames[i]);
+            }
+        }
+        this->_filters.toJson(json);
+    }
+
 protected:
+    /**
+     * Add the values of a good read to the rolling statistics and the history
+     * 
+     * @param values One value for each sample name, in the same order
+     * @param now The millis() of the read
+     */
+    void addSamples(const float *values, uint32_t now)
+    {
+        for (uint8_t i = 0; i < SENSOR_SAMPLES; i++)
+        {
+            if (this->_sampleNames[i] != NULL)
+            {
+                this->_samples[i].add(values[i], now);
+                this->addHistory(this->_sampleNames[i], values[i]);
+            }
+        }
+    }
+
+    /**
+     * Add a value of a good read to the history only, for values without rolling statistics (e.g. the GPS position)
+     * 
+     * @param value The name of the value
+     * @param sample The value
+     */
+    void addHistory(const char *value, float sample)
+    {
+        History.add(this->_name, value, sample, NTPInfo.getEpoch());
+    }
+
+    /**
+     * Run the values of a read through the sensor's filter pipelines, before they are published
+     * 
+     * @param names The name of each value, as used in the "filters" element of the sensor's section
+     * @param values The values, replaced by the filtered values
+     * @param count The number of values
+     * @param now The millis() of the read
+     * @return False if a value was rejected as an outlier, the read should not be published
+     */
+    bool filterValues(const char *const *names, float *values, uint8_t count, uint32_t now)
+    {
+        return this->_filters.apply(names, values, count, now);
+    }
+
     char _name[10];
     char _toString[256];
-    TaskHandle_t _taskHandle;
-    SemaphoreHandle_t _semaphoreFlag;
+    ResourceLock *_lock;
     bool _connected;
     bool _enabled;
     uint16_t _sampleRate;
     uint64_t _last_read;
     long _epoch_time;
     bool _singleThreadOnly;
-    SensorInstance _instance;
+    bool _reconfigure;
+    const char *_sampleNames[SENSOR_SAMPLES];
+    SampleWindows _samples[SENSOR_SAMPLES];
+    SensorFilters _filters;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include <math.h>
+#include "SampleWindows.h"
+
+// Window lengths in seconds and the names they are reported under
+const uint16_t SampleWindows::_spans[SAMPLE_WINDOWS] = {60, 300, 900};
+const char *SampleWindows::_names[SAMPLE_WINDOWS] = {"1m", "5m", "15m"};
+
+/**
+ * Class Constructor
+ */
+SampleWindows::SampleWindows() : _last(0)
+{
+    memset(this->_buckets, 0, sizeof(this->_buckets));
+}
+
+/**
+ * Add a sample to its bucket in every window, a bucket left over from an earlier pass round the ring is
+ * started again
+ *
+ * @param value The sample
+ * @param now The millis() the sample was taken
+ */
+void SampleWindows::add(float value, uint32_t now)
+{
+    this->_mux.enter();
+    for (uint8_t w = 0; w < SAMPLE_WINDOWS; w++)
+    {
+        uint32_t index = now / (_spans[w] * 1000UL / SAMPLE_BUCKETS);
+        SampleBucket *bucket = &this->_buckets[w][index % (SAMPLE_BUCKETS + 1)];
+        if (bucket->count == 0 || bucket->index != index)
+        {
+            bucket->index = index;
+            bucket->count = 1;
+            bucket->mean = value;
+            bucket->m2 = 0;
+            bucket->min = value;
+            bucket->max = value;
+            continue;
+        }
+        if (bucket->count < UINT16_MAX)
+        {
+            bucket->count++;
+            float delta = value - bucket->mean;
+            bucket->mean += delta / bucket->count;
+            bucket->m2 += delta * (value - bucket->mean);
+        }
+        bucket->min = fminf(bucket->min, value);
+        bucket->max = fmaxf(bucket->max, value);
+    }
+    this->_last = now;
+    this->_mux.exit();
+}
+
+/**
+ * Create a JSON element with the count, min, max, mean and standard deviation of each window
+ *
+ * @param ob The ArduinoJson object that this element will be added to.
+ * @param name The name of the value
+ */
+void SampleWindows::toJson(JsonObject ob, const char *name)
+{
+    SampleStats stats[SAMPLE_WINDOWS];
+    this->_mux.enter();
+    for (uint8_t w = 0; w < SAMPLE_WINDOWS; w++)
+    {
+        this->merge(w, &stats[w]);
+    }
+    this->_mux.exit();
+    auto json = ob.createNestedObject(name);
+    for (uint8_t w = 0; w < SAMPLE_WINDOWS; w++)
+    {
+        auto element = json.createNestedObject(_names[w]);
+        element["n"] = stats[w].count;
+        element["min"] = stats[w].min;
+        element["max"] = stats[w].max;
+        element["mean"] = stats[w].mean;
+        element["sd"] = stats[w].count > 1 ? sqrtf(fmaxf(stats[w].m2, 0.0f) / (stats[w].count - 1)) : 0;
+    }
+}
+
+/**
+ * Merge the buckets in the window's span before the last sample (Chan's parallel form of Welford's method).
+ * The bucket being filled is only part of the way through, so the span is covered by it and the
+ * SAMPLE_BUCKETS whole buckets before it.
+ *
+ * @param window The window
+ * @param stats Set to the statistics of the window, all 0 if it has no samples
+ */
+void SampleWindows::merge(uint8_t window, SampleStats *stats)
+{
+    memset(stats, 0, sizeof(SampleStats));
+    uint32_t current = this->_last / (_spans[window] * 1000UL / SAMPLE_BUCKETS);
+    for (uint8_t b = 0; b <= SAMPLE_BUCKETS; b++)
+    {
+        const SampleBucket *bucket = &this->_buckets[window][b];
+        if (bucket->count == 0 || current - bucket->index > SAMPLE_BUCKETS)
+        {
+            continue;
+        }
+        if (stats->count == 0)
+        {
+            stats->min = bucket->min;
+            stats->max = bucket->max;
+        }
+        uint32_t count = stats->count + bucket->count;
+        float delta = bucket->mean - stats->mean;
+        stats->mean += delta * bucket->count / count;
+        stats->m2 += bucket->m2 + delta * delta * ((float)stats->count * bucket->count / count);
+        stats->min = fminf(stats->min, bucket->min);
+        stats->max = fmaxf(stats->max, bucket->max);
+        stats->count = count;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef SAMPLEWINDOWS_H
+#define SAMPLEWINDOWS_H
+
+#include "Hal.h"
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+
+#define SAMPLE_BUCKETS 15        // Buckets each window is split into, a bucket is 1/15 of the window's span
+#define SAMPLE_WINDOWS 3         // Windows reported per channel, see SampleWindows::_spans
+
+typedef struct sampleBucketStruct
+{
+    uint32_t index;     // The time the bucket is for, millis() / bucket length
+    uint16_t count;     // 0 if the bucket has never been used
+    float mean;         // Welford running mean and sum of squared differences
+    float m2;
+    float min;
+    float max;
+} SampleBucket;
+
+typedef struct sampleStatsStruct
+{
+    uint32_t count;
+    float mean;
+    float m2;
+    float min;
+    float max;
+} SampleStats;
+
+/**
+ * Rolling statistics of one sensor value over several time windows.  Each window is split into SAMPLE_BUCKETS
+ * buckets of the same length, a sample is added to the bucket for its time in each window with Welford's
+ * method and the buckets are merged when the statistics are reported, so a window holds every sample in its
+ * span however fast the sensor is read and a sample costs the same whatever the window size.
+ */
+class SampleWindows
+{
+public:
+    SampleWindows();
+    void add(float value, uint32_t now);
+    void toJson(JsonObject ob, const char *name);
+
+private:
+    void merge(uint8_t window, SampleStats *stats);
+    static const uint16_t _spans[SAMPLE_WINDOWS];
+    static const char *_names[SAMPLE_WINDOWS];
+    // One more bucket than the span, the one being filled is only part of the way through
+    SampleBucket _buckets[SAMPLE_WINDOWS][SAMPLE_BUCKETS + 1];
+    uint32_t _last;     // The millis() of the last sample, the windows end here
+    Hal::Spinlock _mux;
+};
+
+#endif
@@ -0,0 +1,352 @@
+#include "SensorFilter.h"
+#include "LogInfo.h"
+
+const char *SensorFilter::_typeNames[FT_COUNT] = {"none", "median", "ema", "kalman", "outlier"};
+
+/**
+ * Class Constructor, the pipeline starts with no stages so the values are passed through
+ */
+SensorFilter::SensorFilter() : _count(0), _rejected(0)
+{
+    memset(this->_stages, 0, sizeof(this->_stages));
+}
+
+/**
+ * Load the stages of the pipeline, an unknown type is logged and left out
+ * 
+ * @param stages The stages in the order they run, e.g. [{"type": "median", "size": 5}, {"type": "ema", "alpha": 0.3}]
+ * @return True if every stage was loaded
+ */
+bool SensorFilter::load(JsonArrayConst stages)
+{
+    bool loaded = true;
+    this->_count = 0;
+    for (JsonObjectConst element : stages)
+    {
+        const char *typeName = element["type"] | "";
+        uint8_t type = FT_MEDIAN;
+        while (type < FT_COUNT && strcmp(typeName, SensorFilter::_typeNames[type]) != 0)
+        {
+            type++;
+        }
+        if (type == FT_COUNT || this->_count >= FILTER_STAGES)
+        {
+            LogInfo.log(LM_SENSOR, LOG_ERROR, "Filter %s not loaded, the type is unknown or there are more than %u stages",
+                        typeName, FILTER_STAGES);
+            loaded = false;
+            continue;
+        }
+        FilterStage *stage = &this->_stages[this->_count++];
+        stage->type = type;
+        switch (type)
+        {
+        case FT_MEDIAN:
+            // An odd window, so the median is a sample and not an average of two
+            stage->first = (constrain(element["size"] | 3, 1, FILTER_MEDIAN_MAX) - 1) | 1;
+            break;
+        case FT_EMA:
+            stage->first = constrain(element["alpha"] | 0.5f, 0.01f, 1.0f);
+            break;
+        case FT_KALMAN:
+            stage->first = max(element["q"] | 0.01f, 0.0f);
+            stage->second = max(element["r"] | 1.0f, 1e-12f);
+            break;
+        case FT_OUTLIER:
+            stage->first = max(element["maxRate"] | 1.0f, 0.0f);
+            stage->second = constrain(element["limit"] | 3, 1, 255);
+            break;
+        }
+    }
+    this->reset();
+    return loaded;
+}
+
+/**
+ * Save the stages of the pipeline
+ * 
+ * @param stages The ArduinoJson array the stages are added to
+ */
+void SensorFilter::save(JsonArray stages)
+{
+    for (uint8_t i = 0; i < this->_count; i++)
+    {
+        FilterStage *stage = &this->_stages[i];
+        auto element = stages.createNestedObject();
+        element["type"] = SensorFilter::_typeNames[stage->type];
+        switch (stage->type)
+        {
+        case FT_MEDIAN:
+            element["size"] = (uint8_t)stage->first;
+            break;
+        case FT_EMA:
+            element["alpha"] = stage->first;
+            break;
+        case FT_KALMAN:
+            element["q"] = stage->first;
+            element["r"] = stage->second;
+            break;
+        case FT_OUTLIER:
+            element["maxRate"] = stage->first;
+            element["limit"] = (uint8_t)stage->second;
+            break;
+        }
+    }
+}
+
+/**
+ * Forget the samples, the next sample starts each stage again
+ */
+void SensorFilter::reset()
+{
+    for (uint8_t i = 0; i < this->_count; i++)
+    {
+        FilterStage *stage = &this->_stages[i];
+        stage->primed = false;
+        stage->count = 0;
+        stage->next = 0;
+    }
+    this->_rejected = 0;
+}
+
+/**
+ * Run a sample through the pipeline
+ * 
+ * @param value The sample, replaced by the filtered value
+ * @param now The millis() of the sample
+ * @return False if an outlier stage rejected the sample, the value should not be used
+ */
+bool SensorFilter::apply(float *value, uint32_t now)
+{
+    for (uint8_t i = 0; i < this->_count; i++)
+    {
+        FilterStage *stage = &this->_stages[i];
+        switch (stage->type)
+        {
+        case FT_MEDIAN:
+            *value = SensorFilter::median(stage, *value);
+            break;
+        case FT_EMA:
+            stage->value = stage->primed ? stage->value + stage->first * (*value - stage->value) : *value;
+            stage->primed = true;
+            *value = stage->value;
+            break;
+        case FT_KALMAN:
+            *value = SensorFilter::kalman(stage, *value, now);
+            break;
+        case FT_OUTLIER:
+            if (!SensorFilter::outlier(stage, *value, now))
+            {
+                this->_rejected++;
+                return false;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Get the number of stages
+ * 
+ * @return The stages in the pipeline
+ */
+uint8_t SensorFilter::getCount()
+{
+    return this->_count;
+}
+
+/**
+ * Get the number of samples rejected as outliers
+ * 
+ * @return The rejected samples
+ */
+uint32_t SensorFilter::getRejected()
+{
+    return this->_rejected;
+}
+
+/**
+ * Add the sample to the median window and get the median, the window is at most FILTER_MEDIAN_MAX samples so
+ * sorting a copy costs no more than keeping it sorted
+ * 
+ * @param stage The median stage
+ * @param sample The sample
+ * @return The median of the window
+ */
+float SensorFilter::median(FilterStage *stage, float sample)
+{
+    uint8_t size = stage->first;
+    stage->window[stage->next] = sample;
+    stage->next = (stage->next + 1) % size;
+    stage->count = min((uint8_t)(stage->count + 1), size);
+    float sorted[FILTER_MEDIAN_MAX];
+    for (uint8_t i = 0; i < stage->count; i++)
+    {
+        float value = stage->window[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+    return sorted[stage->count / 2];
+}
+
+/**
+ * Update the Kalman estimate with the sample.  The value is modelled as constant with a random walk, so the
+ * error variance grows by q for each second since the last sample and the sample has the variance r.
+ * 
+ * @param stage The Kalman stage
+ * @param sample The sample
+ * @param now The millis() of the sample
+ * @return The new estimate
+ */
+float SensorFilter::kalman(FilterStage *stage, float sample, uint32_t now)
+{
+    if (!stage->primed)
+    {
+        stage->primed = true;
+        stage->value = sample;
+        stage->variance = stage->second;
+    }
+    else
+    {
+        stage->variance += stage->first * (now - stage->time) / 1000.0f;
+        float gain = stage->variance / (stage->variance + stage->second);
+        stage->value += gain * (sample - stage->value);
+        stage->variance *= 1.0f - gain;
+    }
+    stage->time = now;
+    return stage->value;
+}
+
+/**
+ * Check the sample did not change faster than maxRate per second since the last sample let through.  After
+ * limit rejects in a row the sample is let through, so a real step in the value is only held back for a while.
+ * 
+ * @param stage The outlier stage
+ * @param sample The sample
+ * @param now The millis() of the sample
+ * @return True if the sample is let through
+ */
+bool SensorFilter::outlier(FilterStage *stage, float sample, uint32_t now)
+{
+    if (stage->primed && fabsf(sample - stage->value) > stage->first * (now - stage->time) / 1000.0f &&
+        stage->count < stage->second)
+    {
+        stage->count++;
+        return false;
+    }
+    stage->primed = true;
+    stage->value = sample;
+    stage->time = now;
+    stage->count = 0;
+    return true;
+}
+
+/**
+ * Class Constructor, no value has a pipeline
+ */
+SensorFilters::SensorFilters() : _count(0)
+{
+    memset(this->_names, 0, sizeof(this->_names));
+}
+
+/**
+ * Load the pipelines of the values
+ * 
+ * @param filters The "filters" element of the sensor's section, each member is a value name and its stages
+ */
+void SensorFilters::load(JsonObjectConst filters)
+{
+    this->_count = 0;
+    for (JsonPairConst pair : filters)
+    {
+        if (this->_count >= FILTER_VALUES)
+        {
+            LogInfo.log(LM_SENSOR, LOG_ERROR, "Filter for %s not loaded, only %u values can be filtered", pair.key().c_str(), FILTER_VALUES);
+            continue;
+        }
+        strlcpy(this->_names[this->_count], pair.key().c_str(), FILTER_NAME_SIZE);
+        this->_filters[this->_count++].load(pair.value().as<JsonArrayConst>());
+    }
+}
+
+/**
+ * Save the pipelines, nothing is added if there are none
+ * 
+ * @param json The sensor's section, the "filters" element is added to it
+ */
+void SensorFilters::save(JsonObject json)
+{
+    if (this->_count == 0)
+    {
+        return;
+    }
+    auto filters = json.createNestedObject("filters");
+    for (uint8_t i = 0; i < this->_count; i++)
+    {
+        this->_filters[i].save(filters.createNestedArray((const char *)this->_names[i]));
+    }
+}
+
+/**
+ * Run the values of a read through their pipelines, a value without a pipeline is left as it is.  Every value
+ * is run even if one is rejected, so each pipeline sees every read.
+ * 
+ * @param names The name of each value
+ * @param values The values, replaced by the filtered values
+ * @param count The number of values
+ * @param now The millis() of the read
+ * @return False if a value was rejected as an outlier, the read should not be used
+ */
+bool SensorFilters::apply(const char *const *names, float *values, uint8_t count, uint32_t now)
+{
+    bool accepted = true;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        SensorFilter *filter = this->find(names[i]);
+        if (filter != NULL && !filter->apply(&values[i], now))
+        {
+            accepted = false;
+        }
+    }
+    return accepted;
+}
+
+/**
+ * Create a JSON element with the samples rejected for each value, nothing is added if there are no pipelines
+ * 
+ * @param ob The ArduinoJson object that this element will be added to.
+ */
+void SensorFilters::toJson(JsonObject ob)
+{
+    if (this->_count == 0)
+    {
+        return;
+    }
+    auto json = ob.createNestedObject("rejected");
+    for (uint8_t i = 0; i < this->_count; i++)
+    {
+        json[(const char *)this->_names[i]] = this->_filters[i].getRejected();
+    }
+}
+
+/**
+ * Find the pipeline of a value
+ * 
+ * @param name The value name
+ * @return The pipeline, NULL if the value has none
+ */
+SensorFilter *SensorFilters::find(const char *name)
+{
+    for (uint8_t i = 0; i < this->_count; i++)
+    {
+        if (strcmp(this->_names[i], name) == 0)
+        {
+            return &this->_filters[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef SENSORFILTER_H
+#define SENSORFILTER_H
+
+#include <Arduino.h>
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+
+#define FILTER_STAGES 3            // Stages in one value's pipeline
+#define FILTER_MEDIAN_MAX 7        // Largest median window
+#define FILTER_VALUES 4            // Values per sensor that can have a pipeline
+#define FILTER_NAME_SIZE 12        // Longest value name, including the terminator
+
+typedef enum
+{
+    FT_NONE = 0,
+    FT_MEDIAN,      // Median of the last size samples, removes single spikes
+    FT_EMA,         // Exponential moving average, value += alpha * (sample - value)
+    FT_KALMAN,      // Scalar Kalman filter for a slowly moving value, e.g. a GPS coordinate
+    FT_OUTLIER,     // Rejects a sample that changed faster than maxRate per second
+    FT_COUNT
+} FilterType;
+
+typedef struct filterStageStruct
+{
+    uint8_t type;
+    float first;                      // size, alpha, q (process noise per second) or maxRate
+    float second;                     // r (measurement noise) or limit (rejects in a row before a step is taken)
+    bool primed;                      // Has had a sample
+    uint32_t time;                    // millis() of the last sample
+    float value;                      // The average, the estimate or the last sample let through
+    float variance;                   // Kalman error variance
+    uint8_t count;                    // Samples in the median window or rejects in a row
+    uint8_t next;                     // Median window slot for the next sample
+    float window[FILTER_MEDIAN_MAX];
+} FilterStage;
+
+/**
+ * The filter pipeline of one sensor value.  The stages run in the order they are configured, each keeps a fixed
+ * amount of state, so a sample costs the same however long the sensor has been running.
+ */
+class SensorFilter
+{
+public:
+    SensorFilter();
+    bool load(JsonArrayConst stages);
+    void save(JsonArray stages);
+    void reset();
+    bool apply(float *value, uint32_t now);
+    uint8_t getCount();
+    uint32_t getRejected();
+
+private:
+    static float median(FilterStage *stage, float sample);
+    static float kalman(FilterStage *stage, float sample, uint32_t now);
+    static bool outlier(FilterStage *stage, float sample, uint32_t now);
+    static const char *_typeNames[FT_COUNT];
+    FilterStage _stages[FILTER_STAGES];
+    uint8_t _count;
+    uint32_t _rejected;
+};
+
+/**
+ * The filter pipelines of a sensor, by value name, loaded from the "filters" element of the sensor's section, e.g.
+ * "filters": { "temperature": [{ "type": "outlier", "maxRate": 0.5 }, { "type": "median", "size": 3 }] }
+ */
+class SensorFilters
+{
+public:
+    SensorFilters();
+    void load(JsonObjectConst filters);
+    void save(JsonObject json);
+    bool apply(const char *const *names, float *values, uint8_t count, uint32_t now);
+    void toJson(JsonObject ob);
+
+private:
+    SensorFilter *find(const char *name);
+    char _names[FILTER_VALUES][FILTER_NAME_SIZE];
+    SensorFilter _filters[FILTER_VALUES];
+    uint8_t _count;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include "Hal.h"
+
+/**
+ * A sequence lock holding a copy of a reading.  There is a single writer (the sensor's read) and any number of
+ * readers, which never block the writer and never take a lock.  The sequence is odd while a write is in
+ * progress, so a reader that sees it odd or sees it change copies the value again.
+ */
+template <typename T>
+class SeqLock
+{
+public:
+    /**
+     * Class Constructor, the value starts zeroed with sequence 0
+     */
+    SeqLock() : _sequence(0)
+    {
+        memset(&this->_value, 0, sizeof(T));
+    }
+
+    /**
+     * Publish a new value.  The copy is done with the writer's core in a critical section, so a reader on
+     * the same core can never spin on a half finished write.
+     *
+     * @param value The new value
+     * @return The sequence number of the value, it counts the writes
+     */
+    uint32_t write(const T &value)
+    {
+        this->_mux.enter();
+        this->_sequence++;
+        __sync_synchronize();
+        memcpy((void *)&this->_value, &value, sizeof(T));
+        __sync_synchronize();
+        this->_sequence++;
+        this->_mux.exit();
+        return this->_sequence / 2;
+    }
+
+    /**
+     * Copy out a consistent value, all of it from the same write
+     *
+     * @param value Where the value is copied to
+     * @return The sequence number of the value, 0 if nothing has been written
+     */
+    uint32_t read(T *value) const
+    {
+        uint32_t start;
+        do
+        {
+            start = this->_sequence;
+            __sync_synchronize();
+            memcpy(value, (const void *)&this->_value, sizeof(T));
+            __sync_synchronize();
+        } while ((start & 1) != 0 || start != this->_sequence);
+        return start / 2;
+    }
+
+    /**
+     * Get the sequence number of the last value written
+     *
+     * @return The sequence number, 0 if nothing has been written
+     */
+    uint32_t getSequence() const
+    {
+        return this->_sequence / 2;
+    }
+
+private:
+    volatile uint32_t _sequence;
+    T _value;
+    Hal::Spinlock _mux;
+};
+
+#endif
@@ -4,7 +4,7 @@
 #include "WakeUpInfo.h"
 #include "LedInfo.h"
 
-RTC_DATA_ATTR int _Aws_count;
+HAL_RTC_DATA int _Aws_count;
 
 /**
  * This the static callback for processing messages return from the IoT broker
@@ -33,7 +33,7 @@ AwsInstanceClass::AwsInstanceClass() : BaseCloudProvider(CPT_AWS)
  */
 bool AwsInstanceClass::sendDeviceReport(JsonObject json)
 {
-    LogInfo.log(LOG_VERBOSE, F("Calling AWS sendDeviceReport"));
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Calling AWS sendDeviceReport"));
     DynamicJsonDocument doc(500);
     JsonObject state = doc.createNestedObject("state");
     JsonObject reported = state.createNestedObject("reported");
@@ -53,7 +53,7 @@ bool AwsInstanceClass::sendDeviceReport(JsonObject json)
  */
 bool AwsInstanceClass::updateProperty(JsonObjectConst element)
 {
-    LogInfo.log(LOG_VERBOSE, F("Calling AWS updateProperty"));    
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Calling AWS updateProperty"));    
     if (this->getIsConnected())
     {
         DynamicJsonDocument doc(500);
@@ -77,17 +77,17 @@ bool AwsInstanceClass::connect(const IoTConfig *config)
         this->_tryConnecting = true;
         this->_config = config;
         this->initialiseConnection(AwsInstanceClass::mqttCallback);
-        if (heap_caps_check_integrity_all(true) == false)
+        if (!Hal::heapCheck())
         {
-            LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -AWS Connect -1"));
+            LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -AWS Connect -1"));
         }        
         if (this->mqttConnection())
         {
             this->getCurrentStatus();
         }
-        if (heap_caps_check_integrity_all(true) == false)
+        if (!Hal::heapCheck())
         {
-            LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -AWS Connect -2"));
+            LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -AWS Connect -2"));
         }          
     }
     return this->getIsConnected();
@@ -107,12 +107,12 @@ bool AwsInstanceClass::getCurrentStatus()
         strcpy(topic, this->_shadowPrefix);
         strcat(topic, "/get");
 
-        LogInfo.log(LOG_VERBOSE, "Getting Current Status to [%s]", topic);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Getting Current Status to [%s]", topic);
         sent = this->_mqttClient.publish(
             topic,
             nullptr);
     }
-    LogInfo.log(LOG_INFO, "Current GET status is %s at %s", sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
+    LogInfo.log(LM_CLOUD, LOG_INFO, "Current GET status is %s at %s", sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
     return sent;
 }
 
@@ -122,9 +122,9 @@ bool AwsInstanceClass::getCurrentStatus()
 void AwsInstanceClass::buildUserName(char *userName)
 {
     userName = NULL;
-    if (heap_caps_check_integrity_all(true) == false)
+    if (!Hal::heapCheck())
     {
-        LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -buildUserName"));
+        LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -buildUserName"));
     }    
 }
 
@@ -137,7 +137,7 @@ void AwsInstanceClass::buildUserName(char *userName)
  */
 void AwsInstanceClass::processReply(char *topic, byte *payload, unsigned int length)
 {
-    LogInfo.log(LOG_VERBOSE, "Received Aws Reply from [%s][%u]", topic, length);
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Received Aws Reply from [%s][%u]", topic, length);
     DynamicJsonDocument doc(length * 2);
     bool hasBody = false;
     if (length > 0)
@@ -145,10 +145,10 @@ void AwsInstanceClass::processReply(char *topic, byte *payload, unsigned int len
         DeserializationError err = deserializeJson(doc, (char *)payload);
         if (err)
         {
-            LogInfo.log(LOG_ERROR, "Invalid payload: %i!!!!", err.code());
+            LogInfo.log(LM_CLOUD, LOG_ERROR, "Invalid payload: %i!!!!", err.code());
             return;
         }
-        LogInfo.log(LOG_VERBOSE, F("MQTT Update Message"), doc.as<JsonObject>());
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("MQTT Update Message"), doc.as<JsonObject>());
         hasBody = true;
     }
     // check for accepted twin update
@@ -157,7 +157,7 @@ void AwsInstanceClass::processReply(char *topic, byte *payload, unsigned int len
     strcat(reply, "/update/accepted");
     if (strstr(topic, reply) != NULL)
     {
-        LogInfo.log(LOG_VERBOSE, "OK Reply from hub ");
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "OK Reply from hub ");
     }
     strcpy(reply, this->_shadowPrefix);
     strcpy(reply, "/get/accepted");
@@ -173,7 +173,7 @@ void AwsInstanceClass::processReply(char *topic, byte *payload, unsigned int len
         this->processDesiredStatus(doc["state"].as<JsonObject>());
     }    
 
-    LogInfo.log(LOG_VERBOSE, "Finished Updating - Body: %s",
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Finished Updating - Body: %s",
                 hasBody ? "Yes" : "No");
 }
 
@@ -202,7 +202,11 @@ void AwsInstanceClass::loadTopics()
     strcpy(this->_topics[4].topic, this->_shadowPrefix);
     strcat(this->_topics[4].topic, "/get/accepted");
     this->_topics[4].type = TT_SUBSCRIBE;    
-    this->_topicsAdded = 5;
+    strcpy(this->_topics[5].topic, "devices/");
+    strcat(this->_topics[5].topic, DeviceInfo.getDeviceId());
+    strcat(this->_topics[5].topic, "/messages/logs");
+    this->_topics[5].type = TT_LOGS;
+    this->_topicsAdded = 6;
 }
 
 AwsInstanceClass Aws;
\ No newline at end of file
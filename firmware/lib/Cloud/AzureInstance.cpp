@@ -4,7 +4,7 @@
 #include "WakeUpInfo.h"
 #include "LedInfo.h"
 
-RTC_DATA_ATTR int _Azure_count;
+HAL_RTC_DATA int _Azure_count;
 
 /**
  * This the static callback for processing messages return from the IoT broker
@@ -33,7 +33,7 @@ AzureInstanceClass::AzureInstanceClass() : BaseCloudProvider(CPT_AZURE)
  */
 bool AzureInstanceClass::sendDeviceReport(JsonObject json)
 {
-    LogInfo.log(LOG_VERBOSE, F("Calling Azure sendDeviceReport"));
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Calling Azure sendDeviceReport"));
     DynamicJsonDocument doc(500);
     doc.set(json);
     DeviceInfo.toJson(doc.as<JsonObject>());
@@ -49,7 +49,7 @@ bool AzureInstanceClass::sendDeviceReport(JsonObject json)
  */
 bool AzureInstanceClass::updateProperty(JsonObjectConst element)
 {
-    LogInfo.log(LOG_VERBOSE, F("Calling Azure updateProperty"));    
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Calling Azure updateProperty"));    
     if (this->getIsConnected())
     {
         DynamicJsonDocument doc(500);
@@ -91,12 +91,12 @@ bool AzureInstanceClass::getCurrentStatus()
     {
         char topic[64];
         strcpy(topic, ("$iothub/twin/GET/?$rid=" + String(++_Azure_count)).c_str());
-        LogInfo.log(LOG_VERBOSE, "Getting Current Status to[%s]", topic);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Getting Current Status to[%s]", topic);
         sent = this->_mqttClient.publish(
             topic,
             nullptr);
     }
-    LogInfo.log(LOG_INFO, "Current GET status is %s at %s", sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
+    LogInfo.log(LM_CLOUD, LOG_INFO, "Current GET status is %s at %s", sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
     return sent;
 }
 
@@ -120,7 +120,7 @@ void AzureInstanceClass::buildUserName(char *userName)
  */
 void AzureInstanceClass::processReply(char *topic, byte *payload, unsigned int length)
 {
-    LogInfo.log(LOG_VERBOSE, "Received Azure Reply from [%s][%u]", topic, length);
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Received Azure Reply from [%s][%u]", topic, length);
     DynamicJsonDocument doc(length * 2);
     bool hasBody = false;
     if (length > 0)
@@ -128,10 +128,10 @@ void AzureInstanceClass::processReply(char *topic, byte *payload, unsigned int l
         DeserializationError err = deserializeJson(doc, (char *)payload);
         if (err)
         {
-            LogInfo.log(LOG_ERROR, "Invalid payload: %i!!!!", err.code());
+            LogInfo.log(LM_CLOUD, LOG_ERROR, "Invalid payload: %i!!!!", err.code());
             return;
         }
-        LogInfo.log(LOG_VERBOSE, F("MQTT Update Message"), doc.as<JsonObject>());
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("MQTT Update Message"), doc.as<JsonObject>());
         hasBody = true;
     }
     // check for 204 on twin update
@@ -140,7 +140,7 @@ void AzureInstanceClass::processReply(char *topic, byte *payload, unsigned int l
     strcat(reply, String(_Azure_count).c_str());
     if (strstr(topic, reply) != NULL)
     {
-        LogInfo.log(LOG_VERBOSE, "OK Reply from hub ");
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "OK Reply from hub ");
     }
     strcpy(reply, "$iothub/twin/res/200/?$rid=");
     strcat(reply, String(_Azure_count).c_str());
@@ -155,7 +155,7 @@ void AzureInstanceClass::processReply(char *topic, byte *payload, unsigned int l
         this->processDesiredStatus(doc.as<JsonObject>());
     }
 
-    LogInfo.log(LOG_VERBOSE, "Finished Updating - Body: %s",
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Finished Updating - Body: %s",
                 hasBody ? "Yes" : "No");
 }
 
@@ -182,7 +182,11 @@ void AzureInstanceClass::loadTopics()
     strcpy(this->_topics[5].topic, "$iothub/twin/GET/?$rid=");
     this->_topics[5].type = TT_SYNCDEVICETWIN;
     this->_topics[5].appendUniqueId = true;
-    this->_topicsAdded = 6;
+    strcpy(this->_topics[6].topic, "devices/");
+    strcat(this->_topics[6].topic, DeviceInfo.getDeviceId());
+    strcat(this->_topics[6].topic, "/messages/events/type=log");
+    this->_topics[6].type = TT_LOGS;
+    this->_topicsAdded = 7;
 }
 
 AzureInstanceClass Azure;
\ No newline at end of file
@@ -4,8 +4,9 @@
 #include "WakeUpInfo.h"
 #include "NTPInfo.h"
 #include "LedInfo.h"
+#include "History.h"
 
-RTC_DATA_ATTR int _send_count;
+HAL_RTC_DATA int _send_count;
 
 /**
  * Static task function that is ran.  This will cast the parameters point to a struct 
@@ -16,26 +17,25 @@ RTC_DATA_ATTR int _send_count;
 void BaseCloudProvider::checkTask(void *parameters)
 {
     auto cloud = (struct cloudInstanceStruct *)parameters;
-    LogInfo.log(LOG_VERBOSE, "Initializing %s Task and is connected %s",
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Initializing %s Task and is connected %s",
                 cloud->instance->getProviderType(),
                 cloud->instance->getIsConnected() ? "Yes" : "No");
-    vTaskSuspend(cloud->checkTaskHandle);
     for (;;)
     {
+        cloud->checkSignal.take(HAL_WAIT_FOREVER);
         if (cloud->instance->getIsConnected())
         {
-            if (xSemaphoreTake(cloud->instance->getSemaphore(), portMAX_DELAY))
+            if (cloud->instance->getLock()->take(CLOUD_LOCK_TIMEOUT_MS))
             {
                 cloud->instance->checkForMessages();
-                xSemaphoreGive(cloud->instance->getSemaphore());
+                cloud->instance->getLock()->give();
             }
             else
             {
-                LogInfo.log(LOG_VERBOSE, "Could not get flag for %s", cloud->instance->getProviderType());
+                LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Could not get the MQTT lock for %s", cloud->instance->getProviderType());
             }
         }
-        vTaskDelay(20);
-        vTaskSuspend(cloud->checkTaskHandle);
+        Hal::delay(20);
     }
 }
 
@@ -46,8 +46,8 @@ void BaseCloudProvider::checkTask(void *parameters)
  */
 BaseCloudProvider::BaseCloudProvider(CloudProviderType type)
 {
-    this->_providerType = type;
     this->_mqttClient = PubSubClient(this->_httpsClient);
+    this->_providerType = type;
     this->_cloudInstance.instance = this;
 }
 
@@ -75,11 +75,11 @@ bool BaseCloudProvider::getIsConnected()
 }
 
 /**
- * Resume the check task
+ * Wake the check task
  */
 void BaseCloudProvider::tick()
 {
-    vTaskResume(this->_cloudInstance.checkTaskHandle);
+    this->_cloudInstance.checkSignal.give();
 }
 
 /**
@@ -96,7 +96,7 @@ void BaseCloudProvider::checkForMessages()
 /**
  * Initialise the MQTT client and secure HTTP client
  */
-void BaseCloudProvider::initialiseConnection(std::function<void(char *, uint8_t *, unsigned int)> callback)
+void BaseCloudProvider::initialiseConnection(MQTT_CALLBACK_SIGNATURE)
 {
     LedInfo.blinkOn(LED_CLOUD);
     this->_httpsClient.setCACert(this->_config->certificates[CT_CA].contents);
@@ -114,60 +114,60 @@ void BaseCloudProvider::initialiseConnection(std::function<void(char *, uint8_t
 bool BaseCloudProvider::mqttConnection()
 {
     uint8_t retries = 0;
-    LogInfo.log(LOG_VERBOSE, "Connecting to IoT Hub (%s):(%i) - (%s) @ %s",
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Connecting to IoT Hub (%s):(%i) - (%s) @ %s",
                 this->_config->endPoint,
                 this->_config->port,
                 DeviceInfo.getDeviceId(),
                 NTPInfo.getISO8601Formatted().c_str());
     char userName[256];
     this->buildUserName(userName);
-    uint32_t free = xPortGetFreeHeapSize();
-    LogInfo.log(LOG_VERBOSE, "Current Free Heap Size is %i", free);
+    uint32_t free = Hal::freeHeap();
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Current Free Heap Size is %i", free);
     while (!this->_mqttClient.connected() && retries < RECONNECT_RETRIES)
     {
-        if (heap_caps_check_integrity_all(true) == false)
+        if (!Hal::heapCheck())
         {
-            LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -Base Mqtt Connect -1"));
+            LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -Base Mqtt Connect -1"));
             return false;
         }
-        this->_mqttClient.setBufferSize(2048);
+        this->_mqttClient.setBufferSize(CLOUD_MQTT_BUFFER_SIZE);
         if (this->_mqttClient.connect(DeviceInfo.getDeviceId(), userName, NULL))
         {
-            if (heap_caps_check_integrity_all(true) == false)
+            if (!Hal::heapCheck())
             {
-                LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -Base Mqtt Connect -2"));
+                LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -Base Mqtt Connect -2"));
                 return false;
             }
-            LogInfo.log(LOG_VERBOSE, "Current Free Heap Size is %i", free);
-            LogInfo.log(LOG_VERBOSE, "Connected Successfully to [%s]", this->_config->endPoint);
-            LogInfo.log(LOG_VERBOSE, "Checking %i Topic for subscription", this->_topicsAdded);
+            LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Current Free Heap Size is %i", free);
+            LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Connected Successfully to [%s]", this->_config->endPoint);
+            LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Checking %i Topic for subscription", this->_topicsAdded);
             for (uint8_t i = 0; i < this->_topicsAdded; i++)
             {
                 auto topic = &this->_topics[i];
                 if (topic->type == TT_SUBSCRIBE)
                 {
-                    if (heap_caps_check_integrity(MALLOC_CAP_8BIT, true) == false)
+                    if (!Hal::heapCheck())
                     {
-                        LogInfo.log(LOG_ERROR, F("DRAM Heap Corruption detected! -Base Mqtt Connect -0"));
+                        LogInfo.log(LM_CLOUD, LOG_ERROR, F("DRAM Heap Corruption detected! -Base Mqtt Connect -0"));
                         return false;
                     }
                     bool subbed = this->_mqttClient.subscribe(topic->topic, QOS_LEVEL);
-                    LogInfo.log(LOG_VERBOSE, "Subscribed: %s (%s)",
+                    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Subscribed: %s (%s)",
                                 subbed ? "Yes" : "No", topic->topic);
-                    if (heap_caps_check_integrity(MALLOC_CAP_8BIT, true) == false)
+                    if (!Hal::heapCheck())
                     {
-                        LogInfo.log(LOG_ERROR, F("DRAM Heap Corruption detected! -Base Mqtt Connect -0"));
+                        LogInfo.log(LM_CLOUD, LOG_ERROR, F("DRAM Heap Corruption detected! -Base Mqtt Connect -0"));
                         return false;
                     }
-                    LogInfo.log(LOG_VERBOSE, "Current Free Heap Size is %i", free);
+                    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Current Free Heap Size is %i", free);
                 }
             }
             break;
         }
         else
         {
-            LogInfo.log(LOG_WARNING, "MQTT Connections State: %i", this->_mqttClient.state());
-            delay(100);
+            LogInfo.log(LM_CLOUD, LOG_WARNING, "MQTT Connections State: %i", this->_mqttClient.state());
+            Hal::delay(100);
             retries++;
         }
     }
@@ -176,23 +176,22 @@ bool BaseCloudProvider::mqttConnection()
     this->_tryConnecting = false;
     if (!this->_mqttClient.connected())
     {
-        LogInfo.log(LOG_WARNING, F("Timed out!"));
+        LogInfo.log(LM_CLOUD, LOG_WARNING, F("Timed out!"));
         return false;
     }
     this->_connected = true;
     if (this->getIsConnected())
     {
-        LogInfo.log(LOG_VERBOSE, "Creating %s Check Messages Task on Core 0", this->getProviderType());
-        xTaskCreatePinnedToCore(BaseCloudProvider::checkTask, "CheckMsgsTask",
-                                16392,
-                                (void *)&this->_cloudInstance,
-                                1,
-                                &this->_cloudInstance.checkTaskHandle,
-                                0);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Creating %s Check Messages Task on Core 0", this->getProviderType());
+        Hal::startTask(BaseCloudProvider::checkTask, "CheckMsgsTask",
+                       16392,
+                       (void *)&this->_cloudInstance,
+                       1,
+                       0);
     }
-    if (heap_caps_check_integrity_all(true) == false)
+    if (!Hal::heapCheck())
     {
-        LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -Base Mqtt Connect -2"));
+        LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -Base Mqtt Connect -2"));
         return false;
     }
     LedInfo.switchOn(LED_CLOUD);
@@ -219,13 +218,13 @@ const char *BaseCloudProvider::getProviderType()
 }
 
 /**
- * Get the semaphore flag
+ * Get the lock for the MQTT client
  * 
- * @return The semaphore flag
+ * @return The resource lock
  */
-const SemaphoreHandle_t BaseCloudProvider::getSemaphore()
+ResourceLock *BaseCloudProvider::getLock()
 {
-    return this->_config->semaphore;
+    return this->_config->lock;
 }
 
 /**
@@ -271,7 +270,7 @@ const char *BaseCloudProvider::getFirstTopic(TopicType type)
  */
 bool BaseCloudProvider::updateProperty(JsonObjectConst element)
 {
-    LogInfo.log(LOG_VERBOSE, F("Calling Base updateProperty"));    
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Calling Base updateProperty"));    
     bool sent = false;
     if (this->getIsConnected())
     {
@@ -279,16 +278,21 @@ bool BaseCloudProvider::updateProperty(JsonObjectConst element)
         _send_count++;
 
         size_t len = measureJson(element);
-        char payload[len];
+        char payload[len + 1];
         serializeJson(element, payload, len + 1);
-        LogInfo.log(LOG_VERBOSE, "Updating Property to [%s]", topic);
-        LogInfo.log(LOG_VERBOSE, F("Device Twin Payload"), element);
-        LogInfo.log(LOG_INFO, "JSON Size : %u", measureJson(element));        
-        sent = this->_mqttClient.publish(
-            topic,
-            payload);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Updating Property to [%s]", topic);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Device Twin Payload"), element);
+        LogInfo.log(LM_CLOUD, LOG_INFO, "JSON Size : %u", measureJson(element));        
+        // The desired callback already holds the lock, it is recursive so this does not block
+        if (this->getLock()->take(CLOUD_LOCK_TIMEOUT_MS))
+        {
+            sent = this->_mqttClient.publish(
+                topic,
+                payload);
+            this->getLock()->give();
+        }
     }
-    LogInfo.log(LOG_INFO, "Current Property status is %s at %s",
+    LogInfo.log(LM_CLOUD, LOG_INFO, "Current Property status is %s at %s",
                 sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
 
     return sent;
@@ -300,24 +304,54 @@ bool BaseCloudProvider::updateProperty(JsonObjectConst element)
 bool BaseCloudProvider::sendData()
 {
     // Only send if we have valid Epoch (time greater then 2020-01-01)
-    if (this->getIsConnected() && this->canSendNow() && NTPInfo.getEpoch() > 1577836800)
+    if (this->getIsConnected() && this->canSendNow() && NTPInfo.getEpoch() > 1577836800 &&
+        this->getLock()->take(CLOUD_LOCK_TIMEOUT_MS))
     {
         WakeUp.suspendSleep();
         LedInfo.blinkOn(LED_CLOUD);
-        DynamicJsonDocument payload(800);
+        DynamicJsonDocument payload(CLOUD_PAYLOAD_SIZE);
         auto root = payload.to<JsonObject>();
+        // A payload that did not fit would be sent with its last elements missing
         this->_builder(root, true);
-        this->sendDeviceReport(root);
+        if (!this->payloadOverflowed(payload, "Device twin"))
+        {
+            this->sendDeviceReport(root);
+        }
+        // Clearing the object would keep the twin's memory, the document is emptied instead
+        root = payload.to<JsonObject>();
         this->_builder(root, false);
-        this->sendTelemetry(root);
+        if (!this->payloadOverflowed(payload, "Telemetry"))
+        {
+            this->sendTelemetry(root);
+        }
         this->_lastSent = millis();
         LedInfo.blinkOff(LED_CLOUD);
         WakeUp.resumeSleep();
+        this->getLock()->give();
         return true;
     }
     return false;
 }
 
+/**
+ * Check whether the payload overflowed its document, test_cloud_payload sizes CLOUD_PAYLOAD_SIZE for the shipped
+ * configuration but more sensors take more
+ * 
+ * @param doc The document the payload was built in
+ * @param name What the payload is, for the log
+ * @return True if it overflowed and must not be sent
+ */
+bool BaseCloudProvider::payloadOverflowed(const JsonDocument &doc, const char *name)
+{
+    if (!doc.overflowed())
+    {
+        return false;
+    }
+    LogInfo.log(LM_CLOUD, LOG_ERROR, "%s payload is larger than the %u bytes of CLOUD_PAYLOAD_SIZE, not sent", name,
+                (unsigned)CLOUD_PAYLOAD_SIZE);
+    return true;
+}
+
 /**
  * Send Device Twin Reported Properties
  * 
@@ -326,23 +360,23 @@ bool BaseCloudProvider::sendData()
  */
 bool BaseCloudProvider::sendDeviceReport(JsonObject json)
 {
-    LogInfo.log(LOG_VERBOSE, F("Calling Base sendDeviceReport"));
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Calling Base sendDeviceReport"));
     bool sent = false;
     if (this->_config->sendDeviceTwin)
     {
         auto topic = this->getFirstTopic(TT_DEVICETWIN);
         _send_count++;
         size_t len = measureJson(json);
-        char payload[len];
+        char payload[len + 1];
         serializeJson(json, payload, len + 1);
-        LogInfo.log(LOG_VERBOSE, "Publishing to[%s]", topic);
-        LogInfo.log(LOG_VERBOSE, F("Device Twin Payload"), json);
-        LogInfo.log(LOG_INFO, "JSON Size : %u", measureJson(json));
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Publishing to[%s]", topic);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Device Twin Payload"), json);
+        LogInfo.log(LM_CLOUD, LOG_INFO, "JSON Size : %u", measureJson(json));
         sent = this->_mqttClient.publish(
             topic,
             payload);
 
-        LogInfo.log(LOG_INFO, "Current Publish status is %s at %s",
+        LogInfo.log(LM_CLOUD, LOG_INFO, "Current Publish status is %s at %s",
                     sent ? "True" : "False",
                     NTPInfo.getISO8601Formatted().c_str());
     }
@@ -360,29 +394,106 @@ bool BaseCloudProvider::sendTelemetry(JsonObject json)
     bool sent = false;
     if (this->_config->sendTelemetry)
     {
-        DynamicJsonDocument doc(600);
+        DynamicJsonDocument doc(CLOUD_PAYLOAD_SIZE);
         doc.set(json);
         DeviceInfo.toJson(doc.as<JsonObject>());
         doc["time_epoch"] = NTPInfo.getEpoch();
+        if (this->payloadOverflowed(doc, "Telemetry"))
+        {
+            return false;
+        }
         size_t len = measureJson(doc);
-        char payload[len];
+        char payload[len + 1];
         serializeJson(doc, payload, len + 1);
         auto topic = this->getFirstTopic(TT_TELEMETRY);
         _send_count++;
-        LogInfo.log(LOG_VERBOSE, "Sending to[%s]", topic);
-        LogInfo.log(LOG_VERBOSE, F("Telemetry MQTT Payload"), doc.as<JsonObject>());
-        LogInfo.log(LOG_INFO, "JSON Size : %u", measureJson(doc));
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Sending to[%s]", topic);
+        LogInfo.log(LM_CLOUD, LOG_VERBOSE, F("Telemetry MQTT Payload"), doc.as<JsonObject>());
+        LogInfo.log(LM_CLOUD, LOG_INFO, "JSON Size : %u", measureJson(doc));
         sent = this->_mqttClient.publish(
             topic,
             payload);
 
-        LogInfo.log(LOG_INFO, "Current Send status is %s at %s",
+        LogInfo.log(LM_CLOUD, LOG_INFO, "Current Send status is %s at %s",
                     sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
     }
 
     return sent;
 }
 
+/**
+ * Answer a history request from the cloud, the records are sent to the telemetry topic under "history"
+ * 
+ * @param request The series and time range wanted, see HistoryClass::queryToJson
+ * @return True if successfully sent
+ */
+bool BaseCloudProvider::sendHistory(JsonObjectConst request)
+{
+    if (!this->getIsConnected() || !this->getLock()->take(CLOUD_LOCK_TIMEOUT_MS))
+    {
+        return false;
+    }
+    DynamicJsonDocument doc(HISTORY_REPLY_DOC);
+    History.queryToJson(request, doc.createNestedObject("history"));
+    doc["time_epoch"] = NTPInfo.getEpoch();
+    size_t len = measureJson(doc);
+    char payload[len + 1];
+    serializeJson(doc, payload, len + 1);
+    auto topic = this->getFirstTopic(TT_TELEMETRY);
+    LogInfo.log(LM_CLOUD, LOG_INFO, "History JSON Size : %u", len);
+    bool sent = this->_mqttClient.publish(topic, payload);
+    this->getLock()->give();
+    return sent;
+}
+
+/**
+ * Send a batch of log records to the logs topic, falling back to the telemetry topic if the provider has no
+ * separate logs topic.
+ * 
+ * @param json The log records to send
+ * @return True if successfully sent
+ */
+bool BaseCloudProvider::sendLogs(JsonObjectConst json)
+{
+    bool sent = false;
+    if (this->getIsConnected())
+    {
+        size_t len = measureJson(json);
+        char payload[len + 1];
+        serializeJson(json, payload, len + 1);
+        LogInfo.log(LM_CLOUD, LOG_INFO, "JSON Size : %u", len);
+        sent = this->sendLogs((const uint8_t *)payload, len);
+
+        LogInfo.log(LM_CLOUD, LOG_INFO, "Current Logs status is %s at %s",
+                    sent ? "True" : "False", NTPInfo.getISO8601Formatted().c_str());
+    }
+    return sent;
+}
+
+/**
+ * Send a batch of log messages as they are to the logs topic, falling back to the telemetry topic if the
+ * provider has no separate logs topic.  Nothing is logged here, so sending the logs does not make more logs.
+ * 
+ * @param payload The log messages to send
+ * @param length The size of the payload
+ * @return True if successfully sent
+ */
+bool BaseCloudProvider::sendLogs(const uint8_t *payload, size_t length)
+{
+    if (!this->getIsConnected() || !this->getLock()->take(CLOUD_LOCK_TIMEOUT_MS))
+    {
+        return false;
+    }
+    auto topic = this->getFirstTopic(TT_LOGS);
+    if (strlen(topic) == 0)
+    {
+        topic = this->getFirstTopic(TT_TELEMETRY);
+    }
+    bool sent = this->_mqttClient.publish(topic, payload, length);
+    this->getLock()->give();
+    return sent;
+}
+
 /**
  * Can the telementry or reported be sent now
  * 
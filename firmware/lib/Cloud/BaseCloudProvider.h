@@ -7,16 +7,22 @@
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 #include "CloudMisc.h"
+#include "Hal.h"
 
 const uint8_t QOS_LEVEL = 0;
 const uint8_t RECONNECT_RETRIES = 5;
+const uint32_t CLOUD_LOCK_TIMEOUT_MS = 5000;    // Longest wait for the MQTT client before giving up
+const size_t CLOUD_PAYLOAD_SLOTS = 176;         // Members and elements of the device twin, test_cloud_payload counts 162
+const size_t CLOUD_PAYLOAD_STRINGS = 1152;      // Bytes of the strings copied into it, 1008 on the host
+const size_t CLOUD_PAYLOAD_SIZE = JSON_OBJECT_SIZE(CLOUD_PAYLOAD_SLOTS) + CLOUD_PAYLOAD_STRINGS;
+const size_t CLOUD_MQTT_BUFFER_SIZE = 4096;     // Largest MQTT packet with its topic, the crash report and history replies need most of it
 
 class BaseCloudProvider;
 
 typedef struct cloudInstanceStruct
 {
     BaseCloudProvider *instance;
-    TaskHandle_t checkTaskHandle;
+    Hal::Signal checkSignal;
 } CloudInstance;
 
 class BaseCloudProvider
@@ -33,18 +39,22 @@ public:
     bool getIsConnected();
     const char* getProviderType();
     void tick();
-    const SemaphoreHandle_t getSemaphore();
+    ResourceLock *getLock();
     bool virtual updateProperty(JsonObjectConst element);
+    bool sendHistory(JsonObjectConst request);
+    bool sendLogs(JsonObjectConst json);
+    bool sendLogs(const uint8_t *payload, size_t length);
     void virtual processReply(char *topic, byte *payload, unsigned int length) = 0;        
 
 protected:
     void virtual loadTopics() = 0;
-    void initialiseConnection(std::function<void (char *, uint8_t *, unsigned int)> callback);
+    void initialiseConnection(MQTT_CALLBACK_SIGNATURE);
     bool mqttConnection();
     void virtual buildUserName(char *userName) = 0;
     void processDesiredStatus(JsonObject doc);
     bool virtual sendDeviceReport(JsonObject json);
     bool sendTelemetry(JsonObject json);
+    bool payloadOverflowed(const JsonDocument &doc, const char *name);
     const char* getFirstTopic(TopicType type);
     void checkForMessages();
     WiFiClientSecure _httpsClient;
@@ -54,7 +64,7 @@ protected:
     bool _connected;
     uint8_t _retries;
     bool _tryConnecting;
-    IOTTOPIC _topics[6];
+    IOTTOPIC _topics[8];
     uint8_t _topicsAdded;
     CloudInstance _cloudInstance;
     uint64_t _lastSent;
@@ -1,8 +1,30 @@
 #include "CloudInfo.h"
 #include "LogInfo.h"
+#include "LogSinks.h"
 #include "AzureInstance.h"
 #include "AwsInstance.h"
 
+const ConfigField CloudInfoClass::_certFields[] = {
+    CONFIG_STRING("certificate", CloudInfoClass, _config.certificates[CT_CERT].fileName, ""),
+    CONFIG_STRING("key", CloudInfoClass, _config.certificates[CT_KEY].fileName, ""),
+};
+
+const ConfigField CloudInfoClass::_iotHubFields[] = {
+    CONFIG_STRING("endpoint", CloudInfoClass, _config.endPoint, ""),
+    CONFIG_UINT("port", CloudInfoClass, _config.port, 8883, 1, 65535),
+    CONFIG_BOOL("sendTelemetry", CloudInfoClass, _config.sendTelemetry, false),
+    CONFIG_BOOL("sendDeviceTwin", CloudInfoClass, _config.sendDeviceTwin, false),
+    CONFIG_UINT("intervalSeconds", CloudInfoClass, _config.sendInterval, 60, 1, 65535),
+};
+
+const ConfigField CloudInfoClass::_azureFields[] = {
+    CONFIG_STRING("ca", CloudInfoClass, ca_azure_fileName, ""),
+};
+
+const ConfigField CloudInfoClass::_awsFields[] = {
+    CONFIG_STRING("ca", CloudInfoClass, ca_aws_fileName, ""),
+};
+
 /**
  * Base Class Constructor
  * 
@@ -18,11 +40,13 @@ CloudInfoClass::CloudInfoClass() : BaseConfigInfoClass("cloud")
 
 /**
  * Begin the initialization of the cloud
+ * 
+ * @param lock The lock that controls the access to the MQTT client
  */
-void CloudInfoClass::begin(SemaphoreHandle_t flag)
+void CloudInfoClass::begin(ResourceLock *lock)
 {
     this->_provider = NULL;    
-    this->_config.semaphore = flag;
+    this->_config.lock = lock;
 }
 
 /**
@@ -32,36 +56,23 @@ void CloudInfoClass::begin(SemaphoreHandle_t flag)
  */
 void CloudInfoClass::load(JsonObjectConst obj)
 {
-    LogInfo.log(LOG_VERBOSE, "Provider is %s", obj.containsKey("provider") ? obj["provider"].as<const char *>() : "UNKNOWN");
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Provider is %s", obj.containsKey("provider") ? obj["provider"].as<const char *>() : "UNKNOWN");
     this->_config.provider = CloudInfoClass::getProviderTypeFromString(obj.containsKey("provider") ? obj["provider"].as<const char *>() : "");
 
-    if (obj.containsKey("certs"))
-    {
-        strcpy(this->_config.certificates[CT_CERT].fileName, obj["certs"].containsKey("certificate") ? obj["certs"]["certificate"].as<const char *>() : "");
-        strcpy(this->_config.certificates[CT_KEY].fileName, obj["certs"].containsKey("key") ? obj["certs"]["key"].as<const char *>() : "");
-        CloudInfoClass::loadCertificate(&this->_config.certificates[CT_CERT]);
-        CloudInfoClass::loadCertificate(&this->_config.certificates[CT_KEY]);
-    }
-    if (obj.containsKey("iotHub"))
-    {
-        strcpy(this->_config.endPoint, obj["iotHub"].containsKey("endpoint") ? obj["iotHub"]["endpoint"].as<const char *>() : "");
-        this->_config.port = obj["iotHub"].containsKey("port") ? obj["iotHub"]["port"].as<int>() : 8883;
-        this->_config.sendTelemetry = obj["iotHub"].containsKey("sendTelemetry") ? obj["iotHub"]["sendTelemetry"].as<bool>() : false;
-        this->_config.sendDeviceTwin = obj["iotHub"].containsKey("sendDeviceTwin") ? obj["iotHub"]["sendDeviceTwin"].as<bool>() : false;
-        this->_config.sendInterval = obj["iotHub"].containsKey("intervalSeconds") ? obj["iotHub"]["intervalSeconds"].as<int>() : 60;
-    }
-    if (obj.containsKey("azure") && this->_config.provider == CPT_AZURE)
-    {
-        strcpy(this->_config.certificates[CT_CA].fileName, obj["azure"].containsKey("ca") ? obj["azure"]["ca"].as<const char *>() : "");
-    }
-    strcpy(this->ca_azure_fileName, obj["azure"].containsKey("ca") ? obj["azure"]["ca"].as<const char *>() : "");
-    if (obj.containsKey("aws") && this->_config.provider == CPT_AWS)
+    this->loadFields(obj["certs"], CloudInfoClass::_certFields, CONFIG_FIELD_COUNT(CloudInfoClass::_certFields));
+    this->loadFields(obj["iotHub"], CloudInfoClass::_iotHubFields, CONFIG_FIELD_COUNT(CloudInfoClass::_iotHubFields));
+    this->loadFields(obj["azure"], CloudInfoClass::_azureFields, CONFIG_FIELD_COUNT(CloudInfoClass::_azureFields));
+    this->loadFields(obj["aws"], CloudInfoClass::_awsFields, CONFIG_FIELD_COUNT(CloudInfoClass::_awsFields));
+    strlcpy(this->_config.certificates[CT_CA].fileName,
+            this->_config.provider == CPT_AWS ? this->ca_aws_fileName : this->ca_azure_fileName,
+            sizeof(this->_config.certificates[CT_CA].fileName));
+
+    // The certificate files are read when we connect, so a load from the configuration snapshot reads no files
+    for (uint8_t i = 0; i < CERT_COUNT; i++)
     {
-        strcpy(this->_config.certificates[CT_CA].fileName, obj["aws"].containsKey("ca") ? obj["aws"]["ca"].as<const char *>() : "");
+        delete[] this->_config.certificates[i].contents;
+        this->_config.certificates[i].contents = NULL;
     }
-    strcpy(this->ca_aws_fileName, obj["aws"].containsKey("ca") ? obj["aws"]["ca"].as<const char *>() : "");
-
-    CloudInfoClass::loadCertificate(&this->_config.certificates[CT_CA]);
 
     if (this->_config.provider == CPT_AZURE)
     {
@@ -73,7 +84,7 @@ void CloudInfoClass::load(JsonObjectConst obj)
         this->_provider = &Aws;
     }
 
-    LogInfo.log(LOG_VERBOSE, "Connect to %s [%s@%s:%i] Telemetry %s Interval %i seconds",
+    LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Connect to %s [%s@%s:%i] Telemetry %s Interval %i seconds",
                 CloudInfoClass::getStringFromProviderType(this->_config.provider),
                 DeviceInfo.getDeviceId(),
                 this->_config.endPoint,
@@ -92,22 +103,30 @@ void CloudInfoClass::save(JsonObject obj)
     auto json = obj.createNestedObject(this->_sectionName);
     json["provider"] = CloudInfoClass::getStringFromProviderType(this->_config.provider);
 
-    auto certs = json.createNestedObject("certs");
-    certs["certificate"] = this->_config.certificates[CT_CERT].fileName;
-    certs["key"] = this->_config.certificates[CT_KEY].fileName;
-
-    auto iotHub = json.createNestedObject("iotHub");
-    iotHub["endpoint"] = this->_config.endPoint;
-    iotHub["port"] = this->_config.port;
-    iotHub["sendTelemetry"] = this->_config.sendTelemetry;
-    iotHub["sendDeviceTwin"] = this->_config.sendDeviceTwin;    
-    iotHub["intervalSeconds"] = this->_config.sendInterval;
-
-    auto azure_ca = json.createNestedObject("azure");
-    azure_ca["ca"] = this->ca_azure_fileName;
+    this->saveFields(json.createNestedObject("certs"), CloudInfoClass::_certFields, CONFIG_FIELD_COUNT(CloudInfoClass::_certFields));
+    this->saveFields(json.createNestedObject("iotHub"), CloudInfoClass::_iotHubFields, CONFIG_FIELD_COUNT(CloudInfoClass::_iotHubFields));
+    this->saveFields(json.createNestedObject("azure"), CloudInfoClass::_azureFields, CONFIG_FIELD_COUNT(CloudInfoClass::_azureFields));
+    this->saveFields(json.createNestedObject("aws"), CloudInfoClass::_awsFields, CONFIG_FIELD_COUNT(CloudInfoClass::_awsFields));
+}
 
-    auto aws_ca = json.createNestedObject("aws");
-    aws_ca["ca"] = this->ca_aws_fileName;
+/**
+ * overridden apply changed values at runtime.  Only the iotHub settings can be changed, the provider reads
+ * them each time (e.g. intervalSeconds in canSendNow) and the endpoint and port are used on the next connect.
+ * 
+ * @param obj The ArduinoJson object with the new values
+ * @param reported The values that changed are added to this
+ * @param changes Filled with the fields that changed
+ * @param size The most changes that can be added
+ * @return The number of fields that changed
+ */
+uint8_t CloudInfoClass::apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size)
+{
+    if (!obj["iotHub"].is<JsonObjectConst>())
+    {
+        return 0;
+    }
+    return this->applyFields(obj["iotHub"], reported.createNestedObject("iotHub"),
+                             CloudInfoClass::_iotHubFields, CONFIG_FIELD_COUNT(CloudInfoClass::_iotHubFields), changes, size);
 }
 
 /**
@@ -132,8 +151,23 @@ bool CloudInfoClass::connect(DATABUILDER builder, DESIREDPROCESSOR processor)
 {
     if (this->getProvider() != NULL)
     {
+        for (uint8_t i = 0; i < CERT_COUNT; i++)
+        {
+            CloudInfoClass::loadCertificate(&this->_config.certificates[i]);
+        }
         this->getProvider()->begin(builder, processor);
-        return this->getProvider()->connect(&this->_config);
+        bool connected = this->getProvider()->connect(&this->_config);
+        if (connected && LogRing.hasCrashReport())
+        {
+            // Upload the tail of the session before the crash/restart in one batch
+            DynamicJsonDocument doc(LOG_RING_REPORT_SIZE);
+            LogRing.toJson(doc.to<JsonObject>());
+            if (this->getProvider()->sendLogs(doc.as<JsonObjectConst>()))
+            {
+                LogRing.clearCrashReport();
+            }
+        }
+        return connected;
     }
     return false;
 }
@@ -176,24 +210,24 @@ CloudProviderType CloudInfoClass::getProviderTypeFromString(const char* type)
 }
 
 /**
- * Load the certificate body into memory
+ * Load the certificate body into memory, if it has not been already
  * 
  * @param cert The certificate struct to fill
  */
 void CloudInfoClass::loadCertificate(CERTIFICATE *cert)
 {
-    if (strlen(cert->fileName) > 0)
+    if (cert->contents == NULL && strlen(cert->fileName) > 0)
     {
         size_t size = Utilities::fileSize(cert->fileName);
         if (size > 0)
         {
-            LogInfo.log(LOG_VERBOSE, "File %s is %i bytes", cert->fileName, size);
+            LogInfo.log(LM_CLOUD, LOG_VERBOSE, "File %s is %i bytes", cert->fileName, size);
             cert->contents = new char[size+1];
-            Utilities::readFile(cert->fileName, cert->contents, size+1);
-            LogInfo.log(LOG_VERBOSE, "Loaded Certificate (%s)", cert->fileName);
-            if(heap_caps_check_integrity_all(true) == false)
+            cert->contents[Utilities::readFile(cert->fileName, cert->contents, size)] = '\0';
+            LogInfo.log(LM_CLOUD, LOG_VERBOSE, "Loaded Certificate (%s)", cert->fileName);
+            if(!Hal::heapCheck())
             {
-                LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -Setup -0"));
+                LogInfo.log(LM_CLOUD, LOG_ERROR, F("Heap Corruption detected! -Setup -0"));
             }              
         }
     }
@@ -207,8 +241,16 @@ void CloudInfoClass::tick()
     if( this->getProvider() != NULL)
     {
         this->getProvider()->sendData();
-        delay(500);
+        Hal::delay(500);
         this->getProvider()->tick();
+        // The log task only batches the MQTT log messages, they are sent from here as the client is not thread safe
+        size_t length;
+        const uint8_t *batch = MqttSink.takeBatch(&length);
+        if (batch != NULL)
+        {
+            this->getProvider()->sendLogs(batch, length);
+            MqttSink.releaseBatch();
+        }
     }
 }
 
@@ -12,10 +12,11 @@ class CloudInfoClass : public BaseConfigInfoClass
 public:
     CloudInfoClass();
 
-    void begin(SemaphoreHandle_t flag);
+    void begin(ResourceLock *lock);
     bool connect(DATABUILDER builder, DESIREDPROCESSOR processor);
     void load(JsonObjectConst obj) override;
     void save(JsonObject ob) override;
+    uint8_t apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size) override;
     void toJson(JsonObject ob) override;
     void tick();
     BaseCloudProvider* getProvider();
@@ -24,6 +25,10 @@ private:
     static const char* getStringFromProviderType(CloudProviderType type);
     static CloudProviderType getProviderTypeFromString(const char* type);    
     static void loadCertificate(CERTIFICATE *cert);
+    static const ConfigField _certFields[];
+    static const ConfigField _iotHubFields[];
+    static const ConfigField _azureFields[];
+    static const ConfigField _awsFields[];
 
     IOTCONFIG _config;
     BaseCloudProvider *_provider;
@@ -2,6 +2,7 @@
 #define CLOUDMISC_H
 
 #include <Arduino.h>
+#include "ResourceLock.h"
 
 #define CERT_COUNT 3
 
@@ -35,7 +36,7 @@ typedef struct IoTConfig
     bool sendDeviceTwin;
     uint16_t sendInterval;
     CERTIFICATE certificates[CERT_COUNT];
-    SemaphoreHandle_t semaphore;    
+    ResourceLock *lock;
 } IOTCONFIG;
 
 typedef enum{
@@ -43,7 +44,8 @@ typedef enum{
     TT_SUBSCRIBE,
     TT_DEVICETWIN,
     TT_SYNCDEVICETWIN,
-    TT_TELEMETRY
+    TT_TELEMETRY,
+    TT_LOGS
 } TopicType;
 
 typedef struct IoTTopic
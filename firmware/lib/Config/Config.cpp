@@ -1,7 +1,14 @@
 #include "Config.h"
 #include "Utilities.h"
 #include "LogInfo.h"
+#include "Settings.h"
 #include "WakeUpInfo.h"
+#include "Hal.h"
+
+// HAL_RTC_NOINIT is kept over deep sleep, the magic and CRC tell us if it holds a snapshot
+HAL_RTC_NOINIT ConfigSnapshot _configSnapshot;
+// Bytes written to the configuration files since power on
+HAL_RTC_DATA uint32_t _configBytesWritten = 0;
 
 /**
  * During destruction may sure the internal array is deleted.
@@ -9,6 +16,7 @@
 ConfigClass::~ConfigClass()
 {
     delete[] this->_configs;
+    delete[] this->_hashes;
 }
 
 /**
@@ -16,94 +24,91 @@ ConfigClass::~ConfigClass()
  * 
  * @param filename Where the configuration is stored
  * @param defaultSize Set the default number of instances that can referenced
- * @param maxDocSize  Where is the maximum JSON size being read in
+ * @param maxDocSize  The maximum JSON size of one section, the file is read a section at a time
  */
 void ConfigClass::begin(const char *filename, uint8_t defaultSize, uint16_t maxDocSize)
 {
     this->_fileName = filename;
-    this->_configs = new BaseConfigInfoClass *[defaultSize];
+    snprintf(this->_tempName, sizeof(this->_tempName), "%s.tmp", filename);
+    snprintf(this->_backupName, sizeof(this->_backupName), "%s.bak", filename);
+    this->_fileCrc = 0;
+    this->_pendingSince = 0;
+    this->_size = max(defaultSize, (uint8_t)1);
+    this->_configs = new BaseConfigInfoClass *[this->_size];
+    this->_hashes = new uint32_t[this->_size];
     this->_maxDocSize = maxDocSize;
 }
 
 /**
- * Load the configuration file and give each registered instance the correct JSON element.
+ * Load the configuration file and give each registered instance the correct JSON element.  When we wake
+ * from a timer sleep the configuration file cannot have changed, so the snapshot kept in RTC memory is used
+ * and the file is not read or parsed.  If the configuration file is missing or cannot be parsed the backup
+ * from the previous save is used.
  * 
  * @return True if successful or not
  */
 bool ConfigClass::load()
 {
-    LogInfo.log(LOG_VERBOSE, "Loading configuration (%s)", this->_fileName);
-    File json = Utilities::openFile(this->_fileName);
-    if (!json)
-    {
-        LogInfo.log(LOG_ERROR, F("Loading configuration error!!!!"));
-        return false;
-    }
-
-    DynamicJsonDocument doc(this->_maxDocSize);
-    auto err = deserializeJson(doc, json);
-    if (err)
+    int64_t start = Hal::micros();
+    if (Hal::wakeupCause() == HAL_WAKEUP_TIMER && this->loadSnapshot())
     {
-        LogInfo.log(LOG_ERROR, "Loading configuration error (%s)", err.c_str());
-        json.close();
-        return false;
+        LogInfo.log(LM_CONFIG, LOG_INFO, "Loaded configuration snapshot in %lu us", (unsigned long)(Hal::micros() - start));
+        return true;
     }
 
-    auto root = doc.as<JsonObject>();
-    if (this->_total > 0)
+    if (!this->loadFile(this->_fileName))
     {
-        for (JsonPair kv : root)
+        LogInfo.log(LM_CONFIG, LOG_WARNING, "Loading configuration backup (%s)", this->_backupName);
+        if (!this->loadFile(this->_backupName))
         {
-            for (uint8_t i = 0; i < this->_total; i++)
-            {
-                if (this->_configs[i]->isSection(kv.key().c_str()))
-                {
-                    LogInfo.log(LOG_VERBOSE, "Loading section (%s)", kv.key().c_str());
-                    this->_configs[i]->load(kv.value().as<JsonObject>());
-                    if(heap_caps_check_integrity_all(true) == false)
-                    {
-                        LogInfo.log(LOG_ERROR, F("Heap Corruption detected! Config -1"));
-                    }                      
-                }
-            }
+            return false;
         }
-        json.close();
-        return true;
     }
-    json.close();
-    return false;
+    LogInfo.log(LM_CONFIG, LOG_INFO, "Loaded configuration file in %lu us", (unsigned long)(Hal::micros() - start));
+    return true;
 }
 
 /**
- * Save the configuration from each registered instance to the configuration file
+ * Save the configuration from each registered instance to the configuration file.  Nothing is written if
+ * the configuration is the same as the file.  Otherwise it is written to a temporary file which is read back
+ * and checked, the current file becomes the backup and the temporary file replaces it, so a reset part way
+ * through never leaves us without a good copy.
  * 
  * @return True if successful or not
  */
 bool ConfigClass::save()
 {
-    DynamicJsonDocument doc(this->_maxDocSize + 100);
-    auto json = doc.to<JsonObject>();
-    if (this->_total > 0)
+    if (this->_total == 0)
     {
-        for (uint8_t i = 0; i < this->_total; i++)
-        {
-            this->_configs[i]->save(json);
-        }
-        LogInfo.log(LOG_VERBOSE, F("Saving JSON"), json);
-        File file = Utilities::openFile(this->_fileName, false);
-        if (!file)
-        {
-            return false;
-        }
-        size_t saved = serializeJson(doc, file);
-        file.close();
+        return false;
+    }
+    // Measure the configuration and its CRC32 without writing anything, and refresh the snapshot on the way
+    ConfigStream measure;
+    this->beginSnapshot();
+    if (!this->saveSections(measure, true))
+    {
+        return false;
+    }
+    uint32_t crc = measure.getCrc();
+    bool saved = true;
+    if (crc == this->_fileCrc)
+    {
+        LogInfo.log(LM_CONFIG, LOG_VERBOSE, F("Configuration has not changed, nothing written"));
+    }
+    else
+    {
+        saved = this->writeFile(measure.getLength(), crc);
+    }
+    if (saved)
+    {
+        this->endSnapshot(crc);
         for (uint8_t i = 0; i < this->_total; i++)
         {
             this->_configs[i]->hasSaved();
         }
-        return saved > 0;
     }
-    return false;
+    this->_pendingSince = 0;
+    return saved;
 }
 
 /**
@@ -123,6 +128,99 @@ bool ConfigClass::shouldSave()
     return false;
 }
 
+/**
+ * Save the configuration once it has been waiting CONFIG_SAVE_DELAY_MS, so a burst of changes (e.g. several
+ * desired properties) is written once.  Call this regularly, anything still waiting is saved before sleeping.
+ */
+void ConfigClass::tick()
+{
+    if (!this->shouldSave())
+    {
+        this->_pendingSince = 0;
+        return;
+    }
+    if (this->_pendingSince == 0)
+    {
+        // Zero means nothing is waiting
+        this->_pendingSince = max(millis(), 1UL);
+    }
+    else if ((millis() - this->_pendingSince) >= CONFIG_SAVE_DELAY_MS)
+    {
+        this->save();
+    }
+}
+
+/**
+ * Get how many bytes have been written to the configuration files since power on
+ * 
+ * @return The number of bytes
+ */
+uint32_t ConfigClass::getBytesWritten()
+{
+    return _configBytesWritten;
+}
+
+
+/**
+ * Subscribe to changes made to a section at runtime by apply().  The listener is called from the task that
+ * applies the change (for desired properties that is the cloud task), so it should only note what has to be
+ * re-applied or do something quick.
+ * 
+ * @param sectionName The section to listen to
+ * @param key The key to listen to, NULL for any key in the section
+ * @param listener The function called with the section's change set
+ * @return True if there was room for the listener
+ */
+bool ConfigClass::subscribe(const char *sectionName, const char *key, CONFIGLISTENER listener)
+{
+    if (this->_listenerTotal == CONFIG_MAX_LISTENERS)
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, "No room to subscribe to %s", sectionName);
+        return false;
+    }
+    ConfigListener *entry = &this->_listeners[this->_listenerTotal++];
+    entry->sectionName = sectionName;
+    entry->key = key;
+    entry->listener = listener;
+    return true;
+}
+
+/**
+ * Apply changes to the configuration at runtime, e.g. the desired properties from the cloud.  Each section
+ * in desired is given its element, the fields that change are saved (as settings or in the file on the next
+ * save) and the subscribers to the section are told what changed, so nothing needs a restart.  The change set
+ * is passed on before the next section is applied, so each section has room for CONFIG_MAX_CHANGES.
+ * 
+ * @param desired The sections with the values to change
+ * @param reported The values that changed are added to this, ready to be reported back
+ * @return The number of values that changed
+ */
+uint8_t ConfigClass::apply(JsonObjectConst desired, JsonObject reported)
+{
+    ConfigChange changes[CONFIG_MAX_CHANGES];
+    uint8_t total = 0;
+    for (JsonPairConst kv : desired)
+    {
+        int8_t index = this->findSection(kv.key().c_str());
+        if (index < 0 || !kv.value().is<JsonObjectConst>())
+        {
+            continue;
+        }
+        const char *sectionName = this->_configs[index]->getSectionName();
+        JsonObject section = reported.createNestedObject(sectionName);
+        uint8_t count = this->_configs[index]->apply(kv.value().as<JsonObjectConst>(), section, changes, CONFIG_MAX_CHANGES);
+        if (count == 0)
+        {
+            reported.remove(sectionName);
+            continue;
+        }
+        LogInfo.log(LM_CONFIG, LOG_INFO, "Applied %u changes to %s", count, sectionName);
+        this->notify(changes, count);
+        total += count;
+    }
+    return total;
+}
+
 /**
  * Register the instance that requires a configuration JSON element
  * 
@@ -130,7 +228,928 @@ bool ConfigClass::shouldSave()
  */
 void ConfigClass::add(BaseConfigInfoClass *config)
 {
+    if (this->_total == this->_size)
+    {
+        if (this->_size == INT8_MAX)
+        {
+            LogInfo.log(LM_CONFIG, LOG_ERROR, "Too many configuration sections, %s not added", config->getSectionName());
+            return;
+        }
+        uint8_t size = min(this->_size * 2, INT8_MAX);
+        auto configs = new BaseConfigInfoClass *[size];
+        auto hashes = new uint32_t[size];
+        memcpy(configs, this->_configs, this->_total * sizeof(BaseConfigInfoClass *));
+        memcpy(hashes, this->_hashes, this->_total * sizeof(uint32_t));
+        delete[] this->_configs;
+        delete[] this->_hashes;
+        this->_configs = configs;
+        this->_hashes = hashes;
+        this->_size = size;
+    }
+    this->_hashes[this->_total] = ConfigClass::hashName(config->getSectionName());
     this->_configs[this->_total++] = config;
 }
 
+/**
+ * Load the configuration from the file, a section at a time
+ * 
+ * @param fileName The file to load
+ * @return True if the file was parsed and the sections loaded
+ */
+bool ConfigClass::loadFile(const char *fileName)
+{
+    LogInfo.log(LM_CONFIG, LOG_VERBOSE, "Loading configuration (%s)", fileName);
+    Hal::File file;
+    if (!file.open(fileName, "r") || file.size() == 0)
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, F("Loading configuration error!!!!"));
+        return false;
+    }
+    ConfigStream in(&file);
+    this->beginSnapshot();
+    bool loaded = this->loadSections(in);
+    // Read to the end, so the CRC covers the whole file
+    while (in.read() >= 0)
+    {
+    }
+    file.close();
+    if (!loaded)
+    {
+        return false;
+    }
+    // A backup is not the configuration file, so the next save must write it
+    this->_fileCrc = fileName == this->_fileName ? in.getCrc() : 0;
+    this->endSnapshot(this->_fileCrc);
+    return true;
+}
+
+/**
+ * Find each top level element in the stream and give it to the registered instance for that section.  Only
+ * one section is parsed into a document at a time, sections that are not registered are skipped without
+ * being parsed, so the memory used depends on the largest section and not on the size of the file.
+ * 
+ * @param in The configuration file
+ * @return True if the whole file was loaded
+ */
+bool ConfigClass::loadSections(ConfigStream &in)
+{
+    if (this->_total == 0)
+    {
+        return false;
+    }
+    if (ConfigClass::skipWhitespace(in) != '{')
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, F("Loading configuration error (not a JSON object)"));
+        return false;
+    }
+    in.read();
+    DynamicJsonDocument doc(this->_maxDocSize);
+    char sectionName[CONFIG_SECTION_NAME_SIZE];
+    while (true)
+    {
+        int c = ConfigClass::skipWhitespace(in);
+        if (c == '}')
+        {
+            in.read();
+            return true;
+        }
+        if (c == ',')
+        {
+            in.read();
+            continue;
+        }
+        if (c != '"' || !ConfigClass::readKey(in, sectionName, sizeof(sectionName)) || ConfigClass::skipWhitespace(in) != ':')
+        {
+            LogInfo.log(LM_CONFIG, LOG_ERROR, F("Loading configuration error (not valid JSON)"));
+            return false;
+        }
+        in.read();
+        int8_t index = this->findSection(sectionName);
+        c = ConfigClass::skipWhitespace(in);
+        if (index < 0 || (c != '{' && c != '['))
+        {
+            if (!ConfigClass::skipValue(in))
+            {
+                LogInfo.log(LM_CONFIG, LOG_ERROR, "Loading configuration error (%s is not valid JSON)", sectionName);
+                return false;
+            }
+            continue;
+        }
+        // ArduinoJson stops reading at the end of the element, so the stream is left at the next section
+        auto err = deserializeJson(doc, in);
+        if (err)
+        {
+            LogInfo.log(LM_CONFIG, LOG_ERROR, "Loading configuration error (%s %s)", sectionName, err.c_str());
+            return false;
+        }
+        this->addSnapshot(sectionName, doc.as<JsonVariantConst>());
+        this->loadSection(index, doc.as<JsonVariantConst>());
+    }
+}
+
+/**
+ * Write the configuration to the temporary file, check it and then swap it in for the configuration file
+ * 
+ * @param length The size of the configuration
+ * @param crc The CRC32 of the configuration
+ * @return True if the configuration file was replaced
+ */
+bool ConfigClass::writeFile(size_t length, uint32_t crc)
+{
+    Hal::File file;
+    if (!file.open(this->_tempName, "w"))
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, "Could not create %s", this->_tempName);
+        return false;
+    }
+    ConfigStream out(&file);
+    bool serialized = this->saveSections(out, false);
+    file.close();
+    _configBytesWritten += out.getLength();
+    if (!serialized || out.getLength() != length || !ConfigClass::verifyFile(this->_tempName, length, crc))
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, "Configuration did not verify after writing %s", this->_tempName);
+        Hal::removeFile(this->_tempName);
+        return false;
+    }
+    // SPIFFS will not rename over a file, so the backup goes first
+    Hal::removeFile(this->_backupName);
+    Hal::renameFile(this->_fileName, this->_backupName);
+    if (!Hal::renameFile(this->_tempName, this->_fileName))
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, "Could not rename %s", this->_tempName);
+        Hal::renameFile(this->_backupName, this->_fileName);
+        return false;
+    }
+    this->_fileCrc = crc;
+    LogInfo.log(LM_CONFIG, LOG_INFO, "Saved configuration (%u bytes, %u written since power on)", length, _configBytesWritten);
+    return true;
+}
+
+/**
+ * Read the file back and check it is the size and CRC that was written
+ * 
+ * @param fileName The file to check
+ * @param length The expected size
+ * @param crc The expected CRC32
+ * @return True if the file matches
+ */
+bool ConfigClass::verifyFile(const char *fileName, size_t length, uint32_t crc)
+{
+    Hal::File file;
+    if (!file.open(fileName, "r") || file.size() != length)
+    {
+        return false;
+    }
+    uint8_t chunk[128];
+    uint32_t check = 0;
+    size_t read;
+    while ((read = file.read(chunk, sizeof(chunk))) > 0)
+    {
+        check = Hal::crc32(check, chunk, read);
+    }
+    file.close();
+    return check == crc;
+}
+
+/**
+ * Write each registered instance's element to the stream, a section at a time so only one section is ever
+ * held in a document.  The output is the same as serializing the whole configuration in one document.
+ * 
+ * @param out Where the configuration is written
+ * @param snapshot True if each section is also added to the snapshot
+ * @return True if every section fitted in its document
+ */
+bool ConfigClass::saveSections(ConfigStream &out, bool snapshot)
+{
+    DynamicJsonDocument doc(this->_maxDocSize);
+    out.print('{');
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        const char *sectionName = this->_configs[i]->getSectionName();
+        doc.clear();
+        auto json = doc.to<JsonObject>();
+        this->_configs[i]->save(json);
+        if (doc.overflowed())
+        {
+            LogInfo.log(LM_CONFIG, LOG_ERROR, "Saving configuration error (%s is too big)", sectionName);
+            return false;
+        }
+        JsonVariantConst element = json.getMember(sectionName);
+        if (snapshot)
+        {
+            LogInfo.log(LM_CONFIG, LOG_VERBOSE, F("Saving JSON"), json);
+            this->addSnapshot(sectionName, element);
+        }
+        if (i > 0)
+        {
+            out.print(',');
+        }
+        out.print('"');
+        out.print(sectionName);
+        out.print("\":");
+        serializeJson(element, out);
+    }
+    out.print('}');
+    return true;
+}
+
+/**
+ * Find the registered instance for the section
+ * 
+ * @param sectionName The section name
+ * @return The index of the instance, -1 if none is registered
+ */
+int8_t ConfigClass::findSection(const char *sectionName)
+{
+    uint32_t hash = ConfigClass::hashName(sectionName);
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        if (this->_hashes[i] == hash && this->_configs[i]->isSection(sectionName))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Call the listeners subscribed to the section, if any of the keys they listen to changed
+ * 
+ * @param changes The changes to one section
+ * @param count The number of changes
+ */
+void ConfigClass::notify(const ConfigChange *changes, uint8_t count)
+{
+    for (uint8_t i = 0; i < this->_listenerTotal; i++)
+    {
+        ConfigListener *entry = &this->_listeners[i];
+        if (strcmp(entry->sectionName, changes[0].section) != 0)
+        {
+            continue;
+        }
+        for (uint8_t j = 0; j < count; j++)
+        {
+            if (entry->key == NULL || strcmp(entry->key, changes[j].field->key) == 0)
+            {
+                entry->listener(changes, count);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Give the registered instance its JSON element
+ * 
+ * @param index The index of the instance
+ * @param element The section's JSON element
+ */
+void ConfigClass::loadSection(uint8_t index, JsonVariantConst element)
+{
+    LogInfo.log(LM_CONFIG, LOG_VERBOSE, "Loading section (%s)", this->_configs[index]->getSectionName());
+    this->_configs[index]->loadElement(element);
+    if (!Hal::heapCheck())
+    {
+        LogInfo.log(LM_CONFIG, LOG_ERROR, F("Heap Corruption detected! Config -1"));
+    }
+}
+
+/**
+ * Load the configuration from the snapshot in RTC memory, if it is valid
+ * 
+ * @return True if the snapshot was valid and loaded
+ */
+bool ConfigClass::loadSnapshot()
+{
+    if (_configSnapshot.magic != CONFIG_SNAPSHOT_MAGIC || _configSnapshot.length > CONFIG_SNAPSHOT_SIZE ||
+        _configSnapshot.crc != Hal::crc32(0, _configSnapshot.data, _configSnapshot.length))
+    {
+        LogInfo.log(LM_CONFIG, LOG_WARNING, F("Configuration snapshot is not valid"));
+        return false;
+    }
+    DynamicJsonDocument doc(this->_maxDocSize);
+    char sectionName[CONFIG_SECTION_NAME_SIZE];
+    uint16_t offset = 0;
+    while (offset < _configSnapshot.length)
+    {
+        const uint8_t *data = &_configSnapshot.data[offset];
+        uint8_t nameLength = data[0];
+        if (nameLength >= sizeof(sectionName))
+        {
+            return false;
+        }
+        memcpy(sectionName, &data[1], nameLength);
+        sectionName[nameLength] = '\0';
+        uint16_t size = data[nameLength + 1] | (data[nameLength + 2] << 8);
+        offset += nameLength + 3 + size;
+        int8_t index = this->findSection(sectionName);
+        if (index < 0)
+        {
+            continue;
+        }
+        // A const pointer, so the strings are copied and the snapshot is left as it is
+        if (deserializeMsgPack(doc, (const char *)&data[nameLength + 3], size))
+        {
+            return false;
+        }
+        this->loadSection(index, doc.as<JsonVariantConst>());
+    }
+    this->_fileCrc = _configSnapshot.fileCrc;
+    return true;
+}
+
+/**
+ * Start a new snapshot, it is not valid until endSnapshot
+ */
+void ConfigClass::beginSnapshot()
+{
+    _configSnapshot.magic = 0;
+    _configSnapshot.length = 0;
+    this->_snapshotFull = false;
+}
+
+/**
+ * Add a MessagePack copy of the section's element to the snapshot
+ * 
+ * @param sectionName The section name
+ * @param element The section's JSON element
+ */
+void ConfigClass::addSnapshot(const char *sectionName, JsonVariantConst element)
+{
+    if (this->_snapshotFull)
+    {
+        return;
+    }
+    size_t nameLength = strlen(sectionName);
+    size_t size = measureMsgPack(element);
+    uint8_t *data = &_configSnapshot.data[_configSnapshot.length];
+    // One more byte than needed, ArduinoJson may terminate the buffer
+    if (_configSnapshot.length + nameLength + 3 + size + 1 > CONFIG_SNAPSHOT_SIZE)
+    {
+        LogInfo.log(LM_CONFIG, LOG_WARNING, "Configuration is too big for a snapshot (%s)", sectionName);
+        this->_snapshotFull = true;
+        return;
+    }
+    data[0] = nameLength;
+    memcpy(&data[1], sectionName, nameLength);
+    data[nameLength + 1] = size & 0xFF;
+    data[nameLength + 2] = size >> 8;
+    serializeMsgPack(element, &data[nameLength + 3], CONFIG_SNAPSHOT_SIZE - _configSnapshot.length - nameLength - 3);
+    _configSnapshot.length += nameLength + 3 + size;
+}
+
+/**
+ * Mark the snapshot as valid for the next timer wakeup
+ * 
+ * @param fileCrc The CRC32 of the configuration file the snapshot matches
+ */
+void ConfigClass::endSnapshot(uint32_t fileCrc)
+{
+    if (this->_snapshotFull)
+    {
+        return;
+    }
+    _configSnapshot.fileCrc = fileCrc;
+    _configSnapshot.crc = Hal::crc32(0, _configSnapshot.data, _configSnapshot.length);
+    _configSnapshot.magic = CONFIG_SNAPSHOT_MAGIC;
+}
+
+/**
+ * FNV-1a hash of the section name
+ * 
+ * @param name The section name
+ * @return The hash
+ */
+uint32_t ConfigClass::hashName(const char *name)
+{
+    uint32_t hash = 2166136261UL;
+    while (*name)
+    {
+        hash = (hash ^ (uint8_t)*name++) * 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * Skip over any white space in the stream
+ * 
+ * @param in The stream
+ * @return The next character, which has not been read, or -1 at the end of the stream
+ */
+int ConfigClass::skipWhitespace(Stream &in)
+{
+    int c;
+    while ((c = in.peek()) == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+        in.read();
+    }
+    return c;
+}
+
+/**
+ * Read a JSON string, the stream must be at the opening quote.  A string too long for the buffer is
+ * returned empty, so it never matches a section by its first few characters.
+ * 
+ * @param in The stream
+ * @param key Where the string is copied to
+ * @param size The size of the buffer
+ * @return True if the whole string was read
+ */
+bool ConfigClass::readKey(Stream &in, char *key, size_t size)
+{
+    size_t length = 0;
+    bool truncated = false;
+    in.read();
+    while (true)
+    {
+        int c = in.read();
+        if (c < 0)
+        {
+            return false;
+        }
+        if (c == '"')
+        {
+            break;
+        }
+        if (c == '\\')
+        {
+            c = in.read();
+        }
+        if (length < size - 1)
+        {
+            key[length++] = c;
+        }
+        else
+        {
+            truncated = true;
+        }
+    }
+    key[truncated ? 0 : length] = '\0';
+    return true;
+}
+
+/**
+ * Skip over a JSON value without parsing it, only the nesting and strings are tracked
+ * 
+ * @param in The stream
+ * @return True if the value was complete
+ */
+bool ConfigClass::skipValue(Stream &in)
+{
+    int c = ConfigClass::skipWhitespace(in);
+    if (c != '{' && c != '[' && c != '"')
+    {
+        // A number, true, false or null, it ends at the next delimiter
+        while ((c = in.peek()) >= 0 && c != ',' && c != '}' && c != ']' && !isspace(c))
+        {
+            in.read();
+        }
+        return c >= 0;
+    }
+    uint8_t depth = 0;
+    bool inString = false;
+    do
+    {
+        c = in.read();
+        if (c < 0)
+        {
+            return false;
+        }
+        if (inString)
+        {
+            if (c == '\\')
+            {
+                in.read();
+            }
+            else if (c == '"')
+            {
+                inString = false;
+            }
+        }
+        else if (c == '"')
+        {
+            inString = true;
+        }
+        else if (c == '{' || c == '[')
+        {
+            depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            depth--;
+        }
+    } while (depth > 0 || inString);
+    return true;
+}
+
+/**
+ * Class Constructor
+ * 
+ * @param file The file read from or written to, NULL to only count and check what is written
+ */
+ConfigStream::ConfigStream(Hal::File *file) : _file(file), _crc(0), _length(0)
+{
+    // ArduinoJson reads through readBytes, which would wait at the end of the file
+    this->setTimeout(0);
+}
+
+/**
+ * Get the number of bytes that can be read
+ * 
+ * @return The number of bytes
+ */
+int ConfigStream::available()
+{
+    return this->_file ? this->_file->available() : 0;
+}
+
+/**
+ * Read a byte, adding it to the CRC
+ * 
+ * @return The byte or -1 at the end of the stream
+ */
+int ConfigStream::read()
+{
+    int c = this->_file ? this->_file->read() : -1;
+    if (c >= 0)
+    {
+        uint8_t b = c;
+        this->_crc = Hal::crc32(this->_crc, &b, 1);
+        this->_length++;
+    }
+    return c;
+}
+
+/**
+ * Look at the next byte without reading it
+ * 
+ * @return The byte or -1 at the end of the stream
+ */
+int ConfigStream::peek()
+{
+    return this->_file ? this->_file->peek() : -1;
+}
+
+/**
+ * Flush the stream
+ */
+void ConfigStream::flush()
+{
+    if (this->_file)
+    {
+        this->_file->flush();
+    }
+}
+
+/**
+ * Write a byte, adding it to the CRC
+ * 
+ * @param c The byte
+ * @return The number of bytes written
+ */
+size_t ConfigStream::write(uint8_t c)
+{
+    return this->write(&c, 1);
+}
+
+/**
+ * Write the bytes, adding them to the CRC
+ * 
+ * @param buffer The bytes
+ * @param size The number of bytes
+ * @return The number of bytes written
+ */
+size_t ConfigStream::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = this->_file ? this->_file->write(buffer, size) : size;
+    this->_crc = Hal::crc32(this->_crc, buffer, written);
+    this->_length += written;
+    return written;
+}
+
+/**
+ * Get the CRC32 of everything read or written
+ * 
+ * @return The CRC32
+ */
+uint32_t ConfigStream::getCrc()
+{
+    return this->_crc;
+}
+
+/**
+ * Get the number of bytes read or written
+ * 
+ * @return The number of bytes
+ */
+size_t ConfigStream::getLength()
+{
+    return this->_length;
+}
+
+/**
+ * Load the fields described by the table from the JSON element in a single pass over the element.  Every
+ * field is set to its default first, then each value in the element is type and range checked, a value that
+ * is not valid is logged and the default kept.
+ * 
+ * @param obj The ArduinoJson object that the fields will be loaded from
+ * @param fields The field descriptor table
+ * @param count The number of fields in the table
+ * @return The number of values that were not valid
+ */
+uint8_t BaseConfigInfoClass::loadFields(JsonObjectConst obj, const ConfigField *fields, uint8_t count)
+{
+    uint8_t invalid = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const ConfigField *field = &fields[i];
+        if (field->type == CFT_STRING)
+        {
+            strlcpy((char *)field->member(this), field->defaultString, field->size);
+        }
+        else
+        {
+            this->setFieldNumber(field, field->defaultValue);
+        }
+    }
+
+    for (JsonPairConst kv : obj)
+    {
+        const ConfigField *field = BaseConfigInfoClass::findField(fields, count, kv.key().c_str());
+        if (field != NULL && !this->setField(field, kv.value()))
+        {
+            LogInfo.log(LM_CONFIG, LOG_WARNING, "Configuration value %s is not valid, using the default", field->key);
+            invalid++;
+        }
+    }
+    return invalid;
+}
+
+/**
+ * Apply the values in the JSON element to the fields at runtime.  Only the values given are changed, a value
+ * that is not valid, or that does not fit in the change set, is logged and ignored.  Each field that changes is stored as a setting or marks the section
+ * to be saved, is added to reported and to the change set.
+ * 
+ * @param obj The ArduinoJson object with the new values
+ * @param reported The values that changed are added to this
+ * @param fields The field descriptor table
+ * @param count The number of fields in the table
+ * @param changes Filled with the fields that changed
+ * @param size The most changes that can be added
+ * @return The number of fields that changed
+ */
+uint8_t BaseConfigInfoClass::applyFields(JsonObjectConst obj, JsonObject reported, const ConfigField *fields, uint8_t count,
+                                         ConfigChange *changes, uint8_t size)
+{
+    uint8_t total = 0;
+    for (JsonPairConst kv : obj)
+    {
+        const ConfigField *field = BaseConfigInfoClass::findField(fields, count, kv.key().c_str());
+        if (field == NULL)
+        {
+            continue;
+        }
+        if (total == size)
+        {
+            LogInfo.log(LM_CONFIG, LOG_ERROR, "No room to apply %s to %s, ignored", field->key, this->_sectionName);
+            continue;
+        }
+        bool valid;
+        bool changed;
+        if (field->type == CFT_STRING)
+        {
+            char before[field->size];
+            strcpy(before, (const char *)field->member(this));
+            valid = this->setField(field, kv.value());
+            changed = strcmp(before, (const char *)field->member(this)) != 0;
+        }
+        else
+        {
+            int32_t before = this->getFieldNumber(field);
+            valid = this->setField(field, kv.value());
+            changed = this->getFieldNumber(field) != before;
+        }
+        if (!valid)
+        {
+            LogInfo.log(LM_CONFIG, LOG_WARNING, "Configuration value %s is not valid, ignored", field->key);
+            continue;
+        }
+        if (!changed)
+        {
+            continue;
+        }
+        if (!field->setting || !this->storeField(field))
+        {
+            this->_changed = true;
+        }
+        this->saveFields(reported, field, 1);
+        changes[total].section = this->_sectionName;
+        changes[total].config = this;
+        changes[total].field = field;
+        total++;
+    }
+    return total;
+}
+
+/**
+ * Find the field for the key
+ * 
+ * @param fields The field descriptor table
+ * @param count The number of fields in the table
+ * @param key The JSON key
+ * @return The field descriptor or NULL if the key is not in the table
+ */
+const ConfigField *BaseConfigInfoClass::findField(const ConfigField *fields, uint8_t count, const char *key)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (strcmp(fields[i].key, key) == 0)
+        {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Type and range check the value and store it in the field's member
+ * 
+ * @param field The field descriptor
+ * @param value The JSON value
+ * @return True if the value was valid and stored
+ */
+bool BaseConfigInfoClass::setField(const ConfigField *field, JsonVariantConst value)
+{
+    switch (field->type)
+    {
+    case CFT_BOOL:
+        if (value.is<bool>())
+        {
+            this->setFieldNumber(field, value.as<bool>() ? 1 : 0);
+            return true;
+        }
+        break;
+    case CFT_UINT:
+    case CFT_INT:
+        if (value.is<long long>() && value.as<long long>() >= field->min && value.as<long long>() <= field->max)
+        {
+            this->setFieldNumber(field, (int32_t)value.as<long long>());
+            return true;
+        }
+        break;
+    case CFT_STRING:
+        if (value.is<const char *>() && strlen(value.as<const char *>()) < field->size)
+        {
+            strcpy((char *)field->member(this), value.as<const char *>());
+            return true;
+        }
+        break;
+    }
+    return false;
+}
+
+/**
+ * Save the fields described by the table to the JSON element
+ * 
+ * @param json The ArduinoJson object that the fields will be added to
+ * @param fields The field descriptor table
+ * @param count The number of fields in the table
+ */
+void BaseConfigInfoClass::saveFields(JsonObject json, const ConfigField *fields, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const ConfigField *field = &fields[i];
+        switch (field->type)
+        {
+        case CFT_BOOL:
+            json[field->key] = this->getFieldNumber(field) != 0;
+            break;
+        case CFT_UINT:
+        case CFT_INT:
+            json[field->key] = this->getFieldNumber(field);
+            break;
+        case CFT_STRING:
+            // Not copied by ArduinoJson, the member outlives the document
+            json[field->key] = (const char *)field->member(this);
+            break;
+        }
+    }
+}
+
+/**
+ * Overlay the values stored in Settings on the fields marked as settings, so a value changed at runtime
+ * replaces the one in the configuration file.  Call after loadFields.
+ * 
+ * @param fields The field descriptor table
+ * @param count The number of fields in the table
+ */
+void BaseConfigInfoClass::loadSettings(const ConfigField *fields, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const ConfigField *field = &fields[i];
+        if (!field->setting)
+        {
+            continue;
+        }
+        if (field->type == CFT_STRING)
+        {
+            char value[field->size];
+            if (Settings.getString(this->_sectionName, field->key, value, field->size))
+            {
+                strcpy((char *)field->member(this), value);
+            }
+            continue;
+        }
+        uint32_t value;
+        if (Settings.getUInt(this->_sectionName, field->key, &value))
+        {
+            int64_t number = field->type == CFT_INT ? (int64_t)(int32_t)value : (int64_t)value;
+            if (number >= field->min && number <= field->max)
+            {
+                this->setFieldNumber(field, (int32_t)number);
+            }
+        }
+    }
+}
+
+/**
+ * Store the field's current value in Settings, which writes just this key and not the configuration file.
+ * 
+ * @param fields The field descriptor table
+ * @param count The number of fields in the table
+ * @param key The key of the field that has changed
+ * @return True if it was stored, false if the section should be saved to the file instead
+ */
+bool BaseConfigInfoClass::storeSetting(const ConfigField *fields, uint8_t count, const char *key)
+{
+    const ConfigField *field = BaseConfigInfoClass::findField(fields, count, key);
+    return field != NULL && field->setting && this->storeField(field);
+}
+
+/**
+ * Store the field's current value in Settings
+ * 
+ * @param field The field descriptor
+ * @return True if it was stored, false if the section should be saved to the file instead
+ */
+bool BaseConfigInfoClass::storeField(const ConfigField *field)
+{
+    if (!Settings.isPersistent())
+    {
+        return false;
+    }
+    if (field->type == CFT_STRING)
+    {
+        return Settings.setString(this->_sectionName, field->key, (const char *)field->member(this));
+    }
+    return Settings.setUInt(this->_sectionName, field->key, (uint32_t)this->getFieldNumber(field));
+}
+
+/**
+ * Store the number in the member, using the member size
+ * 
+ * @param field The field descriptor
+ * @param number The value to store
+ */
+void BaseConfigInfoClass::setFieldNumber(const ConfigField *field, int32_t number)
+{
+    void *value = field->member(this);
+    switch (field->size)
+    {
+    case 1:
+        *(uint8_t *)value = (uint8_t)number;
+        break;
+    case 2:
+        *(uint16_t *)value = (uint16_t)number;
+        break;
+    case 4:
+        *(uint32_t *)value = (uint32_t)number;
+        break;
+    }
+}
+
+/**
+ * Read the number from the member, using the member size and sign
+ * 
+ * @param field The field descriptor
+ * @return The value of the member
+ */
+int32_t BaseConfigInfoClass::getFieldNumber(const ConfigField *field)
+{
+    const void *value = field->member(this);
+    switch (field->size)
+    {
+    case 1:
+        return field->type == CFT_INT ? *(const int8_t *)value : *(const uint8_t *)value;
+    case 2:
+        return field->type == CFT_INT ? *(const int16_t *)value : *(const uint16_t *)value;
+    case 4:
+        return *(const int32_t *)value;
+    }
+    return 0;
+}
+
 ConfigClass Configuration;
\ No newline at end of file
@@ -1,8 +1,86 @@
 #ifndef CONFIGCLASS_H
 #define CONFIGCLASS_H
 
+#include <Arduino.h>
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
+#include "Hal.h"
+
+#define CONFIG_SNAPSHOT_MAGIC 0x43464753  // "CFGS", marks the RTC snapshot as initialised
+#define CONFIG_SNAPSHOT_SIZE 2048         // Largest MessagePack copy of the configuration kept in RTC memory
+#define CONFIG_SAVE_DELAY_MS 30000        // Changes are held this long so several changes are saved in one write
+#define CONFIG_FILE_NAME_SIZE 32          // SPIFFS file names are limited to 32 characters
+#define CONFIG_SECTION_NAME_SIZE 24       // Longest section name, including the terminator
+#define CONFIG_MAX_LISTENERS 12           // Subscriptions to runtime changes
+#define CONFIG_MAX_CHANGES 16             // Most values changed in one section by one apply()
+
+typedef struct configSnapshotStruct
+{
+    uint32_t magic;
+    uint32_t fileCrc;     // CRC32 of the configuration file the snapshot was taken from
+    uint32_t crc;         // CRC32 of the data
+    uint16_t length;
+    // Each section in turn: name length (1 byte), name, element length (2 bytes), MessagePack element
+    uint8_t data[CONFIG_SNAPSHOT_SIZE];
+} ConfigSnapshot;
+
+typedef enum
+{
+    CFT_BOOL = 0,
+    CFT_UINT,
+    CFT_INT,
+    CFT_STRING
+} ConfigFieldType;
+
+class BaseConfigInfoClass;
+
+typedef struct configFieldStruct
+{
+    const char *key;
+    ConfigFieldType type;
+    void *(*member)(BaseConfigInfoClass *config);   // Finds the member the field is loaded into in an instance
+    uint16_t size;        // sizeof the member, for strings the buffer size
+    int32_t min;
+    int32_t max;
+    int32_t defaultValue;
+    const char *defaultString;
+    bool setting;         // Changed at runtime, so it is stored as a single key in Settings and not in the file
+} ConfigField;
+
+// Field descriptors, the member is named relative to the section's class, e.g. CONFIG_UINT("baud", GpsInfoClass,
+// _baud, ...), and found in whichever instance is being loaded or saved, so instances of a class share a table
+#define CONFIG_MEMBER(type, member) \
+    [](BaseConfigInfoClass *config) -> void * { return &static_cast<type *>(config)->member; }
+#define CONFIG_SIZEOF(type, member) sizeof(((type *)NULL)->member)
+#define CONFIG_BOOL(key, type, member, def) \
+    {key, CFT_BOOL, CONFIG_MEMBER(type, member), CONFIG_SIZEOF(type, member), 0, 1, def, NULL}
+#define CONFIG_UINT(key, type, member, def, min, max) \
+    {key, CFT_UINT, CONFIG_MEMBER(type, member), CONFIG_SIZEOF(type, member), min, max, def, NULL}
+#define CONFIG_INT(key, type, member, def, min, max) \
+    {key, CFT_INT, CONFIG_MEMBER(type, member), CONFIG_SIZEOF(type, member), min, max, def, NULL}
+#define CONFIG_STRING(key, type, member, def) \
+    {key, CFT_STRING, CONFIG_MEMBER(type, member), CONFIG_SIZEOF(type, member), 0, 0, 0, def}
+#define CONFIG_UINT_SETTING(key, type, member, def, min, max) \
+    {key, CFT_UINT, CONFIG_MEMBER(type, member), CONFIG_SIZEOF(type, member), min, max, def, NULL, true}
+#define CONFIG_STRING_SETTING(key, type, member, def) \
+    {key, CFT_STRING, CONFIG_MEMBER(type, member), CONFIG_SIZEOF(type, member), 0, 0, 0, def, true}
+#define CONFIG_FIELD_COUNT(fields) (sizeof(fields) / sizeof(fields[0]))
+
+typedef struct configChangeStruct
+{
+    const char *section;
+    BaseConfigInfoClass *config;   // The instance that changed
+    const ConfigField *field;      // The field that changed, it already has the new value
+} ConfigChange;
+
+typedef void (*CONFIGLISTENER)(const ConfigChange *changes, uint8_t count);
+
+typedef struct configListenerStruct
+{
+    const char *sectionName;
+    const char *key;              // NULL for any key in the section
+    CONFIGLISTENER listener;
+} ConfigListener;
 
 class BaseConfigInfoClass
 {
@@ -13,6 +91,7 @@ class BaseConfigInfoClass
          * @param sectionName The section name which is related to the JSON element in the configuration file
          */    
         BaseConfigInfoClass(const char* sectionName){
+            // Section names are matched by hash and written to the file without escaping, keep them short and plain
             strcpy(this->_sectionName, sectionName);
         }
         /**
@@ -27,6 +106,16 @@ class BaseConfigInfoClass
          * @param json The ArduinoJson object that this element will be loaded from
          */          
         virtual void load(JsonObjectConst json) = 0;
+        /**
+         * Virtual load the section's element, whatever its type.  Sections whose element is not an object
+         * (e.g. the sensors array) override this, the others are given the object by load.
+         * 
+         * @param element The ArduinoJson element that this section will be loaded from
+         */
+        virtual void loadElement(JsonVariantConst element)
+        {
+            this->load(element.as<JsonObjectConst>());
+        }
         /**
          * Virtual create a JSON element that can be used report current telemetry and/or settings to who ever call it
          * 
@@ -34,6 +123,21 @@ class BaseConfigInfoClass
          */         
         virtual void toJson(JsonObject doc) = 0;
 
+        /**
+         * Virtual apply changed values at runtime, e.g. desired properties.  Sections that can be changed without
+         * a restart override this and call applyFields with their field table.
+         * 
+         * @param obj The ArduinoJson object with the new values for this section
+         * @param reported The values that changed are added to this
+         * @param changes Filled with the fields that changed
+         * @param size The most changes that can be added
+         * @return The number of fields that changed
+         */
+        virtual uint8_t apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size)
+        {
+            return 0;
+        }
+
         /**
          * Check to see if the sensor/configuration instance supports this section
          * 
@@ -73,25 +177,89 @@ class BaseConfigInfoClass
         }
 
     protected:
-        char _sectionName[24];
+        uint8_t loadFields(JsonObjectConst obj, const ConfigField *fields, uint8_t count);
+        void saveFields(JsonObject json, const ConfigField *fields, uint8_t count);
+        static const ConfigField *findField(const ConfigField *fields, uint8_t count, const char *key);
+        bool setField(const ConfigField *field, JsonVariantConst value);
+        uint8_t applyFields(JsonObjectConst obj, JsonObject reported, const ConfigField *fields, uint8_t count,
+                            ConfigChange *changes, uint8_t size);
+        void loadSettings(const ConfigField *fields, uint8_t count);
+        bool storeSetting(const ConfigField *fields, uint8_t count, const char *key);
+        bool storeField(const ConfigField *field);
+        void setFieldNumber(const ConfigField *field, int32_t number);
+        int32_t getFieldNumber(const ConfigField *field);
+        char _sectionName[CONFIG_SECTION_NAME_SIZE];
         bool _changed;
 };
 
+/**
+ * Stream over the configuration file that keeps a CRC32 of every byte read or written, so the file is checked
+ * as it is streamed.  With no file it just counts and checks, for measuring what would be written.
+ */
+class ConfigStream : public Stream
+{
+    public:
+        ConfigStream(Hal::File *file = NULL);
+        int available() override;
+        int read() override;
+        int peek() override;
+        void flush() override;
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t *buffer, size_t size) override;
+        uint32_t getCrc();
+        size_t getLength();
+
+    private:
+        Hal::File *_file;
+        uint32_t _crc;
+        size_t _length;
+};
+
 class ConfigClass
 {
     public: 
+        ConfigClass() : _configs(NULL), _hashes(NULL), _total(0), _size(0), _listenerTotal(0) {}
         ~ConfigClass();
         void begin(const char* filename, uint8_t defaultSize = 7, uint16_t maxDocSize = 2048);
         void add(BaseConfigInfoClass* config);
         bool load();
         bool save();
         bool shouldSave();
+        void tick();
+        uint32_t getBytesWritten();
+        bool subscribe(const char *sectionName, const char *key, CONFIGLISTENER listener);
+        uint8_t apply(JsonObjectConst desired, JsonObject reported);
 
     private:
-        BaseConfigInfoClass** _configs;  // Dynamically Allocated array of configs (should not be more then 7 hopefully)
+        void notify(const ConfigChange *changes, uint8_t count);
+        bool loadFile(const char *fileName);
+        bool loadSections(ConfigStream &in);
+        bool writeFile(size_t length, uint32_t crc);
+        static bool verifyFile(const char *fileName, size_t length, uint32_t crc);
+        bool saveSections(ConfigStream &out, bool snapshot);
+        int8_t findSection(const char *sectionName);
+        void loadSection(uint8_t index, JsonVariantConst element);
+        bool loadSnapshot();
+        void beginSnapshot();
+        void addSnapshot(const char *sectionName, JsonVariantConst element);
+        void endSnapshot(uint32_t fileCrc);
+        static uint32_t hashName(const char *name);
+        static int skipWhitespace(Stream &in);
+        static bool readKey(Stream &in, char *key, size_t size);
+        static bool skipValue(Stream &in);
+        BaseConfigInfoClass** _configs;  // Dynamically Allocated array of configs, it grows as sections are added
+        uint32_t* _hashes;               // Hash of each config section name, so a section is found without comparing names
         uint8_t _total; // How many configs have been added.
+        uint8_t _size;  // How many configs the arrays can hold
         const char* _fileName;
-        uint16_t _maxDocSize;
+        char _tempName[CONFIG_FILE_NAME_SIZE];
+        char _backupName[CONFIG_FILE_NAME_SIZE];
+        uint16_t _maxDocSize;            // Largest JSON document for one section
+        uint32_t _fileCrc;
+        bool _snapshotFull;
+        ConfigListener _listeners[CONFIG_MAX_LISTENERS];
+        uint8_t _listenerTotal;
+        uint32_t _pendingSince;
 };
 
 extern ConfigClass Configuration;
@@ -2,6 +2,10 @@
 #include "LogInfo.h"
 #include "WakeUpInfo.h"
 
+const ConfigField DeviceInfoClass::_fields[] = {
+    CONFIG_STRING("prefix", DeviceInfoClass, _prefix, "DEVTMP"),
+    CONFIG_STRING_SETTING("location", DeviceInfoClass, _location, ""),
+};
 
 /**
  * Initialise the device and wakeup
@@ -18,19 +22,14 @@ void DeviceInfoClass::begin()
  */
 void DeviceInfoClass::load(JsonObjectConst obj)
 {
-    strcpy(this->_prefix, obj.containsKey("prefix") ?obj["prefix"].as<const char*>() : "DEVTMP");
-    strncpy(this->_device_id, this->_prefix, sizeof(this->_prefix));
-    strcat(this->_device_id, "-");
-    strcat(this->_device_id, LogInfo.getUniqueId());
-    strcpy(this->_location, obj.containsKey("location") ? obj["location"].as<const char*>() : "");
+    this->loadFields(obj, DeviceInfoClass::_fields, CONFIG_FIELD_COUNT(DeviceInfoClass::_fields));
+    this->loadSettings(DeviceInfoClass::_fields, CONFIG_FIELD_COUNT(DeviceInfoClass::_fields));
+    snprintf(this->_device_id, sizeof(this->_device_id), "%s-%s", this->_prefix, LogInfo.getUniqueId());
     uint32_t wakeup = obj["wakeup"].as<int>();
     WakeUp.setSleepTime(obj.containsKey("sleep") ? obj["sleep"].as<int>() : 30);   
-    if (wakeup > 0)
-    {
-        WakeUp.setTimerWakeUp(wakeup);
-    }
-    LogInfo.log(LOG_INFO, "Device Id           : %s", this->getDeviceId());
-    LogInfo.log(LOG_INFO, "Location            : %s", this->getLocation());
+    WakeUp.setTimerWakeUp(wakeup);
+    LogInfo.log(LM_DEVICE, LOG_INFO, "Device Id           : %s", this->getDeviceId());
+    LogInfo.log(LM_DEVICE, LOG_INFO, "Location            : %s", this->getLocation());
 }
 
 /**
@@ -41,10 +40,24 @@ void DeviceInfoClass::load(JsonObjectConst obj)
 void DeviceInfoClass::save(JsonObject obj)
 {
     auto json = obj.createNestedObject(this->_sectionName);
-    json["prefix"] = this->_prefix;
+    this->saveFields(json, DeviceInfoClass::_fields, CONFIG_FIELD_COUNT(DeviceInfoClass::_fields));
     json["wakeup"] = WakeUp.getWakeupInterval();
     json["sleep"] = WakeUp.getSleepTime();
-    json["location"] = this->_location;
+}
+
+/**
+ * overridden apply changed values at runtime.  The device id is only built when the configuration is loaded,
+ * as it is the id we are connected to the cloud with, so a new prefix is used from the next restart.
+ * 
+ * @param obj The ArduinoJson object with the new values
+ * @param reported The values that changed are added to this
+ * @param changes Filled with the fields that changed
+ * @param size The most changes that can be added
+ * @return The number of fields that changed
+ */
+uint8_t DeviceInfoClass::apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size)
+{
+    return this->applyFields(obj, reported, DeviceInfoClass::_fields, CONFIG_FIELD_COUNT(DeviceInfoClass::_fields), changes, size);
 }
 
 /**
@@ -70,7 +83,7 @@ const char* DeviceInfoClass::getDeviceId()
 }
 
 /**
- * set the current location
+ * set the current location, it is stored as a setting so the configuration file is not rewritten
  * 
  * @param newLocation The new location name
  * @return True if it has changed
@@ -79,8 +92,11 @@ bool DeviceInfoClass::setLocation(const char* newLocation)
 {
     if (strcmp(this->_location, newLocation) != 0)
     {
-        strcpy(this->_location, newLocation);
-        this->_changed = true;
+        strlcpy(this->_location, newLocation, sizeof(this->_location));
+        if (!this->storeSetting(DeviceInfoClass::_fields, CONFIG_FIELD_COUNT(DeviceInfoClass::_fields), "location"))
+        {
+            this->_changed = true;
+        }
         return true;
     }
     return false;
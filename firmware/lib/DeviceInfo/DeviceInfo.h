@@ -13,12 +13,14 @@ public:
     void begin();
     void load(JsonObjectConst obj) override;
     void save(JsonObject ob) override;
+    uint8_t apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size) override;
     void toJson(JsonObject ob) override;
     const char *getDeviceId();
     bool setLocation(const char *newLocation);
     const char *getLocation();
 
 private:
+    static const ConfigField _fields[];
     char _prefix[20];
     char _device_id[32];
     char _location[64];
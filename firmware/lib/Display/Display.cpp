@@ -1,22 +1,12 @@
 #include "Display.h"
 #include "LogInfo.h"
 
-//U8G2_SSD1306_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, 16, 15, 4);
-
-//U8G2_SSD1327_MIDAS_128X128_F_2ND_4W_HW_SPI u8g2(U8G2_R0, 5, 16, 2);
-U8G2_SSD1327_MIDAS_128X128_F_3W_SW_SPI u8g2(U8G2_R0,10, 7, 5, 8);
-
 /**
  * Begin the initialization of the OLED Screen
  */
 void DisplayClass::begin()
 {
-    u8g2.begin();
-    u8g2.setFont(u8g2_font_6x10_tr);
-    u8g2.setFontRefHeightExtendedText();
-    u8g2.setFontPosTop();
-    u8g2.setFontDirection(0);
-    u8g2.clearBuffer();
+    Hal::displayBegin(DISPLAY_CLOCK_PIN, DISPLAY_DATA_PIN, DISPLAY_CS_PIN, DISPLAY_RESET_PIN);
 }
 
 /**
@@ -24,7 +14,7 @@ void DisplayClass::begin()
  */
 void DisplayClass::clear()
 {
-    u8g2.clearBuffer();
+    Hal::displayClear();
 }
 
 /**
@@ -34,27 +24,24 @@ void DisplayClass::clear()
  */
 void DisplayClass::displayExit(const __FlashStringHelper *ifsh, uint8_t secondsToReboot)
 {
-    u8g2.clearDisplay();
-    u8g2.setFontPosTop();
-    u8g2.setFontDirection(0);
-    u8g2.clearBuffer();
-    LogInfo.log(LOG_ERROR, ifsh);
-    u8g2.setDrawColor(1);
+    Hal::displayClear();
+    LogInfo.log(LM_DISPLAY, LOG_ERROR, ifsh);
     sprintf(this->_chBuffer, "%s", reinterpret_cast<const char *>(ifsh));
-    u8g2.drawStr(64 - (u8g2.getStrWidth(this->_chBuffer) / 2), 0, this->_chBuffer);
+    Hal::displayText(64 - (Hal::displayTextWidth(this->_chBuffer) / 2), 0, this->_chBuffer);
     sprintf(this->_chBuffer, "Restarting in %i seconds", secondsToReboot );
-    u8g2.drawStr(64 - (u8g2.getStrWidth(this->_chBuffer) / 2), 15, this->_chBuffer);
-    u8g2.sendBuffer();
-    LogInfo.log(LOG_WARNING, "%s", this->_chBuffer);
+    Hal::displayText(64 - (Hal::displayTextWidth(this->_chBuffer) / 2), 15, this->_chBuffer);
+    Hal::displaySend();
+    LogInfo.log(LM_DISPLAY, LOG_WARNING, "%s", this->_chBuffer);
     for (uint8_t i = secondsToReboot; i > 0; i--)
     {
-        delay(1000);
+        Hal::delay(1000);
         sprintf(this->_chBuffer, "Restarting in %i seconds!", i);
-        u8g2.drawStr(64 - (u8g2.getStrWidth(this->_chBuffer) / 2), 15, this->_chBuffer);
-        u8g2.sendBuffer();
+        Hal::displayText(64 - (Hal::displayTextWidth(this->_chBuffer) / 2), 15, this->_chBuffer);
+        Hal::displaySend();
     }
-    LogInfo.log(LOG_VERBOSE, F("Restarting NOW!"));
-    ESP.restart();
+    LogInfo.log(LM_DISPLAY, LOG_VERBOSE, F("Restarting NOW!"));
+    LogInfo.flush();
+    Hal::restart();
 }
 
 /**
@@ -64,7 +51,7 @@ void DisplayClass::displayExit(const __FlashStringHelper *ifsh, uint8_t secondsT
  * @param y horizontal position in pixels
  * @param ifsh  flash string to be displayed
  */
-void DisplayClass::displayLine(u8g2_uint_t x, u8g2_uint_t y, const __FlashStringHelper *ifsh)
+void DisplayClass::displayLine(uint16_t x, uint16_t y, const __FlashStringHelper *ifsh)
 {
     this->writeLine(x, y, reinterpret_cast<const char *>(ifsh));
 }
@@ -77,7 +64,7 @@ void DisplayClass::displayLine(u8g2_uint_t x, u8g2_uint_t y, const __FlashString
  * @param format The format string that the extra parameters can be written to.
  * @param ... parameters to be added on the message 
  */
-void DisplayClass::displayLine(u8g2_uint_t x, u8g2_uint_t y, const char *format, ...)
+void DisplayClass::displayLine(uint16_t x, uint16_t y, const char *format, ...)
 {
     char * temp = this->_chBuffer;
 
@@ -92,7 +79,7 @@ void DisplayClass::displayLine(u8g2_uint_t x, u8g2_uint_t y, const char *format,
         va_end(arg);
         return;
     };
-    if (len >= sizeof(this->_chBuffer)) {
+    if ((size_t)len >= sizeof(this->_chBuffer)) {
         temp = (char*)malloc(len+1);
         if (temp == NULL) {
             va_end(arg);
@@ -115,18 +102,16 @@ void DisplayClass::displayLine(u8g2_uint_t x, u8g2_uint_t y, const char *format,
  * @param y horizontal position in pixels
  * @param msg The string that is written
  */
-void DisplayClass::writeLine(u8g2_uint_t x, u8g2_uint_t y, const char *msg)
+void DisplayClass::writeLine(uint16_t x, uint16_t y, const char *msg)
 {
-    u8g2.setDrawColor(0);
-    u8g2_uint_t yt = y-(FONT_ONE_HEIGHT / 2);
+    int16_t yt = y-(FONT_ONE_HEIGHT / 2);
     if (yt < 0)
     {
         yt = FONT_ONE_HEIGHT / 2;
     }
-    u8g2.drawBox(x, yt, 128, (FONT_ONE_HEIGHT + 2));
-    u8g2.setDrawColor(1);
-    u8g2.drawStr(x, yt, msg);
-    u8g2.sendBuffer();
+    Hal::displayErase(x, yt, 128, (FONT_ONE_HEIGHT + 2));
+    Hal::displayText(x, yt, msg);
+    Hal::displaySend();
 }
 
 DisplayClass OledDisplay;
\ No newline at end of file
@@ -1,12 +1,18 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <Arduino.h>
+
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
-#include <U8g2lib.h>
+#include "Hal.h"
 
 #define FONT_ONE_HEIGHT 8 // font one height in pixels
 #define FONT_TWO_HEIGHT 20
+#define DISPLAY_CLOCK_PIN 10        // The SSD1327 on 3 wire software SPI
+#define DISPLAY_DATA_PIN 7
+#define DISPLAY_CS_PIN 5
+#define DISPLAY_RESET_PIN 8
 
 class DisplayClass
 {
@@ -14,11 +20,11 @@ public:
     void begin();
     void clear();
     void displayExit(const __FlashStringHelper *ifsh, uint8_t secondsToReboot = 10);
-    void displayLine(u8g2_uint_t x, u8g2_uint_t y, const __FlashStringHelper *ifsh);    
-    void displayLine(u8g2_uint_t x, u8g2_uint_t y, const char *format, ...);
+    void displayLine(uint16_t x, uint16_t y, const __FlashStringHelper *ifsh);    
+    void displayLine(uint16_t x, uint16_t y, const char *format, ...);
 private:
     char _chBuffer[768];
-    void writeLine(u8g2_uint_t x, u8g2_uint_t y, const char *msg);
+    void writeLine(uint16_t x, uint16_t y, const char *msg);
 };
 
 extern DisplayClass OledDisplay;
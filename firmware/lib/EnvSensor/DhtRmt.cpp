@@ -0,0 +1,119 @@
+#include "DhtRmt.h"
+
+/**
+ * Set up the RMT channel to capture the data pin, the pin is open drain so the start signal can be driven
+ * on the same pin the RMT is watching
+ * 
+ * @param pin The data pin
+ * @return DHT_OK or DHT_ERR_DRIVER
+ */
+DhtError DhtRmt::begin(int8_t pin)
+{
+    return this->_capture.open(pin, DHT_IDLE_US) ? DHT_OK : DHT_ERR_DRIVER;
+}
+
+/**
+ * Release the RMT channel
+ */
+void DhtRmt::end()
+{
+    this->_capture.close();
+}
+
+/**
+ * Read the sensor, the task sleeps for the start signal and while the response is captured
+ * 
+ * @param temperature Set to the temperature in celsius
+ * @param humidity Set to the relative humidity
+ * @return DHT_OK or the error
+ */
+DhtError DhtRmt::read(float *temperature, float *humidity)
+{
+    if (!this->_capture.isOpen())
+    {
+        return DHT_ERR_DRIVER;
+    }
+    Hal::Pulse pulses[DHT_PULSES];
+    size_t count = this->_capture.capture(DHT_START_MS, DHT_TIMEOUT_MS, pulses, DHT_PULSES);
+    if (count == 0)
+    {
+        return DHT_ERR_TIMEOUT;
+    }
+    uint8_t data[DHT_BITS / 8];
+    DhtError err = this->decode(pulses, count, data);
+    if (err != DHT_OK)
+    {
+        return err;
+    }
+    *humidity = ((data[0] << 8) | data[1]) / 10.0;
+    *temperature = (((data[2] & 0x7F) << 8) | data[3]) / 10.0;
+    if (data[2] & 0x80)
+    {
+        *temperature = -*temperature;
+    }
+    return DHT_OK;
+}
+
+/**
+ * Decode the captured pulses.  Each bit is a 50 us low followed by a high whose length is the bit, the
+ * response starts with an 80 us low and high, so the bits are the last 40 high pulses.
+ * 
+ * @param pulses The pulses captured
+ * @param count The number of pulses
+ * @param data Set to the 5 bytes received
+ * @return DHT_OK or the error
+ */
+DhtError DhtRmt::decode(const Hal::Pulse *pulses, size_t count, uint8_t *data)
+{
+    uint16_t highs[DHT_BITS];
+    uint16_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (pulses[i].level == 1)
+        {
+            highs[total++ % DHT_BITS] = pulses[i].duration;
+        }
+    }
+    if (total < DHT_BITS)
+    {
+        return DHT_ERR_SHORT;
+    }
+    memset(data, 0, DHT_BITS / 8);
+    for (uint8_t bit = 0; bit < DHT_BITS; bit++)
+    {
+        // highs is a ring of the last 40, the oldest is at total % 40
+        if (highs[(total + bit) % DHT_BITS] > DHT_BIT_THRESHOLD_US)
+        {
+            data[bit / 8] |= 0x80 >> (bit % 8);
+        }
+    }
+    if (((data[0] + data[1] + data[2] + data[3]) & 0xFF) != data[4])
+    {
+        return DHT_ERR_CHECKSUM;
+    }
+    return DHT_OK;
+}
+
+/**
+ * Convert the error to a string for the logs
+ * 
+ * @param err The error
+ * @return The name
+ */
+const char *DhtRmt::errorToString(DhtError err)
+{
+    switch (err)
+    {
+    case DHT_OK:
+        return "OK";
+    case DHT_ERR_DRIVER:
+        return "DRIVER";
+    case DHT_ERR_TIMEOUT:
+        return "TIMEOUT";
+    case DHT_ERR_SHORT:
+        return "SHORT";
+    case DHT_ERR_CHECKSUM:
+        return "CHECKSUM";
+    }
+    return "UNKNOWN";
+}
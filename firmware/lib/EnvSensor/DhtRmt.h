@@ -0,0 +1,43 @@
+#ifndef DHTRMT_H
+#define DHTRMT_H
+
+#include <Arduino.h>
+#include "Hal.h"
+
+#define DHT_RMT_CHANNEL 4                // RMT channel used to capture the first DHT-22's response, the next use 5 to 7
+#define DHT_START_MS 3                   // Start signal, the host holds the line low for at least 1 ms
+#define DHT_TIMEOUT_MS 20                // Longest wait for the response, it takes about 5 ms
+#define DHT_IDLE_US 120                  // No edge for this long ends the capture, the longest pulse is 80 us
+#define DHT_BIT_THRESHOLD_US 50          // A high pulse longer than this is a 1, 26-28 us is a 0 and 70 us a 1
+#define DHT_BITS 40
+#define DHT_PULSES 128                   // Most pulses kept from a capture, the response is 84
+
+typedef enum
+{
+    DHT_OK = 0,
+    DHT_ERR_DRIVER,      // The RMT driver could not be installed
+    DHT_ERR_TIMEOUT,     // No response from the sensor
+    DHT_ERR_SHORT,       // Fewer than 40 bits were captured
+    DHT_ERR_CHECKSUM
+} DhtError;
+
+/**
+ * DHT-22 driver that captures the response with a Hal::PulseCapture, the RMT peripheral on the ESP32.  The
+ * start signal is a task delay and the task blocks on the RMT ring buffer while the sensor answers, so nothing
+ * busy waits and the read can run on any core without starving the watchdog.
+ */
+class DhtRmt
+{
+public:
+    DhtRmt(uint8_t channel = DHT_RMT_CHANNEL) : _capture(channel) {}
+    DhtError begin(int8_t pin);
+    void end();
+    DhtError read(float *temperature, float *humidity);
+    static const char *errorToString(DhtError err);
+
+private:
+    DhtError decode(const Hal::Pulse *pulses, size_t count, uint8_t *data);
+    Hal::PulseCapture _capture;
+};
+
+#endif
@@ -2,25 +2,49 @@
 #include "EnvSensor.h"
 #include "NTPInfo.h"
 #include "WakeUpInfo.h"
+#include "SensorScheduler.h"
+#include "SensorRegistry.h"
 
-RTC_DATA_ATTR int _envCount;
+HAL_RTC_DATA int _envCount[ENV_MAX_SENSORS];
+
+const ConfigField EnvSensorClass::_fields[] = {
+    CONFIG_UINT("scale", EnvSensorClass, _scale, ENV_CELSIUS, ENV_CELSIUS, ENV_FAHRENHEIT),
+    CONFIG_UINT("data", EnvSensorClass, _dataPin, 14, 0, 39),
+    CONFIG_BOOL("enabled", EnvSensorClass, _enabled, false),
+    CONFIG_UINT("sampleRate", EnvSensorClass, _sampleRate, 2500, 2000, 60000),
+};
 
 /**
- * overridden begin method to initialise the environment sensor and assign the semaphore flag
+ * Class Constructor, the first DHT-22 is "env" and the next "env2" and so on
  * 
- * @param flag The semaphore flag to use
+ * @param sectionName The section the sensor's settings are in
+ * @param index The number of DHT-22s created before this one
  */
-void EnvSensorClass::begin(SemaphoreHandle_t flag)
+EnvSensorClass::EnvSensorClass(const char *sectionName, uint8_t index)
+    : BaseConfigInfoClass(sectionName), BaseSensorClass("env", false, "temperature", "humidity"), _index(index),
+      _sensor(DHT_RMT_CHANNEL + index)
 {
-    this->_semaphoreFlag = flag;
+    if (index > 0)
+    {
+        snprintf(this->_name, sizeof(this->_name), "env%u", index + 1);
+    }
+}
+
+/**
+ * overridden begin method to initialise the environment sensor and assign the resource lock
+ * 
+ * @param lock The lock for the hardware the sensor is on
+ */
+void EnvSensorClass::begin(ResourceLock *lock)
+{
+    this->_lock = lock;
+    this->_reconfigure = false;
+    Configuration.subscribe(this->_sectionName, NULL, EnvSensorClass::configChanged);
     //Check if we are waking up or we have started because of manual reset or power on
     if (WakeUp.isPoweredOn())
     {
-        _envCount = 0;
+        _envCount[this->_index] = 0;
     }
-
-    this->_humidity = 0.0;
-    this->_temperature = 0.0;
 }
 
 /**
@@ -30,12 +54,11 @@ void EnvSensorClass::begin(SemaphoreHandle_t flag)
  */
 void EnvSensorClass::load(JsonObjectConst obj)
 {
-    this->_scale = obj.containsKey("scale") ? static_cast<ScaleType>(obj["scale"].as<int>()) : ENV_CELSIUS;
-    this->_dataPin = obj.containsKey("data") ? obj["data"].as<int>() : 14;
-    this->_enabled = obj.containsKey("enabled") ? obj["enabled"].as<bool>() : false;
-    this->_sampleRate = obj.containsKey("sampleRate") ? obj["sampleRate"].as<int>() : 2500;
-    this->_sensor = SimpleDHT22(this->_dataPin);
-    LogInfo.log(LOG_VERBOSE, "Env Data: %i Enabled: %s",
+    this->loadFields(obj, EnvSensorClass::_fields, CONFIG_FIELD_COUNT(EnvSensorClass::_fields));
+    this->_filters.load(obj["filters"]);
+    // The RMT channel is set up on the sensor's next read, by the task that reads it
+    this->reconfigure();
+    LogInfo.log(LM_ENV, LOG_VERBOSE, "Env Data: %i Enabled: %s",
                 this->_dataPin, this->getIsEnabled() ? "Yes" : "No");
 }
 
@@ -47,10 +70,47 @@ void EnvSensorClass::load(JsonObjectConst obj)
 void EnvSensorClass::save(JsonObject obj)
 {
     auto json = obj.createNestedObject(this->_sectionName);
-    json["scale"] = (int)this->_scale;
-    json["data"] = this->_dataPin;
-    json["enabled"] = this->_enabled;
-    json["sampleRate"] = this->_sampleRate;
+    this->saveFields(json, EnvSensorClass::_fields, CONFIG_FIELD_COUNT(EnvSensorClass::_fields));
+    this->_filters.save(json);
+}
+
+/**
+ * overridden apply changed values at runtime
+ * 
+ * @param obj The ArduinoJson object with the new values
+ * @param reported The values that changed are added to this
+ * @param changes Filled with the fields that changed
+ * @param size The most changes that can be added
+ * @return The number of fields that changed
+ */
+uint8_t EnvSensorClass::apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size)
+{
+    return this->applyFields(obj, reported, EnvSensorClass::_fields, CONFIG_FIELD_COUNT(EnvSensorClass::_fields), changes, size);
+}
+
+/**
+ * The Env settings have changed, a new data pin is set up before the next read and a new sample rate re-arms
+ * the schedule
+ * 
+ * @param changes The changes to the section
+ * @param count The number of changes
+ */
+void EnvSensorClass::configChanged(const ConfigChange *changes, uint8_t count)
+{
+    EnvSensorClass *sensor = static_cast<EnvSensorClass *>(changes[0].config);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const char *key = changes[i].field->key;
+        if (strcmp(key, "data") == 0)
+        {
+            LogInfo.log(LM_ENV, LOG_INFO, F("Env sensor will move to the new data pin"));
+            sensor->reconfigure();
+        }
+        else if (strcmp(key, "sampleRate") == 0)
+        {
+            SensorScheduler.reschedule(sensor);
+        }
+    }
 }
 
 /**
@@ -60,12 +120,32 @@ void EnvSensorClass::save(JsonObject obj)
  */
 void EnvSensorClass::toJson(JsonObject ob)
 {
-    auto json = ob.createNestedObject("EnvSensor");
-    json["temperature"] = this->_temperature;
-    json["humidity"] = this->_humidity;
-    json["read_count"] = _envCount;
-    json["last_read"] = this->_last_read;
-    json["last_epoch"] = this->_epoch_time;
+    EnvReading reading;
+    uint32_t sequence = this->getReading(&reading);
+    char name[16] = "EnvSensor";
+    if (this->_index > 0)
+    {
+        snprintf(name, sizeof(name), "EnvSensor%u", this->_index + 1);
+    }
+    auto json = ob.createNestedObject(name);
+    json["temperature"] = reading.temperature;
+    json["humidity"] = reading.humidity;
+    json["read_count"] = _envCount[this->_index];
+    json["sequence"] = sequence;
+    json["last_read"] = reading.lastRead;
+    json["last_epoch"] = reading.epoch;
+    this->statsToJson(json);
+}
+
+/**
+ * Get the last reading, this never waits for a read in progress on the other core
+ * 
+ * @param reading Where the reading is copied to
+ * @return The sequence number of the reading, 0 if the sensor has not been read
+ */
+uint32_t EnvSensorClass::getReading(EnvReading *reading)
+{
+    return this->_reading.read(reading);
 }
 
 /**
@@ -75,22 +155,45 @@ void EnvSensorClass::toJson(JsonObject ob)
  */
 bool EnvSensorClass::taskToRun()
 {
+    if (this->_reconfigure)
+    {
+        this->_reconfigure = false;
+        DhtError err = this->_sensor.begin(this->_dataPin);
+        if (err != DHT_OK)
+        {
+            LogInfo.log(LM_ENV, LOG_ERROR, "Could not set up %s sensor on pin %i - %s", this->getName(),
+                        this->_dataPin, DhtRmt::errorToString(err));
+        }
+    }
     if (this->getIsEnabled())
     {
-        int err = this->_sensor.read2(&this->_temperature, &this->_humidity, NULL);
+        EnvReading reading;
+        // A failed read is not tried again here, the DHT-22 needs 2 seconds between reads and the sample rate is
+        // never less than that, so the next scheduled read is the retry
+        DhtError err = this->_sensor.read(&reading.temperature, &reading.humidity);
         this->_last_read = millis();
-        if (err != SimpleDHTErrSuccess)
+        if (err != DHT_OK)
+        {
+            LogInfo.log(LM_ENV, LOG_WARNING, "Problem reading %s sensor - %s", this->getName(), DhtRmt::errorToString(err));
+            return false;
+        }
+        float values[] = {reading.temperature, reading.humidity};
+        if (!this->filterValues(this->_sampleNames, values, SENSOR_SAMPLES, this->_last_read))
         {
-            // Run it again, maybe just a timing issue.
-            if (this->taskToRun() == false)
-            {
-                LogInfo.log(LOG_WARNING, "Problem reading %s sensor - 0x%x", this->getName(), err);
-                return false;
-            }
+            LogInfo.log(LM_ENV, LOG_WARNING, "Rejected %s read of %0.2f (%0.2f%%) as an outlier", this->getName(),
+                        reading.temperature, reading.humidity);
+            return false;
         }
-        LogInfo.log(LOG_VERBOSE, "Temp = %s @ %s", this->toString(), NTPInfo.getISO8601Formatted().c_str());
-        _envCount++;
+        _envCount[this->_index]++;
         this->setEpoch();
+        reading.temperature = values[0];
+        reading.humidity = values[1];
+        reading.lastRead = this->_last_read;
+        reading.epoch = this->_epoch_time;
+        this->_reading.write(reading);
+        this->addSamples(values, reading.lastRead);
+        LogInfo.log(LM_ENV, LOG_VERBOSE, "Temp = %0.2f (%0.2f%%) @ %s", reading.temperature, reading.humidity,
+                    NTPInfo.getISO8601Formatted().c_str());
         return true;
     }
     return false;
@@ -105,23 +208,10 @@ const bool EnvSensorClass::connect()
 {
     if (this->taskToRun())
     {
-        if (this->getSingleThreadFlag() == false)
-        {
-            LogInfo.log(LOG_VERBOSE, "Creating %s Task on Core 0", this->getName());
-            xTaskCreatePinnedToCore(EnvSensorClass::task, "ReadEnvTask",
-                                    10000,
-                                    (void *)&this->_instance,
-                                    1,
-                                    &this->_taskHandle,
-                                    0);
-        }
-        else
-        {
-            LogInfo.log(LOG_VERBOSE, "%s Task will run in single thread mode on Core 1", this->getName());
-        }
         this->_connected = true;
+        SensorScheduler.add(this);
     }
-    LogInfo.log(LOG_VERBOSE, "Env is connected : %s", this->getIsConnected() ? "Yes" : "No");
+    LogInfo.log(LM_ENV, LOG_VERBOSE, "Env is connected : %s", this->getIsConnected() ? "Yes" : "No");
     return this->_connected;
 }
 
@@ -151,10 +241,12 @@ const char *EnvSensorClass::getSymbol()
  */
 const char *EnvSensorClass::toString()
 {
+    EnvReading reading;
+    this->getReading(&reading);
     snprintf(this->_toString, sizeof(this->_toString), "%0.2f%s (%0.2f%%)",
-             this->_temperature,
+             reading.temperature,
              this->getSymbol(),
-             this->_humidity);
+             reading.humidity);
     return this->_toString;
 }
 
@@ -172,4 +264,17 @@ void EnvSensorClass::changeEnabled(bool flag)
     }
 }
 
-EnvSensorClass EnvSensor;
\ No newline at end of file
+/**
+ * Factory for the "dht22" sensor type, each DHT-22 in the sensors array is a new instance with its own section,
+ * data pin and RMT channel
+ * 
+ * @param sectionName The section the sensor's settings are in
+ * @param index The number of DHT-22s created before this one
+ * @return The sensor, NULL if all the RMT channels are taken
+ */
+BaseSensorClass *EnvSensorClass::create(const char *sectionName, uint8_t index)
+{
+    return index < ENV_MAX_SENSORS ? new EnvSensorClass(sectionName, index) : NULL;
+}
+
+SensorType EnvSensorType("dht22", "envSensor", EnvSensorClass::create, &BusLock);
@@ -1,13 +1,17 @@
 #ifndef ENVSENSORS_H
 #define ENVSENSORS_H
 
-#include <SimpleDHT.h>
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 
 #include "BaseSensor.h"
+#include "SeqLock.h"
+#include "DhtRmt.h"
+
 #include "Config.h"
 
+#define ENV_MAX_SENSORS 4    // One for each RMT channel from DHT_RMT_CHANNEL
+
 typedef enum
 {
     ENV_CELSIUS = 1,
@@ -15,29 +19,41 @@ typedef enum
     ENV_FAHRENHEIT = 3
 } ScaleType;
 
+typedef struct envReadingStruct
+{
+    float temperature;
+    float humidity;
+    uint64_t lastRead;    // The millis() of the read
+    long epoch;           // The epoch time of the read
+} EnvReading;
+
 class EnvSensorClass : public BaseConfigInfoClass, public BaseSensorClass
 {
 public:
-    EnvSensorClass() : BaseConfigInfoClass("envSensor"), BaseSensorClass("env", true) {}
+    EnvSensorClass(const char *sectionName, uint8_t index);
 
-    void begin(SemaphoreHandle_t flag) override;
+    void begin(ResourceLock *lock) override;
     void toJson(JsonObject ob) override;
     void load(JsonObjectConst obj) override;
     void save(JsonObject ob) override;
+    uint8_t apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size) override;
+    static void configChanged(const ConfigChange *changes, uint8_t count);
     const bool connect() override;
     bool taskToRun() override;   
     const char* toString() override;
     void changeEnabled(bool flag) override;
+    BaseConfigInfoClass *getConfig() override { return this; }
+    static BaseSensorClass *create(const char *sectionName, uint8_t index);
     const char* getSymbol();
+    uint32_t getReading(EnvReading *reading);
 
 private:
+    static const ConfigField _fields[];
+    uint8_t _index;       // The DHT-22s of the sensors array are numbered from 0, each has its own RMT channel
     ScaleType _scale;
-    float _humidity;
-    float _temperature;
+    SeqLock<EnvReading> _reading;
     uint8_t _dataPin;
-    SimpleDHT22 _sensor;
+    DhtRmt _sensor;
 };
 
-extern EnvSensorClass EnvSensor;
-
 #endif
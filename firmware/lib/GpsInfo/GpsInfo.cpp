@@ -2,21 +2,63 @@
 #include "LogInfo.h"
 #include "NTPInfo.h"
 #include "WakeUpInfo.h"
+#include "SensorScheduler.h"
+#include "SensorRegistry.h"
+#include "Hal.h"
 
-RTC_DATA_ATTR int _gpsCount;
+HAL_RTC_DATA int _gpsCount[GPS_MAX_SENSORS];
+
+const char *const GpsInfoClass::_filterNames[] = {"latitude", "longitude", "altitude", "speed"};
+
+const ConfigField GpsInfoClass::_fields[] = {
+    CONFIG_BOOL("enabled", GpsInfoClass, _enabled, true),
+    CONFIG_UINT("baud", GpsInfoClass, _baud, 9600, 1200, 921600),
+    CONFIG_UINT("rx", GpsInfoClass, _rxPin, 22, 0, 39),
+    CONFIG_UINT("tx", GpsInfoClass, _txPin, 23, 0, 33),
+    CONFIG_UINT("sampleRate", GpsInfoClass, _sampleRate, 1000, 100, 60000),
+    CONFIG_UINT("protocol", GpsInfoClass, _protocol, GPS_NMEA, GPS_NMEA, GPS_UBX),
+    CONFIG_UINT("ubxBaud", GpsInfoClass, _ubxBaud, 38400, 9600, 921600),
+    CONFIG_UINT("navRate", GpsInfoClass, _navRate, 1000, 100, 10000),
+    CONFIG_BOOL("adaptive", GpsInfoClass, _adaptive, false),
+    CONFIG_UINT("moveSpeed", GpsInfoClass, _moveSpeed, 5, 1, 500),
+    CONFIG_UINT("radius", GpsInfoClass, _radius, 25, 5, 10000),
+    CONFIG_UINT("maxInterval", GpsInfoClass, _maxInterval, 300000, 1000, 3600000),
+    CONFIG_UINT("powerSave", GpsInfoClass, _powerSaveInterval, 30000, 0, 3600000),
+};
+
+/**
+ * Class Constructor, the first GPS is "gps" on GPS_UART and the second "gps2" on GPS_SECOND_UART
+ * 
+ * @param sectionName The section the sensor's settings are in
+ * @param index The number of GPS modules created before this one
+ */
+GpsInfoClass::GpsInfoClass(const char *sectionName, uint8_t index)
+    : BaseConfigInfoClass(sectionName), BaseSensorClass("gps", false, "altitude", "speed"), _index(index),
+      _uart(index == 0 ? GPS_UART : GPS_SECOND_UART), _ubxConfigured(false), _frameDone(true),
+      _readerStarted(false), _sentences(0), _epochSeen(0), _epochFix(0), _epochTime(0)
+{
+    memset(&this->_epoch, 0, sizeof(this->_epoch));
+    if (index > 0)
+    {
+        snprintf(this->_name, sizeof(this->_name), "gps%u", index + 1);
+    }
+}
 
 /**
- * overridden begin method to initialise the gp sensor and assign the semaphore flag
+ * overridden begin method to initialise the gp sensor and assign the resource lock
  * 
- * @param flag The semaphore flag to use
+ * @param lock The lock for the hardware the sensor is on
  */
-void GpsInfoClass::begin(SemaphoreHandle_t flag)
+void GpsInfoClass::begin(ResourceLock *lock)
 {
-    this->_semaphoreFlag = flag;
+    this->_lock = lock;
+    this->_reconfigure = false;
+    memset(&this->_adapt, 0, sizeof(this->_adapt));
+    Configuration.subscribe(this->_sectionName, NULL, GpsInfoClass::configChanged);
     // Check if we are waking up or we have started because of manual reset or power on
     if (WakeUp.isPoweredOn())
     {
-        _gpsCount = 0;
+        _gpsCount[this->_index] = 0;
     }
 }
 
@@ -27,18 +69,11 @@ void GpsInfoClass::begin(SemaphoreHandle_t flag)
  */
 void GpsInfoClass::load(JsonObjectConst obj)
 {
-    this->_enabled = obj.containsKey("enabled") ? obj["enabled"].as<bool>() : true;
-    this->_baud = obj.containsKey("baud") ? obj["baud"].as<uint32_t>() : 9600;
-    this->_rxPin = obj.containsKey("rx") ? obj["rx"].as<uint16_t>() : 22;
-    this->_txPin = obj.containsKey("tx") ? obj["tx"].as<uint16_t>() : 23;
-    this->_sampleRate = obj.containsKey("sampleRate") ? obj["sampleRate"].as<int>() : 1000;
-    LogInfo.log(LOG_VERBOSE, "GPS RX: %i TX: %i Baud: %i Enabled: %s",
+    this->loadFields(obj, GpsInfoClass::_fields, CONFIG_FIELD_COUNT(GpsInfoClass::_fields));
+    this->_filters.load(obj["filters"]);
+    LogInfo.log(LM_GPS, LOG_VERBOSE, "GPS RX: %i TX: %i Baud: %i Enabled: %s",
                 this->_rxPin, this->_txPin,
                 this->_baud, this->getIsEnabled() ? "Yes" : "No");
-    this->_gpsSerial.begin(this->_baud,
-                           SERIAL_8N1,
-                           this->_rxPin,
-                           this->_txPin);
 }
 
 /**
@@ -49,10 +84,50 @@ void GpsInfoClass::load(JsonObjectConst obj)
 void GpsInfoClass::save(JsonObject obj)
 {
     auto json = obj.createNestedObject(this->_sectionName);
-    json["enabled"] = this->getIsEnabled();
-    json["baud"] = this->_baud;
-    json["rx"] = this->_rxPin;
-    json["tx"] = this->_txPin;
+    this->saveFields(json, GpsInfoClass::_fields, CONFIG_FIELD_COUNT(GpsInfoClass::_fields));
+    this->_filters.save(json);
+}
+
+/**
+ * overridden apply changed values at runtime
+ * 
+ * @param obj The ArduinoJson object with the new values
+ * @param reported The values that changed are added to this
+ * @param changes Filled with the fields that changed
+ * @param size The most changes that can be added
+ * @return The number of fields that changed
+ */
+uint8_t GpsInfoClass::apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size)
+{
+    return this->applyFields(obj, reported, GpsInfoClass::_fields, CONFIG_FIELD_COUNT(GpsInfoClass::_fields), changes, size);
+}
+
+/**
+ * The GPS settings have changed, a new baud rate or pins make the reader task re-open the UART and a new
+ * sample rate or adaptive setting re-arms the schedule.  The enabled flag is read each time, so it needs nothing.
+ * 
+ * @param changes The changes to the section
+ * @param count The number of changes
+ */
+void GpsInfoClass::configChanged(const ConfigChange *changes, uint8_t count)
+{
+    GpsInfoClass *sensor = static_cast<GpsInfoClass *>(changes[0].config);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const char *key = changes[i].field->key;
+        if (strcmp(key, "baud") == 0 || strcmp(key, "rx") == 0 || strcmp(key, "tx") == 0 ||
+            strcmp(key, "protocol") == 0 || strcmp(key, "ubxBaud") == 0 || strcmp(key, "navRate") == 0)
+        {
+            LogInfo.log(LM_GPS, LOG_INFO, "GPS UART will be re-opened for the new %s", key);
+            sensor->reconfigure();
+        }
+        else if (strcmp(key, "sampleRate") == 0 || strcmp(key, "adaptive") == 0 || strcmp(key, "maxInterval") == 0)
+        {
+            // Start again from the sample rate
+            sensor->_adapt.interval = 0;
+            SensorScheduler.reschedule(sensor);
+        }
+    }
 }
 
 /**
@@ -62,16 +137,41 @@ void GpsInfoClass::save(JsonObject obj)
  */
 void GpsInfoClass::toJson(JsonObject ob)
 {
-    auto json = ob.createNestedObject("GPSSensor");
+    GpsReading reading;
+    uint32_t sequence = this->getReading(&reading);
+    char name[16] = "GPSSensor";
+    if (this->_index > 0)
+    {
+        snprintf(name, sizeof(name), "GPSSensor%u", this->_index + 1);
+    }
+    auto json = ob.createNestedObject(name);
     auto loc = json.createNestedObject("location");
-    loc["longitude"] = this->_long;
-    loc["latitude"] = this->_lat;
-    loc["satellites"] = this->_satelites;
-    loc["course"] = this->_course;
-    loc["speed"] = this->_speed;
-    loc["altitude"] = this->_altitude;
-    loc["last_read"] = this->_last_read;    
-    loc["last_epoch"] = this->_epoch_time;    
+    loc["longitude"] = reading.longitude;
+    loc["latitude"] = reading.latitude;
+    loc["satellites"] = reading.satellites;
+    loc["course"] = reading.course;
+    loc["speed"] = reading.speed;
+    loc["altitude"] = reading.altitude;
+    loc["sequence"] = sequence;
+    loc["last_read"] = reading.lastRead;    
+    loc["last_epoch"] = reading.epoch;    
+    auto reader = json.createNestedObject("reader");
+    reader["cpuUs"] = this->_stats.cpuUs;
+    reader["latencyUs"] = this->_stats.latencyUs;
+    reader["maxLatencyUs"] = this->_stats.maxLatencyUs;
+    reader["fixes"] = this->_stats.fixes;
+    reader["passed"] = this->passedFrames();
+    reader["failed"] = this->_protocol == GPS_UBX ? this->_ubx.failedChecksum() : this->_gps.failedChecksum();
+    reader["overflows"] = this->_stats.overflows;
+    reader["bytes"] = this->_stats.bytes;
+    if (this->_adaptive)
+    {
+        auto adaptive = json.createNestedObject("adaptive");
+        adaptive["interval"] = this->getInterval();
+        adaptive["moving"] = this->_adapt.moving;
+        adaptive["sleeps"] = this->_adapt.sleeps;
+    }
+    this->statsToJson(json);
 }
 
 /**
@@ -81,7 +181,14 @@ void GpsInfoClass::toJson(JsonObject ob)
  */
 void GpsInfoClass::toGeoJson(JsonObject ob)
 {
-    auto json = ob.createNestedObject("GPS");
+    GpsReading reading;
+    this->getReading(&reading);
+    char name[8] = "GPS";
+    if (this->_index > 0)
+    {
+        snprintf(name, sizeof(name), "GPS%u", this->_index + 1);
+    }
+    auto json = ob.createNestedObject(name);
     json["type"] = "FeatureCollection";
     auto fc = json.createNestedArray("features");
 
@@ -90,97 +197,528 @@ void GpsInfoClass::toGeoJson(JsonObject ob)
     auto loc = feature.createNestedObject("geometry");
     loc["type"] = "Point";
     auto coords = loc.createNestedArray("coordinates");
-    coords.add(this->_long);
-    coords.add(this->_lat);
-    coords.add(this->_altitude);
+    coords.add(reading.longitude);
+    coords.add(reading.latitude);
+    coords.add(reading.altitude);
     auto props = feature.createNestedObject("properties");
-    props["last_read"] = this->_last_read;    
-    props["last_epoch"] = this->_epoch_time;    
+    props["last_read"] = reading.lastRead;    
+    props["last_epoch"] = reading.epoch;    
+}
+
+/**
+ * Get the last fix, this never waits for a read in progress on the other core.  The latitude, longitude and
+ * altitude are always from the same fix.
+ * 
+ * @param reading Where the fix is copied to
+ * @return The sequence number of the fix, 0 if there has not been one
+ */
+uint32_t GpsInfoClass::getReading(GpsReading *reading)
+{
+    return this->_reading.read(reading);
 }
 
 /**
- * overridden task that will be ran every n sample rate
+ * overridden task that will be ran every n sample rate.  The reader task keeps the fix up to date, so this only
+ * checks there is a recent one and never waits on the UART.
  * 
- * @return True if successfully read the GPS sensor
+ * @return True if there is a GPS fix less than GPS_FIX_TIMEOUT_MS old
  */
 bool GpsInfoClass::taskToRun()
 {
-    if (this->getIsEnabled())
+    if (!this->getIsEnabled())
     {
-        int count = 0;
-        int retries = 0;
-        uint64_t now = millis();
-        this->_isValid = false;
-        TinyGPSPlus gps = TinyGPSPlus();
-        while (true)
+        return false;
+    }
+    GpsReading reading;
+    this->_reading.read(&reading);
+    this->_last_read = millis();
+    if (!this->isFresh(&reading))
+    {
+        if (this->_adapt.sleepUntil != 0)
         {
-            while (this->_gpsSerial.available() > 0)
+            if ((int32_t)(this->_last_read - this->_adapt.sleepUntil) < 0)
             {
-                count = gps.encode(this->_gpsSerial.read());
+                // Read early (e.g. after a settings change) while the receiver is still in power save
+                return false;
             }
-            vTaskDelay(30);
-            if ((millis() - now) > 5000)
+            // No fix since the receiver woke, read at the sample rate until there is one.  A receiver without a
+            // backup supply forgets its settings, so the UBX mode is set again.
+            LogInfo.log(LM_GPS, LOG_WARNING, F("No GPS fix since the receiver woke from power save"));
+            this->_adapt.sleepUntil = 0;
+            this->_adapt.interval = this->_sampleRate;
+            SensorScheduler.reschedule(this);
+            if (this->_protocol == GPS_UBX)
             {
-                LogInfo.log(LOG_WARNING, F("Have not received valid GPS data in the last 5 seconds"));
-                LogInfo.log(LOG_VERBOSE, "Count read is %i", count);
-                retries++;
-                now = millis();
-                vTaskDelay(100);
-                if (retries > 10)
-                {
-                    LogInfo.log(LOG_WARNING, "Tried at least 10 times to get GPS and Failed");
-                    break;
-                }
+                this->reconfigure();
+            }
+            return false;
+        }
+        LogInfo.log(LM_GPS, LOG_WARNING, "Have not received valid GPS data in the last %u seconds", GPS_FIX_TIMEOUT_MS / 1000);
+        return false;
+    }
+    this->_adapt.sleepUntil = 0;
+    _gpsCount[this->_index]++;
+    // The fix is sampled at the sample rate, not every fix the receiver sends
+    float values[] = {reading.altitude, (float)reading.speed};
+    this->addSamples(values, this->_last_read);
+    // The position has no rolling statistics, it is kept in the history so the track can be read back
+    this->addHistory("latitude", reading.latitude);
+    this->addHistory("longitude", reading.longitude);
+    if (this->_adaptive)
+    {
+        this->adapt(&reading);
+    }
+    return true;
+}
+
+/**
+ * Choose the interval to the next read from the fix.  While the receiver is moving faster than moveSpeed, or
+ * has moved out of radius metres of where it stopped, it is read at the sample rate.  While it is still the
+ * interval doubles up to maxInterval, and once the interval is at least powerSave the receiver is put in
+ * power save until GPS_WAKE_LEAD_MS before the next read.
+ * 
+ * @param reading The fix just read
+ */
+void GpsInfoClass::adapt(const GpsReading *reading)
+{
+    float speed = reading->speed * GPS_KNOTS_TO_KMH / 100.0f;
+    bool moving = !this->_adapt.anchored || speed >= this->_moveSpeed ||
+                  GpsInfoClass::distance(this->_adapt.anchorLatitude, this->_adapt.anchorLongitude,
+                                         reading->latitude, reading->longitude) > this->_radius;
+    uint32_t interval = this->getInterval();
+    if (moving)
+    {
+        // The last position while moving is where it stopped
+        this->_adapt.anchorLatitude = reading->latitude;
+        this->_adapt.anchorLongitude = reading->longitude;
+        this->_adapt.anchored = true;
+        interval = this->_sampleRate;
+    }
+    else
+    {
+        interval = min(interval * 2, max(this->_maxInterval, (uint32_t)this->_sampleRate));
+    }
+    this->_adapt.moving = moving;
+    if (interval != this->getInterval())
+    {
+        this->_adapt.interval = interval;
+        SensorScheduler.reschedule(this);
+        LogInfo.log(LM_GPS, LOG_VERBOSE, "GPS is %s, next read in %u ms", moving ? "moving" : "still", interval);
+    }
+    if (this->_powerSaveInterval > 0 && interval >= this->_powerSaveInterval && interval > GPS_WAKE_LEAD_MS)
+    {
+        this->powerSave(interval - GPS_WAKE_LEAD_MS);
+    }
+}
+
+/**
+ * Put the receiver in backup mode (UBX-RXM-PMREQ), it stops tracking and sending and wakes itself after the
+ * duration.  The ephemeris is kept, so it has a fix again within a few seconds of waking.
+ * 
+ * @param duration The milliseconds to stay in backup mode
+ */
+void GpsInfoClass::powerSave(uint32_t duration)
+{
+    uint8_t request[] = {(uint8_t)(duration & 0xFF), (uint8_t)((duration >> 8) & 0xFF), (uint8_t)((duration >> 16) & 0xFF),
+                         (uint8_t)(duration >> 24), 0x02, 0, 0, 0};
+    this->sendUbx(UBX_CLASS_RXM, UBX_RXM_PMREQ, request, sizeof(request));
+    uint32_t wake = millis() + duration;
+    this->_adapt.sleepUntil = wake == 0 ? 1 : wake;
+    this->_adapt.sleeps++;
+}
+
+/**
+ * Get the distance between two positions, an equirectangular approximation that is good for the few hundred
+ * metres the radius is compared with
+ * 
+ * @param latitude1 The first position
+ * @param longitude1 The first position
+ * @param latitude2 The second position
+ * @param longitude2 The second position
+ * @return The distance in metres
+ */
+float GpsInfoClass::distance(float latitude1, float longitude1, float latitude2, float longitude2)
+{
+    float x = radians(longitude2 - longitude1) * cosf(radians((latitude1 + latitude2) / 2));
+    float y = radians(latitude2 - latitude1);
+    return sqrtf(x * x + y * y) * GPS_EARTH_RADIUS_M;
+}
+
+/**
+ * Static reader task, it waits on the UART event queue and feeds every byte received to the one parser, so the
+ * fix is published as soon as the sentence carrying it is complete.
+ * 
+ * @param parameters The GpsInfoClass instance
+ */
+void GpsInfoClass::readerTask(void *parameters)
+{
+    auto gps = (GpsInfoClass *)parameters;
+    size_t size;
+    int64_t windowStart = Hal::micros();
+    uint32_t busyUs = 0;
+    for (;;)
+    {
+        if ((gps->_reconfigure || !gps->_uart.isOpen()) && gps->_lock->take(LOCK_WAIT_FOREVER))
+        {
+            gps->openUart();
+            gps->_lock->give();
+        }
+        if (!gps->_uart.isOpen())
+        {
+            // The UART could not be opened, there is no queue to wait on, so try again later
+            Hal::delay(GPS_REOPEN_WAIT_MS);
+            continue;
+        }
+        HalUartEvent event = gps->_uart.wait(&size, GPS_READER_WAIT_MS);
+        if (event != HAL_UART_TIMEOUT)
+        {
+            int64_t received = Hal::micros();
+            switch (event)
+            {
+            case HAL_UART_DATA:
+                gps->ingest(size, received);
+                break;
+            case HAL_UART_OVERFLOW:
+                // The sentence in progress is lost either way, start again from the next one
+                gps->_stats.overflows++;
+                gps->_uart.flushInput();
+                break;
+            case HAL_UART_END:
+                // A replayed capture on the host has ended, nothing more will arrive
+                Hal::delay(GPS_READER_WAIT_MS);
+                break;
+            default:
+                break;
             }
-            if (gps.location.isValid())
+            busyUs += Hal::micros() - received;
+        }
+        int64_t now = Hal::micros();
+        if (now - windowStart >= 1000000)
+        {
+            gps->_stats.cpuUs = (uint64_t)busyUs * 1000000 / (now - windowStart);
+            busyUs = 0;
+            windowStart = now;
+        }
+    }
+}
+
+/**
+ * Open the UART with the configured baud rate and pins, the driver queues an event for each block received
+ * 
+ * @return True if the driver was installed
+ */
+bool GpsInfoClass::openUart()
+{
+    this->_reconfigure = false;
+    this->_sentences = 0;
+    this->_epochSeen = 0;
+    this->_epochFix = 0;
+    if (!this->_uart.open(this->_baud, this->_txPin, this->_rxPin, GPS_RX_BUFFER, GPS_EVENT_QUEUE,
+                          GPS_EVENT_SIZE))
+    {
+        LogInfo.log(LM_GPS, LOG_ERROR, "Could not open the GPS UART %u", this->_index == 0 ? GPS_UART : GPS_SECOND_UART);
+        return false;
+    }
+    LogInfo.log(LM_GPS, LOG_VERBOSE, "GPS UART open at %u baud", this->_baud);
+    if (this->_protocol == GPS_UBX)
+    {
+        // Both tell the receiver to change to ubxBaud.  The first is sent at the configured rate, which a
+        // receiver is at after power on, the second at ubxBaud for a receiver that kept its settings on its
+        // backup supply.
+        this->configureUbx(this->_ubxBaud, true);
+        this->_uart.setBaud(this->_ubxBaud);
+        this->configureUbx(this->_ubxBaud, true);
+        this->_ubxConfigured = true;
+        LogInfo.log(LM_GPS, LOG_VERBOSE, "GPS set to UBX NAV-PVT every %u ms at %u baud", this->_navRate, this->_ubxBaud);
+    }
+    else if (this->_ubxConfigured)
+    {
+        // Put the receiver back to NMEA at the configured baud rate
+        this->_uart.setBaud(this->_ubxBaud);
+        this->configureUbx(this->_baud, false);
+        this->_uart.setBaud(this->_baud);
+        this->_ubxConfigured = false;
+    }
+    this->_uart.flushInput();
+    return true;
+}
+
+/**
+ * Configure the receiver's UART, the new baud rate is used once the last command has been sent
+ * 
+ * @param baud The baud rate the receiver should change to
+ * @param ubx True to send only NAV-PVT at navRate, false to send the default NMEA sentences
+ */
+void GpsInfoClass::configureUbx(uint32_t baud, bool ubx)
+{
+    if (ubx)
+    {
+        uint8_t msg[] = {UBX_CLASS_NAV, UBX_NAV_PVT, 1};
+        this->sendUbx(UBX_CLASS_CFG, UBX_CFG_MSG, msg, sizeof(msg));
+        // Measurement rate, one navigation solution per measurement, aligned to GPS time
+        uint8_t rate[] = {(uint8_t)(this->_navRate & 0xFF), (uint8_t)(this->_navRate >> 8), 1, 0, 1, 0};
+        this->sendUbx(UBX_CLASS_CFG, UBX_CFG_RATE, rate, sizeof(rate));
+    }
+    // UART1, 8N1, UBX and NMEA in, only UBX or only NMEA out
+    uint8_t port[20] = {1, 0, 0, 0, 0xC0, 0x08, 0, 0,
+                        (uint8_t)(baud & 0xFF), (uint8_t)((baud >> 8) & 0xFF), (uint8_t)((baud >> 16) & 0xFF), 0,
+                        0x03, 0, (uint8_t)(ubx ? 0x01 : 0x02), 0, 0, 0, 0, 0};
+    this->sendUbx(UBX_CLASS_CFG, UBX_CFG_PRT, port, sizeof(port));
+    this->_uart.waitSent(GPS_BAUD_SWITCH_MS);
+    Hal::delay(GPS_BAUD_SWITCH_MS);
+}
+
+/**
+ * Send a UBX frame to the receiver
+ * 
+ * @param msgClass The message class
+ * @param id The message id
+ * @param payload The payload
+ * @param length The payload length
+ */
+void GpsInfoClass::sendUbx(uint8_t msgClass, uint8_t id, const uint8_t *payload, uint16_t length)
+{
+    uint8_t frame[UBX_MAX_PAYLOAD + UBX_OVERHEAD];
+    size_t size = UbxParser::build(msgClass, id, payload, length, frame);
+    this->_uart.write(frame, size);
+}
+
+/**
+ * Copy the bytes received out of the driver buffer and feed them to the parser
+ * 
+ * @param size The bytes the event says are waiting
+ * @param received The Hal::micros() time the event was taken off the queue
+ */
+void GpsInfoClass::ingest(size_t size, int64_t received)
+{
+    uint8_t data[GPS_READ_CHUNK];
+    while (size > 0)
+    {
+        int length = this->_uart.read(data, min(size, sizeof(data)), 0);
+        if (length <= 0)
+        {
+            break;
+        }
+        size -= length;
+        this->_stats.bytes += length;
+        for (int i = 0; i < length; i++)
+        {
+            if (this->_protocol == GPS_UBX)
             {
-                this->_long = gps.location.lng();
-                this->_lat = gps.location.lat();
-                this->_course = gps.course.value();
-                this->_speed = gps.speed.value();
-                if (gps.altitude.isUpdated())
+                // Bytes between frames are not the start of the next one, it starts at its sync
+                if (this->_frameDone && data[i] == UBX_SYNC_1)
                 {
-                    this->_altitude = gps.altitude.meters();
+                    this->_sentenceStart = received;
+                    this->_frameDone = false;
                 }
-                if (gps.satellites.isUpdated())
+                if (this->_ubx.encode(data[i]))
                 {
-                    this->_satelites = gps.satellites.value();
+                    this->_frameDone = true;
+                    this->publishPvt(Hal::micros());
                 }
-                this->_isValid = true;
-                this->_connected = true;
-                LogInfo.log(LOG_VERBOSE, "GPS = %s @ %s", this->toString(), NTPInfo.getISO8601Formatted().c_str());
-                _gpsCount++;
-                vTaskDelay(100);
-                break;
+                continue;
+            }
+            if (data[i] == '$')
+            {
+                this->_sentenceStart = received;
             }
+            // encode is true at the end of each sentence with a good checksum
+            if (this->_gps.encode(data[i]))
+            {
+                this->collect(Hal::micros());
+            }
+        }
+    }
+}
+
+/**
+ * Add the GGA or RMC sentence the parser has just read to the fix of its epoch.  Both carry the position and
+ * the UTC time, GGA has the altitude and satellites and RMC the speed and course.  The fix is published once,
+ * when every sentence the receiver sends has arrived with a fix for the same UTC time, so the altitude and the
+ * position are always from the same epoch.  The sentences the receiver sends are only known once an epoch has
+ * ended, so nothing is published in the first.
+ * 
+ * @param now The Hal::micros() time, for the latency
+ */
+void GpsInfoClass::collect(int64_t now)
+{
+    // The satellites are only in GGA and the date only in RMC, and both are there with or without a fix.  Each
+    // value is read, which clears its updated flag for the next sentence.
+    uint8_t sentence = (this->_gps.satellites.isUpdated() ? GPS_SENTENCE_GGA : 0) |
+                       (this->_gps.date.isUpdated() ? GPS_SENTENCE_RMC : 0);
+    if (sentence == 0)
+    {
+        return;
+    }
+    uint32_t time = this->_gps.time.value();
+    if (time != this->_epochTime)
+    {
+        this->_sentences |= this->_epochSeen;
+        this->_epochSeen = 0;
+        this->_epochFix = 0;
+        this->_epochTime = time;
+    }
+    this->_epochSeen |= sentence;
+    this->_gps.date.value();
+    if (this->_gps.satellites.isUpdated())
+    {
+        this->_epoch.satellites = this->_gps.satellites.value();
+    }
+    if (this->_gps.altitude.isUpdated())
+    {
+        this->_epoch.altitude = this->_gps.altitude.meters();
+        this->_epochFix |= GPS_SENTENCE_GGA;
+    }
+    if (this->_gps.speed.isUpdated())
+    {
+        this->_epoch.speed = this->_gps.speed.value();
+        this->_epoch.course = this->_gps.course.value();
+        this->_epochFix |= GPS_SENTENCE_RMC;
+    }
+    if (this->_gps.location.isUpdated())
+    {
+        this->_epoch.longitude = this->_gps.location.lng();
+        this->_epoch.latitude = this->_gps.location.lat();
+    }
+    if (this->_sentences != 0 && (this->_epochFix & (this->_sentences | GPS_SENTENCE_PUBLISHED)) == this->_sentences)
+    {
+        this->_epochFix |= GPS_SENTENCE_PUBLISHED;
+        this->publishFix(now);
+    }
+}
+
+/**
+ * Publish the fix of the current epoch as the current reading
+ * 
+ * @param now The Hal::micros() time, for the latency
+ */
+void GpsInfoClass::publishFix(int64_t now)
+{
+    GpsReading reading = this->_epoch;
+    reading.isValid = true;
+    this->publish(&reading, now);
+}
+
+/**
+ * Publish the NAV-PVT frame as the current reading.  The fields are scaled to the same units TinyGPSPlus
+ * gives, so the reading is the same whatever the protocol.
+ * 
+ * @param now The Hal::micros() time, for the latency
+ */
+void GpsInfoClass::publishPvt(int64_t now)
+{
+    if (this->_ubx.getClass() != UBX_CLASS_NAV || this->_ubx.getId() != UBX_NAV_PVT ||
+        this->_ubx.getLength() != UBX_NAV_PVT_LENGTH)
+    {
+        return;
+    }
+    uint8_t fixType = this->_ubx.getU1(20);
+    // gnssFixOK and a 2D, 3D or GNSS and dead reckoning fix
+    if ((this->_ubx.getU1(21) & 0x01) == 0 || fixType < 2 || fixType > 4)
+    {
+        return;
+    }
+    GpsReading reading;
+    this->_reading.read(&reading);
+    reading.longitude = this->_ubx.getI4(24) * 1e-7f;
+    reading.latitude = this->_ubx.getI4(28) * 1e-7f;
+    reading.altitude = this->_ubx.getI4(36) / 1000.0f;              // Height above mean sea level, mm
+    reading.satellites = this->_ubx.getU1(23);
+    reading.speed = (uint32_t)this->_ubx.getI4(60) * 100 / 514;     // Ground speed mm/s to 1/100 knot
+    reading.course = this->_ubx.getI4(64) / 1000;                   // Heading of motion 1e-5 to 1/100 degree
+    reading.isValid = true;
+    this->publish(&reading, now);
+}
+
+/**
+ * Publish the reading and update the reader statistics.  A fix is run through the filter pipelines first and
+ * is not published if it is rejected as an outlier.
+ * 
+ * @param reading The new fix
+ * @param now The Hal::micros() time, for the latency
+ */
+void GpsInfoClass::publish(GpsReading *reading, int64_t now)
+{
+    reading->lastRead = millis();
+    if (reading->isValid)
+    {
+        float values[] = {reading->latitude, reading->longitude, reading->altitude, (float)reading->speed};
+        if (!this->filterValues(GpsInfoClass::_filterNames, values, sizeof(values) / sizeof(values[0]), reading->lastRead))
+        {
+            return;
         }
-        this->_last_read = millis();
+        reading->latitude = values[0];
+        reading->longitude = values[1];
+        reading->altitude = values[2];
+        reading->speed = values[3];
     }
-    return this->_isValid;
+    reading->epoch = NTPInfo.getEpoch();
+    this->_reading.write(*reading);
+    this->_stats.latencyUs = now - this->_sentenceStart;
+    this->_stats.maxLatencyUs = max(this->_stats.maxLatencyUs, this->_stats.latencyUs);
+    this->_stats.fixes++;
 }
 
 /**
- * overridden connect to the sensor and see it is working or not
+ * Get the number of sentences or frames received with a good checksum
+ * 
+ * @return The count for the protocol in use
+ */
+uint32_t GpsInfoClass::passedFrames()
+{
+    return this->_protocol == GPS_UBX ? this->_ubx.passedChecksum() : this->_gps.passedChecksum();
+}
+
+/**
+ * Is the fix valid and recent
+ * 
+ * @param reading The fix
+ * @return True if the fix is less than GPS_FIX_TIMEOUT_MS old
+ */
+bool GpsInfoClass::isFresh(const GpsReading *reading)
+{
+    return reading->isValid && (millis() - reading->lastRead) < GPS_FIX_TIMEOUT_MS;
+}
+
+/**
+ * overridden connect to the sensor and see it is working or not.  The UART is opened and the reader started,
+ * the sensor is connected once the module has sent a good sentence, it does not have to have a fix.
  * 
  * @return True if successfully connect
  */
 const bool GpsInfoClass::connect()
 {
-    if (this->taskToRun())
+    // The UART is started here and not in load, so reloading the configuration does not restart it
+    // Once the reader is running it re-opens the UART itself
+    if (!this->_readerStarted && this->openUart())
+    {
+        memset(&this->_stats, 0, sizeof(this->_stats));
+        this->_readerStarted = Hal::startTask(GpsInfoClass::readerTask, "GpsReader", GPS_READER_STACK, (void *)this, 2, 0);
+    }
+    uint32_t start = millis();
+    while (this->_uart.isOpen() && this->passedFrames() == 0 && (millis() - start) < GPS_CONNECT_WAIT_MS)
+    {
+        Hal::delay(50);
+    }
+    if (this->passedFrames() > 0)
     {
-        LogInfo.log(LOG_VERBOSE, "Creating %s Task on Core 0", this->getName());
-        xTaskCreatePinnedToCore(GpsInfoClass::task, "ReadGpsTask",
-                                16352,
-                                (void *)&this->_instance,
-                                1,
-                                &this->_taskHandle,
-                                0);
         this->_connected = true;
+        SensorScheduler.add(this);
     }
-    LogInfo.log(LOG_VERBOSE, "GPS is connected : %s", this->getIsConnected() ? "Yes" : "No");
+    LogInfo.log(LM_GPS, LOG_VERBOSE, "GPS is connected : %s", this->getIsConnected() ? "Yes" : "No");
     return this->_connected;
 }
 
+/**
+ * overridden get the milliseconds until the next read, the adaptive interval if it is on
+ * 
+ * @return The interval
+ */
+uint32_t GpsInfoClass::getInterval()
+{
+    return this->_adaptive && this->_adapt.interval > 0 ? this->_adapt.interval : this->_sampleRate;
+}
+
 /**
  * get display friendly info
  * 
@@ -188,11 +726,13 @@ const bool GpsInfoClass::connect()
  */
 const char *GpsInfoClass::toString()
 {
-    if (this->getIsConnected() && this->_isValid)
+    GpsReading reading;
+    this->getReading(&reading);
+    if (this->getIsConnected() && this->isFresh(&reading))
     {
         snprintf(this->_location, 50, "%0.4f,%0.4f",
-                 this->_lat,
-                 this->_long);
+                 reading.latitude,
+                 reading.longitude);
     }
     else
     {
@@ -215,4 +755,17 @@ void GpsInfoClass::changeEnabled(bool flag)
     }
 }
 
-GpsInfoClass GpsSensor;
\ No newline at end of file
+/**
+ * Factory for the "gps" sensor type, each GPS in the sensors array is a new instance with its own section, pins
+ * and UART
+ * 
+ * @param sectionName The section the sensor's settings are in
+ * @param index The number of GPS modules created before this one
+ * @return The sensor, NULL if both UARTs are taken
+ */
+BaseSensorClass *GpsInfoClass::create(const char *sectionName, uint8_t index)
+{
+    return index < GPS_MAX_SENSORS ? new GpsInfoClass(sectionName, index) : NULL;
+}
+
+SensorType GpsSensorType("gps", "gpsSensor", GpsInfoClass::create, &UartLock);
@@ -4,43 +4,142 @@
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 #include <TinyGPS++.h>
-#include <HardwareSerial.h>
 #include "Config.h"
+#include "Hal.h"
 #include "BaseSensor.h"
+#include "SeqLock.h"
+#include "UbxParser.h"
 
+#define GPS_UART 2                   // The UART the first GPS module is on
+#define GPS_SECOND_UART 1            // The UART the second is on, UART 0 is the console
+#define GPS_MAX_SENSORS 2
+#define GPS_RX_BUFFER 1024           // Driver receive buffer, about a second of NMEA at 9600 baud
+#define GPS_EVENT_QUEUE 20           // UART events the driver can queue for the reader
+#define GPS_EVENT_SIZE 48            // Bytes in the FIFO that wake the reader before the line goes idle
+#define GPS_READ_CHUNK 128           // Bytes copied out of the driver buffer at a time
+#define GPS_READER_STACK 4096        // Stack of the reader task
+#define GPS_READER_WAIT_MS 200       // Longest the reader waits for an event before it checks for a reconfigure
+#define GPS_REOPEN_WAIT_MS 5000      // Time the reader waits before trying again to open a UART that failed to open
+#define GPS_CONNECT_WAIT_MS 3000     // Time connect waits for the first good sentence from the module
+#define GPS_FIX_TIMEOUT_MS 5000      // A fix older than this is treated as lost
+#define GPS_BAUD_SWITCH_MS 100       // Time the receiver takes to change baud rate
+#define UBX_NAV_PVT_LENGTH 92
+#define GPS_SENTENCE_GGA 0x01        // The NMEA sentences with a position the receiver has been seen to send
+#define GPS_SENTENCE_RMC 0x02
+#define GPS_SENTENCE_PUBLISHED 0x80  // The fix of the epoch has been published
+#define GPS_WAKE_LEAD_MS 10000       // The receiver is woken this long before the next read, time for a hot start
+#define GPS_EARTH_RADIUS_M 6371000.0f
+#define GPS_KNOTS_TO_KMH 1.852f
+
+typedef enum
+{
+    GPS_NMEA = 0,     // Parse the receiver's default NMEA sentences
+    GPS_UBX = 1       // Configure the receiver to send only UBX NAV-PVT, needs u-blox protocol 14+ (M8 and later)
+} GpsProtocol;
+
+typedef struct gpsReadingStruct
+{
+    float latitude;
+    float longitude;
+    float altitude;
+    uint16_t satellites;
+    uint16_t course;
+    uint16_t speed;
+    bool isValid;
+    uint64_t lastRead;    // The millis() of the fix
+    long epoch;           // The epoch time of the fix
+} GpsReading;
+
+typedef struct gpsAdaptiveStruct
+{
+    uint32_t interval;        // Milliseconds to the next read
+    float anchorLatitude;     // Where the receiver stopped, moving out of the radius counts as moving
+    float anchorLongitude;
+    bool anchored;
+    bool moving;
+    uint32_t sleepUntil;      // millis() the receiver wakes from its last power save, 0 if it is not asleep
+    uint32_t sleeps;
+} GpsAdaptive;
+
+typedef struct gpsReaderStatsStruct
+{
+    uint32_t cpuUs;           // Microseconds per second the reader spent handling UART events
+    uint32_t latencyUs;       // Time from the UART event with the start of the sentence to the fix being published
+    uint32_t maxLatencyUs;
+    uint32_t fixes;
+    uint32_t overflows;       // Times the UART FIFO or the driver buffer overflowed and the input was dropped
+    uint32_t bytes;           // Bytes fed to the parser
+} GpsReaderStats;
 
 class GpsInfoClass : public BaseConfigInfoClass, public BaseSensorClass
 {
 public:
-    GpsInfoClass() : BaseConfigInfoClass("gpsSensor"), BaseSensorClass("gps"), _gpsSerial(2) {}  
+    GpsInfoClass(const char *sectionName, uint8_t index);
+    static void readerTask(void *parameters);
 
-    void begin(SemaphoreHandle_t flag) override;
+    void begin(ResourceLock *lock) override;
     void toJson(JsonObject ob) override;
     void load(JsonObjectConst obj) override;
     void save(JsonObject ob) override;
+    uint8_t apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size) override;
+    static void configChanged(const ConfigChange *changes, uint8_t count);
     const bool connect() override;
     bool taskToRun() override;   
     const char* toString() override;
 
+    void toTelemetry(JsonObject ob) override { this->toGeoJson(ob); }
+    BaseConfigInfoClass *getConfig() override { return this; }
+    static BaseSensorClass *create(const char *sectionName, uint8_t index);
     void toGeoJson(JsonObject ob);
+    uint32_t getReading(GpsReading *reading);
     void changeEnabled(bool flag) override;
+    uint32_t getInterval() override;
 
 private:
+    bool openUart();
+    void ingest(size_t size, int64_t received);
+    void configureUbx(uint32_t baud, bool ubx);
+    void sendUbx(uint8_t msgClass, uint8_t id, const uint8_t *payload, uint16_t length);
+    void collect(int64_t now);
+    void publishFix(int64_t now);
+    void publishPvt(int64_t now);
+    void publish(GpsReading *reading, int64_t now);
+    uint32_t passedFrames();
+    bool isFresh(const GpsReading *reading);
+    void adapt(const GpsReading *reading);
+    void powerSave(uint32_t duration);
+    static float distance(float latitude1, float longitude1, float latitude2, float longitude2);
+    static const ConfigField _fields[];
+    static const char *const _filterNames[];    // The fix values that can be filtered
+    uint8_t _index;       // The GPS modules of the sensors array are numbered from 0, each has its own UART
+    Hal::Uart _uart;
     uint16_t _txPin;
     uint16_t _rxPin;
     uint32_t _baud;
+    uint8_t _protocol;
+    uint32_t _ubxBaud;
+    uint16_t _navRate;
+    bool _adaptive;
+    uint16_t _moveSpeed;
+    uint16_t _radius;
+    uint32_t _maxInterval;
+    uint32_t _powerSaveInterval;
+    GpsAdaptive _adapt;
+    bool _ubxConfigured;
     char _location[65];
 
-    float _long;
-    float _lat;
-    uint16_t _satelites;
-    uint16_t _course;
-    uint16_t _speed;
-    float _altitude;
-    bool _isValid;
-    HardwareSerial _gpsSerial;
+    SeqLock<GpsReading> _reading;
+    TinyGPSPlus _gps;
+    UbxParser _ubx;
+    bool _frameDone;
+    bool _readerStarted;
+    uint8_t _sentences;         // The GGA and RMC sentences the receiver sends each epoch
+    uint8_t _epochSeen;         // The sentences of the current epoch that have arrived
+    uint8_t _epochFix;          // The sentences of the current epoch that have arrived with a fix
+    uint32_t _epochTime;        // The UTC time of the current epoch, hhmmsscc
+    GpsReading _epoch;          // The fix of the current epoch, from its sentences
+    int64_t _sentenceStart;
+    GpsReaderStats _stats;
 };
 
-extern GpsInfoClass GpsSensor;
-
 #endif
\ No newline at end of file
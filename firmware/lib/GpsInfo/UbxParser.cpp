@@ -0,0 +1,233 @@
+#include "UbxParser.h"
+
+typedef enum
+{
+    UBX_SYNC1 = 0,
+    UBX_SYNC2,
+    UBX_CLASS,
+    UBX_ID,
+    UBX_LENGTH1,
+    UBX_LENGTH2,
+    UBX_PAYLOAD,
+    UBX_CK_A,
+    UBX_CK_B
+} UbxState;
+
+/**
+ * Class Constructor
+ */
+UbxParser::UbxParser() : _state(UBX_SYNC1), _class(0), _id(0), _length(0), _index(0), _passed(0), _failed(0)
+{
+}
+
+/**
+ * Add the next byte received
+ * 
+ * @param c The byte
+ * @return True if it completed a frame with a good checksum, the frame can be read until the next byte is added
+ */
+bool UbxParser::encode(uint8_t c)
+{
+    switch (this->_state)
+    {
+    case UBX_SYNC1:
+        this->_state = c == UBX_SYNC_1 ? UBX_SYNC2 : UBX_SYNC1;
+        break;
+    case UBX_SYNC2:
+        this->_state = c == UBX_SYNC_2 ? UBX_CLASS : (c == UBX_SYNC_1 ? UBX_SYNC2 : UBX_SYNC1);
+        this->_ckA = 0;
+        this->_ckB = 0;
+        break;
+    case UBX_CLASS:
+        this->checksum(c);
+        this->_class = c;
+        this->_state = UBX_ID;
+        break;
+    case UBX_ID:
+        this->checksum(c);
+        this->_id = c;
+        this->_state = UBX_LENGTH1;
+        break;
+    case UBX_LENGTH1:
+        this->checksum(c);
+        this->_length = c;
+        this->_state = UBX_LENGTH2;
+        break;
+    case UBX_LENGTH2:
+        this->checksum(c);
+        this->_length |= (uint16_t)c << 8;
+        this->_index = 0;
+        if (this->_length > UBX_MAX_PAYLOAD)
+        {
+            // Not a frame we want, or noise that looked like a header, look for the next one
+            this->_failed++;
+            this->_state = UBX_SYNC1;
+        }
+        else
+        {
+            this->_state = this->_length == 0 ? UBX_CK_A : UBX_PAYLOAD;
+        }
+        break;
+    case UBX_PAYLOAD:
+        this->checksum(c);
+        this->_payload[this->_index++] = c;
+        if (this->_index == this->_length)
+        {
+            this->_state = UBX_CK_A;
+        }
+        break;
+    case UBX_CK_A:
+        this->_state = c == this->_ckA ? UBX_CK_B : UBX_SYNC1;
+        if (c != this->_ckA)
+        {
+            this->_failed++;
+        }
+        break;
+    case UBX_CK_B:
+        this->_state = UBX_SYNC1;
+        if (c == this->_ckB)
+        {
+            this->_passed++;
+            return true;
+        }
+        this->_failed++;
+        break;
+    }
+    return false;
+}
+
+/**
+ * Get the class of the last frame
+ * 
+ * @return The message class
+ */
+uint8_t UbxParser::getClass()
+{
+    return this->_class;
+}
+
+/**
+ * Get the id of the last frame
+ * 
+ * @return The message id
+ */
+uint8_t UbxParser::getId()
+{
+    return this->_id;
+}
+
+/**
+ * Get the payload length of the last frame
+ * 
+ * @return The length
+ */
+uint16_t UbxParser::getLength()
+{
+    return this->_length;
+}
+
+/**
+ * Get an unsigned byte from the payload
+ * 
+ * @param offset The offset in the payload
+ * @return The value
+ */
+uint8_t UbxParser::getU1(uint16_t offset)
+{
+    return this->_payload[offset];
+}
+
+/**
+ * Get a little endian unsigned 16 bit value from the payload
+ * 
+ * @param offset The offset in the payload
+ * @return The value
+ */
+uint16_t UbxParser::getU2(uint16_t offset)
+{
+    return this->_payload[offset] | (uint16_t)this->_payload[offset + 1] << 8;
+}
+
+/**
+ * Get a little endian unsigned 32 bit value from the payload
+ * 
+ * @param offset The offset in the payload
+ * @return The value
+ */
+uint32_t UbxParser::getU4(uint16_t offset)
+{
+    return this->getU2(offset) | (uint32_t)this->getU2(offset + 2) << 16;
+}
+
+/**
+ * Get a little endian signed 32 bit value from the payload
+ * 
+ * @param offset The offset in the payload
+ * @return The value
+ */
+int32_t UbxParser::getI4(uint16_t offset)
+{
+    return (int32_t)this->getU4(offset);
+}
+
+/**
+ * Get the number of frames with a good checksum
+ * 
+ * @return The count
+ */
+uint32_t UbxParser::passedChecksum()
+{
+    return this->_passed;
+}
+
+/**
+ * Get the number of frames dropped for a bad checksum or length
+ * 
+ * @return The count
+ */
+uint32_t UbxParser::failedChecksum()
+{
+    return this->_failed;
+}
+
+/**
+ * Build a frame to send to the receiver
+ * 
+ * @param msgClass The message class
+ * @param id The message id
+ * @param payload The payload
+ * @param length The payload length
+ * @param frame Where the frame is built, it must have room for length + UBX_OVERHEAD bytes
+ * @return The size of the frame
+ */
+size_t UbxParser::build(uint8_t msgClass, uint8_t id, const uint8_t *payload, uint16_t length, uint8_t *frame)
+{
+    frame[0] = UBX_SYNC_1;
+    frame[1] = UBX_SYNC_2;
+    frame[2] = msgClass;
+    frame[3] = id;
+    frame[4] = length & 0xFF;
+    frame[5] = length >> 8;
+    memcpy(&frame[6], payload, length);
+    uint8_t ckA = 0;
+    uint8_t ckB = 0;
+    for (uint16_t i = 2; i < length + 6; i++)
+    {
+        ckA += frame[i];
+        ckB += ckA;
+    }
+    frame[length + 6] = ckA;
+    frame[length + 7] = ckB;
+    return length + UBX_OVERHEAD;
+}
+
+/**
+ * Add the byte to the 8-bit Fletcher checksum
+ * 
+ * @param c The byte
+ */
+void UbxParser::checksum(uint8_t c)
+{
+    this->_ckA += c;
+    this->_ckB += this->_ckA;
+}
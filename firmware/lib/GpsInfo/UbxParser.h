@@ -0,0 +1,55 @@
+#ifndef UBXPARSER_H
+#define UBXPARSER_H
+
+#include "Hal.h"
+
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+#define UBX_MAX_PAYLOAD 100     // Largest payload kept, NAV-PVT is 92 bytes, longer frames are dropped
+#define UBX_OVERHEAD 8          // Sync (2), class, id, length (2) and checksum (2)
+
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_RXM 0x02
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_CFG 0x06
+#define UBX_NAV_PVT 0x07
+#define UBX_CFG_PRT 0x00
+#define UBX_CFG_MSG 0x01
+#define UBX_CFG_RATE 0x08
+#define UBX_RXM_PMREQ 0x41
+
+/**
+ * Parser for u-blox UBX binary frames, fed one byte at a time like TinyGPSPlus.  The payload is kept as it is
+ * and read with the little endian field accessors, so there is no text to number conversion.
+ */
+class UbxParser
+{
+public:
+    UbxParser();
+    bool encode(uint8_t c);
+    uint8_t getClass();
+    uint8_t getId();
+    uint16_t getLength();
+    uint8_t getU1(uint16_t offset);
+    uint16_t getU2(uint16_t offset);
+    uint32_t getU4(uint16_t offset);
+    int32_t getI4(uint16_t offset);
+    uint32_t passedChecksum();
+    uint32_t failedChecksum();
+    static size_t build(uint8_t msgClass, uint8_t id, const uint8_t *payload, uint16_t length, uint8_t *frame);
+
+private:
+    void checksum(uint8_t c);
+    uint8_t _state;
+    uint8_t _class;
+    uint8_t _id;
+    uint16_t _length;
+    uint16_t _index;
+    uint8_t _ckA;
+    uint8_t _ckB;
+    uint8_t _payload[UBX_MAX_PAYLOAD];
+    uint32_t _passed;
+    uint32_t _failed;
+};
+
+#endif
@@ -0,0 +1,457 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <FS.h>
+#else
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#endif
+
+#define HAL_WAIT_FOREVER UINT32_MAX     // Timeout that waits until the mutex is free
+#define HAL_ANY_CORE -1                 // The task can run on either core
+#define HAL_CORES 2                     // Cores the tasks run on, each has its own log buffer and rate limits
+#define HAL_POSIX_ROOT "sim"            // Default directory the POSIX files and partitions are kept in, HAL_ROOT overrides it
+#define HAL_POSIX_PARTITION_SIZE 0x100000   // Size of a POSIX partition file that does not exist yet
+#define HAL_FLASH_SECTOR_SIZE 4096      // Erase unit of a partition
+#define HAL_GPIO_PINS 40
+#define HAL_DISPLAY_WIDTH 128           // Pixels
+#define HAL_DISPLAY_HEIGHT 128
+#define HAL_DISPLAY_CHAR_WIDTH 6        // The font is 6x10, the POSIX display keeps a grid of characters this size
+#define HAL_DISPLAY_LINE_HEIGHT 8
+#define HAL_UART_EVENT_SIZE 120         // Most bytes in one UART data event by default, the FIFO threshold of the driver
+#define HAL_UART_IDLE_BYTES 20          // Byte times the line is idle before fewer bytes are passed on, the receive timeout
+#define HAL_PULSE_FILE_SIZE 4096        // Largest POSIX pulse file
+
+// Variables kept over deep sleep (RTC_DATA) and over software resets (RTC_NOINIT), ordinary variables on the host
+#ifdef ARDUINO
+#define HAL_RTC_DATA RTC_DATA_ATTR
+#define HAL_RTC_NOINIT RTC_NOINIT_ATTR
+#else
+#define HAL_RTC_DATA
+#define HAL_RTC_NOINIT
+#endif
+
+typedef enum
+{
+    HAL_RESET_UNKNOWN = 0,
+    HAL_RESET_POWERON,
+    HAL_RESET_EXTERNAL,
+    HAL_RESET_SOFTWARE,
+    HAL_RESET_PANIC,
+    HAL_RESET_INT_WDT,
+    HAL_RESET_TASK_WDT,
+    HAL_RESET_WDT,
+    HAL_RESET_DEEPSLEEP,
+    HAL_RESET_BROWNOUT
+} HalResetReason;
+
+typedef enum
+{
+    HAL_WAKEUP_UNDEFINED = 0,   // Power on or reset, not a wake from deep sleep
+    HAL_WAKEUP_EXT0,
+    HAL_WAKEUP_EXT1,
+    HAL_WAKEUP_TIMER,
+    HAL_WAKEUP_TOUCHPAD,
+    HAL_WAKEUP_ULP
+} HalWakeupCause;
+
+typedef enum
+{
+    HAL_UART_TIMEOUT = 0,   // Nothing happened before the timeout
+    HAL_UART_DATA,          // Bytes are waiting to be read
+    HAL_UART_OVERFLOW,      // The FIFO or the receive buffer overflowed and bytes were lost
+    HAL_UART_OTHER,         // A break, framing or parity error
+    HAL_UART_END            // The POSIX replay file has ended, nothing more will arrive
+} HalUartEvent;
+
+typedef enum
+{
+    HAL_NETWORK_STARTED = 0,
+    HAL_NETWORK_CONNECTED,
+    HAL_NETWORK_DISCONNECTED,
+    HAL_NETWORK_WPS_SUCCESS,    // The credentials are kept by the driver, WPS has to be stopped before connecting
+    HAL_NETWORK_WPS_FAILED,
+    HAL_NETWORK_WPS_TIMEOUT,
+    HAL_NETWORK_WPS_PIN         // The detail is the PIN
+} HalNetworkEvent;
+
+/**
+ * The hardware abstraction layer, the firmware calls these and not the Arduino, ESP-IDF or FreeRTOS APIs so it
+ * can be built for the ESP32 (HalEsp32.cpp) or for a Linux or macOS host (HalPosix.cpp).  Only one of them is
+ * compiled, picked by whether ARDUINO is defined.
+ */
+namespace Hal
+{
+    // Time
+    uint32_t millis();
+    int64_t micros();
+    void delay(uint32_t ms);
+
+    // Tasks
+    typedef void (*TaskFunction)(void *arg);
+    typedef void *Task;
+    bool startTask(TaskFunction function, const char *name, uint32_t stack, void *arg, uint8_t priority,
+                   int8_t core = HAL_ANY_CORE, Task *handle = NULL);
+    Task currentTask();
+    uint8_t coreId();
+    uint32_t stackFree();
+
+    /**
+     * A recursive mutex between tasks, the task holding it can take it again
+     */
+    class Mutex
+    {
+    public:
+        Mutex();
+        bool take(uint32_t timeoutMs);
+        void give();
+
+    private:
+#ifdef ARDUINO
+        SemaphoreHandle_t _handle;
+#else
+        pthread_mutex_t _handle;
+#endif
+    };
+
+    /**
+     * A short critical section shared with the other core, it must only be held for a few instructions and
+     * nothing that blocks can be called while holding it
+     */
+    class Spinlock
+    {
+    public:
+#ifdef ARDUINO
+        Spinlock() : _mux(portMUX_INITIALIZER_UNLOCKED) {}
+        void enter() { portENTER_CRITICAL(&this->_mux); }
+        void exit() { portEXIT_CRITICAL(&this->_mux); }
+
+    private:
+        portMUX_TYPE _mux;
+#else
+        Spinlock() : _mux(PTHREAD_MUTEX_INITIALIZER) {}
+        void enter() { pthread_mutex_lock(&this->_mux); }
+        void exit() { pthread_mutex_unlock(&this->_mux); }
+
+    private:
+        pthread_mutex_t _mux;
+#endif
+    };
+
+    /**
+     * Wakes one waiting task, a give with no task waiting is kept until the next take (a binary semaphore)
+     */
+    class Signal
+    {
+    public:
+        Signal();
+        void give();
+        bool take(uint32_t timeoutMs);
+
+    private:
+#ifdef ARDUINO
+        SemaphoreHandle_t _handle;
+#else
+        pthread_mutex_t _mutex;
+        pthread_cond_t _cond;
+        bool _given;
+#endif
+    };
+
+    /**
+     * A fixed size queue of fixed size items between tasks, created empty
+     */
+    class Queue
+    {
+    public:
+        Queue(size_t itemSize, size_t length);
+        ~Queue();
+        bool send(const void *item, uint32_t timeoutMs);
+        bool receive(void *item, uint32_t timeoutMs);
+        void reset();
+
+    private:
+#ifdef ARDUINO
+        QueueHandle_t _handle;
+#else
+        pthread_mutex_t _mutex;
+        pthread_cond_t _cond;
+        uint8_t *_items;
+        size_t _itemSize;
+        size_t _length;
+        size_t _head;
+        size_t _count;
+#endif
+    };
+
+    /**
+     * A buffer of variable size items that are never split, an item is read in place and returned once it has
+     * been used, in the order they were received
+     */
+    class RingBuffer
+    {
+    public:
+        RingBuffer(size_t size);
+        ~RingBuffer();
+        bool send(const void *item, size_t size, uint32_t timeoutMs);
+        void *receive(size_t *size, uint32_t timeoutMs);
+        void returnItem(void *item);
+        size_t waiting();
+
+    private:
+#ifdef ARDUINO
+        void *_handle;      // The RingbufHandle_t
+#else
+        pthread_mutex_t _mutex;
+        pthread_cond_t _cond;
+        uint8_t *_buffer;
+        size_t _size;
+        size_t _write;      // Where the next item goes
+        size_t _read;       // The oldest item that has not been returned
+        size_t _next;       // The next item to be received
+        size_t _used;
+        size_t _items;      // Items that have not been received
+#endif
+    };
+
+    /**
+     * A one shot timer, the callback runs on the timer task and must not block
+     */
+    class Timer
+    {
+    public:
+        Timer();
+        bool begin(TaskFunction callback, void *arg, const char *name);
+        void startOnce(uint64_t us);
+        void stop();
+
+    private:
+        TaskFunction _callback;
+        void *_arg;
+#ifdef ARDUINO
+        void *_handle;      // The esp_timer_handle_t
+#else
+        static void timerTask(void *arg);
+        pthread_mutex_t _mutex;
+        pthread_cond_t _cond;
+        int64_t _due;       // The micros() the callback runs at, 0 if the timer is stopped
+#endif
+    };
+
+    // Storage, the paths are SPIFFS paths like "/config.json"
+    bool storageBegin();
+    bool fileExists(const char *path);
+    size_t fileSize(const char *path);
+    size_t readFile(const char *path, uint8_t *buffer, size_t size);
+    bool writeFile(const char *path, const uint8_t *data, size_t length, bool append = false);
+    bool removeFile(const char *path);
+    bool renameFile(const char *from, const char *to);
+
+    /**
+     * An open file, for reading or writing a file in pieces.  The modes are the fopen modes, "r", "w", "a",
+     * "r+" and "w+".
+     */
+    class File
+    {
+    public:
+        File();
+        ~File();
+        bool open(const char *path, const char *mode);
+        void close();
+        bool isOpen();
+        int available();
+        int read();
+        int peek();
+        size_t read(uint8_t *data, size_t size);
+        size_t write(const uint8_t *data, size_t size);
+        bool seek(uint32_t position);
+        size_t size();
+        void flush();
+
+    private:
+#ifdef ARDUINO
+        fs::File _file;
+#else
+        FILE *_file;
+#endif
+    };
+
+    /**
+     * A raw flash partition from partitions.csv.  Like flash a write can only clear bits, so a region must be
+     * erased (all 0xFF) before it is written again.
+     */
+    class Partition
+    {
+    public:
+        Partition();
+        ~Partition();
+        bool open(const char *label);
+        bool isOpen();
+        uint32_t getSize();
+        bool read(uint32_t offset, void *data, size_t size);
+        bool write(uint32_t offset, const void *data, size_t size);
+        bool erase(uint32_t offset, size_t size);
+
+    private:
+        uint32_t _size;
+#ifdef ARDUINO
+        const void *_handle;    // The esp_partition_t
+#else
+        int _handle;
+#endif
+    };
+
+    // Console, the USB serial port on the device and stdout on the host
+    void consoleBegin(uint32_t baud);
+    size_t consoleWrite(const uint8_t *data, size_t length);
+    size_t consolePrint(const char *text);
+    void consoleFlush();
+
+    /**
+     * Lets ArduinoJson serialize straight to the console
+     */
+    struct ConsoleWriter
+    {
+        size_t write(uint8_t c) { return consoleWrite(&c, 1); }
+        size_t write(const uint8_t *data, size_t length) { return consoleWrite(data, length); }
+    };
+
+    /**
+     * A UART, opened with an event queue the reader can wait on for data and overflows.  On the host the port
+     * is the file or serial device named by the HAL_UART<port> environment variable, e.g. HAL_UART2=/dev/ttyUSB0
+     * or HAL_UART2=capture.bin, a file is replayed at the baud rate (see the readme for the replay options).
+     */
+    class Uart
+    {
+    public:
+        Uart(uint8_t port);
+        bool open(uint32_t baud, int8_t txPin, int8_t rxPin, size_t rxBuffer, size_t eventQueue = 0,
+                  size_t eventSize = HAL_UART_EVENT_SIZE);
+        void close();
+        bool isOpen();
+        bool setBaud(uint32_t baud);
+        HalUartEvent wait(size_t *size, uint32_t timeoutMs);
+        int read(uint8_t *data, size_t size, uint32_t timeoutMs);
+        int write(const uint8_t *data, size_t size);
+        bool waitSent(uint32_t timeoutMs);
+        void flushInput();
+
+    private:
+        uint8_t _port;
+        bool _open;
+#ifdef ARDUINO
+        void *_queue;           // The QueueHandle_t of uart_event_t
+#else
+        uint64_t paced();
+        size_t due(uint32_t timeoutMs);
+        void zeros(size_t waiting, size_t *leading, size_t *trailing);
+        void skip(size_t size);
+        bool dropping(uint64_t position);
+        uint32_t random();
+        int _fd;
+        bool _tty;
+        bool _events;
+        size_t _eventSize;      // Bytes that raise a data event without waiting for the line to go idle
+        uint32_t _baud;
+        size_t _rxBuffer;
+        off_t _fileSize;
+        float _speed;           // Replay speed, 1 is the baud rate and 0 as fast as it is read
+        bool _loop;
+        float _corrupt;         // Chance of a bit error in each byte
+        float _drop;            // Chance of a dropout starting in each second of the stream
+        uint32_t _dropMs;
+        uint32_t _random;
+        int64_t _paceStart;     // micros() the pacing was last started from
+        uint64_t _paceBase;     // Bytes taken from the file when the pacing was last started
+        uint64_t _taken;        // Bytes taken from the file, read or lost
+        uint64_t _dropUntil;    // The byte the dropout in progress ends at
+        uint32_t _corrupted;
+        uint32_t _dropped;
+        uint32_t _overflowed;
+#endif
+    };
+
+    /**
+     * A pulse on an input pin, the level and how long it was held
+     */
+    typedef struct pulseStruct
+    {
+        uint8_t level;
+        uint16_t duration;      // Microseconds
+    } Pulse;
+
+    /**
+     * Captures the pulses on an open drain pin after the pin has been pulled low for a start signal, for
+     * sensors like the DHT-22 that answer in pulse widths.  On the ESP32 this is an RMT receive channel, on
+     * the host the pulses are read from the file named by HAL_PULSE<pin>.
+     */
+    class PulseCapture
+    {
+    public:
+        PulseCapture(uint8_t channel) : _channel(channel), _pin(-1), _handle(NULL) {}
+        bool open(int8_t pin, uint16_t idleUs);
+        void close();
+        bool isOpen();
+        size_t capture(uint32_t startMs, uint32_t timeoutMs, Pulse *pulses, size_t size);
+
+    private:
+        uint8_t _channel;
+        int8_t _pin;
+        void *_handle;          // The RMT ring buffer, not used on the host
+    };
+
+    // GPIO and PWM, on the host the pins are kept in memory and traced when HAL_TRACE is set
+    void pinMode(uint8_t pin, bool output);
+    void digitalWrite(uint8_t pin, bool high);
+    bool digitalRead(uint8_t pin);
+    void pwmWrite(uint8_t pin, uint8_t value);
+
+    // Display, an SSD1327 on software SPI, on the host the text is kept in a character grid and printed when it is
+    // sent
+    void displayBegin(uint8_t clockPin, uint8_t dataPin, uint8_t csPin, uint8_t resetPin);
+    void displayClear();
+    void displayErase(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+    void displayText(uint16_t x, uint16_t y, const char *text);
+    uint16_t displayTextWidth(const char *text);
+    void displaySend();
+
+    // Network, the handler is told about the station and WPS events and decides what to do about them
+    typedef void (*NetworkHandler)(HalNetworkEvent event, const char *detail);
+    void networkBegin();
+    void networkReconnect();
+    void networkEvents(NetworkHandler handler);
+    bool networkUp();
+    size_t networkName(char *buffer, size_t size);
+    size_t networkAddress(char *buffer, size_t size);
+    int8_t networkSignal();
+    bool wpsStart(const char *manufacturer, const char *model, const char *name, const char *device);
+    void wpsStop();
+    bool udpSend(const char *host, uint16_t port, const uint8_t *data, size_t length);
+
+    // Time of day, SNTP on the device and the system clock on the host
+    void timeBegin(const char *server);
+    bool timeUpdate();
+    uint32_t epoch();
+
+    // System
+    uint64_t chipId();
+    HalResetReason resetReason();
+    HalWakeupCause wakeupCause();
+    bool heapCheck();
+    uint32_t freeHeap();
+    uint8_t crc8(uint8_t crc, const uint8_t *data, size_t length);
+    uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length);
+    uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length);
+
+    // Power
+    void deepSleep(uint64_t us);
+    void restart();
+} // namespace Hal
+
+#endif
@@ -0,0 +1,1502 @@
+#ifdef ARDUINO
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <NTPClient.h>
+#include <U8g2lib.h>
+#include <analogWrite.h>
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
+#include <esp_wps.h>
+#include <freertos/ringbuf.h>
+#include <driver/uart.h>
+#include <driver/rmt.h>
+#include <rom/crc.h>
+#include "Hal.h"
+
+#define HAL_RMT_BUFFER_SIZE 512     // RMT ring buffer, a DHT-22 response is 42 items of 4 bytes
+
+typedef struct halTaskStartStruct
+{
+    Hal::TaskFunction function;
+    void *arg;
+} HalTaskStart;
+
+static U8G2 *_halDisplay = NULL;
+
+WiFiUDP _halUdp;
+WiFiUDP _halNtpUdp;
+NTPClient *_halNtp = NULL;
+static esp_wps_config_t _halWps;
+static Hal::NetworkHandler _halNetworkHandler = NULL;
+
+/**
+ * The task entry point, it runs the task function and deletes the task when it returns
+ *
+ * @param arg The HalTaskStart, it is freed here
+ */
+static void halTask(void *arg)
+{
+    HalTaskStart start = *(HalTaskStart *)arg;
+    free(arg);
+    start.function(start.arg);
+    vTaskDelete(NULL);
+}
+
+/**
+ * Get the FreeRTOS ticks for a timeout
+ *
+ * @param timeoutMs The milliseconds, HAL_WAIT_FOREVER to wait until it happens
+ * @return The ticks
+ */
+static TickType_t halTicks(uint32_t timeoutMs)
+{
+    return timeoutMs == HAL_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+}
+
+/**
+ * Tell the network handler about the WiFi events it is interested in
+ *
+ * @param event The event been raised
+ * @param info The information related to the event
+ */
+static void halNetworkEvent(WiFiEvent_t event, system_event_info_t info)
+{
+    char pin[9];
+    if (_halNetworkHandler == NULL)
+    {
+        return;
+    }
+    switch (event)
+    {
+    case SYSTEM_EVENT_STA_START:
+        _halNetworkHandler(HAL_NETWORK_STARTED, "");
+        break;
+    case SYSTEM_EVENT_STA_GOT_IP:
+        _halNetworkHandler(HAL_NETWORK_CONNECTED, WiFi.SSID().c_str());
+        break;
+    case SYSTEM_EVENT_STA_DISCONNECTED:
+        _halNetworkHandler(HAL_NETWORK_DISCONNECTED, "");
+        break;
+    case SYSTEM_EVENT_STA_WPS_ER_SUCCESS:
+        _halNetworkHandler(HAL_NETWORK_WPS_SUCCESS, WiFi.SSID().c_str());
+        break;
+    case SYSTEM_EVENT_STA_WPS_ER_FAILED:
+        _halNetworkHandler(HAL_NETWORK_WPS_FAILED, "");
+        break;
+    case SYSTEM_EVENT_STA_WPS_ER_TIMEOUT:
+        _halNetworkHandler(HAL_NETWORK_WPS_TIMEOUT, "");
+        break;
+    case SYSTEM_EVENT_STA_WPS_ER_PIN:
+        memcpy(pin, info.sta_er_pin.pin_code, 8);
+        pin[8] = '\0';
+        _halNetworkHandler(HAL_NETWORK_WPS_PIN, pin);
+        break;
+    default:
+        break;
+    }
+}
+
+namespace Hal
+{
+    /**
+     * Get the milliseconds since boot
+     *
+     * @return The milliseconds, wraps after 49 days
+     */
+    uint32_t millis()
+    {
+        return ::millis();
+    }
+
+    /**
+     * Get the microseconds since boot
+     *
+     * @return The esp_timer time
+     */
+    int64_t micros()
+    {
+        return esp_timer_get_time();
+    }
+
+    /**
+     * Block the calling task, other tasks run while it waits
+     *
+     * @param ms The milliseconds to wait
+     */
+    void delay(uint32_t ms)
+    {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+    }
+
+    /**
+     * Start a task, the task deletes itself when the function returns
+     *
+     * @param function The task function
+     * @param name The task name
+     * @param stack The stack size in bytes
+     * @param arg Passed to the function
+     * @param priority The FreeRTOS priority
+     * @param core The core to pin the task to, HAL_ANY_CORE to let the scheduler pick
+     * @param handle Set to the task, if not NULL
+     * @return True if the task was started
+     */
+    bool startTask(TaskFunction function, const char *name, uint32_t stack, void *arg, uint8_t priority, int8_t core,
+                   Task *handle)
+    {
+        HalTaskStart *start = (HalTaskStart *)malloc(sizeof(HalTaskStart));
+        if (start == NULL)
+        {
+            return false;
+        }
+        start->function = function;
+        start->arg = arg;
+        TaskHandle_t task;
+        BaseType_t created = xTaskCreatePinnedToCore(halTask, name, stack, start, priority, &task,
+                                                     core == HAL_ANY_CORE ? tskNO_AFFINITY : core);
+        if (created != pdPASS)
+        {
+            free(start);
+            return false;
+        }
+        if (handle != NULL)
+        {
+            *handle = task;
+        }
+        return true;
+    }
+
+    /**
+     * Get the task that is running
+     *
+     * @return The task, as startTask gives it
+     */
+    Task currentTask()
+    {
+        return xTaskGetCurrentTaskHandle();
+    }
+
+    /**
+     * Get the core the calling task is running on
+     *
+     * @return 0 or 1
+     */
+    uint8_t coreId()
+    {
+        return xPortGetCoreID();
+    }
+
+    /**
+     * Get the least free stack the calling task has had
+     *
+     * @return The high water mark in bytes
+     */
+    uint32_t stackFree()
+    {
+        return uxTaskGetStackHighWaterMark(NULL);
+    }
+
+    /**
+     * Class Constructor, the mutex is created free
+     */
+    Mutex::Mutex()
+    {
+        this->_handle = xSemaphoreCreateRecursiveMutex();
+    }
+
+    /**
+     * Take the mutex
+     *
+     * @param timeoutMs The most milliseconds to wait, 0 to not wait and HAL_WAIT_FOREVER to wait until it is free
+     * @return True if it was taken
+     */
+    bool Mutex::take(uint32_t timeoutMs)
+    {
+        return xSemaphoreTakeRecursive(this->_handle, halTicks(timeoutMs)) == pdTRUE;
+    }
+
+    /**
+     * Give the mutex back
+     */
+    void Mutex::give()
+    {
+        xSemaphoreGiveRecursive(this->_handle);
+    }
+
+    /**
+     * Class Constructor, the signal is created not given
+     */
+    Signal::Signal()
+    {
+        this->_handle = xSemaphoreCreateBinary();
+    }
+
+    /**
+     * Wake the task waiting, or the next task to wait
+     */
+    void Signal::give()
+    {
+        xSemaphoreGive(this->_handle);
+    }
+
+    /**
+     * Wait for the signal
+     *
+     * @param timeoutMs The most milliseconds to wait, HAL_WAIT_FOREVER to wait until it is given
+     * @return True if it was given
+     */
+    bool Signal::take(uint32_t timeoutMs)
+    {
+        return xSemaphoreTake(this->_handle, halTicks(timeoutMs)) == pdTRUE;
+    }
+
+    /**
+     * Class Constructor
+     *
+     * @param itemSize The size of each item
+     * @param length The most items it holds
+     */
+    Queue::Queue(size_t itemSize, size_t length)
+    {
+        this->_handle = xQueueCreate(length, itemSize);
+    }
+
+    /**
+     * Class Destructor
+     */
+    Queue::~Queue()
+    {
+        vQueueDelete(this->_handle);
+    }
+
+    /**
+     * Add an item to the back of the queue
+     *
+     * @param item The item, it is copied
+     * @param timeoutMs The most milliseconds to wait for space, 0 to not wait
+     * @return True if it was added
+     */
+    bool Queue::send(const void *item, uint32_t timeoutMs)
+    {
+        return xQueueSend(this->_handle, item, halTicks(timeoutMs)) == pdTRUE;
+    }
+
+    /**
+     * Take the item at the front of the queue
+     *
+     * @param item Where the item is copied to
+     * @param timeoutMs The most milliseconds to wait for an item, HAL_WAIT_FOREVER to wait until there is one
+     * @return True if an item was taken
+     */
+    bool Queue::receive(void *item, uint32_t timeoutMs)
+    {
+        return xQueueReceive(this->_handle, item, halTicks(timeoutMs)) == pdTRUE;
+    }
+
+    /**
+     * Empty the queue
+     */
+    void Queue::reset()
+    {
+        xQueueReset(this->_handle);
+    }
+
+    /**
+     * Class Constructor
+     *
+     * @param size The bytes it holds, each item also takes an 8 byte header
+     */
+    RingBuffer::RingBuffer(size_t size)
+    {
+        this->_handle = xRingbufferCreate(size, RINGBUF_TYPE_NOSPLIT);
+    }
+
+    /**
+     * Class Destructor
+     */
+    RingBuffer::~RingBuffer()
+    {
+        vRingbufferDelete((RingbufHandle_t)this->_handle);
+    }
+
+    /**
+     * Copy an item into the buffer
+     *
+     * @param item The item
+     * @param size The size of the item
+     * @param timeoutMs The most milliseconds to wait for space, 0 to not wait
+     * @return True if it was added
+     */
+    bool RingBuffer::send(const void *item, size_t size, uint32_t timeoutMs)
+    {
+        return xRingbufferSend((RingbufHandle_t)this->_handle, item, size, halTicks(timeoutMs)) == pdTRUE;
+    }
+
+    /**
+     * Get the oldest item, it stays in the buffer until it is returned
+     *
+     * @param size Set to the size of the item
+     * @param timeoutMs The most milliseconds to wait for an item
+     * @return The item, NULL if there was none
+     */
+    void *RingBuffer::receive(size_t *size, uint32_t timeoutMs)
+    {
+        return xRingbufferReceive((RingbufHandle_t)this->_handle, size, halTicks(timeoutMs));
+    }
+
+    /**
+     * Give the space of a received item back
+     *
+     * @param item The item from receive
+     */
+    void RingBuffer::returnItem(void *item)
+    {
+        vRingbufferReturnItem((RingbufHandle_t)this->_handle, item);
+    }
+
+    /**
+     * Get the items that have not been received
+     *
+     * @return The number of items
+     */
+    size_t RingBuffer::waiting()
+    {
+        UBaseType_t items;
+        vRingbufferGetInfo((RingbufHandle_t)this->_handle, NULL, NULL, NULL, &items);
+        return items;
+    }
+
+    /**
+     * Class Constructor, the timer is created by begin
+     */
+    Timer::Timer() : _callback(NULL), _arg(NULL), _handle(NULL)
+    {
+    }
+
+    /**
+     * Create the esp_timer, the callback runs on the esp_timer task
+     *
+     * @param callback Called when the timer fires
+     * @param arg Passed to the callback
+     * @param name The timer name
+     * @return True if it was created
+     */
+    bool Timer::begin(TaskFunction callback, void *arg, const char *name)
+    {
+        this->_callback = callback;
+        this->_arg = arg;
+        esp_timer_create_args_t args;
+        memset(&args, 0, sizeof(args));
+        args.callback = callback;
+        args.arg = arg;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = name;
+        return esp_timer_create(&args, (esp_timer_handle_t *)&this->_handle) == ESP_OK;
+    }
+
+    /**
+     * Fire once after a delay, a timer that is already running is started again
+     *
+     * @param us The microseconds from now
+     */
+    void Timer::startOnce(uint64_t us)
+    {
+        esp_timer_stop((esp_timer_handle_t)this->_handle);
+        esp_timer_start_once((esp_timer_handle_t)this->_handle, us);
+    }
+
+    /**
+     * Stop the timer if it is running
+     */
+    void Timer::stop()
+    {
+        esp_timer_stop((esp_timer_handle_t)this->_handle);
+    }
+
+    /**
+     * Mount SPIFFS, it is formatted if it cannot be mounted
+     *
+     * @return True if it is mounted
+     */
+    bool storageBegin()
+    {
+        return SPIFFS.begin(true);
+    }
+
+    /**
+     * Is there a file
+     *
+     * @param path The file name
+     * @return True if it exists
+     */
+    bool fileExists(const char *path)
+    {
+        return SPIFFS.exists(path);
+    }
+
+    /**
+     * Get the size of a file
+     *
+     * @param path The file name
+     * @return The size, 0 if it does not exist
+     */
+    size_t fileSize(const char *path)
+    {
+        if (!SPIFFS.exists(path))
+        {
+            return 0;
+        }
+        fs::File file = SPIFFS.open(path, "r");
+        size_t size = file ? file.size() : 0;
+        file.close();
+        return size;
+    }
+
+    /**
+     * Read the start of a file
+     *
+     * @param path The file name
+     * @param buffer Where the contents are read to
+     * @param size The size of the buffer
+     * @return The bytes read, 0 if it does not exist
+     */
+    size_t readFile(const char *path, uint8_t *buffer, size_t size)
+    {
+        if (!SPIFFS.exists(path))
+        {
+            return 0;
+        }
+        fs::File file = SPIFFS.open(path, "r");
+        if (!file)
+        {
+            return 0;
+        }
+        size_t length = file.read(buffer, size);
+        file.close();
+        return length;
+    }
+
+    /**
+     * Write or append to a file
+     *
+     * @param path The file name
+     * @param data What is written
+     * @param length The size of the data
+     * @param append True to add to the end of the file, false to replace it
+     * @return True if all of it was written
+     */
+    bool writeFile(const char *path, const uint8_t *data, size_t length, bool append)
+    {
+        fs::File file = SPIFFS.open(path, append ? "a" : "w");
+        if (!file)
+        {
+            return false;
+        }
+        size_t written = file.write(data, length);
+        file.close();
+        return written == length;
+    }
+
+    /**
+     * Remove a file
+     *
+     * @param path The file name
+     * @return True if it was removed
+     */
+    bool removeFile(const char *path)
+    {
+        return SPIFFS.remove(path);
+    }
+
+    /**
+     * Rename a file, SPIFFS will not rename over a file so the new name must not exist
+     *
+     * @param from The file name
+     * @param to The new name
+     * @return True if it was renamed
+     */
+    bool renameFile(const char *from, const char *to)
+    {
+        return SPIFFS.rename(from, to);
+    }
+
+    /**
+     * Class Constructor, the file is not open
+     */
+    File::File()
+    {
+    }
+
+    /**
+     * Class Destructor, the file is closed
+     */
+    File::~File()
+    {
+        this->close();
+    }
+
+    /**
+     * Open a file
+     *
+     * @param path The file name
+     * @param mode The fopen mode
+     * @return True if it was opened
+     */
+    bool File::open(const char *path, const char *mode)
+    {
+        this->close();
+        if (mode[0] == 'r' && !SPIFFS.exists(path))
+        {
+            return false;
+        }
+        this->_file = SPIFFS.open(path, mode);
+        return (bool)this->_file;
+    }
+
+    /**
+     * Close the file
+     */
+    void File::close()
+    {
+        if (this->_file)
+        {
+            this->_file.close();
+        }
+    }
+
+    /**
+     * Is the file open
+     *
+     * @return True if it can be used
+     */
+    bool File::isOpen()
+    {
+        return (bool)this->_file;
+    }
+
+    /**
+     * Get the bytes left to read
+     *
+     * @return The bytes after the position
+     */
+    int File::available()
+    {
+        return this->_file ? this->_file.available() : 0;
+    }
+
+    /**
+     * Read a byte
+     *
+     * @return The byte, -1 at the end of the file
+     */
+    int File::read()
+    {
+        return this->_file ? this->_file.read() : -1;
+    }
+
+    /**
+     * Look at the next byte without reading it
+     *
+     * @return The byte, -1 at the end of the file
+     */
+    int File::peek()
+    {
+        return this->_file ? this->_file.peek() : -1;
+    }
+
+    /**
+     * Read bytes
+     *
+     * @param data Where they are read to
+     * @param size The most bytes to read
+     * @return The bytes read
+     */
+    size_t File::read(uint8_t *data, size_t size)
+    {
+        return this->_file ? this->_file.read(data, size) : 0;
+    }
+
+    /**
+     * Write bytes at the position
+     *
+     * @param data What is written
+     * @param size The size of the data
+     * @return The bytes written
+     */
+    size_t File::write(const uint8_t *data, size_t size)
+    {
+        return this->_file ? this->_file.write(data, size) : 0;
+    }
+
+    /**
+     * Move the position
+     *
+     * @param position The offset from the start of the file
+     * @return True if it was moved
+     */
+    bool File::seek(uint32_t position)
+    {
+        return this->_file && this->_file.seek(position);
+    }
+
+    /**
+     * Get the size of the file
+     *
+     * @return The bytes
+     */
+    size_t File::size()
+    {
+        return this->_file ? this->_file.size() : 0;
+    }
+
+    /**
+     * Write what is buffered to the flash
+     */
+    void File::flush()
+    {
+        if (this->_file)
+        {
+            this->_file.flush();
+        }
+    }
+
+    /**
+     * Class Constructor, the partition is not open
+     */
+    Partition::Partition() : _size(0), _handle(NULL)
+    {
+    }
+
+    /**
+     * Class Destructor, there is nothing to close on the ESP32
+     */
+    Partition::~Partition()
+    {
+    }
+
+    /**
+     * Find the data partition
+     *
+     * @param label The name in partitions.csv
+     * @return True if it was found
+     */
+    bool Partition::open(const char *label)
+    {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        this->_handle = partition;
+        this->_size = partition != NULL ? partition->size : 0;
+        return partition != NULL;
+    }
+
+    /**
+     * Has the partition been found
+     *
+     * @return True if it can be used
+     */
+    bool Partition::isOpen()
+    {
+        return this->_handle != NULL;
+    }
+
+    /**
+     * Get the size of the partition
+     *
+     * @return The bytes, 0 if it is not open
+     */
+    uint32_t Partition::getSize()
+    {
+        return this->_size;
+    }
+
+    /**
+     * Read from the partition
+     *
+     * @param offset The offset from the start of the partition
+     * @param data Where it is read to
+     * @param size The bytes to read
+     * @return True if it was read
+     */
+    bool Partition::read(uint32_t offset, void *data, size_t size)
+    {
+        return esp_partition_read((const esp_partition_t *)this->_handle, offset, data, size) == ESP_OK;
+    }
+
+    /**
+     * Write to an erased part of the partition
+     *
+     * @param offset The offset from the start of the partition
+     * @param data What is written
+     * @param size The bytes to write
+     * @return True if it was written
+     */
+    bool Partition::write(uint32_t offset, const void *data, size_t size)
+    {
+        return esp_partition_write((const esp_partition_t *)this->_handle, offset, data, size) == ESP_OK;
+    }
+
+    /**
+     * Erase part of the partition
+     *
+     * @param offset The offset from the start of the partition, a multiple of HAL_FLASH_SECTOR_SIZE
+     * @param size The bytes to erase, a multiple of HAL_FLASH_SECTOR_SIZE
+     * @return True if it was erased
+     */
+    bool Partition::erase(uint32_t offset, size_t size)
+    {
+        return esp_partition_erase_range((const esp_partition_t *)this->_handle, offset, size) == ESP_OK;
+    }
+
+    /**
+     * Start the USB serial port
+     *
+     * @param baud The baud rate
+     */
+    void consoleBegin(uint32_t baud)
+    {
+        Serial.begin(baud);
+    }
+
+    /**
+     * Write to the USB serial port
+     *
+     * @param data What is written
+     * @param length The size of the data
+     * @return The bytes written
+     */
+    size_t consoleWrite(const uint8_t *data, size_t length)
+    {
+        return Serial.write(data, length);
+    }
+
+    /**
+     * Write text to the USB serial port
+     *
+     * @param text The text
+     * @return The bytes written
+     */
+    size_t consolePrint(const char *text)
+    {
+        return Serial.print(text);
+    }
+
+    /**
+     * Wait for everything written to the USB serial port to be sent
+     */
+    void consoleFlush()
+    {
+        Serial.flush();
+    }
+
+    /**
+     * Class Constructor
+     *
+     * @param port The UART number
+     */
+    Uart::Uart(uint8_t port) : _port(port), _open(false), _queue(NULL)
+    {
+    }
+
+    /**
+     * Install the UART driver, 8N1 with no flow control.  A data event is raised when eventSize bytes are in the
+     * FIFO or the line has been idle for HAL_UART_IDLE_BYTES byte times, so the short gaps a receiver leaves
+     * between the sentences of a burst do not each wake the reader.
+     *
+     * @param baud The baud rate
+     * @param txPin The pin to send on
+     * @param rxPin The pin to receive on
+     * @param rxBuffer The size of the driver receive buffer
+     * @param eventQueue The events the driver can queue, 0 for none
+     * @param eventSize The FIFO threshold, at most HAL_UART_EVENT_SIZE
+     * @return True if the driver was installed
+     */
+    bool Uart::open(uint32_t baud, int8_t txPin, int8_t rxPin, size_t rxBuffer, size_t eventQueue, size_t eventSize)
+    {
+        this->close();
+        uart_config_t config;
+        memset(&config, 0, sizeof(config));
+        config.baud_rate = baud;
+        config.data_bits = UART_DATA_8_BITS;
+        config.parity = UART_PARITY_DISABLE;
+        config.stop_bits = UART_STOP_BITS_1;
+        config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+        uart_param_config((uart_port_t)this->_port, &config);
+        uart_set_pin((uart_port_t)this->_port, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+        this->_queue = NULL;
+        this->_open = uart_driver_install((uart_port_t)this->_port, rxBuffer, 0, eventQueue,
+                                          eventQueue > 0 ? (QueueHandle_t *)&this->_queue : NULL, 0) == ESP_OK;
+        if (this->_open)
+        {
+            // The interrupts the driver enables, with the thresholds set rather than left at its defaults
+            uart_intr_config_t interrupts;
+            memset(&interrupts, 0, sizeof(interrupts));
+            interrupts.intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M |
+                                          UART_FRM_ERR_INT_ENA_M | UART_RXFIFO_OVF_INT_ENA_M |
+                                          UART_BRK_DET_INT_ENA_M | UART_PARITY_ERR_INT_ENA_M;
+            interrupts.rxfifo_full_thresh = eventSize < HAL_UART_EVENT_SIZE ? eventSize : HAL_UART_EVENT_SIZE;
+            interrupts.rx_timeout_thresh = HAL_UART_IDLE_BYTES;
+            interrupts.txfifo_empty_intr_thresh = 10;
+            uart_intr_config((uart_port_t)this->_port, &interrupts);
+        }
+        return this->_open;
+    }
+
+    /**
+     * Remove the UART driver, the event queue goes with it
+     */
+    void Uart::close()
+    {
+        if (this->_open)
+        {
+            uart_driver_delete((uart_port_t)this->_port);
+            this->_open = false;
+            this->_queue = NULL;
+        }
+    }
+
+    /**
+     * Is the driver installed
+     *
+     * @return True if it can be read
+     */
+    bool Uart::isOpen()
+    {
+        return this->_open;
+    }
+
+    /**
+     * Change the baud rate
+     *
+     * @param baud The new baud rate
+     * @return True if it was changed
+     */
+    bool Uart::setBaud(uint32_t baud)
+    {
+        return this->_open && uart_set_baudrate((uart_port_t)this->_port, baud) == ESP_OK;
+    }
+
+    /**
+     * Wait on the driver's event queue
+     *
+     * @param size Set to the bytes waiting for a data event
+     * @param timeoutMs The most milliseconds to wait
+     * @return The event
+     */
+    HalUartEvent Uart::wait(size_t *size, uint32_t timeoutMs)
+    {
+        *size = 0;
+        uart_event_t event;
+        if (this->_queue == NULL || xQueueReceive((QueueHandle_t)this->_queue, &event, halTicks(timeoutMs)) != pdTRUE)
+        {
+            return HAL_UART_TIMEOUT;
+        }
+        switch (event.type)
+        {
+        case UART_DATA:
+            *size = event.size;
+            return HAL_UART_DATA;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            return HAL_UART_OVERFLOW;
+        default:
+            return HAL_UART_OTHER;
+        }
+    }
+
+    /**
+     * Read what has been received
+     *
+     * @param data Where it is read to
+     * @param size The most bytes to read
+     * @param timeoutMs The most milliseconds to wait for the bytes
+     * @return The bytes read, -1 if the UART is not open
+     */
+    int Uart::read(uint8_t *data, size_t size, uint32_t timeoutMs)
+    {
+        if (!this->_open)
+        {
+            return -1;
+        }
+        return uart_read_bytes((uart_port_t)this->_port, data, size, pdMS_TO_TICKS(timeoutMs));
+    }
+
+    /**
+     * Queue bytes to be sent
+     *
+     * @param data What is sent
+     * @param size The size of the data
+     * @return The bytes queued, -1 if the UART is not open
+     */
+    int Uart::write(const uint8_t *data, size_t size)
+    {
+        if (!this->_open)
+        {
+            return -1;
+        }
+        return uart_write_bytes((uart_port_t)this->_port, (const char *)data, size);
+    }
+
+    /**
+     * Wait for the bytes queued to be sent
+     *
+     * @param timeoutMs The most milliseconds to wait
+     * @return True when they have been sent
+     */
+    bool Uart::waitSent(uint32_t timeoutMs)
+    {
+        return this->_open && uart_wait_tx_done((uart_port_t)this->_port, pdMS_TO_TICKS(timeoutMs)) == ESP_OK;
+    }
+
+    /**
+     * Throw away what has been received, and the events for it
+     */
+    void Uart::flushInput()
+    {
+        if (this->_open)
+        {
+            uart_flush_input((uart_port_t)this->_port);
+            if (this->_queue != NULL)
+            {
+                xQueueReset((QueueHandle_t)this->_queue);
+            }
+        }
+    }
+
+    /**
+     * Set up the RMT channel to capture the pin, the pin is open drain so the start signal can be driven on the
+     * same pin the RMT is watching
+     *
+     * @param pin The GPIO number
+     * @param idleUs No edge for this long ends a capture
+     * @return True if the RMT driver was installed
+     */
+    bool PulseCapture::open(int8_t pin, uint16_t idleUs)
+    {
+        this->close();
+        rmt_config_t config;
+        memset(&config, 0, sizeof(config));
+        config.rmt_mode = RMT_MODE_RX;
+        config.channel = (rmt_channel_t)this->_channel;
+        config.gpio_num = (gpio_num_t)pin;
+        config.clk_div = 80;    // 1 us ticks from the 80 MHz APB clock
+        config.mem_block_num = 1;
+        config.rx_config.filter_en = true;
+        config.rx_config.filter_ticks_thresh = 100;    // Ignore glitches shorter than 1.25 us
+        config.rx_config.idle_threshold = idleUs;
+        if (rmt_config(&config) != ESP_OK ||
+            rmt_driver_install((rmt_channel_t)this->_channel, HAL_RMT_BUFFER_SIZE, 0) != ESP_OK)
+        {
+            return false;
+        }
+        rmt_get_ringbuf_handle((rmt_channel_t)this->_channel, (RingbufHandle_t *)&this->_handle);
+        gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT_OD);
+        gpio_set_pull_mode((gpio_num_t)pin, GPIO_PULLUP_ONLY);
+        gpio_set_level((gpio_num_t)pin, 1);
+        this->_pin = pin;
+        return true;
+    }
+
+    /**
+     * Release the RMT channel
+     */
+    void PulseCapture::close()
+    {
+        if (this->_handle != NULL)
+        {
+            rmt_driver_uninstall((rmt_channel_t)this->_channel);
+            this->_handle = NULL;
+        }
+        this->_pin = -1;
+    }
+
+    /**
+     * Is the RMT channel installed
+     *
+     * @return True if it can capture
+     */
+    bool PulseCapture::isOpen()
+    {
+        return this->_handle != NULL;
+    }
+
+    /**
+     * Pull the pin low for the start signal, then capture the pulses until the line goes idle.  The task sleeps
+     * for the start signal and blocks on the RMT ring buffer, so nothing busy waits.
+     *
+     * @param startMs How long the pin is held low
+     * @param timeoutMs The most milliseconds to wait for the answer
+     * @param pulses Where the pulses are put
+     * @param size The most pulses
+     * @return The number of pulses, 0 if nothing answered
+     */
+    size_t PulseCapture::capture(uint32_t startMs, uint32_t timeoutMs, Pulse *pulses, size_t size)
+    {
+        if (this->_handle == NULL)
+        {
+            return 0;
+        }
+        RingbufHandle_t ringBuffer = (RingbufHandle_t)this->_handle;
+        size_t length;
+        void *stale;
+        // Anything left from a capture that timed out would be taken as this one's answer
+        while ((stale = xRingbufferReceive(ringBuffer, &length, 0)) != NULL)
+        {
+            vRingbufferReturnItem(ringBuffer, stale);
+        }
+        gpio_set_level((gpio_num_t)this->_pin, 0);
+        vTaskDelay(pdMS_TO_TICKS(startMs));
+        rmt_rx_start((rmt_channel_t)this->_channel, true);
+        gpio_set_level((gpio_num_t)this->_pin, 1);
+        auto items = (rmt_item32_t *)xRingbufferReceive(ringBuffer, &length, pdMS_TO_TICKS(timeoutMs));
+        rmt_rx_stop((rmt_channel_t)this->_channel);
+        if (items == NULL)
+        {
+            return 0;
+        }
+        size_t count = 0;
+        for (size_t i = 0; i < length / sizeof(rmt_item32_t) && count + 2 <= size; i++)
+        {
+            // A zero duration marks the end of the capture, the line went idle
+            if (items[i].duration0 == 0)
+            {
+                break;
+            }
+            pulses[count].level = items[i].level0;
+            pulses[count++].duration = items[i].duration0;
+            if (items[i].duration1 == 0)
+            {
+                break;
+            }
+            pulses[count].level = items[i].level1;
+            pulses[count++].duration = items[i].duration1;
+        }
+        vRingbufferReturnItem(ringBuffer, items);
+        return count;
+    }
+
+    /**
+     * Set a pin as an input or output
+     *
+     * @param pin The GPIO number
+     * @param output True for an output
+     */
+    void pinMode(uint8_t pin, bool output)
+    {
+        ::pinMode(pin, output ? OUTPUT : INPUT);
+    }
+
+    /**
+     * Set an output pin
+     *
+     * @param pin The GPIO number
+     * @param high True to set it high
+     */
+    void digitalWrite(uint8_t pin, bool high)
+    {
+        ::digitalWrite(pin, high ? HIGH : LOW);
+    }
+
+    /**
+     * Read an input pin
+     *
+     * @param pin The GPIO number
+     * @return True if it is high
+     */
+    bool digitalRead(uint8_t pin)
+    {
+        return ::digitalRead(pin) == HIGH;
+    }
+
+    /**
+     * Set the PWM duty of a pin, a LEDC channel is given to the pin the first time
+     *
+     * @param pin The GPIO number
+     * @param value The duty, 0 is off and 255 is always on
+     */
+    void pwmWrite(uint8_t pin, uint8_t value)
+    {
+        analogWrite(pin, value);
+    }
+
+    /**
+     * Start the OLED screen with the 6x10 font, the driver is made on the first call
+     *
+     * @param clockPin The SPI clock
+     * @param dataPin The SPI data
+     * @param csPin The chip select
+     * @param resetPin The reset
+     */
+    void displayBegin(uint8_t clockPin, uint8_t dataPin, uint8_t csPin, uint8_t resetPin)
+    {
+        if (_halDisplay == NULL)
+        {
+            _halDisplay = new U8G2_SSD1327_MIDAS_128X128_F_3W_SW_SPI(U8G2_R0, clockPin, dataPin, csPin, resetPin);
+        }
+        _halDisplay->begin();
+        _halDisplay->setFont(u8g2_font_6x10_tr);
+        _halDisplay->setFontRefHeightExtendedText();
+        _halDisplay->setFontPosTop();
+        _halDisplay->setFontDirection(0);
+        _halDisplay->clearBuffer();
+    }
+
+    /**
+     * Clear the screen buffer, the screen changes on the next displaySend
+     */
+    void displayClear()
+    {
+        _halDisplay->clearBuffer();
+    }
+
+    /**
+     * Clear an area of the screen buffer
+     *
+     * @param x The left of the area in pixels
+     * @param y The top of the area in pixels
+     * @param width The width in pixels
+     * @param height The height in pixels
+     */
+    void displayErase(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+    {
+        _halDisplay->setDrawColor(0);
+        _halDisplay->drawBox(x, y, width, height);
+        _halDisplay->setDrawColor(1);
+    }
+
+    /**
+     * Draw text in the screen buffer
+     *
+     * @param x The left of the text in pixels
+     * @param y The top of the text in pixels
+     * @param text The text
+     */
+    void displayText(uint16_t x, uint16_t y, const char *text)
+    {
+        _halDisplay->setDrawColor(1);
+        _halDisplay->drawStr(x, y, text);
+    }
+
+    /**
+     * Get the width of text in the font
+     *
+     * @param text The text
+     * @return The width in pixels
+     */
+    uint16_t displayTextWidth(const char *text)
+    {
+        return _halDisplay->getStrWidth(text);
+    }
+
+    /**
+     * Send the screen buffer to the screen
+     */
+    void displaySend()
+    {
+        _halDisplay->sendBuffer();
+    }
+
+    /**
+     * Start the WiFi with the credentials kept by the WiFi driver
+     */
+    void networkBegin()
+    {
+        WiFi.begin();
+    }
+
+    /**
+     * Connect again to the station that was lost
+     */
+    void networkReconnect()
+    {
+        WiFi.reconnect();
+    }
+
+    /**
+     * Tell the handler about the station and WPS events from now on
+     *
+     * @param handler The handler, it runs in the WiFi event task
+     */
+    void networkEvents(NetworkHandler handler)
+    {
+        _halNetworkHandler = handler;
+        WiFi.onEvent(halNetworkEvent);
+    }
+
+    /**
+     * Is the WiFi connected
+     *
+     * @return True if packets can be sent
+     */
+    bool networkUp()
+    {
+        return WiFi.status() == WL_CONNECTED;
+    }
+
+    /**
+     * Get the SSID
+     *
+     * @param buffer Where the SSID is written
+     * @param size The size of the buffer
+     * @return The length of the SSID
+     */
+    size_t networkName(char *buffer, size_t size)
+    {
+        snprintf(buffer, size, "%s", WiFi.SSID().c_str());
+        return strlen(buffer);
+    }
+
+    /**
+     * Get the IP address
+     *
+     * @param buffer Where the dotted address is written
+     * @param size The size of the buffer
+     * @return The length of the address
+     */
+    size_t networkAddress(char *buffer, size_t size)
+    {
+        snprintf(buffer, size, "%s", WiFi.localIP().toString().c_str());
+        return strlen(buffer);
+    }
+
+    /**
+     * Get the signal strength
+     *
+     * @return The RSSI in dBm
+     */
+    int8_t networkSignal()
+    {
+        return WiFi.RSSI();
+    }
+
+    /**
+     * Switch to station mode and start WPS push button, the events say how it went
+     *
+     * @param manufacturer The WPS factory information
+     * @param model The model number
+     * @param name The model name
+     * @param device The device name
+     * @return True if WPS was started
+     */
+    bool wpsStart(const char *manufacturer, const char *model, const char *name, const char *device)
+    {
+        WiFi.mode(WIFI_MODE_STA);
+        memset(&_halWps, 0, sizeof(_halWps));
+        _halWps.crypto_funcs = &g_wifi_default_wps_crypto_funcs;
+        _halWps.wps_type = WPS_TYPE_PBC;
+        strncpy(_halWps.factory_info.manufacturer, manufacturer, sizeof(_halWps.factory_info.manufacturer) - 1);
+        strncpy(_halWps.factory_info.model_number, model, sizeof(_halWps.factory_info.model_number) - 1);
+        strncpy(_halWps.factory_info.model_name, name, sizeof(_halWps.factory_info.model_name) - 1);
+        strncpy(_halWps.factory_info.device_name, device, sizeof(_halWps.factory_info.device_name) - 1);
+        return esp_wifi_wps_enable(&_halWps) == ESP_OK && esp_wifi_wps_start(0) == ESP_OK;
+    }
+
+    /**
+     * Stop WPS
+     */
+    void wpsStop()
+    {
+        esp_wifi_wps_disable();
+    }
+
+    /**
+     * Send a UDP datagram
+     *
+     * @param host The host name or address
+     * @param port The port
+     * @param data The datagram
+     * @param length The size of the datagram
+     * @return True if it was sent
+     */
+    bool udpSend(const char *host, uint16_t port, const uint8_t *data, size_t length)
+    {
+        if (!_halUdp.beginPacket(host, port))
+        {
+            return false;
+        }
+        _halUdp.write(data, length);
+        return _halUdp.endPacket() == 1;
+    }
+
+    /**
+     * Start the NTP client
+     *
+     * @param server The NTP server
+     */
+    void timeBegin(const char *server)
+    {
+        if (_halNtp == NULL)
+        {
+            _halNtp = new NTPClient(_halNtpUdp, server);
+        }
+        _halNtp->begin();
+        _halNtp->update();
+    }
+
+    /**
+     * Ask the NTP server for the time, it is only asked once a minute
+     *
+     * @return True if the time has been set
+     */
+    bool timeUpdate()
+    {
+        return _halNtp != NULL && _halNtp->update();
+    }
+
+    /**
+     * Get the time of day
+     *
+     * @return The seconds since 1970, the seconds since boot until NTP has answered
+     */
+    uint32_t epoch()
+    {
+        return _halNtp != NULL ? _halNtp->getEpochTime() : millis() / 1000;
+    }
+
+    /**
+     * Get the id of the chip
+     *
+     * @return The factory MAC address
+     */
+    uint64_t chipId()
+    {
+        return ESP.getEfuseMac();
+    }
+
+    /**
+     * Get why the chip last reset
+     *
+     * @return The reason
+     */
+    HalResetReason resetReason()
+    {
+        switch (esp_reset_reason())
+        {
+        case ESP_RST_POWERON:
+            return HAL_RESET_POWERON;
+        case ESP_RST_EXT:
+            return HAL_RESET_EXTERNAL;
+        case ESP_RST_SW:
+            return HAL_RESET_SOFTWARE;
+        case ESP_RST_PANIC:
+            return HAL_RESET_PANIC;
+        case ESP_RST_INT_WDT:
+            return HAL_RESET_INT_WDT;
+        case ESP_RST_TASK_WDT:
+            return HAL_RESET_TASK_WDT;
+        case ESP_RST_WDT:
+            return HAL_RESET_WDT;
+        case ESP_RST_DEEPSLEEP:
+            return HAL_RESET_DEEPSLEEP;
+        case ESP_RST_BROWNOUT:
+            return HAL_RESET_BROWNOUT;
+        default:
+            return HAL_RESET_UNKNOWN;
+        }
+    }
+
+    /**
+     * Get what woke the chip from deep sleep
+     *
+     * @return The cause, HAL_WAKEUP_UNDEFINED after a power on or reset
+     */
+    HalWakeupCause wakeupCause()
+    {
+        switch (esp_sleep_get_wakeup_cause())
+        {
+        case ESP_SLEEP_WAKEUP_EXT0:
+            return HAL_WAKEUP_EXT0;
+        case ESP_SLEEP_WAKEUP_EXT1:
+            return HAL_WAKEUP_EXT1;
+        case ESP_SLEEP_WAKEUP_TIMER:
+            return HAL_WAKEUP_TIMER;
+        case ESP_SLEEP_WAKEUP_TOUCHPAD:
+            return HAL_WAKEUP_TOUCHPAD;
+        case ESP_SLEEP_WAKEUP_ULP:
+            return HAL_WAKEUP_ULP;
+        default:
+            return HAL_WAKEUP_UNDEFINED;
+        }
+    }
+
+    /**
+     * Check every heap for corruption, what is wrong is printed
+     *
+     * @return True if the heaps are sound
+     */
+    bool heapCheck()
+    {
+        return heap_caps_check_integrity_all(true);
+    }
+
+    /**
+     * Get the free heap
+     *
+     * @return The bytes
+     */
+    uint32_t freeHeap()
+    {
+        return xPortGetFreeHeapSize();
+    }
+
+    /**
+     * Work out a CRC-8 with the ROM function
+     *
+     * @param crc The CRC so far, 0 to start
+     * @param data The bytes to add
+     * @param length The number of bytes
+     * @return The new CRC
+     */
+    uint8_t crc8(uint8_t crc, const uint8_t *data, size_t length)
+    {
+        return crc8_le(crc, data, length);
+    }
+
+    /**
+     * Work out a CRC-16 with the ROM function
+     *
+     * @param crc The CRC so far, 0 to start
+     * @param data The bytes to add
+     * @param length The number of bytes
+     * @return The new CRC
+     */
+    uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length)
+    {
+        return crc16_le(crc, data, length);
+    }
+
+    /**
+     * Work out a CRC-32 with the ROM function
+     *
+     * @param crc The CRC so far, 0 to start
+     * @param data The bytes to add
+     * @param length The number of bytes
+     * @return The new CRC
+     */
+    uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length)
+    {
+        return crc32_le(crc, data, length);
+    }
+
+    /**
+     * Go into deep sleep, the device restarts when the timer wakes it
+     *
+     * @param us The microseconds to sleep for
+     */
+    void deepSleep(uint64_t us)
+    {
+        esp_sleep_enable_timer_wakeup(us);
+        esp_deep_sleep_start();
+    }
+
+    /**
+     * Restart the device
+     */
+    void restart()
+    {
+        ESP.restart();
+    }
+} // namespace Hal
+
+#endif
@@ -0,0 +1,2153 @@
+#ifndef ARDUINO
+#include <errno.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "Hal.h"
+
+#define HAL_POSIX_RING_HEADER 8         // Size and padding in front of each ring buffer item, keeps them 8 byte aligned
+#define HAL_POSIX_RING_WRAP UINT32_MAX  // Size of the marker at the end of the ring buffer, the next item is at the start
+#define HAL_POSIX_UART_STEP_MS 10       // A replayed UART delivers what is due every this many milliseconds
+
+typedef struct halTaskStartStruct
+{
+    Hal::TaskFunction function;
+    void *arg;
+} HalTaskStart;
+
+static struct timespec halNow();
+
+static struct timespec _halStart = halNow();
+static uint8_t _halPins[HAL_GPIO_PINS];
+static char _halScreen[HAL_DISPLAY_HEIGHT / HAL_DISPLAY_LINE_HEIGHT][HAL_DISPLAY_WIDTH / HAL_DISPLAY_CHAR_WIDTH + 1];
+static int _halUdp = -1;
+
+/**
+ * Read the monotonic clock
+ *
+ * @return The time now
+ */
+static struct timespec halNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+/**
+ * Build the host path of a file, the SPIFFS path is put under HAL_ROOT
+ *
+ * @param path The SPIFFS path
+ * @param buffer Where the host path is written
+ * @param size The size of the buffer
+ * @return The buffer
+ */
+static const char *halPath(const char *path, char *buffer, size_t size)
+{
+    const char *root = getenv("HAL_ROOT");
+    snprintf(buffer, size, "%s/%s", root != NULL ? root : HAL_POSIX_ROOT, path[0] == '/' ? path + 1 : path);
+    return buffer;
+}
+
+/**
+ * Should the simulated hardware be traced to stderr
+ *
+ * @return True if HAL_TRACE is set
+ */
+static bool halTrace()
+{
+    return getenv("HAL_TRACE") != NULL;
+}
+
+/**
+ * The pthread entry point, it runs the task function
+ *
+ * @param arg The HalTaskStart, it is freed here
+ * @return Nothing
+ */
+static void *halTask(void *arg)
+{
+    HalTaskStart start = *(HalTaskStart *)arg;
+    free(arg);
+    start.function(start.arg);
+    return NULL;
+}
+
+/**
+ * Get the termios speed for a baud rate
+ *
+ * @param baud The baud rate
+ * @return The speed, B0 if it is not supported
+ */
+static speed_t halSpeed(uint32_t baud)
+{
+    switch (baud)
+    {
+    case 4800:
+        return B4800;
+    case 9600:
+        return B9600;
+    case 19200:
+        return B19200;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+    }
+    return B0;
+}
+
+/**
+ * Read an environment variable as a number
+ *
+ * @param name The variable
+ * @param fallback The value if it is not set
+ * @return The value
+ */
+static double halNumber(const char *name, double fallback)
+{
+    const char *value = getenv(name);
+    return value != NULL ? atof(value) : fallback;
+}
+
+/**
+ * Wait on a condition variable, the mutex must be held
+ *
+ * @param cond The condition variable
+ * @param mutex The mutex it is used with
+ * @param timeoutMs The most milliseconds to wait, HAL_WAIT_FOREVER to wait until it is signalled
+ * @return False if the wait timed out
+ */
+static bool halWait(pthread_cond_t *cond, pthread_mutex_t *mutex, uint32_t timeoutMs)
+{
+    if (timeoutMs == HAL_WAIT_FOREVER)
+    {
+        return pthread_cond_wait(cond, mutex) == 0;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(cond, mutex, &deadline) != ETIMEDOUT;
+}
+
+/**
+ * Start a condition variable and its mutex
+ *
+ * @param cond The condition variable
+ * @param mutex The mutex
+ */
+static void halInitWait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+    pthread_cond_init(cond, NULL);
+}
+
+/**
+ * Round a ring buffer item up to the 8 byte alignment
+ *
+ * @param size The size of the item
+ * @return The bytes it takes with its header
+ */
+static size_t halRingSpace(size_t size)
+{
+    return HAL_POSIX_RING_HEADER + ((size + 7) & ~(size_t)7);
+}
+
+/**
+ * Work out a reflected CRC a bit at a time, the value is inverted before and after like the ESP32 ROM functions
+ *
+ * @param crc The CRC so far
+ * @param poly The reflected polynomial
+ * @param mask The bits of the CRC
+ * @param data The bytes to add
+ * @param length The number of bytes
+ * @return The new CRC
+ */
+static uint32_t halCrc(uint32_t crc, uint32_t poly, uint32_t mask, const uint8_t *data, size_t length)
+{
+    crc = ~crc & mask;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+        }
+    }
+    return ~crc & mask;
+}
+
+namespace Hal
+{
+    /**
+     * Get the milliseconds since the program started
+     *
+     * @return The milliseconds, wraps after 49 days
+     */
+    uint32_t millis()
+    {
+        return (uint32_t)(micros() / 1000);
+    }
+
+    /**
+     * Get the microseconds since the program started
+     *
+     * @return The monotonic clock time
+     */
+    int64_t micros()
+    {
+        struct timespec now = halNow();
+        return (int64_t)(now.tv_sec - _halStart.tv_sec) * 1000000LL + (now.tv_nsec - _halStart.tv_nsec) / 1000;
+    }
+
+    /**
+     * Block the calling thread
+     *
+     * @param ms The milliseconds to wait
+     */
+    void delay(uint32_t ms)
+    {
+        struct timespec wait = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+        while (nanosleep(&wait, &wait) != 0 && errno == EINTR)
+        {
+        }
+    }
+
+    /**
+     * Start a detached thread.  The FreeRTOS stack sizes are too small for the host so the default stack is
+     * used, the priority and core are ignored.
+     *
+     * @param function The task function, the thread ends when it returns
+     * @param name The thread name, shown by top and the debuggers
+     * @param stack Not used
+     * @param arg Passed to the function
+     * @param priority Not used
+     * @param core Not used
+     * @param handle Set to the thread, if not NULL
+     * @return True if the thread was started
+     */
+    bool startTask(TaskFunction function, const char *name, uint32_t stack, void *arg, uint8_t priority, int8_t core,
+                   Task *handle)
+    {
+        HalTaskStart *start = (HalTaskStart *)malloc(sizeof(HalTaskStart));
+        if (start == NULL)
+        {
+            return false;
+        }
+        start->function = function;
+        start->arg = arg;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, halTask, start) != 0)
+        {
+            free(start);
+            return false;
+        }
+#ifdef __linux__
+        char shortName[16];
+        snprintf(shortName, sizeof(shortName), "%s", name);
+        pthread_setname_np(thread, shortName);
+#endif
+        pthread_detach(thread);
+        if (handle != NULL)
+        {
+            *handle = (Task)(uintptr_t)thread;
+        }
+        return true;
+    }
+
+    /**
+     * Get the thread that is running
+     *
+     * @return The thread, as startTask gives it
+     */
+    Task currentTask()
+    {
+        return (Task)(uintptr_t)pthread_self();
+    }
+
+    /**
+     * Get the core the thread is running on, the host CPUs are folded onto the HAL_CORES cores
+     *
+     * @return The core
+     */
+    uint8_t coreId()
+    {
+#ifdef __linux__
+        int cpu = sched_getcpu();
+        return cpu > 0 ? cpu % HAL_CORES : 0;
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Get the stack the thread has left.  There is no high water mark on the host, so it is the stack below
+     * the caller.
+     *
+     * @return The bytes left, 0 if it cannot be found
+     */
+    uint32_t stackFree()
+    {
+#ifdef __linux__
+        pthread_attr_t attr;
+        void *base;
+        size_t size;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0)
+        {
+            return 0;
+        }
+        pthread_attr_getstack(&attr, &base, &size);
+        pthread_attr_destroy(&attr);
+        uint8_t here;
+        return (uint32_t)(&here - (uint8_t *)base);
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Class Constructor, the mutex is created free
+     */
+    Mutex::Mutex()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&this->_handle, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    /**
+     * Take the mutex.  macOS has no timed lock, so there it is polled every millisecond.
+     *
+     * @param timeoutMs The most milliseconds to wait, 0 to not wait and HAL_WAIT_FOREVER to wait until it is free
+     * @return True if it was taken
+     */
+    bool Mutex::take(uint32_t timeoutMs)
+    {
+        if (timeoutMs == HAL_WAIT_FOREVER)
+        {
+            return pthread_mutex_lock(&this->_handle) == 0;
+        }
+        if (pthread_mutex_trylock(&this->_handle) == 0)
+        {
+            return true;
+        }
+#ifdef __linux__
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        return pthread_mutex_timedlock(&this->_handle, &deadline) == 0;
+#else
+        for (uint32_t waited = 0; waited < timeoutMs; waited++)
+        {
+            delay(1);
+            if (pthread_mutex_trylock(&this->_handle) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+#endif
+    }
+
+    /**
+     * Give the mutex back
+     */
+    void Mutex::give()
+    {
+        pthread_mutex_unlock(&this->_handle);
+    }
+
+
+    /**
+     * Class Constructor, nothing has been given
+     */
+    Signal::Signal() : _given(false)
+    {
+        halInitWait(&this->_cond, &this->_mutex);
+    }
+
+    /**
+     * Wake the waiting thread, or the next one to take if none is waiting
+     */
+    void Signal::give()
+    {
+        pthread_mutex_lock(&this->_mutex);
+        this->_given = true;
+        pthread_cond_signal(&this->_cond);
+        pthread_mutex_unlock(&this->_mutex);
+    }
+
+    /**
+     * Wait for a give
+     *
+     * @param timeoutMs The most milliseconds to wait, 0 to not wait and HAL_WAIT_FOREVER to wait until it is given
+     * @return True if it was given
+     */
+    bool Signal::take(uint32_t timeoutMs)
+    {
+        pthread_mutex_lock(&this->_mutex);
+        while (!this->_given && timeoutMs > 0 && halWait(&this->_cond, &this->_mutex, timeoutMs))
+        {
+        }
+        bool given = this->_given;
+        this->_given = false;
+        pthread_mutex_unlock(&this->_mutex);
+        return given;
+    }
+
+    /**
+     * Class Constructor
+     *
+     * @param itemSize The bytes in each item
+     * @param length The most items it holds
+     */
+    Queue::Queue(size_t itemSize, size_t length)
+        : _items((uint8_t *)malloc(itemSize * length)), _itemSize(itemSize), _length(length), _head(0), _count(0)
+    {
+        halInitWait(&this->_cond, &this->_mutex);
+    }
+
+    /**
+     * Class Destructor
+     */
+    Queue::~Queue()
+    {
+        free(this->_items);
+    }
+
+    /**
+     * Add an item to the back of the queue
+     *
+     * @param item The item, itemSize bytes are copied
+     * @param timeoutMs The most milliseconds to wait for room
+     * @return True if it was added
+     */
+    bool Queue::send(const void *item, uint32_t timeoutMs)
+    {
+        pthread_mutex_lock(&this->_mutex);
+        while (this->_count == this->_length && timeoutMs > 0 && halWait(&this->_cond, &this->_mutex, timeoutMs))
+        {
+        }
+        bool sent = this->_count < this->_length;
+        if (sent)
+        {
+            memcpy(&this->_items[((this->_head + this->_count) % this->_length) * this->_itemSize], item, this->_itemSize);
+            this->_count++;
+            pthread_cond_broadcast(&this->_cond);
+        }
+        pthread_mutex_unlock(&this->_mutex);
+        return sent;
+    }
+
+    /**
+     * Take the item at the front of the queue
+     *
+     * @param item Where the item is copied to
+     * @param timeoutMs The most milliseconds to wait for an item
+     * @return True if an item was taken
+     */
+    bool Queue::receive(void *item, uint32_t timeoutMs)
+    {
+        pthread_mutex_lock(&this->_mutex);
+        while (this->_count == 0 && timeoutMs > 0 && halWait(&this->_cond, &this->_mutex, timeoutMs))
+        {
+        }
+        bool received = this->_count > 0;
+        if (received)
+        {
+            memcpy(item, &this->_items[this->_head * this->_itemSize], this->_itemSize);
+            this->_head = (this->_head + 1) % this->_length;
+            this->_count--;
+            pthread_cond_broadcast(&this->_cond);
+        }
+        pthread_mutex_unlock(&this->_mutex);
+        return received;
+    }
+
+    /**
+     * Empty the queue
+     */
+    void Queue::reset()
+    {
+        pthread_mutex_lock(&this->_mutex);
+        this->_count = 0;
+        pthread_cond_broadcast(&this->_cond);
+        pthread_mutex_unlock(&this->_mutex);
+    }
+
+    /**
+     * Class Constructor
+     *
+     * @param size The bytes the buffer holds, each item takes HAL_POSIX_RING_HEADER more than its size
+     */
+    RingBuffer::RingBuffer(size_t size)
+        : _buffer((uint8_t *)malloc(size)), _size(size & ~(size_t)7), _write(0), _read(0), _next(0), _used(0), _items(0)
+    {
+        halInitWait(&this->_cond, &this->_mutex);
+    }
+
+    /**
+     * Class Destructor
+     */
+    RingBuffer::~RingBuffer()
+    {
+        free(this->_buffer);
+    }
+
+    /**
+     * Copy an item into the buffer, an item that does not fit before the end goes at the start
+     *
+     * @param item The item
+     * @param size The size of the item
+     * @param timeoutMs The most milliseconds to wait for room
+     * @return True if it was added
+     */
+    bool RingBuffer::send(const void *item, size_t size, uint32_t timeoutMs)
+    {
+        size_t space = halRingSpace(size);
+        pthread_mutex_lock(&this->_mutex);
+        for (;;)
+        {
+            // The end of the buffer is wasted when the item does not fit there
+            size_t tail = this->_write + space > this->_size ? this->_size - this->_write : 0;
+            if (this->_used + tail + space <= this->_size)
+            {
+                if (tail >= HAL_POSIX_RING_HEADER)
+                {
+                    *(uint32_t *)&this->_buffer[this->_write] = HAL_POSIX_RING_WRAP;
+                }
+                this->_used += tail;
+                this->_write = tail > 0 ? 0 : this->_write;
+                break;
+            }
+            if (timeoutMs == 0 || space > this->_size || !halWait(&this->_cond, &this->_mutex, timeoutMs))
+            {
+                pthread_mutex_unlock(&this->_mutex);
+                return false;
+            }
+        }
+        *(uint32_t *)&this->_buffer[this->_write] = (uint32_t)size;
+        memcpy(&this->_buffer[this->_write + HAL_POSIX_RING_HEADER], item, size);
+        this->_write = (this->_write + space) % this->_size;
+        this->_used += space;
+        this->_items++;
+        pthread_cond_broadcast(&this->_cond);
+        pthread_mutex_unlock(&this->_mutex);
+        return true;
+    }
+
+    /**
+     * Get the next item, it stays in the buffer until it is returned
+     *
+     * @param size Set to the size of the item
+     * @param timeoutMs The most milliseconds to wait for an item
+     * @return The item, NULL if there is none
+     */
+    void *RingBuffer::receive(size_t *size, uint32_t timeoutMs)
+    {
+        pthread_mutex_lock(&this->_mutex);
+        while (this->_items == 0 && timeoutMs > 0 && halWait(&this->_cond, &this->_mutex, timeoutMs))
+        {
+        }
+        if (this->_items == 0)
+        {
+            pthread_mutex_unlock(&this->_mutex);
+            return NULL;
+        }
+        if (this->_size - this->_next < HAL_POSIX_RING_HEADER ||
+            *(uint32_t *)&this->_buffer[this->_next] == HAL_POSIX_RING_WRAP)
+        {
+            this->_next = 0;
+        }
+        *size = *(uint32_t *)&this->_buffer[this->_next];
+        void *item = &this->_buffer[this->_next + HAL_POSIX_RING_HEADER];
+        this->_next = (this->_next + halRingSpace(*size)) % this->_size;
+        this->_items--;
+        pthread_mutex_unlock(&this->_mutex);
+        return item;
+    }
+
+    /**
+     * Give the space of an item back, the items must be returned in the order they were received
+     *
+     * @param item The item from receive
+     */
+    void RingBuffer::returnItem(void *item)
+    {
+        pthread_mutex_lock(&this->_mutex);
+        if (this->_size - this->_read < HAL_POSIX_RING_HEADER ||
+            *(uint32_t *)&this->_buffer[this->_read] == HAL_POSIX_RING_WRAP)
+        {
+            this->_used -= this->_size - this->_read;
+            this->_read = 0;
+        }
+        size_t space = halRingSpace(*(uint32_t *)&this->_buffer[this->_read]);
+        this->_read = (this->_read + space) % this->_size;
+        this->_used -= space;
+        pthread_cond_broadcast(&this->_cond);
+        pthread_mutex_unlock(&this->_mutex);
+    }
+
+    /**
+     * Get the number of items that have not been received
+     *
+     * @return The items
+     */
+    size_t RingBuffer::waiting()
+    {
+        pthread_mutex_lock(&this->_mutex);
+        size_t items = this->_items;
+        pthread_mutex_unlock(&this->_mutex);
+        return items;
+    }
+
+    /**
+     * Class Constructor, the timer does nothing until it is started
+     */
+    Timer::Timer() : _callback(NULL), _arg(NULL), _due(0)
+    {
+        halInitWait(&this->_cond, &this->_mutex);
+    }
+
+    /**
+     * Start the thread the callback runs on
+     *
+     * @param callback Called when the timer fires
+     * @param arg Passed to the callback
+     * @param name The thread name
+     * @return True if the thread was started
+     */
+    bool Timer::begin(TaskFunction callback, void *arg, const char *name)
+    {
+        this->_callback = callback;
+        this->_arg = arg;
+        return startTask(Timer::timerTask, name, 0, this, 0);
+    }
+
+    /**
+     * Fire the timer once, it replaces a start that has not fired yet
+     *
+     * @param us The microseconds from now
+     */
+    void Timer::startOnce(uint64_t us)
+    {
+        pthread_mutex_lock(&this->_mutex);
+        this->_due = micros() + (int64_t)us;
+        pthread_cond_signal(&this->_cond);
+        pthread_mutex_unlock(&this->_mutex);
+    }
+
+    /**
+     * Stop the timer if it has not fired
+     */
+    void Timer::stop()
+    {
+        pthread_mutex_lock(&this->_mutex);
+        this->_due = 0;
+        pthread_cond_signal(&this->_cond);
+        pthread_mutex_unlock(&this->_mutex);
+    }
+
+    /**
+     * The timer thread, it sleeps until the timer is due and then runs the callback
+     *
+     * @param arg The timer
+     */
+    void Timer::timerTask(void *arg)
+    {
+        Timer *timer = (Timer *)arg;
+        pthread_mutex_lock(&timer->_mutex);
+        for (;;)
+        {
+            int64_t wait = timer->_due - micros();
+            if (timer->_due == 0)
+            {
+                halWait(&timer->_cond, &timer->_mutex, HAL_WAIT_FOREVER);
+            }
+            else if (wait > 0)
+            {
+                halWait(&timer->_cond, &timer->_mutex, (uint32_t)((wait + 999) / 1000));
+            }
+            else
+            {
+                timer->_due = 0;
+                pthread_mutex_unlock(&timer->_mutex);
+                timer->_callback(timer->_arg);
+                pthread_mutex_lock(&timer->_mutex);
+            }
+        }
+    }
+
+    /**
+     * Create the HAL_ROOT directory the files are kept in
+     *
+     * @return True if it exists
+     */
+    bool storageBegin()
+    {
+        char path[256];
+        halPath("", path, sizeof(path));
+        return mkdir(path, 0755) == 0 || errno == EEXIST;
+    }
+
+    /**
+     * Is there a file
+     *
+     * @param path The SPIFFS path
+     * @return True if it exists
+     */
+    bool fileExists(const char *path)
+    {
+        char name[256];
+        return access(halPath(path, name, sizeof(name)), F_OK) == 0;
+    }
+
+    /**
+     * Get the size of a file
+     *
+     * @param path The SPIFFS path
+     * @return The size, 0 if it does not exist
+     */
+    size_t fileSize(const char *path)
+    {
+        char name[256];
+        struct stat info;
+        return stat(halPath(path, name, sizeof(name)), &info) == 0 ? (size_t)info.st_size : 0;
+    }
+
+    /**
+     * Read the start of a file
+     *
+     * @param path The SPIFFS path
+     * @param buffer Where the contents are read to
+     * @param size The size of the buffer
+     * @return The bytes read, 0 if it does not exist
+     */
+    size_t readFile(const char *path, uint8_t *buffer, size_t size)
+    {
+        char name[256];
+        FILE *file = fopen(halPath(path, name, sizeof(name)), "rb");
+        if (file == NULL)
+        {
+            return 0;
+        }
+        size_t length = fread(buffer, 1, size, file);
+        fclose(file);
+        return length;
+    }
+
+    /**
+     * Write or append to a file
+     *
+     * @param path The SPIFFS path
+     * @param data What is written
+     * @param length The size of the data
+     * @param append True to add to the end of the file, false to replace it
+     * @return True if all of it was written
+     */
+    bool writeFile(const char *path, const uint8_t *data, size_t length, bool append)
+    {
+        char name[256];
+        FILE *file = fopen(halPath(path, name, sizeof(name)), append ? "ab" : "wb");
+        if (file == NULL)
+        {
+            return false;
+        }
+        size_t written = fwrite(data, 1, length, file);
+        return fclose(file) == 0 && written == length;
+    }
+
+    /**
+     * Remove a file
+     *
+     * @param path The SPIFFS path
+     * @return True if it was removed
+     */
+    bool removeFile(const char *path)
+    {
+        char name[256];
+        return unlink(halPath(path, name, sizeof(name))) == 0;
+    }
+
+    /**
+     * Rename a file, like SPIFFS it will not rename over a file
+     *
+     * @param from The SPIFFS path
+     * @param to The new SPIFFS path
+     * @return True if it was renamed
+     */
+    bool renameFile(const char *from, const char *to)
+    {
+        char oldName[256];
+        char newName[256];
+        if (fileExists(to))
+        {
+            return false;
+        }
+        return rename(halPath(from, oldName, sizeof(oldName)), halPath(to, newName, sizeof(newName))) == 0;
+    }
+
+
+    /**
+     * Class Constructor, the file is not open
+     */
+    File::File() : _file(NULL)
+    {
+    }
+
+    /**
+     * Class Destructor, the file is closed
+     */
+    File::~File()
+    {
+        this->close();
+    }
+
+    /**
+     * Open a file under HAL_ROOT
+     *
+     * @param path The SPIFFS path
+     * @param mode The fopen mode
+     * @return True if it was opened
+     */
+    bool File::open(const char *path, const char *mode)
+    {
+        char name[256];
+        char binary[8];
+        this->close();
+        snprintf(binary, sizeof(binary), "%sb", mode);
+        this->_file = fopen(halPath(path, name, sizeof(name)), binary);
+        return this->_file != NULL;
+    }
+
+    /**
+     * Close the file
+     */
+    void File::close()
+    {
+        if (this->_file != NULL)
+        {
+            fclose(this->_file);
+            this->_file = NULL;
+        }
+    }
+
+    /**
+     * Is the file open
+     *
+     * @return True if it can be read or written
+     */
+    bool File::isOpen()
+    {
+        return this->_file != NULL;
+    }
+
+    /**
+     * Get the bytes from the position to the end of the file
+     *
+     * @return The bytes left to read
+     */
+    int File::available()
+    {
+        if (this->_file == NULL)
+        {
+            return 0;
+        }
+        long position = ftell(this->_file);
+        return position < 0 ? 0 : (int)(this->size() - position);
+    }
+
+    /**
+     * Read a byte
+     *
+     * @return The byte, -1 at the end of the file
+     */
+    int File::read()
+    {
+        return this->_file != NULL ? fgetc(this->_file) : -1;
+    }
+
+    /**
+     * Look at the next byte without reading it
+     *
+     * @return The byte, -1 at the end of the file
+     */
+    int File::peek()
+    {
+        int c = this->read();
+        if (c >= 0)
+        {
+            ungetc(c, this->_file);
+        }
+        return c;
+    }
+
+    /**
+     * Read bytes
+     *
+     * @param data Where they are read to
+     * @param size The most bytes to read
+     * @return The bytes read
+     */
+    size_t File::read(uint8_t *data, size_t size)
+    {
+        return this->_file != NULL ? fread(data, 1, size, this->_file) : 0;
+    }
+
+    /**
+     * Write bytes
+     *
+     * @param data What is written
+     * @param size The size of the data
+     * @return The bytes written
+     */
+    size_t File::write(const uint8_t *data, size_t size)
+    {
+        return this->_file != NULL ? fwrite(data, 1, size, this->_file) : 0;
+    }
+
+    /**
+     * Move to a position from the start of the file
+     *
+     * @param position The offset
+     * @return True if it moved
+     */
+    bool File::seek(uint32_t position)
+    {
+        return this->_file != NULL && fseek(this->_file, position, SEEK_SET) == 0;
+    }
+
+    /**
+     * Get the size of the file, a file being written is at least as long as the position
+     *
+     * @return The size
+     */
+    size_t File::size()
+    {
+        struct stat info;
+        if (this->_file == NULL || fstat(fileno(this->_file), &info) != 0)
+        {
+            return 0;
+        }
+        long position = ftell(this->_file);
+        return position > info.st_size ? (size_t)position : (size_t)info.st_size;
+    }
+
+    /**
+     * Write out what has been buffered
+     */
+    void File::flush()
+    {
+        if (this->_file != NULL)
+        {
+            fflush(this->_file);
+        }
+    }
+
+    /**
+     * Class Constructor, the partition is not open
+     */
+    Partition::Partition() : _size(0), _handle(-1)
+    {
+    }
+
+    /**
+     * Class Destructor, the partition file is closed
+     */
+    Partition::~Partition()
+    {
+        if (this->_handle >= 0)
+        {
+            close(this->_handle);
+        }
+    }
+
+    /**
+     * Open the file holding the partition, <label>.bin under HAL_ROOT.  A new file is HAL_POSIX_PARTITION_SIZE
+     * bytes of 0xFF, like erased flash.
+     *
+     * @param label The name in partitions.csv
+     * @return True if it was opened
+     */
+    bool Partition::open(const char *label)
+    {
+        char path[256];
+        char name[64];
+        snprintf(name, sizeof(name), "%s.bin", label);
+        int fd = ::open(halPath(name, path, sizeof(path)), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        this->_handle = fd;
+        this->_size = info.st_size > 0 ? (uint32_t)info.st_size : HAL_POSIX_PARTITION_SIZE;
+        if (info.st_size == 0 && !this->erase(0, this->_size))
+        {
+            ::close(fd);
+            this->_handle = -1;
+            this->_size = 0;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Has the partition been opened
+     *
+     * @return True if it can be used
+     */
+    bool Partition::isOpen()
+    {
+        return this->_handle >= 0;
+    }
+
+    /**
+     * Get the size of the partition
+     *
+     * @return The bytes, 0 if it is not open
+     */
+    uint32_t Partition::getSize()
+    {
+        return this->_size;
+    }
+
+    /**
+     * Read from the partition
+     *
+     * @param offset The offset from the start of the partition
+     * @param data Where it is read to
+     * @param size The bytes to read
+     * @return True if it was read
+     */
+    bool Partition::read(uint32_t offset, void *data, size_t size)
+    {
+        if (this->_handle < 0 || offset + size > this->_size)
+        {
+            return false;
+        }
+        return pread(this->_handle, data, size, offset) == (ssize_t)size;
+    }
+
+    /**
+     * Write to the partition, the bits are ANDed with what is there like a flash write
+     *
+     * @param offset The offset from the start of the partition
+     * @param data What is written
+     * @param size The bytes to write
+     * @return True if it was written
+     */
+    bool Partition::write(uint32_t offset, const void *data, size_t size)
+    {
+        uint8_t chunk[256];
+        const uint8_t *bytes = (const uint8_t *)data;
+        while (size > 0)
+        {
+            size_t length = size < sizeof(chunk) ? size : sizeof(chunk);
+            if (!this->read(offset, chunk, length))
+            {
+                return false;
+            }
+            for (size_t i = 0; i < length; i++)
+            {
+                chunk[i] &= bytes[i];
+            }
+            if (pwrite(this->_handle, chunk, length, offset) != (ssize_t)length)
+            {
+                return false;
+            }
+            offset += length;
+            bytes += length;
+            size -= length;
+        }
+        return true;
+    }
+
+    /**
+     * Erase part of the partition to 0xFF
+     *
+     * @param offset The offset from the start of the partition, a multiple of HAL_FLASH_SECTOR_SIZE
+     * @param size The bytes to erase, a multiple of HAL_FLASH_SECTOR_SIZE
+     * @return True if it was erased
+     */
+    bool Partition::erase(uint32_t offset, size_t size)
+    {
+        if (this->_handle < 0 || offset % HAL_FLASH_SECTOR_SIZE != 0 || size % HAL_FLASH_SECTOR_SIZE != 0 ||
+            offset + size > this->_size)
+        {
+            return false;
+        }
+        uint8_t sector[HAL_FLASH_SECTOR_SIZE];
+        memset(sector, 0xFF, sizeof(sector));
+        for (uint32_t done = 0; done < size; done += HAL_FLASH_SECTOR_SIZE)
+        {
+            if (pwrite(this->_handle, sector, sizeof(sector), offset + done) != (ssize_t)sizeof(sector))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The console is stdout, there is nothing to start
+     *
+     * @param baud Not used
+     */
+    void consoleBegin(uint32_t baud)
+    {
+    }
+
+    /**
+     * Write to stdout
+     *
+     * @param data What is written
+     * @param length The size of the data
+     * @return The bytes written
+     */
+    size_t consoleWrite(const uint8_t *data, size_t length)
+    {
+        return fwrite(data, 1, length, stdout);
+    }
+
+    /**
+     * Write text to stdout
+     *
+     * @param text The text
+     * @return The bytes written
+     */
+    size_t consolePrint(const char *text)
+    {
+        return consoleWrite((const uint8_t *)text, strlen(text));
+    }
+
+    /**
+     * Flush stdout
+     */
+    void consoleFlush()
+    {
+        fflush(stdout);
+    }
+
+    /**
+     * Class Constructor
+     *
+     * @param port The UART number, HAL_UART<port> names the file or device
+     */
+    Uart::Uart(uint8_t port)
+        : _port(port), _open(false), _fd(-1), _tty(false), _events(false), _eventSize(HAL_UART_EVENT_SIZE),
+          _baud(0), _rxBuffer(0), _fileSize(0), _speed(1), _loop(false), _corrupt(0), _drop(0), _dropMs(0),
+          _random(1), _paceStart(0), _paceBase(0), _taken(0), _dropUntil(0), _corrupted(0), _dropped(0), _overflowed(0)
+    {
+    }
+
+    /**
+     * Open the file or device named by HAL_UART<port>.  A serial device is set to 8N1 raw at the baud rate, a
+     * file is replayed from its start with the options in the HAL_UART_ variables.
+     *
+     * @param baud The baud rate
+     * @param txPin Not used
+     * @param rxPin Not used
+     * @param rxBuffer The bytes a replay can fall behind by before it overflows
+     * @param eventQueue More than 0 to wait for events
+     * @param eventSize The bytes that raise a data event, at most HAL_UART_EVENT_SIZE
+     * @return True if it was opened
+     */
+    bool Uart::open(uint32_t baud, int8_t txPin, int8_t rxPin, size_t rxBuffer, size_t eventQueue, size_t eventSize)
+    {
+        this->close();
+        char variable[16];
+        snprintf(variable, sizeof(variable), "HAL_UART%u", this->_port);
+        const char *path = getenv(variable);
+        if (path == NULL)
+        {
+            return false;
+        }
+        this->_fd = ::open(path, O_RDWR | O_NOCTTY);
+        if (this->_fd < 0)
+        {
+            // A capture file may be read only
+            this->_fd = ::open(path, O_RDONLY);
+        }
+        if (this->_fd < 0)
+        {
+            return false;
+        }
+        this->_tty = isatty(this->_fd);
+        this->_open = true;
+        this->_events = eventQueue > 0;
+        this->_eventSize = eventSize > 0 && eventSize < HAL_UART_EVENT_SIZE ? eventSize : HAL_UART_EVENT_SIZE;
+        this->_rxBuffer = rxBuffer;
+        this->_baud = baud;
+        if (this->_tty)
+        {
+            struct termios options;
+            tcgetattr(this->_fd, &options);
+            cfmakeraw(&options);
+            options.c_cflag |= CLOCAL | CREAD;
+            tcsetattr(this->_fd, TCSANOW, &options);
+            this->setBaud(baud);
+            return true;
+        }
+        struct stat info;
+        this->_fileSize = fstat(this->_fd, &info) == 0 ? info.st_size : 0;
+        this->_speed = halNumber("HAL_UART_SPEED", 1);
+        this->_loop = getenv("HAL_UART_LOOP") != NULL;
+        this->_corrupt = halNumber("HAL_UART_CORRUPT", 0);
+        this->_drop = halNumber("HAL_UART_DROP", 0);
+        this->_dropMs = (uint32_t)halNumber("HAL_UART_DROP_MS", 1000);
+        this->_random = (uint32_t)halNumber("HAL_UART_SEED", 1);
+        this->_random = this->_random != 0 ? this->_random : 1;
+        this->_paceStart = micros();
+        this->_paceBase = 0;
+        this->_taken = 0;
+        this->_dropUntil = 0;
+        this->_corrupted = 0;
+        this->_dropped = 0;
+        this->_overflowed = 0;
+        return true;
+    }
+
+    /**
+     * Close the file or device, what a replay lost is traced
+     */
+    void Uart::close()
+    {
+        if (this->_open)
+        {
+            if (!this->_tty && halTrace())
+            {
+                fprintf(stderr, "[uart%u] %llu bytes, %u corrupted, %u dropped, %u lost to overflows\n", this->_port,
+                        (unsigned long long)this->_taken, this->_corrupted, this->_dropped, this->_overflowed);
+            }
+            ::close(this->_fd);
+            this->_fd = -1;
+            this->_open = false;
+        }
+    }
+
+    /**
+     * Is the port open
+     *
+     * @return True if it can be read
+     */
+    bool Uart::isOpen()
+    {
+        return this->_open;
+    }
+
+    /**
+     * Change the baud rate, a replay carries on at the new rate from what has arrived so far
+     *
+     * @param baud The new baud rate
+     * @return True if it was changed
+     */
+    bool Uart::setBaud(uint32_t baud)
+    {
+        if (!this->_open)
+        {
+            return false;
+        }
+        if (!this->_tty)
+        {
+            this->_paceBase = this->paced();
+            this->_paceStart = micros();
+            this->_baud = baud;
+            return true;
+        }
+        speed_t speed = halSpeed(baud);
+        struct termios options;
+        if (speed == B0 || tcgetattr(this->_fd, &options) != 0)
+        {
+            return false;
+        }
+        cfsetispeed(&options, speed);
+        cfsetospeed(&options, speed);
+        return tcsetattr(this->_fd, TCSANOW, &options) == 0;
+    }
+
+    /**
+     * Wait for bytes to arrive.  A replay opened with an event queue raises a data event as the driver does,
+     * when the event size it was opened with has arrived or the line has been idle for HAL_UART_IDLE_BYTES byte
+     * times.  Zero bytes in a replay stand for the idle line: a run of HAL_UART_IDLE_BYTES of them ends an event
+     * early, and HAL_UART_EVENT_SIZE of nothing else are not received.  A replay that has fallen more than the
+     * receive buffer behind loses the oldest bytes and reports an overflow, like the driver.
+     *
+     * @param size Set to the bytes waiting for a data event
+     * @param timeoutMs The most milliseconds to wait
+     * @return The event
+     */
+    HalUartEvent Uart::wait(size_t *size, uint32_t timeoutMs)
+    {
+        *size = 0;
+        if (!this->_open)
+        {
+            return HAL_UART_END;
+        }
+        if (this->_tty)
+        {
+            struct pollfd fd = {this->_fd, POLLIN, 0};
+            if (poll(&fd, 1, timeoutMs == HAL_WAIT_FOREVER ? -1 : (int)timeoutMs) <= 0)
+            {
+                return HAL_UART_TIMEOUT;
+            }
+            int count = 0;
+            ioctl(this->_fd, FIONREAD, &count);
+            *size = count > 0 ? count : 1;
+            return HAL_UART_DATA;
+        }
+        int64_t deadline = micros() + (timeoutMs == HAL_WAIT_FOREVER ? INT32_MAX : timeoutMs) * 1000LL;
+        for (;;)
+        {
+            int64_t left = deadline - micros();
+            size_t waiting = this->due(left > 0 ? (uint32_t)((left + 999) / 1000) : 0);
+            if (waiting == 0)
+            {
+                return !this->_loop && this->_taken >= (uint64_t)this->_fileSize ? HAL_UART_END : HAL_UART_TIMEOUT;
+            }
+            if (this->_rxBuffer > 0 && waiting > this->_rxBuffer)
+            {
+                this->_overflowed += waiting - this->_rxBuffer;
+                this->skip(waiting - this->_rxBuffer);
+                return HAL_UART_OVERFLOW;
+            }
+            if (!this->_events)
+            {
+                // Without an event queue what has arrived can be read straight away
+                *size = waiting < this->_eventSize ? waiting : this->_eventSize;
+                return HAL_UART_DATA;
+            }
+            size_t leading;
+            size_t trailing;
+            this->zeros(waiting, &leading, &trailing);
+            bool ended = !this->_loop && this->_taken + waiting >= (uint64_t)this->_fileSize;
+            bool idle = leading == (waiting < HAL_UART_EVENT_SIZE ? waiting : HAL_UART_EVENT_SIZE);
+            if (idle && (waiting >= HAL_UART_EVENT_SIZE || ended))
+            {
+                // Nothing is received from an idle line, but the signal can still be lost while it is
+                size_t lost = waiting < HAL_UART_EVENT_SIZE ? waiting : HAL_UART_EVENT_SIZE;
+                for (size_t i = 0; i < lost; i++)
+                {
+                    this->dropping(this->_taken + i);
+                }
+                this->skip(lost);
+                continue;
+            }
+            if (!idle && waiting >= this->_eventSize)
+            {
+                *size = this->_eventSize;
+                return HAL_UART_DATA;
+            }
+            // The end of a file that does not loop leaves the line idle
+            if (!idle && (trailing >= HAL_UART_IDLE_BYTES || ended))
+            {
+                *size = waiting;
+                return HAL_UART_DATA;
+            }
+            left = deadline - micros();
+            if (left <= 0)
+            {
+                return HAL_UART_TIMEOUT;
+            }
+            // Sleep until the FIFO threshold or the receive timeout could be reached, or a step while idle
+            size_t need = idle ? HAL_UART_EVENT_SIZE - waiting : this->_eventSize - waiting;
+            if (!idle && HAL_UART_IDLE_BYTES - trailing < need)
+            {
+                need = HAL_UART_IDLE_BYTES - trailing;
+            }
+            int64_t us = this->_speed > 0 ? (int64_t)(need * 10000000.0 / (this->_baud * this->_speed)) : 0;
+            us = idle && us > HAL_POSIX_UART_STEP_MS * 1000 ? HAL_POSIX_UART_STEP_MS * 1000 : us;
+            delay((uint32_t)(((us < left ? us : left) + 999) / 1000));
+        }
+    }
+
+    /**
+     * Read what has arrived.  A replay gives the bytes that are due at the baud rate, with the dropouts and
+     * bit errors asked for, and returns 0 at the end of the file.
+     *
+     * @param data Where it is read to
+     * @param size The most bytes to read
+     * @param timeoutMs The most milliseconds to wait for bytes
+     * @return The bytes read, -1 if the port is not open
+     */
+    int Uart::read(uint8_t *data, size_t size, uint32_t timeoutMs)
+    {
+        if (!this->_open)
+        {
+            return -1;
+        }
+        if (this->_tty)
+        {
+            struct pollfd fd = {this->_fd, POLLIN, 0};
+            if (poll(&fd, 1, (int)timeoutMs) <= 0)
+            {
+                return 0;
+            }
+            ssize_t length = ::read(this->_fd, data, size);
+            return length < 0 ? 0 : (int)length;
+        }
+        size_t waiting = this->due(timeoutMs);
+        size = size < waiting ? size : waiting;
+        size_t got = 0;
+        while (got < size)
+        {
+            ssize_t length = ::read(this->_fd, data + got, size - got);
+            if (length == 0 && this->_loop)
+            {
+                lseek(this->_fd, 0, SEEK_SET);
+                continue;
+            }
+            if (length <= 0)
+            {
+                break;
+            }
+            got += length;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < got; i++)
+        {
+            if (this->dropping(this->_taken + i))
+            {
+                this->_dropped++;
+                continue;
+            }
+            data[kept] = data[i];
+            if (this->_corrupt > 0 && this->random() < this->_corrupt * UINT32_MAX)
+            {
+                data[kept] ^= 1 << (this->random() % 8);
+                this->_corrupted++;
+            }
+            kept++;
+        }
+        this->_taken += got;
+        return (int)kept;
+    }
+
+    /**
+     * Send bytes, what is written to a capture file is dropped
+     *
+     * @param data What is sent
+     * @param size The size of the data
+     * @return The bytes sent, -1 if the port is not open
+     */
+    int Uart::write(const uint8_t *data, size_t size)
+    {
+        if (!this->_open)
+        {
+            return -1;
+        }
+        if (!this->_tty)
+        {
+            return (int)size;
+        }
+        ssize_t length = ::write(this->_fd, data, size);
+        return length < 0 ? 0 : (int)length;
+    }
+
+    /**
+     * Wait for what has been written to be sent
+     *
+     * @param timeoutMs Not used, a serial device is drained
+     * @return True when it has been sent
+     */
+    bool Uart::waitSent(uint32_t timeoutMs)
+    {
+        return !this->_open || !this->_tty || tcdrain(this->_fd) == 0;
+    }
+
+    /**
+     * Throw away what has arrived and not been read
+     */
+    void Uart::flushInput()
+    {
+        if (!this->_open)
+        {
+            return;
+        }
+        if (this->_tty)
+        {
+            tcflush(this->_fd, TCIFLUSH);
+            return;
+        }
+        uint64_t arrived = this->paced();
+        if (!this->_loop && arrived > (uint64_t)this->_fileSize)
+        {
+            arrived = this->_fileSize;
+        }
+        if (arrived > this->_taken)
+        {
+            this->skip(arrived - this->_taken);
+        }
+    }
+
+    /**
+     * Get the bytes of a replay that have arrived since it was opened, at the baud rate times HAL_UART_SPEED
+     *
+     * @return The bytes, a speed of 0 always has a data event's worth more than has been taken
+     */
+    uint64_t Uart::paced()
+    {
+        if (this->_speed <= 0)
+        {
+            return this->_taken + this->_eventSize;
+        }
+        double seconds = (micros() - this->_paceStart) / 1000000.0;
+        return this->_paceBase + (uint64_t)(seconds * this->_speed * this->_baud / 10);
+    }
+
+    /**
+     * Wait for bytes of a replay to be due, a step at a time
+     *
+     * @param timeoutMs The most milliseconds to wait
+     * @return The bytes due, 0 at the end of the file or if none arrived in time
+     */
+    size_t Uart::due(uint32_t timeoutMs)
+    {
+        int64_t deadline = micros() + (timeoutMs == HAL_WAIT_FOREVER ? INT32_MAX : timeoutMs) * 1000LL;
+        for (;;)
+        {
+            uint64_t arrived = this->paced();
+            if (!this->_loop && arrived > (uint64_t)this->_fileSize)
+            {
+                arrived = this->_fileSize;
+            }
+            if (arrived > this->_taken)
+            {
+                return (size_t)(arrived - this->_taken);
+            }
+            int64_t left = deadline - micros();
+            if ((!this->_loop && this->_taken >= (uint64_t)this->_fileSize) || this->_fileSize == 0 || left <= 0)
+            {
+                return 0;
+            }
+            delay(left < HAL_POSIX_UART_STEP_MS * 1000 ? (uint32_t)(left + 999) / 1000 : HAL_POSIX_UART_STEP_MS);
+        }
+    }
+
+    /**
+     * Count the zero bytes at the start and the end of what has arrived in a replay.  A run of them at the end
+     * is the time the line has been idle.
+     *
+     * @param waiting The bytes that have arrived and not been taken, at most HAL_UART_EVENT_SIZE are looked at
+     * @param leading Set to the zero bytes at the start, all of those looked at if there is nothing else
+     * @param trailing Set to the zero bytes at the end
+     */
+    void Uart::zeros(size_t waiting, size_t *leading, size_t *trailing)
+    {
+        uint8_t data[HAL_UART_EVENT_SIZE];
+        waiting = waiting < sizeof(data) ? waiting : sizeof(data);
+        uint64_t position = this->_taken;
+        if (this->_loop && this->_fileSize > 0)
+        {
+            position %= this->_fileSize;
+        }
+        size_t first = position + waiting > (uint64_t)this->_fileSize ? this->_fileSize - position : waiting;
+        ssize_t got = pread(this->_fd, data, first, (off_t)position);
+        if (got == (ssize_t)first && first < waiting)
+        {
+            // A looped replay carries on from the start of the file
+            ssize_t more = pread(this->_fd, data + first, waiting - first, 0);
+            got += more > 0 ? more : 0;
+        }
+        size_t size = got > 0 ? (size_t)got : 0;
+        *leading = 0;
+        while (*leading < size && data[*leading] == 0)
+        {
+            (*leading)++;
+        }
+        *trailing = 0;
+        while (*trailing < size && data[size - 1 - *trailing] == 0)
+        {
+            (*trailing)++;
+        }
+    }
+
+    /**
+     * Lose bytes of a replay without reading them
+     *
+     * @param size The bytes to lose
+     */
+    void Uart::skip(size_t size)
+    {
+        this->_taken += size;
+        uint64_t position = this->_taken;
+        if (this->_loop && this->_fileSize > 0)
+        {
+            position %= this->_fileSize;
+        }
+        lseek(this->_fd, (off_t)position, SEEK_SET);
+    }
+
+    /**
+     * Draw the chance of a dropout starting at a byte of a replay, from the chance in each second of the stream
+     *
+     * @param position The byte's place in the stream
+     * @return True if the byte is lost to a dropout
+     */
+    bool Uart::dropping(uint64_t position)
+    {
+        if (this->_drop > 0 && position >= this->_dropUntil &&
+            this->random() < this->_drop * 10.0 / this->_baud * UINT32_MAX)
+        {
+            this->_dropUntil = position + (uint64_t)this->_dropMs * this->_baud / 10000;
+        }
+        return position < this->_dropUntil;
+    }
+
+    /**
+     * Get the next number of the replay's xorshift generator, HAL_UART_SEED picks the sequence
+     *
+     * @return The number
+     */
+    uint32_t Uart::random()
+    {
+        this->_random ^= this->_random << 13;
+        this->_random ^= this->_random >> 17;
+        this->_random ^= this->_random << 5;
+        return this->_random;
+    }
+
+    /**
+     * Open the pin, on the host HAL_PULSE<pin> names a file of the pulses each capture returns
+     *
+     * @param pin The GPIO number
+     * @param idleUs Not used
+     * @return True, a pin with no file captures nothing
+     */
+    bool PulseCapture::open(int8_t pin, uint16_t idleUs)
+    {
+        this->_pin = pin;
+        return true;
+    }
+
+    /**
+     * Close the pin
+     */
+    void PulseCapture::close()
+    {
+        this->_pin = -1;
+    }
+
+    /**
+     * Is the pin open
+     *
+     * @return True if it can capture
+     */
+    bool PulseCapture::isOpen()
+    {
+        return this->_pin >= 0;
+    }
+
+    /**
+     * Read the pulses from the HAL_PULSE<pin> file, "level duration" pairs in microseconds with # comments.
+     * Without a file the sensor does not answer, so it waits for the timeout and returns nothing.
+     *
+     * @param startMs Not used, the start signal is not simulated
+     * @param timeoutMs How long a sensor that does not answer is waited for
+     * @param pulses Where the pulses are put
+     * @param size The most pulses
+     * @return The number of pulses
+     */
+    size_t PulseCapture::capture(uint32_t startMs, uint32_t timeoutMs, Pulse *pulses, size_t size)
+    {
+        char variable[16];
+        snprintf(variable, sizeof(variable), "HAL_PULSE%d", this->_pin);
+        const char *path = getenv(variable);
+        FILE *file = path != NULL && this->_pin >= 0 ? fopen(path, "r") : NULL;
+        if (file == NULL)
+        {
+            delay(timeoutMs);
+            return 0;
+        }
+        char text[HAL_PULSE_FILE_SIZE];
+        size_t length = fread(text, 1, sizeof(text) - 1, file);
+        fclose(file);
+        text[length] = '\0';
+        size_t count = 0;
+        char *line = strtok(text, "\n");
+        for (; line != NULL && count < size; line = strtok(NULL, "\n"))
+        {
+            unsigned level;
+            unsigned duration;
+            if (line[strspn(line, " \t")] != '#' && sscanf(line, "%u %u", &level, &duration) == 2)
+            {
+                pulses[count].level = level > 0 ? 1 : 0;
+                pulses[count].duration = (uint16_t)duration;
+                count++;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Set a pin as an input or output
+     *
+     * @param pin The GPIO number
+     * @param output True for an output
+     */
+    void pinMode(uint8_t pin, bool output)
+    {
+        if (halTrace())
+        {
+            fprintf(stderr, "[gpio] %u %s\n", pin, output ? "output" : "input");
+        }
+    }
+
+    /**
+     * Set an output pin
+     *
+     * @param pin The GPIO number
+     * @param high True to set it high
+     */
+    void digitalWrite(uint8_t pin, bool high)
+    {
+        pwmWrite(pin, high ? 255 : 0);
+    }
+
+    /**
+     * Read a pin, it is what was last written
+     *
+     * @param pin The GPIO number
+     * @return True if it is high
+     */
+    bool digitalRead(uint8_t pin)
+    {
+        return pin < HAL_GPIO_PINS && _halPins[pin] > 0;
+    }
+
+    /**
+     * Set the PWM duty of a pin
+     *
+     * @param pin The GPIO number
+     * @param value The duty, 0 is off and 255 is always on
+     */
+    void pwmWrite(uint8_t pin, uint8_t value)
+    {
+        if (pin >= HAL_GPIO_PINS || _halPins[pin] == value)
+        {
+            return;
+        }
+        _halPins[pin] = value;
+        if (halTrace())
+        {
+            fprintf(stderr, "[gpio] %u = %u\n", pin, value);
+        }
+    }
+
+    /**
+     * Start the display with every character blank
+     *
+     * @param clockPin Not used
+     * @param dataPin Not used
+     * @param csPin Not used
+     * @param resetPin Not used
+     */
+    void displayBegin(uint8_t clockPin, uint8_t dataPin, uint8_t csPin, uint8_t resetPin)
+    {
+        displayClear();
+    }
+
+    /**
+     * Blank every character
+     */
+    void displayClear()
+    {
+        memset(_halScreen, ' ', sizeof(_halScreen));
+        for (size_t row = 0; row < sizeof(_halScreen) / sizeof(_halScreen[0]); row++)
+        {
+            _halScreen[row][sizeof(_halScreen[0]) - 1] = '\0';
+        }
+    }
+
+    /**
+     * Blank the characters that start in an area
+     *
+     * @param x The left of the area in pixels
+     * @param y The top of the area in pixels
+     * @param width The width in pixels
+     * @param height The height in pixels
+     */
+    void displayErase(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+    {
+        const size_t rows = sizeof(_halScreen) / sizeof(_halScreen[0]);
+        const size_t columns = sizeof(_halScreen[0]) - 1;
+        for (size_t row = y / HAL_DISPLAY_LINE_HEIGHT; row < rows && row * HAL_DISPLAY_LINE_HEIGHT < (size_t)y + height; row++)
+        {
+            for (size_t column = x / HAL_DISPLAY_CHAR_WIDTH;
+                 column < columns && column * HAL_DISPLAY_CHAR_WIDTH < (size_t)x + width; column++)
+            {
+                _halScreen[row][column] = ' ';
+            }
+        }
+    }
+
+    /**
+     * Put text in the character grid, it is cut off at the right of the screen
+     *
+     * @param x The left of the text in pixels
+     * @param y The top of the text in pixels
+     * @param text The text
+     */
+    void displayText(uint16_t x, uint16_t y, const char *text)
+    {
+        size_t row = y / HAL_DISPLAY_LINE_HEIGHT;
+        size_t column = x / HAL_DISPLAY_CHAR_WIDTH;
+        if (row >= sizeof(_halScreen) / sizeof(_halScreen[0]))
+        {
+            return;
+        }
+        for (; *text != '\0' && column < sizeof(_halScreen[0]) - 1; text++, column++)
+        {
+            _halScreen[row][column] = *text;
+        }
+    }
+
+    /**
+     * Get the width of text in the font
+     *
+     * @param text The text
+     * @return The width in pixels
+     */
+    uint16_t displayTextWidth(const char *text)
+    {
+        return strlen(text) * HAL_DISPLAY_CHAR_WIDTH;
+    }
+
+    /**
+     * Print the lines of the display that have text to stderr when HAL_TRACE is set
+     */
+    void displaySend()
+    {
+        if (!halTrace())
+        {
+            return;
+        }
+        for (size_t row = 0; row < sizeof(_halScreen) / sizeof(_halScreen[0]); row++)
+        {
+            if (strspn(_halScreen[row], " ") < sizeof(_halScreen[0]) - 1)
+            {
+                fprintf(stderr, "[display] %2u |%s|\n", (unsigned)row, _halScreen[row]);
+            }
+        }
+    }
+
+    /**
+     * The host network is already up, there is nothing to start
+     */
+    void networkBegin()
+    {
+    }
+
+    /**
+     * The host network is never lost
+     */
+    void networkReconnect()
+    {
+    }
+
+    /**
+     * There are no station or WPS events on the host, the handler is never called
+     *
+     * @param handler Not used
+     */
+    void networkEvents(NetworkHandler handler)
+    {
+    }
+
+    /**
+     * The host network is always up
+     *
+     * @return True
+     */
+    bool networkUp()
+    {
+        return true;
+    }
+
+    /**
+     * Get the network name, the host name stands in for the SSID
+     *
+     * @param buffer Where the name is written
+     * @param size The size of the buffer
+     * @return The length of the name
+     */
+    size_t networkName(char *buffer, size_t size)
+    {
+        if (gethostname(buffer, size) != 0)
+        {
+            buffer[0] = '\0';
+        }
+        buffer[size - 1] = '\0';
+        return strlen(buffer);
+    }
+
+    /**
+     * Get the IP address, the first IPv4 address that is not the loopback
+     *
+     * @param buffer Where the dotted address is written
+     * @param size The size of the buffer
+     * @return The length of the address
+     */
+    size_t networkAddress(char *buffer, size_t size)
+    {
+        snprintf(buffer, size, "127.0.0.1");
+        struct ifaddrs *interfaces;
+        if (getifaddrs(&interfaces) != 0)
+        {
+            return strlen(buffer);
+        }
+        for (struct ifaddrs *entry = interfaces; entry != NULL; entry = entry->ifa_next)
+        {
+            if (entry->ifa_addr != NULL && entry->ifa_addr->sa_family == AF_INET)
+            {
+                struct in_addr address = ((struct sockaddr_in *)entry->ifa_addr)->sin_addr;
+                if (ntohl(address.s_addr) >> 24 != 127)
+                {
+                    inet_ntop(AF_INET, &address, buffer, size);
+                    break;
+                }
+            }
+        }
+        freeifaddrs(interfaces);
+        return strlen(buffer);
+    }
+
+    /**
+     * There is no radio on the host
+     *
+     * @return 0 dBm
+     */
+    int8_t networkSignal()
+    {
+        return 0;
+    }
+
+    /**
+     * There is no WPS on the host, the network is always up
+     *
+     * @return False
+     */
+    bool wpsStart(const char *manufacturer, const char *model, const char *name, const char *device)
+    {
+        return false;
+    }
+
+    /**
+     * There is no WPS on the host
+     */
+    void wpsStop()
+    {
+    }
+
+    /**
+     * Send a UDP datagram
+     *
+     * @param host The host name or address
+     * @param port The port
+     * @param data The datagram
+     * @param length The size of the datagram
+     * @return True if it was sent
+     */
+    bool udpSend(const char *host, uint16_t port, const uint8_t *data, size_t length)
+    {
+        char service[8];
+        snprintf(service, sizeof(service), "%u", port);
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        struct addrinfo *address;
+        if (getaddrinfo(host, service, &hints, &address) != 0)
+        {
+            return false;
+        }
+        if (_halUdp < 0)
+        {
+            _halUdp = socket(AF_INET, SOCK_DGRAM, 0);
+        }
+        bool sent = _halUdp >= 0 &&
+                    sendto(_halUdp, data, length, 0, address->ai_addr, address->ai_addrlen) == (ssize_t)length;
+        freeaddrinfo(address);
+        return sent;
+    }
+
+    /**
+     * The host clock is already set, there is nothing to start
+     *
+     * @param server Not used
+     */
+    void timeBegin(const char *server)
+    {
+    }
+
+    /**
+     * The host clock is kept by the system
+     *
+     * @return True
+     */
+    bool timeUpdate()
+    {
+        return true;
+    }
+
+    /**
+     * Get the time of day
+     *
+     * @return The seconds since 1970
+     */
+    uint32_t epoch()
+    {
+        return (uint32_t)time(NULL);
+    }
+
+    /**
+     * Get an id for the host, in place of the MAC address
+     *
+     * @return The host id
+     */
+    uint64_t chipId()
+    {
+        return (uint32_t)gethostid();
+    }
+
+    /**
+     * The host program is always started fresh
+     *
+     * @return HAL_RESET_POWERON
+     */
+    HalResetReason resetReason()
+    {
+        return HAL_RESET_POWERON;
+    }
+
+    /**
+     * The host never wakes from deep sleep, deepSleep() ends the program.  HAL_WAKEUP=timer makes it look like a
+     * timer wakeup, so what is kept in RTC memory is used as after a sleep.
+     *
+     * @return HAL_WAKEUP_TIMER if HAL_WAKEUP is timer, otherwise HAL_WAKEUP_UNDEFINED
+     */
+    HalWakeupCause wakeupCause()
+    {
+        const char *cause = getenv("HAL_WAKEUP");
+        return cause != NULL && strcmp(cause, "timer") == 0 ? HAL_WAKEUP_TIMER : HAL_WAKEUP_UNDEFINED;
+    }
+
+    /**
+     * The host heap is checked by the sanitizers, not here
+     *
+     * @return True
+     */
+    bool heapCheck()
+    {
+        return true;
+    }
+
+    /**
+     * Get the free memory of the host
+     *
+     * @return The bytes, capped at 4GB
+     */
+    uint32_t freeHeap()
+    {
+        uint64_t bytes = (uint64_t)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+        return bytes > UINT32_MAX ? UINT32_MAX : (uint32_t)bytes;
+    }
+
+    /**
+     * Work out a CRC-8 like the ROM crc8_le
+     *
+     * @param crc The CRC so far, 0 to start
+     * @param data The bytes to add
+     * @param length The number of bytes
+     * @return The new CRC
+     */
+    uint8_t crc8(uint8_t crc, const uint8_t *data, size_t length)
+    {
+        return (uint8_t)halCrc(crc, 0x8C, 0xFF, data, length);
+    }
+
+    /**
+     * Work out a CRC-16 like the ROM crc16_le
+     *
+     * @param crc The CRC so far, 0 to start
+     * @param data The bytes to add
+     * @param length The number of bytes
+     * @return The new CRC
+     */
+    uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length)
+    {
+        return (uint16_t)halCrc(crc, 0x8408, 0xFFFF, data, length);
+    }
+
+    /**
+     * Work out a CRC-32 like the ROM crc32_le
+     *
+     * @param crc The CRC so far, 0 to start
+     * @param data The bytes to add
+     * @param length The number of bytes
+     * @return The new CRC
+     */
+    uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length)
+    {
+        return halCrc(crc, 0xEDB88320, 0xFFFFFFFF, data, length);
+    }
+
+    /**
+     * There is no deep sleep on the host, the program ends so a script can start it again
+     *
+     * @param us The microseconds the device would sleep for
+     */
+    void deepSleep(uint64_t us)
+    {
+        fprintf(stderr, "[power] deep sleep for %llu us\n", (unsigned long long)us);
+        consoleFlush();
+        exit(EXIT_SUCCESS);
+    }
+
+    /**
+     * There is no restart on the host, the program ends so a script can start it again
+     */
+    void restart()
+    {
+        fprintf(stderr, "[power] restart\n");
+        consoleFlush();
+        exit(EXIT_SUCCESS);
+    }
+} // namespace Hal
+
+#endif
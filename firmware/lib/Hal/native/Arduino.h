@@ -0,0 +1,189 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include "Hal.h"
+
+/**
+ * The part of the Arduino core the firmware uses, for the native environment.  Time goes through the Hal, the
+ * rest is the C and C++ libraries.  The firmware should call the Hal for anything that touches the hardware,
+ * this is only so the code that still uses the Arduino types builds on the host.
+ */
+
+#define PI 3.1415926535897932384626433832795
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define radians(deg) ((deg) * DEG_TO_RAD)
+#define degrees(rad) ((rad) * RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define strcpy_P strcpy
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+
+inline unsigned long millis()
+{
+    return Hal::millis();
+}
+
+inline unsigned long micros()
+{
+    return (unsigned long)Hal::micros();
+}
+
+inline void delay(unsigned long ms)
+{
+    Hal::delay(ms);
+}
+
+inline void yield()
+{
+    Hal::delay(0);
+}
+
+void setup();
+void loop();
+
+#if defined(__GLIBC__) && __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+/**
+ * Copy a string into a buffer, cut short to fit, newlib and the BSDs have it and glibc only from 2.38
+ *
+ * @param destination The buffer
+ * @param source The string
+ * @param size The size of the buffer
+ * @return The length of the source, the copy was cut short if it is size or more
+ */
+inline size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t copied = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+#endif
+
+/**
+ * The Arduino String, kept in a std::string
+ */
+class String
+{
+public:
+    String(const char *text = "") : _text(text != NULL ? text : "") {}
+    String(const std::string &text) : _text(text) {}
+    String(const __FlashStringHelper *text) : _text((const char *)text) {}
+    String(char c) : _text(1, c) {}
+    String(int value) : _text(std::to_string(value)) {}
+    String(unsigned int value) : _text(std::to_string(value)) {}
+    String(long value) : _text(std::to_string(value)) {}
+    String(unsigned long value) : _text(std::to_string(value)) {}
+    String(float value, unsigned char decimals = 2) : _text(format(value, decimals)) {}
+    String(double value, unsigned char decimals = 2) : _text(format(value, decimals)) {}
+    const char *c_str() const { return this->_text.c_str(); }
+    unsigned int length() const { return this->_text.length(); }
+    String &operator+=(const String &other)
+    {
+        this->_text += other._text;
+        return *this;
+    }
+    bool operator==(const String &other) const { return this->_text == other._text; }
+    bool operator!=(const String &other) const { return this->_text != other._text; }
+    bool equalsIgnoreCase(const String &other) const
+    {
+        return this->_text.size() == other._text.size() && strcasecmp(this->c_str(), other.c_str()) == 0;
+    }
+    friend String operator+(const String &left, const String &right) { return String(left._text + right._text); }
+
+private:
+    static std::string format(double value, unsigned char decimals)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.*f", decimals, value);
+        return text;
+    }
+    std::string _text;
+};
+
+/**
+ * The Arduino Print, what is written goes to write(uint8_t)
+ */
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        while (written < size && this->write(buffer[written]) == 1)
+        {
+            written++;
+        }
+        return written;
+    }
+    size_t print(char c) { return this->write((uint8_t)c); }
+    size_t print(const char *text) { return this->write((const uint8_t *)text, strlen(text)); }
+    size_t println(const char *text) { return this->print(text) + this->print("\r\n"); }
+    virtual void flush() {}
+};
+
+/**
+ * The Arduino Stream, a Print that can also be read
+ */
+class Stream : public Print
+{
+public:
+    Stream() : _timeout(1000) {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long timeout) { this->_timeout = timeout; }
+    size_t readBytes(char *buffer, size_t length)
+    {
+        size_t count = 0;
+        unsigned long start = millis();
+        while (count < length)
+        {
+            int c = this->read();
+            if (c < 0)
+            {
+                if (millis() - start >= this->_timeout)
+                {
+                    break;
+                }
+                continue;
+            }
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return this->readBytes((char *)buffer, length); }
+
+protected:
+    unsigned long _timeout;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+
+#include "Arduino.h"
+
+/**
+ * The Arduino IPv4 address, only kept for the clients that are given one
+ */
+class IPAddress
+{
+public:
+    IPAddress() { memset(this->_address, 0, sizeof(this->_address)); }
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+    {
+        this->_address[0] = first;
+        this->_address[1] = second;
+        this->_address[2] = third;
+        this->_address[3] = fourth;
+    }
+    uint8_t operator[](int index) const { return this->_address[index]; }
+    bool operator==(const IPAddress &other) const { return memcmp(this->_address, other._address, 4) == 0; }
+
+private:
+    uint8_t _address[4];
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef WIFICLIENTSECURE_H
+#define WIFICLIENTSECURE_H
+
+#include "Client.h"
+
+/**
+ * The TLS client of the ESP32 core.  There is no TLS on the host, so a connect fails like a server that
+ * cannot be reached and nothing is ever sent or received.
+ */
+class WiFiClientSecure : public Client
+{
+public:
+    void setCACert(const char *ca) {}
+    void setCertificate(const char *certificate) {}
+    void setPrivateKey(const char *key) {}
+    int connect(IPAddress ip, uint16_t port) { return 0; }
+    int connect(const char *host, uint16_t port)
+    {
+        if (getenv("HAL_TRACE") != NULL)
+        {
+            fprintf(stderr, "[tls] %s:%u cannot connect on the host\n", host, port);
+        }
+        return 0;
+    }
+    size_t write(uint8_t c) { return 0; }
+    size_t write(const uint8_t *buffer, size_t size) { return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+    int read(uint8_t *buffer, size_t size) { return -1; }
+    int peek() { return -1; }
+    void flush() {}
+    void stop() {}
+    uint8_t connected() { return 0; }
+    operator bool() { return false; }
+};
+
+#endif
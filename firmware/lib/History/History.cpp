@@ -0,0 +1,523 @@
+#include "History.h"
+#include "LogInfo.h"
+#include "NTPInfo.h"
+#include "WakeUpInfo.h"
+
+// The minute and hour being built survive a deep sleep, so a rollup is not cut short by each sleep
+HAL_RTC_DATA HistorySeries _historySeries[HISTORY_SERIES];
+HAL_RTC_DATA uint8_t _historySeriesCount;
+
+const uint32_t HistoryClass::_periods[HL_COUNT] = {0, 60, 3600};
+const uint32_t HistoryClass::_retention[HL_COUNT] = {3600, 86400, 31 * 86400};
+const char *HistoryClass::_levelNames[HL_COUNT] = {"raw", "minute", "hour"};
+const uint16_t HistoryClass::_sectors[HL_COUNT] = {HISTORY_RAW_SECTORS, HISTORY_MINUTE_SECTORS, HISTORY_HOUR_SECTORS};
+
+typedef struct historyHeaderStruct
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint8_t level;
+    uint8_t reserved[HISTORY_HEADER_SIZE - 9];
+} HistoryHeader;
+
+/**
+ * Class Constructor
+ */
+HistoryClass::HistoryClass() : _pendingCount(0), _dropped(0), _ready(false), _lock("history")
+{
+    memset(this->_regions, 0, sizeof(this->_regions));
+    memset(this->_index, 0, sizeof(this->_index));
+    memset(this->_written, 0, sizeof(this->_written));
+}
+
+/**
+ * Find the history partition and build the index of its sectors
+ * 
+ * @return True if the partition was found
+ */
+bool HistoryClass::begin()
+{
+    if (WakeUp.isPoweredOn())
+    {
+        memset(_historySeries, 0, sizeof(_historySeries));
+        _historySeriesCount = 0;
+    }
+    if (!this->_partition.open(HISTORY_PARTITION) || this->_partition.getSize() < sizeof(this->_index) / sizeof(HistorySector) * HISTORY_SECTOR_SIZE)
+    {
+        LogInfo.log(LM_CORE, LOG_ERROR, F("No history partition, the sensor history is not kept"));
+        return false;
+    }
+    uint16_t start = 0;
+    for (uint8_t level = 0; level < HL_COUNT; level++)
+    {
+        this->_regions[level].start = start;
+        this->_regions[level].sectors = HistoryClass::_sectors[level];
+        start += HistoryClass::_sectors[level];
+        this->scan(level);
+    }
+    this->_ready = true;
+    return true;
+}
+
+/**
+ * Read the header and count the records of each sector of a level, the sector with the highest sequence is
+ * the one being written
+ * 
+ * @param level The level to scan
+ */
+void HistoryClass::scan(uint8_t level)
+{
+    HistoryRegion *region = &this->_regions[level];
+    region->current = 0;
+    region->sequence = 0;
+    for (uint16_t i = 0; i < region->sectors; i++)
+    {
+        uint16_t sector = region->start + i;
+        HistorySector *entry = &this->_index[sector];
+        HistoryHeader header;
+        memset(entry, 0, sizeof(HistorySector));
+        if (!this->_partition.read(sector * HISTORY_SECTOR_SIZE, &header, sizeof(header)) ||
+            header.magic != HISTORY_MAGIC || header.level != level)
+        {
+            continue;
+        }
+        entry->valid = true;
+        entry->sequence = header.sequence;
+        entry->count = this->countRecords(sector);
+        if (entry->count > 0)
+        {
+            this->_partition.read(this->recordOffset(sector, 0), &entry->first, sizeof(uint32_t));
+            this->_partition.read(this->recordOffset(sector, entry->count - 1), &entry->last, sizeof(uint32_t));
+        }
+        if (entry->sequence >= region->sequence)
+        {
+            region->sequence = entry->sequence;
+            region->current = i;
+        }
+    }
+    LogInfo.log(LM_CORE, LOG_VERBOSE, "History %s at sector %u of %u, sequence %u", HistoryClass::_levelNames[level],
+                region->current, region->sectors, region->sequence);
+}
+
+/**
+ * Count the records written to a sector.  Records are only ever appended, so the erased ones are all at the
+ * end and a binary search finds the first.
+ * 
+ * @param sector The sector in the partition
+ * @return The number of records
+ */
+uint8_t HistoryClass::countRecords(uint16_t sector)
+{
+    uint16_t low = 0;
+    uint16_t high = HISTORY_SECTOR_RECORDS;
+    while (low < high)
+    {
+        uint16_t middle = (low + high) / 2;
+        uint32_t time = UINT32_MAX;
+        this->_partition.read(this->recordOffset(sector, middle), &time, sizeof(time));
+        if (time != UINT32_MAX)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Get the offset in the partition of a record
+ * 
+ * @param sector The sector in the partition
+ * @param index The record in the sector
+ * @return The offset
+ */
+uint32_t HistoryClass::recordOffset(uint16_t sector, uint16_t index)
+{
+    return sector * HISTORY_SECTOR_SIZE + HISTORY_HEADER_SIZE + index * sizeof(HistoryRecord);
+}
+
+/**
+ * Get the id a series is stored under
+ * 
+ * @param sensor The sensor name
+ * @param value The value name
+ * @return The FNV-1a hash of "sensor/value" folded to 16 bits
+ */
+uint16_t HistoryClass::seriesId(const char *sensor, const char *value)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = sensor; *c != 0; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    hash = (hash ^ '/') * 16777619u;
+    for (const char *c = value; *c != 0; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return (hash >> 16) ^ (hash & 0xFFFF);
+}
+
+/**
+ * Get the CRC8 of a record
+ * 
+ * @param record The record, its check byte is left as it was
+ * @return The CRC8 of the record with the check byte as 0
+ */
+uint8_t HistoryClass::checksum(HistoryRecord *record)
+{
+    uint8_t check = record->check;
+    record->check = 0;
+    uint8_t crc = Hal::crc8(0, (const uint8_t *)record, sizeof(HistoryRecord));
+    record->check = check;
+    return crc;
+}
+
+/**
+ * Add a sample to the history.  This is only RAM work, the records are written to flash by tick, so it can be
+ * called from the sensor tasks on either core.
+ * 
+ * @param sensor The sensor name
+ * @param value The value name
+ * @param sample The value read
+ * @param epoch The time of the read, the sample is ignored if the clock is not set yet
+ */
+void HistoryClass::add(const char *sensor, const char *value, float sample, uint32_t epoch)
+{
+    if (!this->_ready || epoch <= HISTORY_MIN_EPOCH)
+    {
+        return;
+    }
+    uint16_t id = HistoryClass::seriesId(sensor, value);
+    this->_mux.enter();
+    HistorySeries *series = NULL;
+    for (uint8_t i = 0; i < _historySeriesCount && series == NULL; i++)
+    {
+        if (_historySeries[i].series == id)
+        {
+            series = &_historySeries[i];
+        }
+    }
+    if (series == NULL && _historySeriesCount < HISTORY_SERIES)
+    {
+        series = &_historySeries[_historySeriesCount++];
+        memset(series, 0, sizeof(HistorySeries));
+        series->series = id;
+    }
+    HistoryRollup raw = {epoch, 1, sample, sample, sample};
+    this->queue(HL_RAW, id, epoch, &raw);
+    if (series != NULL)
+    {
+        for (uint8_t level = HL_MINUTE; level < HL_COUNT; level++)
+        {
+            this->roll(series, level, sample, epoch);
+        }
+    }
+    this->_mux.exit();
+}
+
+/**
+ * Add a sample to the minute or hour being built, the rollup is queued once a sample for the next period comes.
+ * Called with the lock held.
+ * 
+ * @param series The series the sample is for
+ * @param level The rollup level
+ * @param sample The value read
+ * @param epoch The time of the read
+ */
+void HistoryClass::roll(HistorySeries *series, uint8_t level, float sample, uint32_t epoch)
+{
+    HistoryRollup *rollup = &series->rollups[level - 1];
+    uint32_t start = epoch - epoch % HistoryClass::_periods[level];
+    if (rollup->count > 0 && rollup->start != start)
+    {
+        this->queue(level, series->series, rollup->start, rollup);
+        rollup->count = 0;
+    }
+    if (rollup->count == 0)
+    {
+        rollup->start = start;
+        rollup->sum = 0;
+        rollup->min = sample;
+        rollup->max = sample;
+    }
+    rollup->count++;
+    rollup->sum += sample;
+    rollup->min = min(rollup->min, sample);
+    rollup->max = max(rollup->max, sample);
+}
+
+/**
+ * Queue a record for tick to write, it is dropped if the queue is full.  Called with the lock held.
+ * 
+ * @param level The level the record is for
+ * @param series The series id
+ * @param time The time of the record
+ * @param rollup The samples in the record
+ */
+void HistoryClass::queue(uint8_t level, uint16_t series, uint32_t time, const HistoryRollup *rollup)
+{
+    if (this->_pendingCount >= HISTORY_PENDING)
+    {
+        this->_dropped++;
+        return;
+    }
+    HistoryPending *pending = &this->_pending[this->_pendingCount++];
+    pending->level = level;
+    pending->record.time = time;
+    pending->record.series = series;
+    pending->record.count = min(rollup->count, (uint32_t)UINT8_MAX);
+    pending->record.mean = rollup->sum / rollup->count;
+    pending->record.min = rollup->min;
+    pending->record.max = rollup->max;
+    pending->record.check = 0;
+}
+
+/**
+ * Write the queued records to flash, called from the main loop
+ */
+void HistoryClass::tick()
+{
+    if (!this->_ready || this->_pendingCount == 0)
+    {
+        return;
+    }
+    HistoryPending pending[HISTORY_PENDING];
+    this->_mux.enter();
+    uint8_t count = this->_pendingCount;
+    memcpy(pending, this->_pending, count * sizeof(HistoryPending));
+    this->_pendingCount = 0;
+    this->_mux.exit();
+    if (this->_lock.take(HISTORY_LOCK_TIMEOUT_MS))
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            pending[i].record.check = HistoryClass::checksum(&pending[i].record);
+            if (this->write(pending[i].level, &pending[i].record))
+            {
+                this->_written[pending[i].level]++;
+            }
+        }
+        this->_lock.give();
+    }
+    else
+    {
+        this->_mux.enter();
+        this->_dropped += count;
+        this->_mux.exit();
+    }
+}
+
+/**
+ * Append a record to the current sector of a level, moving on to the next sector when it is full.  Called
+ * with the history lock held.
+ * 
+ * @param level The level to write to
+ * @param record The record
+ * @return True if the record was written
+ */
+bool HistoryClass::write(uint8_t level, HistoryRecord *record)
+{
+    HistoryRegion *region = &this->_regions[level];
+    HistorySector *entry = &this->_index[region->start + region->current];
+    if ((!entry->valid || entry->count >= HISTORY_SECTOR_RECORDS) && !this->rotate(level))
+    {
+        return false;
+    }
+    uint16_t sector = region->start + region->current;
+    entry = &this->_index[sector];
+    if (!this->_partition.write(this->recordOffset(sector, entry->count), record, sizeof(HistoryRecord)))
+    {
+        LogInfo.log(LM_CORE, LOG_ERROR, "Could not write history sector %u", sector);
+        return false;
+    }
+    if (entry->count == 0)
+    {
+        entry->first = record->time;
+    }
+    entry->last = record->time;
+    entry->count++;
+    return true;
+}
+
+/**
+ * Start the next sector of a level, the oldest of the ring.  Each sector of a level is erased once per lap of
+ * the ring, so the wear is spread over the whole level.  A level with no sector started yet starts with the one
+ * it is on.
+ * 
+ * @param level The level to move on
+ * @return True if the sector was erased and its header written
+ */
+bool HistoryClass::rotate(uint8_t level)
+{
+    HistoryRegion *region = &this->_regions[level];
+    if (this->_index[region->start + region->current].valid)
+    {
+        region->current = (region->current + 1) % region->sectors;
+    }
+    uint16_t sector = region->start + region->current;
+    HistorySector *entry = &this->_index[sector];
+    HistoryHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.sequence = region->sequence + 1;
+    header.level = level;
+    memset(entry, 0, sizeof(HistorySector));
+    if (!this->_partition.erase(sector * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE) ||
+        !this->_partition.write(sector * HISTORY_SECTOR_SIZE, &header, sizeof(header)))
+    {
+        LogInfo.log(LM_CORE, LOG_ERROR, "Could not start history sector %u", sector);
+        return false;
+    }
+    region->sequence = header.sequence;
+    entry->sequence = header.sequence;
+    entry->valid = true;
+    return true;
+}
+
+/**
+ * Read the records of a series in a time range, oldest first.  Records older than the retention of the level
+ * are left out even if their sector has not been reused yet.
+ * 
+ * @param sensor The sensor name
+ * @param value The value name
+ * @param level The level to read
+ * @param from The first time wanted
+ * @param to The last time wanted
+ * @param skip Records at the from time to leave out, they were in the last reply
+ * @param records Where the records are copied to
+ * @param size The most records to copy
+ * @return The number of records copied
+ */
+uint16_t HistoryClass::query(const char *sensor, const char *value, HistoryLevel level, uint32_t from, uint32_t to,
+                             uint16_t skip, HistoryRecord *records, uint16_t size)
+{
+    if (!this->_ready || level >= HL_COUNT || !this->_lock.take(HISTORY_LOCK_TIMEOUT_MS))
+    {
+        return 0;
+    }
+    uint16_t id = HistoryClass::seriesId(sensor, value);
+    uint32_t now = NTPInfo.getEpoch();
+    if (now > HistoryClass::_retention[level] && from < now - HistoryClass::_retention[level])
+    {
+        from = now - HistoryClass::_retention[level];
+        skip = 0;
+    }
+    HistoryRegion *region = &this->_regions[level];
+    uint16_t count = 0;
+    HistoryRecord chunk[HISTORY_READ_RECORDS];
+    // The sector after the current one is the oldest
+    for (uint16_t i = 1; i <= region->sectors && count < size; i++)
+    {
+        uint16_t sector = region->start + (region->current + i) % region->sectors;
+        HistorySector *entry = &this->_index[sector];
+        if (!entry->valid || entry->count == 0 || entry->last < from || entry->first > to)
+        {
+            continue;
+        }
+        for (uint16_t index = 0; index < entry->count && count < size; index += HISTORY_READ_RECORDS)
+        {
+            uint16_t read = min((uint16_t)(entry->count - index), (uint16_t)HISTORY_READ_RECORDS);
+            if (!this->_partition.read(this->recordOffset(sector, index), chunk, read * sizeof(HistoryRecord)))
+            {
+                break;
+            }
+            for (uint16_t r = 0; r < read && count < size; r++)
+            {
+                if (chunk[r].series != id || chunk[r].time < from || chunk[r].time > to ||
+                    chunk[r].check != HistoryClass::checksum(&chunk[r]))
+                {
+                    continue;
+                }
+                // A series is written in time order, so the ones at the from time that were sent come first
+                if (chunk[r].time == from && skip > 0)
+                {
+                    skip--;
+                    continue;
+                }
+                records[count++] = chunk[r];
+            }
+        }
+    }
+    this->_lock.give();
+    return count;
+}
+
+/**
+ * Answer a history request from the cloud, e.g.
+ * {"sensor": "env", "value": "temperature", "level": "minute", "from": 1601424000, "to": 1601427600}
+ * Each record is [time, mean, min, max, count].  A reply holds at most HISTORY_REPLY_RECORDS records, if there
+ * could be more "next" and "skip" are the "from" and "skip" to ask for the rest with.  Several raw samples can
+ * have the same second, so the next reply starts at the time of the last record and skips the ones sent.
+ * 
+ * @param request The request
+ * @param ob The ArduinoJson object the reply is added to
+ */
+void HistoryClass::queryToJson(JsonObjectConst request, JsonObject ob)
+{
+    const char *sensor = request["sensor"] | "";
+    const char *value = request["value"] | "";
+    const char *levelName = request["level"] | "raw";
+    uint32_t from = request["from"] | 0;
+    uint32_t to = request["to"] | UINT32_MAX;
+    uint16_t skip = request["skip"] | 0;
+    uint8_t level = HL_RAW;
+    while (level < HL_COUNT && strcmp(levelName, HistoryClass::_levelNames[level]) != 0)
+    {
+        level++;
+    }
+    ob["sensor"] = sensor;
+    ob["value"] = value;
+    ob["level"] = levelName;
+    if (level == HL_COUNT)
+    {
+        ob["error"] = "unknown level";
+        return;
+    }
+    auto records = ob.createNestedArray("records");
+    uint16_t count = this->query(sensor, value, (HistoryLevel)level, from, to, skip, this->_reply, HISTORY_REPLY_RECORDS);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        auto record = records.createNestedArray();
+        record.add(this->_reply[i].time);
+        record.add(this->_reply[i].mean);
+        record.add(this->_reply[i].min);
+        record.add(this->_reply[i].max);
+        record.add(this->_reply[i].count);
+    }
+    if (count == HISTORY_REPLY_RECORDS)
+    {
+        uint32_t last = this->_reply[count - 1].time;
+        uint16_t sent = 0;
+        while (sent < count && this->_reply[count - 1 - sent].time == last)
+        {
+            sent++;
+        }
+        ob["next"] = last;
+        ob["skip"] = sent + (last == from ? skip : 0);
+    }
+}
+
+/**
+ * Create a JSON element with the records written for each level
+ * 
+ * @param ob The ArduinoJson object that this element will be added to.
+ */
+void HistoryClass::toJson(JsonObject ob)
+{
+    auto json = ob.createNestedObject("History");
+    for (uint8_t level = 0; level < HL_COUNT; level++)
+    {
+        auto element = json.createNestedObject(HistoryClass::_levelNames[level]);
+        element["written"] = this->_written[level];
+        element["sector"] = this->_regions[level].current;
+        element["sequence"] = this->_regions[level].sequence;
+    }
+    json["series"] = _historySeriesCount;
+    json["dropped"] = this->_dropped;
+}
+
+HistoryClass History;
@@ -0,0 +1,128 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "Hal.h"
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+#include "ResourceLock.h"
+
+#define HISTORY_PARTITION "history"        // Data partition the history is kept in, see partitions.csv
+#define HISTORY_SECTOR_SIZE 4096           // Flash erase sector
+#define HISTORY_HEADER_SIZE 16
+#define HISTORY_SECTOR_RECORDS ((HISTORY_SECTOR_SIZE - HISTORY_HEADER_SIZE) / sizeof(HistoryRecord))
+#define HISTORY_MAGIC 0x48495354           // "HIST"
+#define HISTORY_SERIES 8                   // Sensor values that can be rolled up
+#define HISTORY_PARTITION_SECTORS 192      // The 768 KB partition
+// Sectors to keep the records for every series, and one more as the oldest sector is erased to start a new one
+#define HISTORY_LEVEL_SECTORS(records) (((records) + HISTORY_SECTOR_RECORDS - 1) / HISTORY_SECTOR_RECORDS + 1)
+// Sectors for each level, they are used as rings so the oldest go first.  The minutes are kept for a day and
+// the hours for 31 days, the raw samples get the rest.
+#define HISTORY_MINUTE_SECTORS HISTORY_LEVEL_SECTORS(HISTORY_SERIES * 24 * 60)
+#define HISTORY_HOUR_SECTORS HISTORY_LEVEL_SECTORS(HISTORY_SERIES * 24 * 31)
+#define HISTORY_RAW_SECTORS (HISTORY_PARTITION_SECTORS - HISTORY_MINUTE_SECTORS - HISTORY_HOUR_SECTORS)
+#define HISTORY_PENDING 32                 // Records waiting for tick to write them
+#define HISTORY_READ_RECORDS 16            // Records read from flash at a time by a query
+#define HISTORY_REPLY_RECORDS 40           // Most records in one query reply, the reply says where to carry on
+#define HISTORY_REPLY_DOC 4096             // JSON document needed for a reply
+#define HISTORY_LOCK_TIMEOUT_MS 1000
+#define HISTORY_MIN_EPOCH 1577836800       // Samples are only kept once the clock is set (2020-01-01)
+
+typedef enum
+{
+    HL_RAW = 0,
+    HL_MINUTE,
+    HL_HOUR,
+    HL_COUNT
+} HistoryLevel;
+
+typedef struct historyRecordStruct
+{
+    uint32_t time;      // Epoch seconds of the sample, or of the start of the minute/hour
+    uint16_t series;    // Hash of the sensor and value names
+    uint8_t count;      // Samples in the rollup, stops at 255
+    uint8_t check;      // CRC8 of the record with this set to 0, a torn write fails it
+    float mean;
+    float min;
+    float max;
+} HistoryRecord;
+
+typedef struct historySectorStruct
+{
+    uint32_t first;     // Time of the first and last records, for the queries
+    uint32_t last;
+    uint32_t sequence;  // Counts the sectors started in the level, the lowest is the oldest
+    uint8_t count;
+    bool valid;         // Has a header, a sector without one is erased before it is used
+} HistorySector;
+
+typedef struct historyRegionStruct
+{
+    uint16_t start;     // First sector of the level
+    uint16_t sectors;
+    uint16_t current;   // Sector being written, relative to start
+    uint32_t sequence;  // Sequence of the current sector
+} HistoryRegion;
+
+typedef struct historyRollupStruct
+{
+    uint32_t start;
+    uint32_t count;
+    double sum;         // A float would lose metres adding up an hour of latitudes
+    float min;
+    float max;
+} HistoryRollup;
+
+typedef struct historySeriesStruct
+{
+    uint16_t series;
+    HistoryRollup rollups[HL_COUNT - 1];    // The minute and hour being built
+} HistorySeries;
+
+typedef struct historyPendingStruct
+{
+    uint8_t level;
+    HistoryRecord record;
+} HistoryPending;
+
+class HistoryClass
+{
+public:
+    HistoryClass();
+    bool begin();
+    void add(const char *sensor, const char *value, float sample, uint32_t epoch);
+    void tick();
+    uint16_t query(const char *sensor, const char *value, HistoryLevel level, uint32_t from, uint32_t to,
+                   uint16_t skip, HistoryRecord *records, uint16_t size);
+    void queryToJson(JsonObjectConst request, JsonObject ob);
+    void toJson(JsonObject ob);
+    static uint16_t seriesId(const char *sensor, const char *value);
+
+private:
+    void roll(HistorySeries *series, uint8_t level, float sample, uint32_t epoch);
+    void queue(uint8_t level, uint16_t series, uint32_t time, const HistoryRollup *rollup);
+    bool write(uint8_t level, HistoryRecord *record);
+    bool rotate(uint8_t level);
+    void scan(uint8_t level);
+    uint8_t countRecords(uint16_t sector);
+    uint32_t recordOffset(uint16_t sector, uint16_t index);
+    static uint8_t checksum(HistoryRecord *record);
+    static const uint32_t _periods[HL_COUNT];
+    static const uint32_t _retention[HL_COUNT];
+    static const char *_levelNames[HL_COUNT];
+    static const uint16_t _sectors[HL_COUNT];
+    Hal::Partition _partition;
+    HistoryRegion _regions[HL_COUNT];
+    HistorySector _index[HISTORY_RAW_SECTORS + HISTORY_MINUTE_SECTORS + HISTORY_HOUR_SECTORS];
+    HistoryPending _pending[HISTORY_PENDING];
+    HistoryRecord _reply[HISTORY_REPLY_RECORDS];
+    uint8_t _pendingCount;
+    uint32_t _written[HL_COUNT];
+    uint32_t _dropped;
+    bool _ready;
+    Hal::Spinlock _mux;
+    ResourceLock _lock;
+};
+
+extern HistoryClass History;
+
+#endif
@@ -1,40 +1,53 @@
-#include <analogWrite.h>
+#include "Hal.h"
 #include "LedInfo.h"
 #include "LogInfo.h"
 
-TaskHandle_t LedInfoClass::blinkTaskHandles[LED_COUNT];
+Hal::Task LedInfoClass::blinkTaskHandles[LED_COUNT];
+Hal::Signal LedInfoClass::blinkStops[LED_COUNT];
+
+const ConfigField LedInfoClass::_fields[] = {
+    CONFIG_UINT_SETTING("brightness", LedInfoClass, _brightness, 100, 0, 100),
+    CONFIG_UINT("power", LedInfoClass, _led[LedType::LED_POWER].pin, 26, 0, 39),
+    CONFIG_UINT("wifi", LedInfoClass, _led[LedType::LED_WIFI].pin, 24, 0, 39),
+    CONFIG_UINT("cloud", LedInfoClass, _led[LedType::LED_CLOUD].pin, 25, 0, 39),
+};
+
+/**
+ * Initialise the LEDs, listening for changes to the settings
+ */
+void LedInfoClass::begin()
+{
+    Configuration.subscribe(this->getSectionName(), NULL, LedInfoClass::configChanged);
+}
 
 /**
  * LED Blink Task, it will take in a LedState structure to switch the LED ON/OFF every 500ms or near there.  It will 
- * continue to blink until a Task Notification has sent a value greater then 0 to the ulStop variable.
+ * continue to blink until the stop signal for the LED is given.
  * 
- * @param parameters The ArduinoJson object that this element will be loaded from
+ * @param parameters The LedState of the LED to blink
  */
 void LedInfoClass::blinkTask(void *parameters)
 {
     LedState *pLed = (struct ledStateStruct *)parameters;
-    LogInfo.log(LOG_VERBOSE, "Starting to blink for %s on pin %i", pLed->typeName, pLed->pin);
-    uint32_t ulStop;
+    LogInfo.log(LM_LED, LOG_VERBOSE, "Starting to blink for %s on pin %i", pLed->typeName, pLed->pin);
     for (;;)
     {
-        xTaskNotifyWait(0x00, ULONG_MAX, &ulStop, 500 / portTICK_PERIOD_MS);
-        if (ulStop > 0)
+        if (LedInfoClass::blinkStops[pLed->idx].take(500))
         {
-            analogWrite(pLed->pin, 0);
+            Hal::pwmWrite(pLed->pin, 0);
             if (pLed->isOn)
             {
                 // Switch back on if we had use switchOn method before the blink
-                vTaskDelay(500 / portTICK_PERIOD_MS);
-                analogWrite(pLed->pin, pLed->brightness);
+                Hal::delay(500);
+                Hal::pwmWrite(pLed->pin, pLed->brightness);
             }
-            LogInfo.log(LOG_VERBOSE, "Stopping blinking for %s on pin %i at %i brightness and state is %s", pLed->typeName, pLed->pin, pLed->brightness, pLed->isOn ? "ON" : "OFF");
-            vTaskDelete(LedInfoClass::blinkTaskHandles[pLed->idx]);
+            LogInfo.log(LM_LED, LOG_VERBOSE, "Stopping blinking for %s on pin %i at %i brightness and state is %s", pLed->typeName, pLed->pin, pLed->brightness, pLed->isOn ? "ON" : "OFF");
             LedInfoClass::blinkTaskHandles[pLed->idx] = NULL;
-            break; // should not be needed, but just incase.
+            return;
         }
-        analogWrite(pLed->pin, pLed->brightness);
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-        analogWrite(pLed->pin, 0);
+        Hal::pwmWrite(pLed->pin, pLed->brightness);
+        Hal::delay(500);
+        Hal::pwmWrite(pLed->pin, 0);
     }
 }
 
@@ -45,12 +58,10 @@ void LedInfoClass::blinkTask(void *parameters)
  */
 void LedInfoClass::load(JsonObjectConst obj)
 {
-    this->_brightness = obj.containsKey("brightness") ? obj["brightness"].as<uint8_t>() : 100;
-    this->_led[LedType::LED_POWER].pin = obj.containsKey("power") ? obj["power"].as<uint8_t>() : 26;
-    this->_led[LedType::LED_WIFI].pin = obj.containsKey("wifi") ? obj["wifi"].as<uint8_t>() : 24;
-    this->_led[LedType::LED_CLOUD].pin = obj.containsKey("cloud") ? obj["cloud"].as<uint8_t>() : 25;
+    this->loadFields(obj, LedInfoClass::_fields, CONFIG_FIELD_COUNT(LedInfoClass::_fields));
+    this->loadSettings(LedInfoClass::_fields, CONFIG_FIELD_COUNT(LedInfoClass::_fields));
     initialise();
-    LogInfo.log(LOG_VERBOSE, "Power Pin: %i WiFi Pin: %i Cloud Pin: %i Brightness: %i",
+    LogInfo.log(LM_LED, LOG_VERBOSE, "Power Pin: %i WiFi Pin: %i Cloud Pin: %i Brightness: %i",
                 this->_led[LedType::LED_POWER].pin,
                 this->_led[LedType::LED_WIFI].pin,
                 this->_led[LedType::LED_CLOUD].pin,
@@ -65,10 +76,7 @@ void LedInfoClass::load(JsonObjectConst obj)
 void LedInfoClass::save(JsonObject obj)
 {
     auto json = obj.createNestedObject(this->getSectionName());
-    json["brightness"] = this->_brightness;
-    json["power"] = this->_led[LedType::LED_POWER].pin;
-    json["wifi"] = this->_led[LedType::LED_WIFI].pin;
-    json["cloud"] = this->_led[LedType::LED_CLOUD].pin;
+    this->saveFields(json, LedInfoClass::_fields, CONFIG_FIELD_COUNT(LedInfoClass::_fields));
 }
 
 /**
@@ -87,7 +95,7 @@ void LedInfoClass::toJson(JsonObject ob)
 }
 
 /**
- * set the current brightness level.
+ * set the current brightness level, it is stored as a setting so the configuration file is not rewritten.
  * 
  * @param brightness The new brightness level to set
  */
@@ -96,20 +104,67 @@ bool LedInfoClass::setBrightness(uint8_t brightness)
     if (this->_brightness != brightness)
     {
         this->_brightness = brightness;
-        this->_changed = true;
-        for (uint8_t i = 0; i < LED_COUNT; i++)
+        if (!this->storeSetting(LedInfoClass::_fields, CONFIG_FIELD_COUNT(LedInfoClass::_fields), "brightness"))
         {
-            this->_led[i].brightness = this->_brightness;
-            if (_led[i].isOn)
-            {
-                analogWrite(this->_led[i].pin, this->_brightness);
-            }
+            this->_changed = true;
         }
+        this->applyBrightness();
         return true;
     }
     return false;
 }
 
+/**
+ * Set every LED to the current brightness, the LEDs that are on change straight away
+ */
+void LedInfoClass::applyBrightness()
+{
+    for (uint8_t i = 0; i < LED_COUNT; i++)
+    {
+        this->_led[i].brightness = this->_brightness;
+        if (this->_led[i].isOn)
+        {
+            Hal::pwmWrite(this->_led[i].pin, this->_brightness);
+        }
+    }
+}
+
+/**
+ * overridden apply changed values at runtime
+ * 
+ * @param obj The ArduinoJson object with the new values
+ * @param reported The values that changed are added to this
+ * @param changes Filled with the fields that changed
+ * @param size The most changes that can be added
+ * @return The number of fields that changed
+ */
+uint8_t LedInfoClass::apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size)
+{
+    return this->applyFields(obj, reported, LedInfoClass::_fields, CONFIG_FIELD_COUNT(LedInfoClass::_fields), changes, size);
+}
+
+/**
+ * The LED settings have changed, a new brightness is shown straight away and new pins are set up with the
+ * LEDs that were on switched back on.
+ * 
+ * @param changes The changes to the section
+ * @param count The number of changes
+ */
+void LedInfoClass::configChanged(const ConfigChange *changes, uint8_t count)
+{
+    LedInfoClass *leds = static_cast<LedInfoClass *>(changes[0].config);
+    bool pins = false;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        pins = pins || strcmp(changes[i].field->key, "brightness") != 0;
+    }
+    if (pins)
+    {
+        leds->initialise();
+    }
+    leds->applyBrightness();
+}
+
 /**
  * initializing the LED setup.  This can't be called begin method as we don't know the pin then.
  */
@@ -119,8 +174,8 @@ void LedInfoClass::initialise()
     {
         strcpy(this->_led[i].typeName, LedInfoClass::ledTypeToString((LedType)i));
         this->_led[i].idx = i;
-        pinMode(this->_led[i].pin, OUTPUT);
-        analogWrite(this->_led[i].pin, 0);
+        Hal::pinMode(this->_led[i].pin, true);
+        Hal::pwmWrite(this->_led[i].pin, 0);
         this->_led[i].brightness = this->_brightness;
     }
 }
@@ -134,8 +189,8 @@ void LedInfoClass::switchOn(LedType type)
 {
     if (this->_brightness > 0)
     {
-        LogInfo.log(LOG_VERBOSE, "Switching on %s", this->_led[type].typeName);
-        analogWrite(this->_led[type].pin, this->_led[type].brightness);
+        LogInfo.log(LM_LED, LOG_VERBOSE, "Switching on %s", this->_led[type].typeName);
+        Hal::pwmWrite(this->_led[type].pin, this->_led[type].brightness);
         this->_led[type].isOn = true;
     }
 }
@@ -149,8 +204,8 @@ void LedInfoClass::switchOff(LedType type)
 {
     if (this->_brightness > 0)
     {
-        LogInfo.log(LOG_VERBOSE, "Switching off %s", this->_led[type].typeName);
-        analogWrite(this->_led[type].pin, 0);
+        LogInfo.log(LM_LED, LOG_VERBOSE, "Switching off %s", this->_led[type].typeName);
+        Hal::pwmWrite(this->_led[type].pin, 0);
         this->_led[type].isOn = false;
     }
 }
@@ -164,12 +219,13 @@ void LedInfoClass::blinkOn(LedType type)
 {
     if (LedInfoClass::blinkTaskHandles[type] == NULL)
     {
-        xTaskCreate(LedInfoClass::blinkTask,
-                    "ledBlinking",
-                    10000,
-                    (void *)&this->_led[type],
-                    1,
-                    &LedInfoClass::blinkTaskHandles[type]);
+        Hal::startTask(LedInfoClass::blinkTask,
+                       "ledBlinking",
+                       10000,
+                       (void *)&this->_led[type],
+                       1,
+                       HAL_ANY_CORE,
+                       &LedInfoClass::blinkTaskHandles[type]);
     }
 }
 
@@ -182,7 +238,7 @@ void LedInfoClass::blinkOff(LedType type)
 {
     if (LedInfoClass::blinkTaskHandles[type] != NULL)
     {
-        xTaskNotify(LedInfoClass::blinkTaskHandles[type], 1, eSetValueWithOverwrite);
+        LedInfoClass::blinkStops[type].give();
     }
 }
 
@@ -5,6 +5,7 @@
 #include <ArduinoJson.h>
 
 #include "Config.h"
+#include "Hal.h"
 
 #define LED_COUNT 3
 typedef enum
@@ -28,12 +29,15 @@ public:
     LedInfoClass() : BaseConfigInfoClass("ledInfo") {}
 
     static void blinkTask(void *parameters);
-    static TaskHandle_t blinkTaskHandles[];    
+    static Hal::Task blinkTaskHandles[];
+    static Hal::Signal blinkStops[];
 
-    void begin(){};
+    void begin();
     void toJson(JsonObject ob) override;
     void load(JsonObjectConst obj) override;
     void save(JsonObject ob) override;
+    uint8_t apply(JsonObjectConst obj, JsonObject reported, ConfigChange *changes, uint8_t size) override;
+    static void configChanged(const ConfigChange *changes, uint8_t count);
 
     void switchOn(LedType type);
     void switchOff(LedType type);
@@ -42,10 +46,12 @@ public:
     bool setBrightness(uint8_t brightness);
     
 private:
+    static const ConfigField _fields[];
     bool _isEnabled;
     LedState _led[LED_COUNT];
     uint8_t _brightness;
     void initialise();
+    void applyBrightness();
     const char* ledTypeToString(LedType level);
 };
 
@@ -0,0 +1,130 @@
+#ifndef BASELOGSINK_H
+#define BASELOGSINK_H
+
+#include "LogInfo.h"
+
+class BaseLogSink
+{
+public:
+    /**
+     * Base Class Constructor
+     *
+     * @param name The sink name, which is the JSON element in the LogInfo "sinks" configuration
+     * @param level The default level the sink reports on
+     * @param enabled Is the sink enabled by default
+     */
+    BaseLogSink(const char *name, LogType level, bool enabled = false)
+    {
+        strcpy(this->_name, name);
+        this->_level = level;
+        this->_enabled = enabled;
+        this->_format = LOG_FORMAT_TEXT;
+    }
+
+    /**
+     * Virtual write a text message to the sink.  This is only ever called from the log task.
+     *
+     * @param record The record being written, for the level, core and flags
+     * @param timestamp The milliseconds since boot the message was logged at
+     * @param message The message text, for JSON records this is the JSON and the header is in record->data
+     * @param length The size of the message
+     */
+    virtual void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) = 0;
+
+    /**
+     * Virtual write a binary frame to the sink, only called if the sink format is binary
+     *
+     * @param record The record being written
+     * @param frame The binary frame
+     * @param length The size of the frame
+     */
+    virtual void writeFrame(const LogRecord *record, const uint8_t *frame, size_t length) {}
+
+    /**
+     * Virtual called by the log task after each batch of records has been written, so sinks that buffer can
+     * decide if it is time to send/write the buffer
+     *
+     * @param force True if everything buffered must be written now, we are about to restart or sleep
+     */
+    virtual void flush(bool force) {}
+
+    /**
+     * Virtual load JSON element into the sink
+     *
+     * @param json The ArduinoJson object that this element will be loaded from
+     */
+    virtual void load(JsonObjectConst obj)
+    {
+        this->_enabled = obj.containsKey("enabled") ? obj["enabled"].as<bool>() : this->_enabled;
+        if (obj.containsKey("level"))
+        {
+            this->_level = LogInfo.stringToLogType(obj["level"].as<const char *>());
+        }
+        if (obj.containsKey("format"))
+        {
+            this->_format = strcasecmp(obj["format"].as<const char *>(), "binary") == 0 ? LOG_FORMAT_BINARY : LOG_FORMAT_TEXT;
+        }
+    }
+
+    /**
+     * Virtual save JSON element from the sink
+     *
+     * @param json The ArduinoJson object that this element will be added to.
+     */
+    virtual void save(JsonObject obj)
+    {
+        auto json = obj.createNestedObject(this->_name);
+        json["enabled"] = this->_enabled;
+        json["level"] = LogInfo.logTypeToString(this->_level);
+        json["format"] = this->_format == LOG_FORMAT_BINARY ? "binary" : "text";
+    }
+
+    /**
+     * Does the sink want this message
+     *
+     * @param level The level of the message
+     * @return True if the sink is enabled and reports on the level
+     */
+    bool accepts(uint8_t level)
+    {
+        return this->_enabled && level <= this->_level;
+    }
+
+    /**
+     * Get the sink name
+     *
+     * @return The sink name
+     */
+    const char *getName()
+    {
+        return this->_name;
+    }
+
+    /**
+     * Get the level the sink reports on
+     *
+     * @return The LogType level
+     */
+    LogType getLevel()
+    {
+        return this->_enabled ? this->_level : LOG_OFF;
+    }
+
+    /**
+     * Get the format the sink wants the messages in
+     *
+     * @return The LogFormat
+     */
+    LogFormat getFormat()
+    {
+        return this->_format;
+    }
+
+protected:
+    char _name[12];
+    LogType _level;
+    LogFormat _format;
+    bool _enabled;
+};
+
+#endif
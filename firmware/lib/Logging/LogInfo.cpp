@@ -1,4 +1,6 @@
 #include "LogInfo.h"
+#include "LogSinks.h"
+#include "Hal.h"
 
 /**
  * Begin the initialization of the logging system
@@ -7,9 +9,20 @@ void LogInfoClass::begin()
 {
     uint64_t chipid;
 
-    chipid = ESP.getEfuseMac(); //The chip ID is essentially its MAC address(length: 6 bytes).
+    chipid = Hal::chipId(); //The chip ID is essentially its MAC address(length: 6 bytes).
                                 //It should be unique per ESP32 
     snprintf(this->_uniqueId, 23, "%04X%08X", (uint16_t)(chipid >> 32), (uint32_t)chipid);
+    LogRing.begin();
+    this->addSink(&SerialSink);
+    this->addSink(&FileSink);
+    this->addSink(&SyslogSink);
+    this->addSink(&MqttSink);
+    for (uint8_t i = 0; i < HAL_CORES; i++)
+    {
+        this->_buffers[i] = new Hal::RingBuffer(LOG_BUFFER_SIZE);
+        this->_lastTimestamps[i] = 0;
+    }
+    Hal::startTask(LogInfoClass::drainTask, "LogTask", 4096, (void *)this, 1, HAL_ANY_CORE, &this->_drainTask);
 }
 
 /**
@@ -20,8 +33,23 @@ void LogInfoClass::begin()
 void LogInfoClass::load(JsonObjectConst obj)
 {
     this->setLogLevel(obj["level"].as<const char*>());
-    this->log(LOG_VERBOSE, "Chip Id: %s", this->getUniqueId());
-    this->log(LOG_OFF, "Log Level: %s", this->getLogLevel());
+    this->setLogFormat(obj.containsKey("format") ? obj["format"].as<const char*>() : "text");
+    LogRing.setLevel(this->stringToLogType(obj.containsKey("ringLevel") ? obj["ringLevel"].as<const char*>() : "INFO"));
+    LogRing.setUseFile(obj.containsKey("crashFile") ? obj["crashFile"].as<bool>() : false);
+    this->setModuleLevels(obj["modules"]);
+    JsonObjectConst rateLimit = obj["rateLimit"];
+    LogLimiter.setRate(rateLimit.containsKey("burst") ? rateLimit["burst"].as<uint16_t>() : 5,
+                       rateLimit.containsKey("perSecond") ? rateLimit["perSecond"].as<uint16_t>() : 1);
+    this->_suppressRepeats = obj.containsKey("suppressRepeats") ? obj["suppressRepeats"].as<bool>() : true;
+    JsonObjectConst sinks = obj["sinks"];
+    for (uint8_t i = 0; i < this->_sinkCount; i++)
+    {
+        this->_sinks[i]->load(sinks[this->_sinks[i]->getName()]);
+    }
+    this->updateModuleLevels();
+    this->log(LM_LOG, LOG_VERBOSE, "Chip Id: %s", this->getUniqueId());
+    this->log(LM_LOG, LOG_OFF, "Log Level: %s", this->getLogLevel());
+    this->log(LM_LOG, LOG_OFF, "Log Format: %s", this->getLogFormat());
     this->_changed = false;
 }
 
@@ -34,6 +62,19 @@ void LogInfoClass::save(JsonObject obj)
 {
     auto json = obj.createNestedObject(this->_sectionName);
     json["level"] = logTypeToString(this->_reportingLevel);
+    json["format"] = this->getLogFormat();
+    json["ringLevel"] = logTypeToString((LogType)LogRing.getLevel());
+    json["crashFile"] = LogRing.getUseFile();
+    this->modulesToJson(json.createNestedObject("modules"));
+    auto rateLimit = json.createNestedObject("rateLimit");
+    rateLimit["burst"] = LogLimiter.getBurst();
+    rateLimit["perSecond"] = LogLimiter.getPerSecond();
+    json["suppressRepeats"] = this->_suppressRepeats;
+    auto sinks = json.createNestedObject("sinks");
+    for (uint8_t i = 0; i < this->_sinkCount; i++)
+    {
+        this->_sinks[i]->save(sinks);
+    }
 }
 
 /**
@@ -45,6 +86,8 @@ void LogInfoClass::toJson(JsonObject ob)
 {
     auto json = ob.createNestedObject(this->getSectionName());
     json["level"] = logTypeToString(this->_reportingLevel);
+    json["format"] = this->getLogFormat();
+    this->modulesToJson(json.createNestedObject("modules"));
 }
 
 /**
@@ -156,6 +199,7 @@ LogType LogInfoClass::stringToLogType(const char* level)
 void LogInfoClass::setLogLevel(LogType level)
 {
     this->_reportingLevel = level;
+    this->updateModuleLevels();
 }
 
 /**
@@ -166,6 +210,7 @@ void LogInfoClass::setLogLevel(LogType level)
 void LogInfoClass::setLogLevel(const char* logType)
 {
     this->_reportingLevel = LogInfoClass::stringToLogType(logType);
+    this->updateModuleLevels();
 }
 
 /**
@@ -179,184 +224,957 @@ const char* LogInfoClass::getLogLevel()
 }
 
 /**
- * Write the message to the log level.  The message is using the embedded flash support.
+ * Set the current log output format.
  * 
- *  @param level The logType level being assigned to.
- *  @param ifsh The pointer to the Flash String Helper
- *  @return The size of the string written.
+ *  @param format The LogFormat that messages are written in.
+ */ 
+void LogInfoClass::setLogFormat(LogFormat format)
+{
+    this->_format = format;
+}
+
+/**
+ * Set the current log output format.
+ * 
+ *  @param format The string format ("text" or "binary") that messages are written in.
  */ 
-size_t LogInfoClass::log(LogType level, const __FlashStringHelper *ifsh)
+void LogInfoClass::setLogFormat(const char* format)
 {
-    return this->write(level, reinterpret_cast<const char *>(ifsh));
+    this->_format = (format != NULL && strcasecmp(format, "binary") == 0) ? LOG_FORMAT_BINARY : LOG_FORMAT_TEXT;
+}
+
+/**
+ * Get the current log output format.
+ * 
+ *  @return The current format name
+ */ 
+const char* LogInfoClass::getLogFormat()
+{
+    return this->_format == LOG_FORMAT_BINARY ? "binary" : "text";
 }
 
 /**
  * Write the message to the log level.  The message is using the embedded flash support.
  * 
+ *  @param module The module the message comes from
  *  @param level The logType level being assigned to.
  *  @param ifsh The pointer to the Flash String Helper
- *  @param object The Arduino JSON object/element to write out
- *  @return The size of the string written.
+ *  @return The size of the record queued.
  */ 
-size_t LogInfoClass::log(LogType level, const __FlashStringHelper *ifsh, JsonObject object)
+size_t LogInfoClass::log(LogModule module, LogType level, const __FlashStringHelper *ifsh)
 {
-    if (level > this->_reportingLevel)
+    if (level > this->_moduleLevels[module] || !LogLimiter.allow(reinterpret_cast<const char *>(ifsh), level, module))
     {
         return 0;
     }
-    int len = 0;
-    len += writePrefix(level);
-    int section = buildSectionHeader(reinterpret_cast<const char *>(ifsh));
-    len += section;
-    len += serializeJsonPretty(object, Serial);
-    len += Serial.println();
-    for (int i =0;i < section - 4; i++)
+    alignas(LogRecord) uint8_t buffer[sizeof(LogRecord) + LOG_RECORD_DATA];
+    LogRecord *record = this->initRecord(buffer, module, level, reinterpret_cast<const char *>(ifsh));
+    if (this->_format == LOG_FORMAT_BINARY)
+    {
+        record->flags = LOG_RECORD_BINARY;
+    }
+    else
     {
-        len += Serial.print("=");
+        strncpy(record->data, reinterpret_cast<const char *>(ifsh), LOG_RECORD_DATA - 1);
+        record->data[LOG_RECORD_DATA - 1] = '\0';
+        record->length = strlen(record->data);
     }
-    len += Serial.println();
-    return 0;
+    return this->submit(record);
 }
 
 /**
  * Write the message to the log level.  The message is using the embedded flash support.
  * 
+ *  @param module The module the message comes from
  *  @param level The logType level being assigned to.
  *  @param ifsh The pointer to the Flash String Helper
  *  @param object The Arduino JSON object/element to write out
- *  @return The size of the string written.
+ *  @return The size of the record queued.
+ */ 
+size_t LogInfoClass::log(LogModule module, LogType level, const __FlashStringHelper *ifsh, JsonObject object)
+{
+    return this->log(module, level, ifsh, (JsonObjectConst)object);
+}
+
+/**
+ * Write the message to the log level.  The message is using the embedded flash support.  The JSON is
+ * serialized into the record here and pretty printed by the log task, if it is too big it is truncated.
+ * 
+ *  @param module The module the message comes from
+ *  @param level The logType level being assigned to.
+ *  @param ifsh The pointer to the Flash String Helper
+ *  @param object The Arduino JSON object/element to write out
+ *  @return The size of the record queued.
  */ 
-size_t LogInfoClass::log(LogType level, const __FlashStringHelper *ifsh, JsonObjectConst object)
+size_t LogInfoClass::log(LogModule module, LogType level, const __FlashStringHelper *ifsh, JsonObjectConst object)
 {
-    if (level > this->_reportingLevel)
+    if (level > this->_moduleLevels[module] || !LogLimiter.allow(reinterpret_cast<const char *>(ifsh), level, module))
     {
         return 0;
     }
-    int len = 0;
-    len += writePrefix(level);
-    int section = buildSectionHeader(reinterpret_cast<const char *>(ifsh));
-    len += section;
-    len += serializeJsonPretty(object, Serial);
-    len += Serial.println();
-    for (int i =0;i < section - 4; i++)
+    alignas(LogRecord) uint8_t buffer[sizeof(LogRecord) + LOG_RECORD_JSON_DATA];
+    LogRecord *record = this->initRecord(buffer, module, level, reinterpret_cast<const char *>(ifsh));
+    record->flags = LOG_RECORD_JSON;
+    // The header and the JSON are stored as two strings one after the other
+    size_t len = strlcpy(record->data, reinterpret_cast<const char *>(ifsh), LOG_RECORD_JSON_DATA / 4) + 1;
+    len = min(len, (size_t)(LOG_RECORD_JSON_DATA / 4));
+    len += serializeJson(object, &record->data[len], LOG_RECORD_JSON_DATA - len);
+    record->length = len;
+    return this->submit(record);
+}
+
+/**
+ * Write the message to the log level.  The message has formatting information.  The message is formatted
+ * into a record on the caller's stack, so nothing is allocated and nothing is shared with other tasks, if it
+ * is too big it is truncated.
+ * 
+ *  @param module The module the message comes from
+ *  @param level The logType level being assigned to.
+ *  @param format The format string that the extra parameters can be written to.
+ *  @param ... parameters to be added on the message
+ *  @return The size of the record queued.
+ */ 
+size_t LogInfoClass::log(LogModule module, LogType level, const char *format, ...)
+{
+    if (level > this->_moduleLevels[module] || !LogLimiter.allow(format, level, module))
+    {
+        return 0;
+    }
+    alignas(LogRecord) uint8_t buffer[sizeof(LogRecord) + LOG_RECORD_DATA];
+    LogRecord *record = this->initRecord(buffer, module, level, format);
+    va_list arg;
+    va_start(arg, format);
+    if (this->_format == LOG_FORMAT_BINARY)
+    {
+        record->flags = LOG_RECORD_BINARY;
+        record->length = LogInfoClass::captureArgs(format, &arg, (uint8_t *)record->data,
+                                                   LOG_BINARY_MAX_FRAME - LOG_BINARY_HEADER_SIZE);
+    }
+    else
+    {
+        int len = vsnprintf(record->data, LOG_RECORD_DATA, format, arg);
+        if (len < 0)
+        {
+            va_end(arg);
+            return 0;
+        }
+        if (len >= LOG_RECORD_DATA)
+        {
+            strcpy(&record->data[LOG_RECORD_DATA - 4], "...");
+            len = LOG_RECORD_DATA - 1;
+        }
+        record->length = len;
+    }
+    va_end(arg);
+    return this->submit(record);
+}
+
+/**
+ * Wait until the log task has written out every queued record and every sink has written out what it has
+ * buffered, used before restarting or sleeping.
+ * 
+ *  @param timeout The most milliseconds to wait
+ */ 
+void LogInfoClass::flush(uint32_t timeout)
+{
+    if (this->_drainTask == NULL || Hal::currentTask() == this->_drainTask)
+    {
+        return;
+    }
+    this->_forceFlush = true;
+    uint32_t start = millis();
+    while (millis() - start < timeout)
     {
-        len += Serial.print("=");
+        size_t waiting = 0;
+        for (uint8_t i = 0; i < HAL_CORES; i++)
+        {
+            waiting = this->_buffers[i]->waiting();
+            if (waiting > 0)
+            {
+                break;
+            }
+        }
+        if (waiting == 0 && this->_emitting == false && this->_forceFlush == false)
+        {
+            break;
+        }
+        this->_wake.give();
+        Hal::delay(1);
     }
-    len += Serial.println();
-    return 0;
+    Hal::consoleFlush();
 }
 
 /**
- * Write the prefix header to the message
+ * Add a sink that the messages are written to.  Sinks are added before the configuration is loaded, as the
+ * configuration is loaded into them by name.
  * 
+ *  @param sink The sink to add
+ */ 
+void LogInfoClass::addSink(BaseLogSink *sink)
+{
+    if (this->_sinkCount < LOG_MAX_SINKS)
+    {
+        this->_sinks[this->_sinkCount++] = sink;
+        this->updateModuleLevels();
+    }
+}
+
+/**
+ * Format the prefix header for a message, this is the same for every text sink.
+ * 
+ *  @param buffer Where the prefix is written to
+ *  @param size The size of the buffer
  *  @param level The logType level being assigned to.
+ *  @param core The core the message was logged on
+ *  @param timestamp The milliseconds since boot the message was logged at
  *  @return The size of the string written.
  */ 
-size_t LogInfoClass::writePrefix(LogType level)
+size_t LogInfoClass::formatPrefix(char *buffer, size_t size, LogType level, uint8_t core, uint32_t timestamp)
 {
-    int len = 0;
-    len = Serial.printf("%10.0lu", millis());
-    len += Serial.print(F(":"));
-    len += Serial.print(this->logTypeToShortString(level));
-    len += Serial.print(F(":"));
-    len += Serial.print(xPortGetCoreID());
-    len += Serial.print(F(":"));
-    return len;
+    int len = snprintf(buffer, size, "%10lu:%s:%u:", (unsigned long)timestamp, this->logTypeToShortString(level), core);
+    return len < 0 ? 0 : min((size_t)len, size - 1);
 }
 
 /**
- * build the message section header to the log level.
+ * Work out the most detailed level each module reports on, messages above it are thrown away by log()
+ * before anything is formatted, with a single lookup.  A module reports on its own level if it has one,
+ * otherwise the global level, limited by the most detailed enabled sink and the crash log ring.
+ */ 
+void LogInfoClass::updateModuleLevels()
+{
+    uint8_t level = LogRing.getLevel();
+    for (uint8_t i = 0; i < this->_sinkCount; i++)
+    {
+        level = max(level, (uint8_t)this->_sinks[i]->getLevel());
+    }
+    for (uint8_t i = 0; i < LM_COUNT; i++)
+    {
+        uint8_t wanted = this->_configuredLevels[i] == LOG_MODULE_DEFAULT ? this->_reportingLevel : this->_configuredLevels[i];
+        this->_moduleLevels[i] = min(wanted, level);
+    }
+}
+
+/**
+ * Set the level a module reports on, overriding the global level for that module.
  * 
- *  @param hdr The character array to write
- *  @return The size of the string written.
+ *  @param module The module to set
+ *  @param level The logType level to report on, or LOG_MODULE_DEFAULT to use the global level
  */ 
-size_t LogInfoClass::buildSectionHeader(const char hdr[])
+void LogInfoClass::setModuleLevel(LogModule module, uint8_t level)
 {
-    int len = 0;
-    len = Serial.println("");
-    len += Serial.print("======= ");
-    len += Serial.print(hdr);
-    len += Serial.println(" =======");
-    return len;
+    if (module < LM_COUNT)
+    {
+        this->_configuredLevels[module] = level;
+        this->updateModuleLevels();
+    }
+}
+
+/**
+ * Set the module levels from a JSON element of module name to level, e.g. {"gps": "VERBOSE"}.  A level of
+ * "DEFAULT" makes the module use the global level again.  If a level changes the section is marked as changed,
+ * so a level set at runtime is saved and kept over a restart.
+ * 
+ *  @param obj The ArduinoJson object holding the levels
+ *  @return True if a level was changed
+ */ 
+bool LogInfoClass::setModuleLevels(JsonObjectConst obj)
+{
+    bool changed = false;
+    for (uint8_t i = 0; i < LM_COUNT; i++)
+    {
+        const char *name = this->moduleToString((LogModule)i);
+        if (obj.containsKey(name))
+        {
+            const char *value = obj[name].as<const char *>();
+            uint8_t level = (value == NULL || strcasecmp(value, "DEFAULT") == 0) ? LOG_MODULE_DEFAULT : this->stringToLogType(value);
+            changed |= level != this->_configuredLevels[i];
+            this->_configuredLevels[i] = level;
+        }
+    }
+    this->updateModuleLevels();
+    this->_changed |= changed;
+    return changed;
+}
+
+/**
+ * Create a JSON element of module name to level, for the modules that have their own level.
+ * 
+ *  @param obj The ArduinoJson object the levels are added to
+ */ 
+void LogInfoClass::modulesToJson(JsonObject obj)
+{
+    for (uint8_t i = 0; i < LM_COUNT; i++)
+    {
+        if (this->_configuredLevels[i] != LOG_MODULE_DEFAULT)
+        {
+            obj[this->moduleToString((LogModule)i)] = this->logTypeToString((LogType)this->_configuredLevels[i]);
+        }
+    }
+}
+
+/**
+ * Workout the configuration name for the module
+ * 
+ *  @param module The LogModule to work with
+ *  @return the pointer to the string.
+ */ 
+const char* LogInfoClass::moduleToString(LogModule module)
+{
+    static const char *names[LM_COUNT] = {"core", "config", "cloud", "led", "gps", "env", "wifi",
+                                          "device", "display", "ntp", "wakeup", "sensor", "log", "utils"};
+    return module < LM_COUNT ? names[module] : "unknown";
 }
 
 /**
- * Write the message to the log level. 
+ * Fill in the record header, the timestamp and core are set when it is submitted
  * 
+ *  @param buffer The memory the record is built in
+ *  @param module The module the message comes from
  *  @param level The logType level being assigned to.
- *  @param msg The character array to write
- *  @param hdr The character array to write
- *  @return The size of the string written.
+ *  @param format The format string, its address is the binary message id
+ *  @return The record
+ */ 
+LogRecord *LogInfoClass::initRecord(uint8_t *buffer, LogModule module, LogType level, const char *format)
+{
+    LogRecord *record = (LogRecord *)buffer;
+    record->timestamp = 0;
+    record->format = format;
+    record->level = level;
+    record->module = module;
+    record->core = 0;
+    record->flags = 0;
+    record->length = 0;
+    return record;
+}
+
+/**
+ * Queue the record on the buffer for the core we are running on, so the tasks on the other core never
+ * wait on us.  The record is timestamped here, after it has been formatted, so records are queued close to
+ * timestamp order, and it is added to the crash log ring on the caller's core.  Until the log task is running
+ * the record is written straight away.  If the buffer is full the record is dropped and counted rather than
+ * blocking the caller.
+ * 
+ *  @param record The record to queue
+ *  @return The size of the record queued.
  */ 
-size_t LogInfoClass::write(LogType level, const char msg[], const char hdr[])
+size_t LogInfoClass::submit(LogRecord *record)
 {
-    if (level > this->_reportingLevel)
+    size_t size = sizeof(LogRecord) + record->length;
+    record->timestamp = Hal::micros();
+    record->core = Hal::coreId();
+    this->keep(record);
+    if (this->_drainTask == NULL)
+    {
+        this->emit(record);
+        return size;
+    }
+    if (!this->_buffers[record->core]->send(record, size, 0))
     {
+        __atomic_add_fetch(&this->_dropped, 1, __ATOMIC_RELAXED);
         return 0;
     }
-    int len = 0;
-    len = this->writePrefix(level);
-    // Check if multi line or not. 
-    boolean multiline = false;
-    if (strstr(msg, "\r"))
+    this->_wake.give();
+    return size;
+}
+
+/**
+ * The log task, it is the only writer to the sinks.  Each time it is woken it merges the records
+ * waiting in the per core buffers, oldest timestamp first.
+ * 
+ *  @param parameters The LogInfo instance
+ */ 
+void LogInfoClass::drainTask(void *parameters)
+{
+    auto logInfo = (LogInfoClass *)parameters;
+    for (;;)
     {
-        multiline = true;
-        len += this->buildSectionHeader(hdr);
+        logInfo->_wake.take(100);
+        logInfo->drain();
     }
-    len += Serial.write((uint8_t*)msg, strlen(msg));
-    len += Serial.println();
-    if (multiline)
+}
+
+/**
+ * Write out every record waiting in the per core buffers in timestamp order
+ */ 
+void LogInfoClass::drain()
+{
+    LogRecord *heads[HAL_CORES];
+    this->_emitting = true;
+    for (uint8_t i = 0; i < HAL_CORES; i++)
     {
-        len += Serial.println("===========================");
+        heads[i] = this->receive(i);
     }
-    Serial.flush();
-    return len;
+    for (;;)
+    {
+        int8_t next = -1;
+        for (uint8_t i = 0; i < HAL_CORES; i++)
+        {
+            if (heads[i] != NULL && (next < 0 || heads[i]->timestamp < heads[next]->timestamp))
+            {
+                next = i;
+            }
+        }
+        if (next < 0)
+        {
+            break;
+        }
+        if (!this->isRepeat(heads[next]))
+        {
+            this->emit(heads[next]);
+        }
+        this->_buffers[next]->returnItem(heads[next]);
+        heads[next] = this->receive(next);
+    }
+    uint32_t dropped = __atomic_exchange_n(&this->_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0)
+    {
+        this->emitNotice(LM_LOG, LOG_WARNING, "Log buffer full, dropped %u records", dropped);
+    }
+    LogLimit limits[4];
+    uint8_t count = LogLimiter.collect(limits, 4);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        this->emitNotice((LogModule)limits[i].module, (LogType)limits[i].level, "Rate limited %u messages like \"%.40s\"",
+                         limits[i].suppressed, limits[i].format);
+    }
+    uint32_t evicted = LogLimiter.takeEvicted();
+    if (evicted > 0)
+    {
+        this->emitNotice(LM_LOG, LOG_WARNING, "Rate limited %u other messages", evicted);
+    }
+    if (this->_repeats > 0 && (millis() - this->_repeatStart) >= LOG_REPEAT_MS)
+    {
+        this->reportRepeats();
+    }
+    bool force = __atomic_exchange_n(&this->_forceFlush, false, __ATOMIC_RELAXED);
+    for (uint8_t i = 0; i < this->_sinkCount; i++)
+    {
+        this->_sinks[i]->flush(force);
+    }
+    this->_emitting = false;
+}
+
+/**
+ * Take the next record from a per core buffer.  A task can be preempted by another task on the same core
+ * between being timestamped and being queued, so the buffer is not always in timestamp order.  A record older
+ * than the one before it from the same buffer is given that record's timestamp, so each buffer is read in the
+ * order it was queued and the merge in drain() can rely on the timestamps never going backwards.
+ * 
+ *  @param core The core whose buffer is read
+ *  @return The record, or NULL if the buffer is empty
+ */ 
+LogRecord *LogInfoClass::receive(uint8_t core)
+{
+    size_t size;
+    LogRecord *record = (LogRecord *)this->_buffers[core]->receive(&size, 0);
+    if (record != NULL)
+    {
+        record->timestamp = max(record->timestamp, this->_lastTimestamps[core]);
+        this->_lastTimestamps[core] = record->timestamp;
+    }
+    return record;
+}
+
+/**
+ * Is the record the same message as the one before it, if so it is counted instead of written and the count
+ * is written as one message when a different message arrives or every LOG_REPEAT_MS.
+ * 
+ *  @param record The record to check
+ *  @return True if the record is a repeat and should not be written
+ */ 
+bool LogInfoClass::isRepeat(const LogRecord *record)
+{
+    if (!this->_suppressRepeats)
+    {
+        return false;
+    }
+    // FNV-1a over the call site, level and message
+    uint32_t hash = 2166136261UL ^ (uint32_t)(uintptr_t)record->format;
+    hash = (hash ^ record->level) * 16777619UL;
+    for (uint16_t i = 0; i < record->length; i++)
+    {
+        hash = (hash ^ (uint8_t)record->data[i]) * 16777619UL;
+    }
+    if (hash == this->_lastHash)
+    {
+        this->_repeats++;
+        return true;
+    }
+    this->reportRepeats();
+    this->_lastHash = hash;
+    this->_lastLevel = record->level;
+    this->_lastModule = record->module;
+    return false;
 }
 
 /**
- * Write the message to the log level.  The message has formatting information
+ * Write how many times the last message was repeated, if it was
+ */ 
+void LogInfoClass::reportRepeats()
+{
+    if (this->_repeats > 0)
+    {
+        this->emitNotice((LogModule)this->_lastModule, (LogType)this->_lastLevel, "Last message repeated %u times",
+                         this->_repeats);
+        this->_repeats = 0;
+    }
+    this->_repeatStart = millis();
+}
+
+/**
+ * Write a message from the log task itself straight to the sinks, these are not rate limited or counted as
+ * repeats.
  * 
+ *  @param module The module the message is about
  *  @param level The logType level being assigned to.
  *  @param format The format string that the extra parameters can be written to.
  *  @param ... parameters to be added on the message
- *  @return The size of the string written.
  */ 
-size_t LogInfoClass::log(LogType level, const char *format, ...)
+void LogInfoClass::emitNotice(LogModule module, LogType level, const char *format, ...)
 {
-    if (level > this->_reportingLevel)
+    if (level > this->_moduleLevels[module])
     {
-        return 0;
+        return;
     }
-    char loc_buf[64];
-    char * temp = loc_buf;
-
+    alignas(LogRecord) uint8_t buffer[sizeof(LogRecord) + LOG_RECORD_DATA];
+    LogRecord *record = this->initRecord(buffer, module, level, format);
     va_list arg;
-    va_list copy;
     va_start(arg, format);
-    va_copy(copy, arg);
+    int len = vsnprintf(record->data, LOG_RECORD_DATA, format, arg);
+    va_end(arg);
+    record->length = len < 0 ? 0 : min(len, LOG_RECORD_DATA - 1);
+    record->timestamp = Hal::micros();
+    record->core = Hal::coreId();
+    this->keep(record);
+    this->emit(record);
+}
 
-    int len = vsnprintf(temp, sizeof(loc_buf), format, copy);
-    va_end(copy);
-    if (len < 0) {
-        va_end(arg);
-        return 0;
-    };
-    if (len >= sizeof(loc_buf)) {
-        temp = (char*)malloc(len+1);
-        if (temp == NULL) {
-            va_end(arg);
-            return 0;
+/**
+ * Write the record to every sink that wants it.  Binary records are sent as a frame to binary sinks, for
+ * text sinks the message is rebuilt from the format string here, once, however many sinks want it.
+ * 
+ *  @param record The record to write
+ *  @return The size of the message written
+ */ 
+size_t LogInfoClass::emit(const LogRecord *record)
+{
+    uint32_t timestamp = (uint32_t)(record->timestamp / 1000);
+    uint8_t frame[LOG_BINARY_MAX_FRAME];
+    size_t frameLen = 0;
+    const char *message = NULL;
+    size_t length = 0;
+    if (record->flags & LOG_RECORD_BINARY)
+    {
+        frameLen = this->buildFrame(record, timestamp, frame);
+    }
+    else if (record->flags & LOG_RECORD_JSON)
+    {
+        // The JSON follows the section header
+        size_t hdrLen = strlen(record->data) + 1;
+        message = &record->data[hdrLen];
+        length = record->length - hdrLen;
+    }
+    else
+    {
+        message = record->data;
+        length = record->length;
+    }
+
+    for (uint8_t i = 0; i < this->_sinkCount; i++)
+    {
+        BaseLogSink *sink = this->_sinks[i];
+        if (!sink->accepts(record->level))
+        {
+            continue;
+        }
+        if (frameLen > 0 && sink->getFormat() == LOG_FORMAT_BINARY)
+        {
+            sink->writeFrame(record, frame, frameLen);
+            continue;
+        }
+        if (message == NULL)
+        {
+            length = LogInfoClass::renderArgs(record->format, (const uint8_t *)record->data, record->length,
+                                              this->_line, sizeof(this->_line));
+            message = this->_line;
         }
-        len = vsnprintf(temp, len+1, format, arg);
+        sink->write(record, timestamp, message, length);
     }
-    va_end(arg);
-    //len = this->log(level, temp);
-    this->write(level, temp);
-    if (temp != loc_buf) {
-        free(temp);
+    return frameLen > 0 ? frameLen : length;
+}
+
+/**
+ * Add the record to the crash log ring.  This is called on the caller's core before the record is queued, so
+ * the records still waiting in the per core buffers when the device panics are in the crash report.  Binary
+ * records are kept as their frame and JSON records as the start of the JSON.
+ * 
+ *  @param record The record to keep
+ */ 
+void LogInfoClass::keep(const LogRecord *record)
+{
+    if (record->level > LogRing.getLevel())
+    {
+        return;
+    }
+    uint32_t timestamp = (uint32_t)(record->timestamp / 1000);
+    if (record->flags & LOG_RECORD_BINARY)
+    {
+        uint8_t frame[LOG_BINARY_MAX_FRAME];
+        size_t frameLen = this->buildFrame(record, timestamp, frame);
+        LogRing.append(record->level, record->core, timestamp, (const char *)frame, frameLen, LOG_RING_BINARY);
+    }
+    else if (record->flags & LOG_RECORD_JSON)
+    {
+        size_t hdrLen = strlen(record->data) + 1;
+        LogRing.append(record->level, record->core, timestamp, &record->data[hdrLen], record->length - hdrLen);
+    }
+    else
+    {
+        LogRing.append(record->level, record->core, timestamp, record->data, record->length);
     }
+}
+
+/**
+ * Build the binary frame for the record.  The format string is not expanded, instead its address is
+ * sent as the message id along with the raw arguments, and the host decoder (tools/logdecode.py)
+ * rebuilds the text from the firmware ELF file.
+ * 
+ * Frame layout (little endian):
+ *    0xA5 | length | format id (4) | timestamp ms (4) | level + core << 4 | arguments
+ * 
+ *  @param record The record holding the message id and raw arguments
+ *  @param timestamp The milliseconds since boot the message was logged at
+ *  @param frame Where the frame is built, LOG_BINARY_MAX_FRAME bytes
+ *  @return The size of the frame.
+ */ 
+size_t LogInfoClass::buildFrame(const LogRecord *record, uint32_t timestamp, uint8_t *frame)
+{
+    size_t len = LOG_BINARY_HEADER_SIZE + min((size_t)record->length, (size_t)(LOG_BINARY_MAX_FRAME - LOG_BINARY_HEADER_SIZE));
+    frame[0] = LOG_BINARY_SYNC;
+    frame[1] = (uint8_t)(len - 2);
+    // The low 32 bits of the address, all of it on the ESP32
+    uint32_t id = (uint32_t)(uintptr_t)record->format;
+    memcpy(&frame[2], &id, sizeof(id));
+    memcpy(&frame[6], &timestamp, sizeof(timestamp));
+    frame[10] = (uint8_t)((record->level & 0x0F) | (record->core << 4));
+    memcpy(&frame[LOG_BINARY_HEADER_SIZE], record->data, len - LOG_BINARY_HEADER_SIZE);
     return len;
 }
 
+/**
+ * Copy the raw arguments for the format string into the buffer without formatting them.  Integers take the
+ * size of their length modifier (4 bytes, 8 bytes for ll, L, q and j), pointers 4 bytes, floating point values
+ * 8 bytes (as passed by varargs) and strings a length byte followed by the characters.  Arguments that do not
+ * fit are dropped.
+ * 
+ *  @param format The format string that describes the arguments
+ *  @param args The arguments to copy
+ *  @param buffer Where the arguments are copied to
+ *  @param size The size of the buffer
+ *  @return The number of bytes copied.
+ */ 
+size_t LogInfoClass::captureArgs(const char *format, va_list *args, uint8_t *buffer, size_t size)
+{
+    size_t len = 0;
+    for (const char *p = format; *p != '\0'; p++)
+    {
+        if (*p != '%')
+        {
+            continue;
+        }
+        p++;
+        if (*p == '%')
+        {
+            continue;
+        }
+        char modifier = '\0';
+        uint8_t longs = 0;
+        while (*p != '\0' && strchr("-+ #0123456789.*hlLqjzt", *p) != NULL)
+        {
+            if (*p == '*')
+            {
+                int width = va_arg(*args, int);
+                if (len + sizeof(width) > size)
+                {
+                    return len;
+                }
+                memcpy(&buffer[len], &width, sizeof(width));
+                len += sizeof(width);
+            }
+            else if (strchr("hlLqjzt", *p) != NULL)
+            {
+                modifier = *p;
+                longs += *p == 'l' ? 1 : 0;
+            }
+            p++;
+        }
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            if (LogInfoClass::integerSize(modifier, longs) == sizeof(long long))
+            {
+                long long value = va_arg(*args, long long);
+                if (len + sizeof(value) > size)
+                {
+                    return len;
+                }
+                memcpy(&buffer[len], &value, sizeof(value));
+                len += sizeof(value);
+            }
+            else
+            {
+                int value = va_arg(*args, int);
+                if (len + sizeof(value) > size)
+                {
+                    return len;
+                }
+                memcpy(&buffer[len], &value, sizeof(value));
+                len += sizeof(value);
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            double value = va_arg(*args, double);
+            if (len + sizeof(value) > size)
+            {
+                return len;
+            }
+            memcpy(&buffer[len], &value, sizeof(value));
+            len += sizeof(value);
+            break;
+        }
+        case 's':
+        {
+            const char *value = va_arg(*args, const char *);
+            if (value == NULL)
+            {
+                value = "(null)";
+            }
+            if (len + 1 > size)
+            {
+                return len;
+            }
+            size_t strLen = min(strlen(value), min(size - len - 1, (size_t)255));
+            buffer[len++] = (uint8_t)strLen;
+            memcpy(&buffer[len], value, strLen);
+            len += strLen;
+            break;
+        }
+        case 'p':
+        {
+            void *value = va_arg(*args, void *);
+            if (len + sizeof(value) > size)
+            {
+                return len;
+            }
+            memcpy(&buffer[len], &value, sizeof(value));
+            len += sizeof(value);
+            break;
+        }
+        case '\0':
+            return len;
+        default:
+            break;
+        }
+    }
+    return len;
+}
+
+/**
+ * Rebuild the text of a binary record from its format string and the arguments copied by captureArgs, so
+ * text sinks still get readable messages when the binary format is used.  Each conversion is formatted on its
+ * own with the original flags, width and precision.
+ * 
+ *  @param format The format string that describes the arguments
+ *  @param args The arguments copied by captureArgs
+ *  @param length The size of the arguments
+ *  @param buffer Where the text is written to
+ *  @param size The size of the buffer
+ *  @return The size of the text written.
+ */ 
+size_t LogInfoClass::renderArgs(const char *format, const uint8_t *args, size_t length, char *buffer, size_t size)
+{
+    size_t len = 0;
+    size_t pos = 0;
+    char spec[24];
+    for (const char *p = format; *p != '\0' && len < size - 1; p++)
+    {
+        if (*p != '%')
+        {
+            buffer[len++] = *p;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            buffer[len++] = *++p;
+            continue;
+        }
+        size_t specLen = 0;
+        spec[specLen++] = *p++;
+        char modifier = '\0';
+        uint8_t longs = 0;
+        while (*p != '\0' && strchr("-+ #0123456789.*hlLqjzt", *p) != NULL && specLen < sizeof(spec) - 12)
+        {
+            if (*p == '*')
+            {
+                int width = 0;
+                if (pos + sizeof(width) <= length)
+                {
+                    memcpy(&width, &args[pos], sizeof(width));
+                    pos += sizeof(width);
+                }
+                specLen += snprintf(&spec[specLen], sizeof(spec) - specLen, "%d", width);
+            }
+            else
+            {
+                if (strchr("hlLqjzt", *p) != NULL)
+                {
+                    modifier = *p;
+                    longs += *p == 'l' ? 1 : 0;
+                }
+                spec[specLen++] = *p;
+            }
+            p++;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        spec[specLen++] = *p;
+        spec[specLen] = '\0';
+        int written = 0;
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            if (LogInfoClass::integerSize(modifier, longs) == sizeof(long long))
+            {
+                long long value;
+                if (pos + sizeof(value) > length)
+                {
+                    return len;
+                }
+                memcpy(&value, &args[pos], sizeof(value));
+                pos += sizeof(value);
+                written = snprintf(&buffer[len], size - len, spec, value);
+            }
+            else
+            {
+                int value;
+                if (pos + sizeof(value) > length)
+                {
+                    return len;
+                }
+                memcpy(&value, &args[pos], sizeof(value));
+                pos += sizeof(value);
+                written = snprintf(&buffer[len], size - len, spec, value);
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            double value;
+            if (pos + sizeof(value) > length)
+            {
+                return len;
+            }
+            memcpy(&value, &args[pos], sizeof(value));
+            pos += sizeof(value);
+            written = snprintf(&buffer[len], size - len, spec, value);
+            break;
+        }
+        case 's':
+        {
+            if (pos + 1 > length)
+            {
+                return len;
+            }
+            char value[256];
+            size_t strLen = (size_t)args[pos];
+            pos++;
+            strLen = min(strLen, length - pos);
+            memcpy(value, &args[pos], strLen);
+            value[strLen] = '\0';
+            pos += strLen;
+            written = snprintf(&buffer[len], size - len, spec, value);
+            break;
+        }
+        case 'p':
+        {
+            void *value;
+            if (pos + sizeof(value) > length)
+            {
+                return len;
+            }
+            memcpy(&value, &args[pos], sizeof(value));
+            pos += sizeof(value);
+            written = snprintf(&buffer[len], size - len, spec, value);
+            break;
+        }
+        default:
+            break;
+        }
+        if (written > 0)
+        {
+            len = min(len + written, size - 1);
+        }
+    }
+    buffer[len] = '\0';
+    return len;
+}
 
-LogInfoClass LogInfo;
\ No newline at end of file
+LogInfoClass LogInfo;
+
+/**
+ * Work out how many bytes varargs passes an integer in from the length modifier of its conversion.  hh and h
+ * are promoted to int, ll, L and q are long long (newlib treats L and q as ll for integers) and j, z and t
+ * are intmax_t, size_t and ptrdiff_t.
+ *
+ *  @param modifier The last length modifier character, or '\0' if there is none
+ *  @param longs The number of 'l' characters, so l and ll can be told apart
+ *  @return The size of the argument.
+ */
+size_t LogInfoClass::integerSize(char modifier, uint8_t longs)
+{
+    switch (modifier)
+    {
+    case 'l':
+        return longs > 1 ? sizeof(long long) : sizeof(long);
+    case 'L':
+    case 'q':
+        return sizeof(long long);
+    case 'j':
+        return sizeof(intmax_t);
+    case 'z':
+        return sizeof(size_t);
+    case 't':
+        return sizeof(ptrdiff_t);
+    default:
+        return sizeof(int);
+    }
+    return sizeof(int);
+}
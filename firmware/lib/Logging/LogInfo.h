@@ -4,6 +4,9 @@
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 #include "Config.h"
+#include "Hal.h"
+#include "LogRing.h"
+#include "LogLimiter.h"
 
 typedef enum
 {
@@ -15,32 +18,134 @@ typedef enum
     LOG_ALL = 5
 } LogType;
 
+typedef enum
+{
+    LM_CORE = 0,
+    LM_CONFIG,
+    LM_CLOUD,
+    LM_LED,
+    LM_GPS,
+    LM_ENV,
+    LM_WIFI,
+    LM_DEVICE,
+    LM_DISPLAY,
+    LM_NTP,
+    LM_WAKEUP,
+    LM_SENSOR,
+    LM_LOG,
+    LM_UTILS,
+    LM_COUNT
+} LogModule;
+
+#define LOG_MODULE_DEFAULT 0xFF    // The module has no level of its own and uses the global level
+
+typedef enum
+{
+    LOG_FORMAT_TEXT = 0,
+    LOG_FORMAT_BINARY = 1
+} LogFormat;
+
+#define LOG_BINARY_SYNC 0xA5       // First byte of every binary log frame
+#define LOG_BINARY_HEADER_SIZE 11  // sync, length, format id (4), timestamp (4), level/core
+#define LOG_BINARY_MAX_FRAME 128   // Largest binary frame, including the header
+
+#define LOG_BUFFER_SIZE 4096       // Size of each per core record buffer
+#define LOG_RECORD_DATA 192        // Largest formatted message, longer messages are truncated
+#define LOG_RECORD_JSON_DATA 768   // Largest JSON message, longer messages are truncated
+
+#define LOG_MAX_SINKS 6            // Most sinks the messages can be written to
+#define LOG_REPEAT_MS 10000        // A message repeating for this long has its repeat count written
+
+#define LOG_RECORD_BINARY 0x01     // The record data holds the raw arguments for a binary frame
+#define LOG_RECORD_JSON 0x02       // The record data holds a section header and a JSON document
+
+typedef struct logRecordStruct
+{
+    int64_t timestamp;  // Hal::micros() when logged, used to merge the per core buffers
+    const char *format; // The format string, its address is the message id for binary frames
+    uint16_t length;
+    uint8_t level;
+    uint8_t module;
+    uint8_t core;
+    uint8_t flags;
+    char data[];
+} LogRecord;
+
+class BaseLogSink;
+
 class LogInfoClass : public BaseConfigInfoClass
 {
 public:
-    LogInfoClass() : BaseConfigInfoClass("LogInfo"), _reportingLevel(LOG_ALL) {}
+    LogInfoClass() : BaseConfigInfoClass("LogInfo"), _reportingLevel(LOG_ALL), _format(LOG_FORMAT_TEXT),
+                     _sinkCount(0), _drainTask(NULL), _dropped(0), _emitting(false), _forceFlush(false),
+                     _suppressRepeats(true), _lastHash(0), _repeats(0)
+    {
+        memset(this->_configuredLevels, LOG_MODULE_DEFAULT, sizeof(this->_configuredLevels));
+        memset(this->_moduleLevels, LOG_ALL, sizeof(this->_moduleLevels));
+    }
     void begin();
     void load(JsonObjectConst obj) override;
     void save(JsonObject ob) override;
     void toJson(JsonObject ob) override;
 
     const char* getUniqueId();
-    size_t log(LogType level, const char *format, ...);
-    size_t log(LogType level, const __FlashStringHelper *ifsh);
-    size_t log(LogType level, const __FlashStringHelper *ifsh, JsonObject object);
-    size_t log(LogType level, const __FlashStringHelper *ifsh, JsonObjectConst object);
+    size_t log(LogModule module, LogType level, const char *format, ...);
+    size_t log(LogModule module, LogType level, const __FlashStringHelper *ifsh);
+    size_t log(LogModule module, LogType level, const __FlashStringHelper *ifsh, JsonObject object);
+    size_t log(LogModule module, LogType level, const __FlashStringHelper *ifsh, JsonObjectConst object);
     void setLogLevel(LogType logType);
     void setLogLevel(const char* logType);
     const char* getLogLevel();
-private:
+    void setModuleLevel(LogModule module, uint8_t level);
+    bool setModuleLevels(JsonObjectConst obj);
+    void modulesToJson(JsonObject obj);
+    void setLogFormat(LogFormat format);
+    void setLogFormat(const char* format);
+    const char* getLogFormat();
+    void flush(uint32_t timeout = 500);
+    void addSink(BaseLogSink *sink);
+    size_t formatPrefix(char *buffer, size_t size, LogType level, uint8_t core, uint32_t timestamp);
     const char* logTypeToShortString(LogType level);
     const char* logTypeToString(LogType level);
     LogType stringToLogType(const char* level);
+    const char* moduleToString(LogModule module);
+private:
+    static void drainTask(void *parameters);
+    void updateModuleLevels();
     LogType _reportingLevel;
-    size_t write(LogType level, const char msg[], const char hdr[] = "Information");
-    size_t writePrefix(LogType level);
-    size_t buildSectionHeader(const char hdr[]);
+    uint8_t _configuredLevels[LM_COUNT];
+    uint8_t _moduleLevels[LM_COUNT];
+    LogFormat _format;
+    BaseLogSink *_sinks[LOG_MAX_SINKS];
+    uint8_t _sinkCount;
+    static size_t captureArgs(const char *format, va_list *args, uint8_t *buffer, size_t size);
+    static size_t renderArgs(const char *format, const uint8_t *args, size_t length, char *buffer, size_t size);
+    static size_t integerSize(char modifier, uint8_t longs);
+    LogRecord *initRecord(uint8_t *buffer, LogModule module, LogType level, const char *format);
+    size_t submit(LogRecord *record);
+    void keep(const LogRecord *record);
+    void drain();
+    LogRecord *receive(uint8_t core);
+    bool isRepeat(const LogRecord *record);
+    void reportRepeats();
+    void emitNotice(LogModule module, LogType level, const char *format, ...);
+    size_t emit(const LogRecord *record);
+    size_t buildFrame(const LogRecord *record, uint32_t timestamp, uint8_t *frame);
     char _uniqueId[23];
+    char _line[LOG_RECORD_DATA];
+    Hal::RingBuffer *_buffers[HAL_CORES];
+    int64_t _lastTimestamps[HAL_CORES];
+    Hal::Task _drainTask;
+    Hal::Signal _wake;      // Wakes the log task when a record is queued
+    uint32_t _dropped;
+    volatile bool _emitting;
+    volatile bool _forceFlush;
+    bool _suppressRepeats;
+    uint32_t _lastHash;
+    uint32_t _repeats;
+    uint32_t _repeatStart;
+    uint8_t _lastLevel;
+    uint8_t _lastModule;
 };
 
 extern LogInfoClass LogInfo;
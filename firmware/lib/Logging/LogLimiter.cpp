@@ -0,0 +1,160 @@
+#include "LogLimiter.h"
+
+/**
+ * Class Constructor, the limiter is off until a rate is set
+ */
+LogLimiterClass::LogLimiterClass() : _burst(0), _perSecond(0)
+{
+    memset(this->_limits, 0, sizeof(this->_limits));
+    memset(this->_evicted, 0, sizeof(this->_evicted));
+}
+
+/**
+ * Set the token bucket used for every call site
+ *
+ * @param burst The most messages a call site can log back to back
+ * @param perSecond The messages per second a call site can keep logging, 0 turns the limiter off
+ */
+void LogLimiterClass::setRate(uint16_t burst, uint16_t perSecond)
+{
+    this->_burst = max(burst, (uint16_t)1);
+    this->_perSecond = perSecond;
+}
+
+/**
+ * Get the most messages a call site can log back to back
+ *
+ * @return The bucket size
+ */
+uint16_t LogLimiterClass::getBurst()
+{
+    return this->_burst;
+}
+
+/**
+ * Get the messages per second a call site can keep logging
+ *
+ * @return The refill rate, 0 if the limiter is off
+ */
+uint16_t LogLimiterClass::getPerSecond()
+{
+    return this->_perSecond;
+}
+
+/**
+ * Can the call site log now.  This is called by log() before the message is formatted, so a call site that
+ * is logging in a tight loop costs a table lookup and not a format and a queue.  Each core has its own table,
+ * so the lock is only ever shared with the log task collecting the counts.  The table is set associative, the
+ * ways of a set are kept with the one used last first, so up to LOG_LIMIT_WAYS call sites whose formats pick the
+ * same set are all limited and a new one replaces the one used longest ago.
+ *
+ * @param format The format string, its address identifies the call site
+ * @param level The level of the message
+ * @param module The module the message comes from
+ * @return True if the message should be logged, false if it has been counted as suppressed
+ */
+bool LogLimiterClass::allow(const char *format, uint8_t level, uint8_t module)
+{
+    if (this->_perSecond == 0 || level == 0)
+    {
+        return true;
+    }
+    uint8_t core = Hal::coreId();
+    // Fibonacci hashing, so string literals laid out at a regular stride are spread over the sets
+    uint32_t hash = ((uint32_t)(uintptr_t)format >> 2) * 2654435761UL;
+    LogLimit *set = this->_limits[core][(hash >> 24) % LOG_LIMIT_SETS];
+    uint32_t now = millis();
+    bool allowed = false;
+    this->_mux[core].enter();
+    uint8_t way = 0;
+    while (way < LOG_LIMIT_WAYS - 1 && set[way].format != format)
+    {
+        way++;
+    }
+    if (way > 0)
+    {
+        LogLimit used = set[way];
+        memmove(&set[1], &set[0], way * sizeof(LogLimit));
+        set[0] = used;
+    }
+    LogLimit *limit = &set[0];
+    if (limit->format != format)
+    {
+        this->_evicted[core] += limit->suppressed;
+        limit->format = format;
+        limit->refilled = now;
+        limit->reported = now;
+        limit->tokens = this->_burst;
+        limit->suppressed = 0;
+    }
+    limit->level = level;
+    limit->module = module;
+    // A call site that has been quiet for a minute has a full bucket whatever the rate
+    uint32_t added = min(now - limit->refilled, (uint32_t)60000) * this->_perSecond / 1000;
+    if (added > 0)
+    {
+        limit->tokens = min((uint32_t)this->_burst, limit->tokens + added);
+        limit->refilled = limit->tokens == this->_burst ? now : limit->refilled + added * 1000 / this->_perSecond;
+    }
+    if (limit->tokens > 0)
+    {
+        limit->tokens--;
+        allowed = true;
+    }
+    else if (limit->suppressed < UINT16_MAX)
+    {
+        limit->suppressed++;
+    }
+    this->_mux[core].exit();
+    return allowed;
+}
+
+/**
+ * Copy out the call sites that have suppressed messages and have not been reported for LOG_LIMIT_REPORT_MS,
+ * their counts are reset.  Called by the log task.
+ *
+ * @param reports Where the call sites are copied to
+ * @param size The most call sites to copy
+ * @return The number of call sites copied
+ */
+uint8_t LogLimiterClass::collect(LogLimit *reports, uint8_t size)
+{
+    uint8_t count = 0;
+    uint32_t now = millis();
+    for (uint8_t core = 0; core < HAL_CORES; core++)
+    {
+        this->_mux[core].enter();
+        for (uint8_t i = 0; i < LOG_LIMIT_SLOTS && count < size; i++)
+        {
+            LogLimit *limit = &this->_limits[core][i / LOG_LIMIT_WAYS][i % LOG_LIMIT_WAYS];
+            if (limit->suppressed > 0 && (now - limit->reported) >= LOG_LIMIT_REPORT_MS)
+            {
+                reports[count++] = *limit;
+                limit->suppressed = 0;
+                limit->reported = now;
+            }
+        }
+        this->_mux[core].exit();
+    }
+    return count;
+}
+
+/**
+ * Get and reset the count of suppressed messages that were lost when their call site was replaced in its set
+ *
+ * @return The number of messages
+ */
+uint32_t LogLimiterClass::takeEvicted()
+{
+    uint32_t evicted = 0;
+    for (uint8_t core = 0; core < HAL_CORES; core++)
+    {
+        this->_mux[core].enter();
+        evicted += this->_evicted[core];
+        this->_evicted[core] = 0;
+        this->_mux[core].exit();
+    }
+    return evicted;
+}
+
+LogLimiterClass LogLimiter;
@@ -0,0 +1,44 @@
+#ifndef LOGLIMITER_H
+#define LOGLIMITER_H
+
+#include <Arduino.h>
+#include "Hal.h"
+
+#define LOG_LIMIT_SETS 4             // Sets of call sites per core, the format's address picks the set
+#define LOG_LIMIT_WAYS 4             // Call sites in each set, a new call site replaces the one used longest ago
+#define LOG_LIMIT_SLOTS (LOG_LIMIT_SETS * LOG_LIMIT_WAYS) // Call sites tracked per core
+#define LOG_LIMIT_REPORT_MS 5000     // Least time between two suppressed summaries for the same call site
+
+typedef struct logLimitStruct
+{
+    const char *format;   // The format string, its address identifies the call site
+    uint32_t refilled;    // The millis() the tokens were last added
+    uint32_t reported;    // The millis() the suppressed count was last reported
+    uint16_t tokens;
+    uint16_t suppressed;
+    uint8_t level;
+    uint8_t module;
+} LogLimit;
+
+class LogLimiterClass
+{
+public:
+    LogLimiterClass();
+    void setRate(uint16_t burst, uint16_t perSecond);
+    uint16_t getBurst();
+    uint16_t getPerSecond();
+    bool allow(const char *format, uint8_t level, uint8_t module);
+    uint8_t collect(LogLimit *reports, uint8_t size);
+    uint32_t takeEvicted();
+
+private:
+    LogLimit _limits[HAL_CORES][LOG_LIMIT_SETS][LOG_LIMIT_WAYS];
+    Hal::Spinlock _mux[HAL_CORES];
+    uint16_t _burst;
+    uint16_t _perSecond;
+    uint32_t _evicted[HAL_CORES];
+};
+
+extern LogLimiterClass LogLimiter;
+
+#endif
@@ -0,0 +1,312 @@
+#include "LogRing.h"
+
+// HAL_RTC_NOINIT is kept over software resets, watchdog resets and deep sleep, but not power on
+HAL_RTC_NOINIT LogRingBuffer _logRing;
+
+/**
+ * Begin the log ring.  If the ring is not valid (power on) it is cleared, if we have restarted after a crash
+ * the previous session's records are copied out so they can be uploaded once we are connected again.
+ */
+void LogRingClass::begin()
+{
+    this->_level = 3;
+    this->_useFile = false;
+    this->_previous = NULL;
+    this->_previousCount = 0;
+    this->_resetReason = Hal::resetReason();
+    if (_logRing.magic != LOG_RING_MAGIC || this->_resetReason == HAL_RESET_POWERON)
+    {
+        memset(&_logRing, 0, sizeof(_logRing));
+        _logRing.magic = LOG_RING_MAGIC;
+        return;
+    }
+
+    if (this->isCrashReset())
+    {
+        this->_previous = new LogRingRecord[LOG_RING_RECORDS];
+        this->_previousCount = this->getRecords(this->_previous);
+    }
+}
+
+/**
+ * Add a record to the core's slice of the RTC ring, the oldest record of the slice is overwritten when it is
+ * full.  This is called by the task logging the message, and only the tasks on its core write the slice, so no
+ * lock is shared with the other core.  The slot is claimed with an atomic add, so a task on the same core that
+ * preempts us takes the next one, and the CRC is written last, so a slot that is still being written (or was
+ * claimed again by a task that lapped the slice) is left out of the report.
+ *
+ * @param level The log level of the message
+ * @param core The core the message was logged on
+ * @param timestamp The milliseconds since boot
+ * @param data The message text or binary frame
+ * @param length The size of the data
+ * @param flags LOG_RING_BINARY if the data is a binary frame
+ */
+void LogRingClass::append(uint8_t level, uint8_t core, uint32_t timestamp, const char *data, size_t length, uint8_t flags)
+{
+    if (level > this->_level || _logRing.magic != LOG_RING_MAGIC)
+    {
+        return;
+    }
+    LogRingSlice *slice = &_logRing.slices[core % HAL_CORES];
+    uint32_t sequence = __atomic_fetch_add(&slice->sequence, 1, __ATOMIC_RELAXED);
+    LogRingRecord *record = &slice->records[sequence % LOG_RING_CORE_RECORDS];
+    record->crc = 0;
+    record->sequence = sequence;
+    record->timestamp = timestamp;
+    record->level = level;
+    record->core = core;
+    record->flags = flags;
+    record->length = (uint8_t)min(length, (size_t)LOG_RING_DATA);
+    memcpy(record->data, data, record->length);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->crc = LogRingClass::recordCrc(record);
+}
+
+/**
+ * Copy the valid records in the ring, the slices of the cores merged oldest first
+ *
+ * @param records Where the records are copied to, room for LOG_RING_RECORDS
+ * @return The number of records copied
+ */
+uint8_t LogRingClass::getRecords(LogRingRecord *records)
+{
+    uint8_t count = 0;
+    for (uint8_t core = 0; core < HAL_CORES; core++)
+    {
+        // Oldest record of the slice first, the head is the next slot to be written
+        const LogRingSlice *slice = &_logRing.slices[core];
+        for (uint8_t i = 0; i < LOG_RING_CORE_RECORDS; i++)
+        {
+            LogRingRecord record = slice->records[(slice->sequence + i) % LOG_RING_CORE_RECORDS];
+            if (!LogRingClass::isValid(&record))
+            {
+                continue;
+            }
+            // An insertion by timestamp keeps each core's own records in the order they were written
+            uint8_t at = count++;
+            while (at > 0 && records[at - 1].timestamp > record.timestamp)
+            {
+                records[at] = records[at - 1];
+                at--;
+            }
+            records[at] = record;
+        }
+    }
+    return count;
+}
+
+/**
+ * Set the highest log level that is kept in the ring
+ *
+ * @param level The LogType level
+ */
+void LogRingClass::setLevel(uint8_t level)
+{
+    this->_level = level;
+}
+
+/**
+ * Get the highest log level that is kept in the ring
+ *
+ * @return The LogType level
+ */
+uint8_t LogRingClass::getLevel()
+{
+    return this->_level;
+}
+
+/**
+ * Keep a copy of every crash report in the crash log file as well, as the RTC memory is lost on power off
+ *
+ * @param flag True if the crash log file is used
+ */
+void LogRingClass::setUseFile(bool flag)
+{
+    this->_useFile = flag;
+    if (flag && this->hasCrashReport())
+    {
+        this->saveToFile();
+    }
+}
+
+/**
+ * Is the crash log file being used
+ *
+ * @return True if the crash log file is used
+ */
+bool LogRingClass::getUseFile()
+{
+    return this->_useFile;
+}
+
+/**
+ * Is there a report of the previous session waiting to be uploaded
+ *
+ * @return True if we restarted after a crash and the ring had records
+ */
+bool LogRingClass::hasCrashReport()
+{
+    return this->_previousCount > 0;
+}
+
+/**
+ * Create a JSON element with the reset reason and the tail of the previous session
+ *
+ * @param json The ArduinoJson object that this element will be added to.
+ */
+void LogRingClass::toJson(JsonObject ob)
+{
+    static const char *levels[] = {"OFF", "ERR", "WRN", "INF", "VRB", "ALL"};
+    auto json = ob.createNestedObject("crash");
+    json["reason"] = this->getResetReason();
+    auto logs = json.createNestedArray("logs");
+    char line[LOG_RING_LINE_SIZE];
+    for (uint8_t i = 0; i < this->_previousCount; i++)
+    {
+        const LogRingRecord *record = &this->_previous[i];
+        int len = snprintf(line, sizeof(line), "%u:%s:%u:", record->timestamp,
+                           levels[record->level % 6], record->core);
+        if (record->flags & LOG_RING_BINARY)
+        {
+            // Binary frames are sent as hex so tools/logdecode.py --hex can decode them
+            for (uint8_t j = 0; j < record->length; j++)
+            {
+                len += snprintf(&line[len], sizeof(line) - len, "%02x", (uint8_t)record->data[j]);
+            }
+        }
+        else
+        {
+            snprintf(&line[len], sizeof(line) - len, "%.*s", record->length, record->data);
+        }
+        logs.add(line);
+    }
+}
+
+/**
+ * The crash report has been uploaded, release the memory holding it
+ */
+void LogRingClass::clearCrashReport()
+{
+    delete[] this->_previous;
+    this->_previous = NULL;
+    this->_previousCount = 0;
+}
+
+/**
+ * Get the reason for the last reset
+ *
+ * @return The reset reason name
+ */
+const char *LogRingClass::getResetReason()
+{
+    switch (this->_resetReason)
+    {
+    case HAL_RESET_POWERON:
+        return "POWERON";
+    case HAL_RESET_EXTERNAL:
+        return "EXTERNAL";
+    case HAL_RESET_SOFTWARE:
+        return "SOFTWARE";
+    case HAL_RESET_PANIC:
+        return "PANIC";
+    case HAL_RESET_INT_WDT:
+        return "INT_WDT";
+    case HAL_RESET_TASK_WDT:
+        return "TASK_WDT";
+    case HAL_RESET_WDT:
+        return "WDT";
+    case HAL_RESET_DEEPSLEEP:
+        return "DEEPSLEEP";
+    case HAL_RESET_BROWNOUT:
+        return "BROWNOUT";
+    default:
+        return "UNKNOWN";
+    }
+    return "UNKNOWN";
+}
+
+/**
+ * Work out the CRC for the record, the crc field itself is not included
+ *
+ * @param record The record to check
+ * @return The CRC16 value
+ */
+uint16_t LogRingClass::recordCrc(const LogRingRecord *record)
+{
+    return Hal::crc16(0, (const uint8_t *)record, offsetof(LogRingRecord, crc));
+}
+
+/**
+ * Check the record has been written and has not been corrupted
+ *
+ * @param record The record to check
+ * @return True if it is valid
+ */
+bool LogRingClass::isValid(const LogRingRecord *record)
+{
+    return record->length > 0 && record->length <= LOG_RING_DATA && record->crc == LogRingClass::recordCrc(record);
+}
+
+/**
+ * Did we restart because of a crash, watchdog or ESP.restart()
+ *
+ * @return True if we should report the previous session
+ */
+bool LogRingClass::isCrashReset()
+{
+    switch (this->_resetReason)
+    {
+    case HAL_RESET_SOFTWARE:
+    case HAL_RESET_PANIC:
+    case HAL_RESET_INT_WDT:
+    case HAL_RESET_TASK_WDT:
+    case HAL_RESET_WDT:
+    case HAL_RESET_BROWNOUT:
+        return true;
+    default:
+        return false;
+    }
+    return false;
+}
+
+/**
+ * Append the crash report to the circular crash log file.  The file is a fixed number of fixed size slots,
+ * the next slot is after the record with the highest sequence, so it never grows and SPIFFS spreads the
+ * writes over its pages.  It is only written once per crash.
+ */
+void LogRingClass::saveToFile()
+{
+    Hal::File file;
+    if (!file.open(LOG_RING_FILE, Hal::fileExists(LOG_RING_FILE) ? "r+" : "w+"))
+    {
+        return;
+    }
+    uint32_t sequence = 0;
+    uint16_t slot = 0;
+    LogRingRecord record;
+    for (uint16_t i = 0; i < LOG_RING_FILE_SLOTS; i++)
+    {
+        if (file.read((uint8_t *)&record, sizeof(record)) != sizeof(record))
+        {
+            break;
+        }
+        if (LogRingClass::isValid(&record) && record.sequence >= sequence)
+        {
+            sequence = record.sequence + 1;
+            slot = (i + 1) % LOG_RING_FILE_SLOTS;
+        }
+    }
+    for (uint8_t i = 0; i < this->_previousCount; i++)
+    {
+        record = this->_previous[i];
+        record.sequence = sequence++;
+        record.crc = LogRingClass::recordCrc(&record);
+        file.seek(slot * sizeof(record));
+        file.write((const uint8_t *)&record, sizeof(record));
+        slot = (slot + 1) % LOG_RING_FILE_SLOTS;
+    }
+    file.close();
+}
+
+LogRingClass LogRing;
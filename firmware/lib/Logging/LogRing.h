@@ -0,0 +1,75 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <Arduino.h>
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+#include "Hal.h"
+
+#define LOG_RING_MAGIC 0x4C475232   // "LGR2", marks the RTC ring as initialised with a slice for each core
+#define LOG_RING_RECORDS 24         // Number of records kept in RTC slow memory
+#define LOG_RING_CORE_RECORDS (LOG_RING_RECORDS / HAL_CORES)    // Records in each core's slice of the ring
+#define LOG_RING_DATA 56            // Message bytes kept per record
+#define LOG_RING_FILE "/crash.log"  // Circular crash log file in SPIFFS
+#define LOG_RING_FILE_SLOTS 96      // Number of records kept in the crash log file
+#define LOG_RING_LINE_SIZE (LOG_RING_DATA * 2 + 24)   // A report line, "millis:level:core:" and the data as hex
+// JSON document size needed for the crash report, every line is copied into the document
+#define LOG_RING_REPORT_SIZE (JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(LOG_RING_RECORDS) + \
+                              LOG_RING_RECORDS * LOG_RING_LINE_SIZE + 64)
+
+#define LOG_RING_BINARY 0x01        // The record data is a binary log frame and not text
+
+typedef struct logRingRecordStruct
+{
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint8_t level;
+    uint8_t core;
+    uint8_t flags;
+    uint8_t length;
+    char data[LOG_RING_DATA];
+    uint16_t crc;
+} LogRingRecord;
+
+typedef struct logRingSliceStruct
+{
+    uint32_t sequence;      // The next record on the core, its slot is the sequence modulo the slice size
+    LogRingRecord records[LOG_RING_CORE_RECORDS];
+} LogRingSlice;
+
+typedef struct logRingStruct
+{
+    uint32_t magic;
+    LogRingSlice slices[HAL_CORES];
+} LogRingBuffer;
+
+class LogRingClass
+{
+public:
+    void begin();
+    void append(uint8_t level, uint8_t core, uint32_t timestamp, const char *data, size_t length, uint8_t flags = 0);
+    void setLevel(uint8_t level);
+    uint8_t getLevel();
+    void setUseFile(bool flag);
+    bool getUseFile();
+    uint8_t getRecords(LogRingRecord *records);
+    bool hasCrashReport();
+    void toJson(JsonObject ob);
+    void clearCrashReport();
+    const char *getResetReason();
+
+private:
+    static uint16_t recordCrc(const LogRingRecord *record);
+    static bool isValid(const LogRingRecord *record);
+    bool isCrashReset();
+    void saveToFile();
+    uint8_t _level;
+    bool _useFile;
+    HalResetReason _resetReason;
+    LogRingRecord *_previous;
+    uint8_t _previousCount;
+};
+
+extern LogRingClass LogRing;
+
+#endif
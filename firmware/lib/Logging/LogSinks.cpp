@@ -0,0 +1,337 @@
+#include "Hal.h"
+#include "LogSinks.h"
+
+/**
+ * Write the text message to the serial port, JSON messages are pretty printed within a section header.
+ *
+ * @param record The record being written
+ * @param timestamp The milliseconds since boot the message was logged at
+ * @param message The message text
+ * @param length The size of the message
+ */
+void SerialLogSinkClass::write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length)
+{
+    this->writePrefix((LogType)record->level, record->core, timestamp);
+    if (record->flags & LOG_RECORD_JSON)
+    {
+        int section = this->buildSectionHeader(record->data);
+        DynamicJsonDocument doc(LOG_RECORD_JSON_DATA * 2);
+        if (deserializeJson(doc, message, length) == DeserializationError::Ok)
+        {
+            Hal::ConsoleWriter console;
+            serializeJsonPretty(doc, console);
+        }
+        else
+        {
+            // Truncated, so just write what we have
+            Hal::consoleWrite((const uint8_t *)message, length);
+        }
+        Hal::consolePrint("\r\n");
+        for (int i = 0; i < section - 4; i++)
+        {
+            Hal::consolePrint("=");
+        }
+        Hal::consolePrint("\r\n");
+        return;
+    }
+    // Check if multi line or not.
+    boolean multiline = false;
+    if (memchr(message, '\r', length))
+    {
+        multiline = true;
+        this->buildSectionHeader("Information");
+    }
+    Hal::consoleWrite((const uint8_t *)message, length);
+    Hal::consolePrint("\r\n");
+    if (multiline)
+    {
+        Hal::consolePrint("===========================\r\n");
+    }
+}
+
+/**
+ * Write the binary frame to the serial port
+ *
+ * @param record The record being written
+ * @param frame The binary frame
+ * @param length The size of the frame
+ */
+void SerialLogSinkClass::writeFrame(const LogRecord *record, const uint8_t *frame, size_t length)
+{
+    Hal::consoleWrite(frame, length);
+}
+
+/**
+ * Write the prefix header to the message
+ *
+ * @param level The logType level being assigned to.
+ * @param core The core the message was logged on
+ * @param timestamp The milliseconds since boot the message was logged at
+ * @return The size of the string written.
+ */
+size_t SerialLogSinkClass::writePrefix(LogType level, uint8_t core, uint32_t timestamp)
+{
+    char prefix[24];
+    size_t len = LogInfo.formatPrefix(prefix, sizeof(prefix), level, core, timestamp);
+    return Hal::consoleWrite((const uint8_t *)prefix, len);
+}
+
+/**
+ * build the message section header to the log level.
+ *
+ * @param hdr The character array to write
+ * @return The size of the string written.
+ */
+size_t SerialLogSinkClass::buildSectionHeader(const char hdr[])
+{
+    int len = 0;
+    len = Hal::consolePrint("\r\n");
+    len += Hal::consolePrint("======= ");
+    len += Hal::consolePrint(hdr);
+    len += Hal::consolePrint(" =======\r\n");
+    return len;
+}
+
+/**
+ * Add the message to the memory buffer, the buffer is written to the file when it is full or flushSeconds
+ * have passed since the last write, so the flash is written in large blocks.
+ *
+ * @param record The record being written
+ * @param timestamp The milliseconds since boot the message was logged at
+ * @param message The message text
+ * @param length The size of the message
+ */
+void FileLogSinkClass::write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length)
+{
+    char prefix[24];
+    size_t prefixLen = LogInfo.formatPrefix(prefix, sizeof(prefix), (LogType)record->level, record->core, timestamp);
+    length = min(length, (size_t)(LOG_FILE_BUFFER - prefixLen - 1));
+    if (this->_length + prefixLen + length + 1 > LOG_FILE_BUFFER)
+    {
+        this->writeBuffer();
+    }
+    memcpy(&this->_buffer[this->_length], prefix, prefixLen);
+    this->_length += prefixLen;
+    memcpy(&this->_buffer[this->_length], message, length);
+    this->_length += length;
+    this->_buffer[this->_length++] = '\n';
+}
+
+/**
+ * Write the buffer to the file if flushSeconds have passed since the last write
+ *
+ * @param force True if the buffer is written whatever the time
+ */
+void FileLogSinkClass::flush(bool force)
+{
+    if (this->_length > 0 && (force || (millis() - this->_lastWrite) >= this->_flushSeconds * 1000UL))
+    {
+        this->writeBuffer();
+    }
+}
+
+/**
+ * overridden load JSON element into the sink
+ *
+ * @param json The ArduinoJson object that this element will be loaded from
+ */
+void FileLogSinkClass::load(JsonObjectConst obj)
+{
+    BaseLogSink::load(obj);
+    this->_maxSize = obj.containsKey("maxSize") ? obj["maxSize"].as<uint32_t>() : 65536;
+    this->_flushSeconds = obj.containsKey("flushSeconds") ? obj["flushSeconds"].as<uint16_t>() : 30;
+}
+
+/**
+ * overridden save JSON element from the sink
+ *
+ * @param json The ArduinoJson object that this element will be added to.
+ */
+void FileLogSinkClass::save(JsonObject obj)
+{
+    BaseLogSink::save(obj);
+    obj[this->_name]["maxSize"] = this->_maxSize;
+    obj[this->_name]["flushSeconds"] = this->_flushSeconds;
+}
+
+/**
+ * Append the buffer to the log file, when the file reaches maxSize it is renamed to the old log file and a
+ * new one is started, so at most two files are kept.
+ */
+void FileLogSinkClass::writeBuffer()
+{
+    this->_lastWrite = millis();
+    if (Hal::fileSize(LOG_FILE_NAME) + this->_length > this->_maxSize)
+    {
+        Hal::removeFile(LOG_FILE_OLD_NAME);
+        Hal::renameFile(LOG_FILE_NAME, LOG_FILE_OLD_NAME);
+    }
+    Hal::writeFile(LOG_FILE_NAME, (const uint8_t *)this->_buffer, this->_length, true);
+    this->_length = 0;
+}
+
+/**
+ * Send the message as a RFC 5424 syslog message, one message to each datagram as RFC 5426 asks, so every
+ * collector splits them the same way.  If there is no network the message is dropped.
+ *
+ * @param record The record being written
+ * @param timestamp The milliseconds since boot the message was logged at
+ * @param message The message text
+ * @param length The size of the message
+ */
+void SyslogLogSinkClass::write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length)
+{
+    if (!Hal::networkUp() || strlen(this->_host) == 0)
+    {
+        return;
+    }
+    // <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA, local0 facility, no clock so the
+    // timestamp is the nil value and the uptime goes in the message
+    int headerLen = snprintf(this->_datagram, LOG_SYSLOG_DATAGRAM, "<%u>1 - %s esp32-iot - - - %lu:%u:",
+                             16 * 8 + SyslogLogSinkClass::severity(record->level),
+                             LogInfo.getUniqueId(), (unsigned long)timestamp, record->core);
+    if (headerLen < 0)
+    {
+        return;
+    }
+    size_t len = min((size_t)headerLen, (size_t)LOG_SYSLOG_DATAGRAM - 1);
+    length = min(length, LOG_SYSLOG_DATAGRAM - len);
+    memcpy(&this->_datagram[len], message, length);
+    Hal::udpSend(this->_host, this->_port, (const uint8_t *)this->_datagram, len + length);
+}
+
+/**
+ * overridden load JSON element into the sink
+ *
+ * @param json The ArduinoJson object that this element will be loaded from
+ */
+void SyslogLogSinkClass::load(JsonObjectConst obj)
+{
+    BaseLogSink::load(obj);
+    strlcpy(this->_host, obj.containsKey("host") ? obj["host"].as<const char *>() : "", sizeof(this->_host));
+    this->_port = obj.containsKey("port") ? obj["port"].as<uint16_t>() : 514;
+}
+
+/**
+ * overridden save JSON element from the sink
+ *
+ * @param json The ArduinoJson object that this element will be added to.
+ */
+void SyslogLogSinkClass::save(JsonObject obj)
+{
+    BaseLogSink::save(obj);
+    obj[this->_name]["host"] = this->_host;
+    obj[this->_name]["port"] = this->_port;
+}
+
+/**
+ * Convert the log level to the syslog severity
+ *
+ * @param level The LogType level
+ * @return The syslog severity
+ */
+uint8_t SyslogLogSinkClass::severity(uint8_t level)
+{
+    switch (level)
+    {
+    case LOG_OFF:
+        return 5; // Notice, LOG_OFF messages are always written
+    case LOG_ERROR:
+        return 3;
+    case LOG_WARNING:
+        return 4;
+    case LOG_INFO:
+        return 6;
+    default:
+        return 7;
+    }
+    return 7;
+}
+
+/**
+ * Add the text message to the batch that is sent by the cloud task
+ *
+ * @param record The record being written
+ * @param timestamp The milliseconds since boot the message was logged at
+ * @param message The message text
+ * @param length The size of the message
+ */
+void MqttLogSinkClass::write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length)
+{
+    char line[LOG_RECORD_DATA + 32];
+    size_t len = LogInfo.formatPrefix(line, sizeof(line), (LogType)record->level, record->core, timestamp);
+    length = min(length, sizeof(line) - len - 1);
+    memcpy(&line[len], message, length);
+    len += length;
+    line[len++] = '\n';
+    this->append((const uint8_t *)line, len);
+}
+
+/**
+ * Add the binary frame to the batch that is sent by the cloud task
+ *
+ * @param record The record being written
+ * @param frame The binary frame
+ * @param length The size of the frame
+ */
+void MqttLogSinkClass::writeFrame(const LogRecord *record, const uint8_t *frame, size_t length)
+{
+    this->append(frame, length);
+}
+
+/**
+ * Take the current batch so it can be published, new messages go into the other buffer until
+ * releaseBatch is called.  The MQTT client is not thread safe, so this is called by the cloud code and not the
+ * log task.
+ *
+ * @param length Set to the size of the batch
+ * @return The batch or NULL if there is nothing to send
+ */
+const uint8_t *MqttLogSinkClass::takeBatch(size_t *length)
+{
+    const uint8_t *batch = NULL;
+    this->_mux.enter();
+    uint8_t taken = this->_active ^ 1;
+    if (this->_lengths[this->_active] > 0 && this->_lengths[taken] == 0)
+    {
+        this->_active = taken;
+        taken ^= 1;
+        batch = this->_batches[taken];
+        *length = this->_lengths[taken];
+    }
+    this->_mux.exit();
+    return batch;
+}
+
+/**
+ * The batch taken has been published (or dropped), the buffer can be reused
+ */
+void MqttLogSinkClass::releaseBatch()
+{
+    this->_mux.enter();
+    this->_lengths[this->_active ^ 1] = 0;
+    this->_mux.exit();
+}
+
+/**
+ * Append the data to the active batch, if it is full the message is dropped until the batch is sent
+ *
+ * @param data The message
+ * @param length The size of the message
+ */
+void MqttLogSinkClass::append(const uint8_t *data, size_t length)
+{
+    this->_mux.enter();
+    uint16_t *used = &this->_lengths[this->_active];
+    if (*used + length <= LOG_MQTT_BATCH)
+    {
+        memcpy(&this->_batches[this->_active][*used], data, length);
+        *used += length;
+    }
+    this->_mux.exit();
+}
+
+SerialLogSinkClass SerialSink;
+FileLogSinkClass FileSink;
+SyslogLogSinkClass SyslogSink;
+MqttLogSinkClass MqttSink;
@@ -0,0 +1,79 @@
+#ifndef LOGSINKS_H
+#define LOGSINKS_H
+
+#include "BaseLogSink.h"
+
+#define LOG_FILE_NAME "/log.txt"       // Local log file in SPIFFS
+#define LOG_FILE_OLD_NAME "/log.old"   // The log file is renamed to this when it is full
+#define LOG_FILE_BUFFER 1024           // Bytes kept in memory before they are written to the file
+#define LOG_SYSLOG_DATAGRAM 1200       // Largest syslog datagram, one message each, fits in an Ethernet frame
+#define LOG_MQTT_BATCH 2048            // Largest batch of messages sent in one MQTT message
+
+class SerialLogSinkClass : public BaseLogSink
+{
+public:
+    SerialLogSinkClass() : BaseLogSink("serial", LOG_ALL, true) {}
+    void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) override;
+    void writeFrame(const LogRecord *record, const uint8_t *frame, size_t length) override;
+
+private:
+    size_t writePrefix(LogType level, uint8_t core, uint32_t timestamp);
+    size_t buildSectionHeader(const char hdr[]);
+};
+
+class FileLogSinkClass : public BaseLogSink
+{
+public:
+    FileLogSinkClass() : BaseLogSink("file", LOG_VERBOSE) {}
+    void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) override;
+    void flush(bool force) override;
+    void load(JsonObjectConst obj) override;
+    void save(JsonObject obj) override;
+
+private:
+    void writeBuffer();
+    char _buffer[LOG_FILE_BUFFER];
+    uint16_t _length;
+    uint32_t _maxSize;
+    uint16_t _flushSeconds;
+    uint32_t _lastWrite;
+};
+
+class SyslogLogSinkClass : public BaseLogSink
+{
+public:
+    SyslogLogSinkClass() : BaseLogSink("syslog", LOG_WARNING) {}
+    void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) override;
+    void load(JsonObjectConst obj) override;
+    void save(JsonObject obj) override;
+
+private:
+    static uint8_t severity(uint8_t level);
+    char _host[64];
+    uint16_t _port;
+    char _datagram[LOG_SYSLOG_DATAGRAM];
+};
+
+class MqttLogSinkClass : public BaseLogSink
+{
+public:
+    MqttLogSinkClass() : BaseLogSink("mqtt", LOG_WARNING), _active(0) {}
+    void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) override;
+    void writeFrame(const LogRecord *record, const uint8_t *frame, size_t length) override;
+    const uint8_t *takeBatch(size_t *length);
+    void releaseBatch();
+
+private:
+    void append(const uint8_t *data, size_t length);
+    uint8_t _batches[2][LOG_MQTT_BATCH];
+    uint16_t _lengths[2];
+    uint8_t _active;
+    Hal::Spinlock _mux;
+};
+
+extern SerialLogSinkClass SerialSink;
+extern FileLogSinkClass FileSink;
+extern SyslogLogSinkClass SyslogSink;
+extern MqttLogSinkClass MqttSink;
+
+#endif
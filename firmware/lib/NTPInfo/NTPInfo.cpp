@@ -5,8 +5,7 @@
  */
 void NTPInfoClass::begin()
 {
-    this->_ntp.begin();
-    this->_ntp.update();
+    Hal::timeBegin("pool.ntp.org");
 }
 
 /**
@@ -18,7 +17,7 @@ void NTPInfoClass::begin()
  */
 String NTPInfoClass::getFormattedDate() // Convert epoch time to date - Surprising not part of NTPClient Package!
 {
-    unsigned long rawTime = this->_ntp.getEpochTime() / 86400L; // in days
+    unsigned long rawTime = Hal::epoch() / 86400L; // in days
     unsigned long days = 0, year = 1970;
     uint8_t month;
     static const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
@@ -58,7 +57,7 @@ String NTPInfoClass::getFormattedDate() // Convert epoch time to date - Surprisi
 String NTPInfoClass::getISO8601Formatted() // Convert epoch time to ISO8601 formatted date/time
 {
     String date = this->getFormattedDate();
-    return date + String("T") + this->_ntp.getFormattedTime() + "Z";
+    return date + String("T") + this->getFormattedTime() + "Z";
 }
 
 /**
@@ -68,9 +67,12 @@ String NTPInfoClass::getISO8601Formatted() // Convert epoch time to ISO8601 form
  * 
  * @return Formmatted time string
  */
-String NTPInfoClass::getFormattedTime() // Get the formatted time from the generic NTP Client
+String NTPInfoClass::getFormattedTime()
 {
-    return this->_ntp.getFormattedTime();
+    unsigned long rawTime = Hal::epoch();
+    char time[9];
+    snprintf(time, sizeof(time), "%02lu:%02lu:%02lu", (rawTime % 86400L) / 3600, (rawTime % 3600) / 60, rawTime % 60);
+    return String(time);
 }
 
 /**
@@ -79,7 +81,7 @@ String NTPInfoClass::getFormattedTime() // Get the formatted time from the gener
 void NTPInfoClass::tick() // Call the NTP update function to pool the site
 {
     int8_t count = 0;
-    this->_ntp.update();
+    Hal::timeUpdate();
     long epoch = this->getEpoch();
     while (epoch < 1577836800)
     {
@@ -88,8 +90,8 @@ void NTPInfoClass::tick() // Call the NTP update function to pool the site
         {
             break;
         }
-        this->_ntp.update();
-        delay(50);
+        Hal::timeUpdate();
+        Hal::delay(50);
         epoch = this->getEpoch();
     };
 }
@@ -103,7 +105,7 @@ void NTPInfoClass::tick() // Call the NTP update function to pool the site
  */
 long NTPInfoClass::getEpoch() // Get the current epoch time
 {
-    long epoch = this->_ntp.getEpochTime();
+    long epoch = Hal::epoch();
     if (epoch > 1577836800)
     {
         return epoch;
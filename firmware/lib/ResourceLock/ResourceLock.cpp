@@ -0,0 +1,96 @@
+#include "ResourceLock.h"
+#include "LogInfo.h"
+
+ResourceLock *ResourceLock::_first = NULL;
+
+/**
+ * Class Constructor, the lock is added to the list reported by allToJson
+ * 
+ * @param name The resource name used in the logs and statistics
+ */
+ResourceLock::ResourceLock(const char *name) : _name(name), _taken(0), _contended(0), _timeouts(0), _maxWaitUs(0)
+{
+    this->_next = ResourceLock::_first;
+    ResourceLock::_first = this;
+}
+
+/**
+ * Take the lock, waiting at most timeoutMs for another task to give it
+ * 
+ * @param timeoutMs The most milliseconds to wait, LOCK_WAIT_FOREVER to wait until it is free
+ * @return True if the lock was taken
+ */
+bool ResourceLock::take(uint32_t timeoutMs)
+{
+    int64_t start = Hal::micros();
+    bool contended = !this->_mutex.take(0);
+    bool taken = !contended || this->_mutex.take(timeoutMs);
+    uint32_t waited = Hal::micros() - start;
+    this->_mux.enter();
+    this->_taken += taken ? 1 : 0;
+    this->_contended += contended ? 1 : 0;
+    this->_timeouts += taken ? 0 : 1;
+    this->_maxWaitUs = max(this->_maxWaitUs, waited);
+    this->_mux.exit();
+    if (!taken)
+    {
+        LogInfo.log(LM_CORE, LOG_WARNING, "Timed out after %u ms waiting for the %s lock", timeoutMs, this->_name);
+    }
+    return taken;
+}
+
+/**
+ * Give the lock back
+ */
+void ResourceLock::give()
+{
+    this->_mutex.give();
+}
+
+/**
+ * Get the resource name
+ * 
+ * @return The name
+ */
+const char *ResourceLock::getName()
+{
+    return this->_name;
+}
+
+/**
+ * Create a JSON element with the lock's counters
+ * 
+ * @param ob The ArduinoJson object that this element will be added to.
+ */
+void ResourceLock::toJson(JsonObject ob)
+{
+    auto json = ob.createNestedObject(this->_name);
+    this->_mux.enter();
+    uint32_t taken = this->_taken;
+    uint32_t contended = this->_contended;
+    uint32_t timeouts = this->_timeouts;
+    uint32_t maxWaitUs = this->_maxWaitUs;
+    this->_mux.exit();
+    json["taken"] = taken;
+    json["contended"] = contended;
+    json["timeouts"] = timeouts;
+    json["maxWaitUs"] = maxWaitUs;
+}
+
+/**
+ * Create a JSON element with the counters of every lock
+ * 
+ * @param ob The ArduinoJson object that this element will be added to.
+ */
+void ResourceLock::allToJson(JsonObject ob)
+{
+    auto json = ob.createNestedObject("locks");
+    for (ResourceLock *lock = ResourceLock::_first; lock != NULL; lock = lock->_next)
+    {
+        lock->toJson(json);
+    }
+}
+
+ResourceLock UartLock("uart");
+ResourceLock BusLock("bus");
+ResourceLock MqttLock("mqtt");
@@ -0,0 +1,40 @@
+#ifndef RESOURCELOCK_H
+#define RESOURCELOCK_H
+
+#include "Hal.h"
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+
+#define LOCK_WAIT_FOREVER HAL_WAIT_FOREVER    // Timeout that waits until the lock is free
+
+/**
+ * A lock for one shared resource (a UART, a bus, the MQTT client), with counters so contention can be seen.
+ * The lock is recursive, so a task holding it can call code that takes it again.
+ */
+class ResourceLock
+{
+public:
+    ResourceLock(const char *name);
+    bool take(uint32_t timeoutMs);
+    void give();
+    const char *getName();
+    void toJson(JsonObject ob);
+    static void allToJson(JsonObject ob);
+
+private:
+    const char *_name;
+    Hal::Mutex _mutex;
+    uint32_t _taken;
+    uint32_t _contended;      // Takes that had to wait for another task
+    uint32_t _timeouts;
+    uint32_t _maxWaitUs;
+    Hal::Spinlock _mux;
+    ResourceLock *_next;
+    static ResourceLock *_first;
+};
+
+extern ResourceLock UartLock;
+extern ResourceLock BusLock;
+extern ResourceLock MqttLock;
+
+#endif
@@ -0,0 +1,262 @@
+#include "SensorRegistry.h"
+#include "LogInfo.h"
+
+SensorType *SensorType::_first = NULL;
+
+/**
+ * Class Constructor, the type is added to the list the configuration's sensors are looked up in
+ * 
+ * @param type The name of the type in the sensors array, e.g. "dht22"
+ * @param sectionName The section of the first sensor of the type, e.g. "envSensor"
+ * @param factory Creates a sensor of the type
+ * @param lock The lock for the hardware the first sensor of the type is on
+ */
+SensorType::SensorType(const char *type, const char *sectionName, SENSORFACTORY factory, ResourceLock *lock)
+    : _type(type), _sectionName(sectionName), _factory(factory), _lock(lock)
+{
+    this->_next = SensorType::_first;
+    SensorType::_first = this;
+}
+
+/**
+ * Get the name of the type
+ * 
+ * @return The name
+ */
+const char *SensorType::getType()
+{
+    return this->_type;
+}
+
+/**
+ * Get the section of the first sensor of the type
+ * 
+ * @return The section name
+ */
+const char *SensorType::getSectionName()
+{
+    return this->_sectionName;
+}
+
+/**
+ * Create a sensor of the type
+ * 
+ * @param sectionName The section the sensor's settings are in
+ * @param index The number of sensors of the type created before this one
+ * @return The sensor, NULL if the type has no more hardware for it
+ */
+BaseSensorClass *SensorType::create(const char *sectionName, uint8_t index)
+{
+    return this->_factory(sectionName, index);
+}
+
+/**
+ * Get the lock for the hardware the first sensor of the type is on
+ * 
+ * @return The resource lock
+ */
+ResourceLock *SensorType::getLock()
+{
+    return this->_lock;
+}
+
+/**
+ * Find a registered type by name
+ * 
+ * @param type The name of the type
+ * @return The type, NULL if no library registered it
+ */
+SensorType *SensorType::find(const char *type)
+{
+    for (SensorType *sensorType = SensorType::_first; sensorType != NULL; sensorType = sensorType->_next)
+    {
+        if (strcmp(sensorType->_type, type) == 0)
+        {
+            return sensorType;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * overridden the sensors element is an array, so it is loaded by loadElement
+ * 
+ * @param obj Not used
+ */
+void SensorRegistryClass::load(JsonObjectConst obj)
+{
+}
+
+/**
+ * overridden create the sensors listed in the sensors array.  Each sensor's own section is added to the
+ * configuration, so it is loaded as the rest of the file is read, which is why the sensors array comes first.
+ * 
+ * @param element The sensors array, e.g. [{"type": "dht22"}, {"type": "dht22", "section": "greenhouse"}]
+ */
+void SensorRegistryClass::loadElement(JsonVariantConst element)
+{
+    // A reload (e.g. from the backup) keeps the sensors already created
+    JsonArrayConst sensors = element.as<JsonArrayConst>();
+    for (size_t i = 0; i < sensors.size(); i++)
+    {
+        const char *type = sensors[i]["type"] | "";
+        uint8_t position = 0;
+        for (size_t j = 0; j < i; j++)
+        {
+            position += strcmp(sensors[j]["type"] | "", type) == 0 ? 1 : 0;
+        }
+        this->create(type, sensors[i]["section"] | "", position);
+    }
+    LogInfo.log(LM_CORE, LOG_VERBOSE, "%u sensors in the configuration", this->_total);
+}
+
+/**
+ * Create a sensor of the type, begin it with its lock and add its section to the configuration.  Unless the
+ * entry names its section the first sensor of a type has the type's section and the next have their number
+ * added (e.g. "envSensor2").  The first sensor created has the type's lock, the next a lock of their own as
+ * they are on other hardware.
+ * 
+ * @param type The name of the type
+ * @param sectionName The section named by the entry, empty for the type's
+ * @param position The number of entries of the type before this one in the sensors array
+ * @return True if the sensor was created
+ */
+bool SensorRegistryClass::create(const char *type, const char *sectionName, uint8_t position)
+{
+    SensorType *sensorType = SensorType::find(type);
+    if (sensorType == NULL)
+    {
+        LogInfo.log(LM_CORE, LOG_ERROR, "Unknown sensor type %s", type);
+        return false;
+    }
+    char section[CONFIG_SECTION_NAME_SIZE];
+    if (sectionName[0] != 0)
+    {
+        strlcpy(section, sectionName, sizeof(section));
+    }
+    else if (position == 0)
+    {
+        strlcpy(section, sensorType->getSectionName(), sizeof(section));
+    }
+    else
+    {
+        snprintf(section, sizeof(section), "%s%u", sensorType->getSectionName(), position + 1);
+    }
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        if (this->_sensors[i]->getConfig()->isSection(section))
+        {
+            return false;
+        }
+    }
+    if (this->_total >= SENSOR_MAX)
+    {
+        LogInfo.log(LM_CORE, LOG_ERROR, "Too many sensors, %s not added", type);
+        return false;
+    }
+    uint8_t index = this->countType(sensorType);
+    BaseSensorClass *sensor = sensorType->create(section, index);
+    if (sensor == NULL)
+    {
+        LogInfo.log(LM_CORE, LOG_ERROR, "No more hardware for a %s sensor, %s not added", type, section);
+        return false;
+    }
+    ResourceLock *lock = index == 0 ? sensorType->getLock() : new ResourceLock(sensor->getConfig()->getSectionName());
+    this->_types[this->_total] = sensorType;
+    this->_sensors[this->_total++] = sensor;
+    sensor->begin(lock);
+    Configuration.add(sensor->getConfig());
+    return true;
+}
+
+/**
+ * Count the sensors of the type created so far
+ * 
+ * @param sensorType The type
+ * @return The number of sensors
+ */
+uint8_t SensorRegistryClass::countType(SensorType *sensorType)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        count += this->_types[i] == sensorType ? 1 : 0;
+    }
+    return count;
+}
+
+/**
+ * overridden save the sensors array, it is saved before the sensors' own sections
+ * 
+ * @param json The ArduinoJson object that this element will be added to
+ */
+void SensorRegistryClass::save(JsonObject obj)
+{
+    auto json = obj.createNestedArray(this->_sectionName);
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        auto sensor = json.createNestedObject();
+        sensor["type"] = this->_types[i]->getType();
+        sensor["section"] = this->_sensors[i]->getConfig()->getSectionName();
+    }
+}
+
+/**
+ * overridden create the device twin element of each sensor
+ * 
+ * @param ob The ArduinoJson object that the elements will be added to.
+ */
+void SensorRegistryClass::toJson(JsonObject ob)
+{
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        this->_sensors[i]->toJson(ob);
+    }
+}
+
+/**
+ * Create the telemetry element of each sensor
+ * 
+ * @param ob The ArduinoJson object that the elements will be added to.
+ */
+void SensorRegistryClass::toTelemetry(JsonObject ob)
+{
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        this->_sensors[i]->toTelemetry(ob);
+    }
+}
+
+/**
+ * Connect each sensor, the connected sensors add themselves to the scheduler
+ */
+void SensorRegistryClass::connect()
+{
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        this->_sensors[i]->connect();
+    }
+}
+
+/**
+ * Get the number of sensors created
+ * 
+ * @return The number of sensors
+ */
+uint8_t SensorRegistryClass::getCount()
+{
+    return this->_total;
+}
+
+/**
+ * Get a sensor
+ * 
+ * @param index The sensor, in the order of the sensors array
+ * @return The sensor, NULL if there is no such sensor
+ */
+BaseSensorClass *SensorRegistryClass::get(uint8_t index)
+{
+    return index < this->_total ? this->_sensors[index] : NULL;
+}
+
+SensorRegistryClass SensorRegistry;
@@ -0,0 +1,59 @@
+#ifndef SENSORREGISTRY_H
+#define SENSORREGISTRY_H
+
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+#include "Config.h"
+#include "BaseSensor.h"
+#include "ResourceLock.h"
+#include "SensorScheduler.h"
+
+typedef BaseSensorClass *(*SENSORFACTORY)(const char *sectionName, uint8_t index);
+
+/**
+ * A kind of sensor that can be listed in the sensors array of the configuration.  Each sensor library has one,
+ * so the sensor is registered by linking its library.
+ */
+class SensorType
+{
+public:
+    SensorType(const char *type, const char *sectionName, SENSORFACTORY factory, ResourceLock *lock);
+    const char *getType();
+    const char *getSectionName();
+    BaseSensorClass *create(const char *sectionName, uint8_t index);
+    ResourceLock *getLock();
+    static SensorType *find(const char *type);
+
+private:
+    const char *_type;
+    const char *_sectionName;     // The section of the first sensor of the type, the next have a number added
+    SENSORFACTORY _factory;
+    ResourceLock *_lock;
+    SensorType *_next;
+    static SensorType *_first;
+};
+
+class SensorRegistryClass : public BaseConfigInfoClass
+{
+public:
+    SensorRegistryClass() : BaseConfigInfoClass("sensors"), _total(0) {}
+    void load(JsonObjectConst obj) override;
+    void loadElement(JsonVariantConst element) override;
+    void save(JsonObject obj) override;
+    void toJson(JsonObject ob) override;
+    void toTelemetry(JsonObject ob);
+    void connect();
+    uint8_t getCount();
+    BaseSensorClass *get(uint8_t index);
+
+private:
+    bool create(const char *type, const char *sectionName, uint8_t position);
+    uint8_t countType(SensorType *sensorType);
+    SensorType *_types[SENSOR_MAX];
+    BaseSensorClass *_sensors[SENSOR_MAX];
+    uint8_t _total;
+};
+
+extern SensorRegistryClass SensorRegistry;
+
+#endif
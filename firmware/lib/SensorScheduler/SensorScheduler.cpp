@@ -0,0 +1,336 @@
+#include "SensorScheduler.h"
+#include "Hal.h"
+
+/**
+ * Class Constructor
+ */
+SensorSchedulerClass::SensorSchedulerClass() : _heapSize(0), _total(0), _started(false), _loopWorker(false),
+                                               _stackFree(SENSOR_WORKER_STACK), _queue(NULL), _loopQueue(NULL)
+{
+}
+
+/**
+ * Add a sensor to be read every sample rate.  Sensors are added when they connect, the first read is one
+ * sample rate after they are added.
+ * 
+ * @param sensor The sensor
+ * @return True if there was room for the sensor
+ */
+bool SensorSchedulerClass::add(BaseSensorClass *sensor)
+{
+    if (this->_total == SENSOR_MAX)
+    {
+        LogInfo.log(LM_SENSOR, LOG_ERROR, "No room to schedule %s", sensor->getName());
+        return false;
+    }
+    this->_mux.enter();
+    uint8_t index = this->_total++;
+    SensorSchedule *schedule = &this->_schedules[index];
+    memset(schedule, 0, sizeof(SensorSchedule));
+    schedule->sensor = sensor;
+    schedule->due = Hal::micros() + sensor->getInterval() * 1000LL;
+    this->push(index);
+    this->_mux.exit();
+    LogInfo.log(LM_SENSOR, LOG_VERBOSE, "Scheduled %s every %u ms", sensor->getName(), sensor->getInterval());
+    if (this->_started)
+    {
+        if (sensor->getSingleThreadFlag())
+        {
+            this->startLoopWorker();
+        }
+        this->arm();
+    }
+    return true;
+}
+
+/**
+ * Create the workers and the timer and start reading the sensors
+ */
+void SensorSchedulerClass::begin()
+{
+    if (this->_started)
+    {
+        return;
+    }
+    this->_queue = new Hal::Queue(sizeof(uint8_t), SENSOR_MAX);
+    for (uint8_t i = 0; i < SENSOR_WORKERS; i++)
+    {
+        Hal::startTask(SensorSchedulerClass::workerTask, "SensorWorker", SENSOR_WORKER_STACK, (void *)this->_queue, 1, 0);
+    }
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        if (this->_schedules[i].sensor->getSingleThreadFlag())
+        {
+            this->startLoopWorker();
+        }
+    }
+
+    this->_timer.begin(SensorSchedulerClass::timerCallback, this, "sensors");
+    this->_started = true;
+    this->arm();
+}
+
+/**
+ * The sensor's sample rate or interval has changed, its next read is one new interval from now
+ * 
+ * @param sensor The sensor
+ */
+void SensorSchedulerClass::reschedule(BaseSensorClass *sensor)
+{
+    this->_mux.enter();
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        if (this->_schedules[i].sensor == sensor)
+        {
+            this->_schedules[i].due = Hal::micros() + sensor->getInterval() * 1000LL;
+            this->heapify();
+        }
+    }
+    this->_mux.exit();
+    if (this->_started)
+    {
+        this->arm();
+    }
+}
+
+/**
+ * Create a JSON element with the read and jitter statistics of each sensor
+ * 
+ * @param ob The ArduinoJson object that this element will be added to.
+ */
+void SensorSchedulerClass::toJson(JsonObject ob)
+{
+    auto json = ob.createNestedObject("scheduler");
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        SensorSchedule schedule;
+        this->_mux.enter();
+        schedule = this->_schedules[i];
+        this->_mux.exit();
+        auto sensor = json.createNestedObject(schedule.sensor->getName());
+        sensor["reads"] = schedule.reads;
+        sensor["overruns"] = schedule.overruns;
+        sensor["jitterAvgUs"] = schedule.reads > 0 ? (uint32_t)(schedule.jitterTotal / schedule.reads) : 0;
+        sensor["jitterMaxUs"] = schedule.jitterMax;
+    }
+    json["workerStackFree"] = this->_stackFree;
+}
+
+/**
+ * The timer has fired, runs in the timer task
+ * 
+ * @param arg The scheduler
+ */
+void SensorSchedulerClass::timerCallback(void *arg)
+{
+    ((SensorSchedulerClass *)arg)->dispatch();
+}
+
+/**
+ * Worker task, reads each sensor it is given
+ * 
+ * @param parameters The queue the worker reads from
+ */
+void SensorSchedulerClass::workerTask(void *parameters)
+{
+    Hal::Queue *queue = (Hal::Queue *)parameters;
+    uint8_t index;
+    for (;;)
+    {
+        if (queue->receive(&index, HAL_WAIT_FOREVER))
+        {
+            SensorScheduler.read(index);
+            uint32_t stackFree = Hal::stackFree();
+            SensorScheduler._mux.enter();
+            SensorScheduler._stackFree = min(SensorScheduler._stackFree, stackFree);
+            SensorScheduler._mux.exit();
+        }
+    }
+}
+
+/**
+ * Start the worker on core 1 for the sensors with the single thread flag, the first time one is added
+ */
+void SensorSchedulerClass::startLoopWorker()
+{
+    if (this->_loopWorker)
+    {
+        return;
+    }
+    this->_loopQueue = new Hal::Queue(sizeof(uint8_t), SENSOR_MAX);
+    this->_loopWorker = Hal::startTask(SensorSchedulerClass::workerTask, "SensorLoopWorker", SENSOR_WORKER_STACK,
+                                       (void *)this->_loopQueue, 1, 1);
+}
+
+/**
+ * Queue every sensor that is due to a worker and work out its next deadline, then arm the timer for the
+ * earliest deadline.  Deadlines stay on the sample rate grid, so a late read does not push the later ones back.
+ */
+void SensorSchedulerClass::dispatch()
+{
+    uint8_t due[SENSOR_MAX];
+    uint8_t count = 0;
+    int64_t now = Hal::micros();
+    this->_mux.enter();
+    while (this->_heapSize > 0 && this->_schedules[this->_heap[0]].due <= now)
+    {
+        uint8_t index = this->pop();
+        SensorSchedule *schedule = &this->_schedules[index];
+        if (schedule->running)
+        {
+            schedule->overruns++;
+        }
+        else
+        {
+            schedule->running = true;
+            schedule->scheduled = schedule->due;
+            due[count++] = index;
+        }
+        int64_t period = max(schedule->sensor->getInterval(), (uint32_t)1) * 1000LL;
+        schedule->due += ((now - schedule->due) / period + 1) * period;
+        this->push(index);
+    }
+    this->_mux.exit();
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        SensorSchedule *schedule = &this->_schedules[due[i]];
+        Hal::Queue *queue = schedule->sensor->getSingleThreadFlag() ? this->_loopQueue : this->_queue;
+        if (!queue->send(&due[i], 0))
+        {
+            this->_mux.enter();
+            schedule->running = false;
+            schedule->overruns++;
+            this->_mux.exit();
+        }
+    }
+    this->arm();
+}
+
+/**
+ * Arm the timer for the earliest deadline
+ */
+void SensorSchedulerClass::arm()
+{
+    this->_mux.enter();
+    bool empty = this->_heapSize == 0;
+    int64_t due = empty ? 0 : this->_schedules[this->_heap[0]].due;
+    this->_mux.exit();
+    if (empty)
+    {
+        return;
+    }
+    int64_t delay = max(due - Hal::micros(), (int64_t)SENSOR_MIN_DELAY_US);
+    this->_timer.stop();
+    this->_timer.startOnce(delay);
+}
+
+/**
+ * Read the sensor, called by a worker
+ * 
+ * @param index The sensor's schedule
+ */
+void SensorSchedulerClass::read(uint8_t index)
+{
+    SensorSchedule *schedule = &this->_schedules[index];
+    BaseSensorClass *sensor = schedule->sensor;
+    uint32_t jitter = Hal::micros() - schedule->scheduled;
+    WakeUp.suspendSleep();
+    if (sensor->getIsEnabled() && sensor->getIsConnected())
+    {
+        if (sensor->getLock()->take(SENSOR_LOCK_TIMEOUT_MS))
+        {
+            if (sensor->taskToRun())
+            {
+                sensor->setEpoch();
+            }
+            sensor->getLock()->give();
+        }
+        else
+        {
+            LogInfo.log(LM_SENSOR, LOG_VERBOSE, "Could not get the %s lock for %s", sensor->getLock()->getName(), sensor->getName());
+        }
+    }
+    WakeUp.resumeSleep();
+    this->_mux.enter();
+    schedule->running = false;
+    schedule->reads++;
+    schedule->jitterTotal += jitter;
+    schedule->jitterMax = max(schedule->jitterMax, jitter);
+    this->_mux.exit();
+}
+
+/**
+ * Add the schedule to the heap
+ * 
+ * @param index The schedule
+ */
+void SensorSchedulerClass::push(uint8_t index)
+{
+    uint8_t pos = this->_heapSize++;
+    while (pos > 0)
+    {
+        uint8_t parent = (pos - 1) / 2;
+        if (this->_schedules[this->_heap[parent]].due <= this->_schedules[index].due)
+        {
+            break;
+        }
+        this->_heap[pos] = this->_heap[parent];
+        pos = parent;
+    }
+    this->_heap[pos] = index;
+}
+
+/**
+ * Take the schedule with the earliest deadline off the heap
+ * 
+ * @return The schedule
+ */
+uint8_t SensorSchedulerClass::pop()
+{
+    uint8_t index = this->_heap[0];
+    this->_heap[0] = this->_heap[--this->_heapSize];
+    this->siftDown(0);
+    return index;
+}
+
+/**
+ * Rebuild the heap after a deadline has changed
+ */
+void SensorSchedulerClass::heapify()
+{
+    for (int8_t pos = this->_heapSize / 2 - 1; pos >= 0; pos--)
+    {
+        this->siftDown(pos);
+    }
+}
+
+/**
+ * Move the schedule at pos down until both its children are due after it
+ * 
+ * @param pos The position in the heap
+ */
+void SensorSchedulerClass::siftDown(uint8_t pos)
+{
+    while (true)
+    {
+        uint8_t smallest = pos;
+        for (uint8_t child = pos * 2 + 1; child <= pos * 2 + 2 && child < this->_heapSize; child++)
+        {
+            if (this->_schedules[this->_heap[child]].due < this->_schedules[this->_heap[smallest]].due)
+            {
+                smallest = child;
+            }
+        }
+        if (smallest == pos)
+        {
+            return;
+        }
+        uint8_t swap = this->_heap[pos];
+        this->_heap[pos] = this->_heap[smallest];
+        this->_heap[smallest] = swap;
+        pos = smallest;
+    }
+}
+
+SensorSchedulerClass SensorScheduler;
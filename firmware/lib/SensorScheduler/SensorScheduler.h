@@ -0,0 +1,63 @@
+#ifndef SENSORSCHEDULER_H
+#define SENSORSCHEDULER_H
+
+#define ARDUINOJSON_USE_LONG_LONG 1
+#include <ArduinoJson.h>
+#include "BaseSensor.h"
+#include "Hal.h"
+
+#define SENSOR_MAX 8                  // Sensors the scheduler can hold
+#define SENSOR_WORKERS 2              // Worker tasks on core 0 that read the sensors
+#define SENSOR_WORKER_STACK 4096      // Stack of each worker, a read only formats log records and files samples,
+                                      // see workerStackFree in toJson
+#define SENSOR_MIN_DELAY_US 1000      // The timer is never armed closer than this
+#define SENSOR_LOCK_TIMEOUT_MS 2000   // Longest wait for the sensor's hardware, the read is skipped after this
+
+typedef struct sensorScheduleStruct
+{
+    BaseSensorClass *sensor;
+    int64_t due;            // Hal::micros time the next read is due
+    int64_t scheduled;      // Hal::micros time the read that has been queued was due
+    bool running;           // Queued or being read, it is not queued again until the read finishes
+    uint32_t reads;
+    uint32_t overruns;      // Reads skipped because the previous read was still running
+    uint32_t jitterMax;     // Most microseconds between a read being due and it starting
+    uint64_t jitterTotal;
+} SensorSchedule;
+
+class SensorSchedulerClass
+{
+public:
+    SensorSchedulerClass();
+    bool add(BaseSensorClass *sensor);
+    void begin();
+    void reschedule(BaseSensorClass *sensor);
+    void toJson(JsonObject ob);
+
+private:
+    static void timerCallback(void *arg);
+    static void workerTask(void *parameters);
+    void startLoopWorker();
+    void dispatch();
+    void arm();
+    void read(uint8_t index);
+    void push(uint8_t index);
+    uint8_t pop();
+    void heapify();
+    void siftDown(uint8_t pos);
+    SensorSchedule _schedules[SENSOR_MAX];
+    uint8_t _heap[SENSOR_MAX];          // Min-heap of schedule indexes, ordered by due
+    uint8_t _heapSize;
+    uint8_t _total;
+    bool _started;
+    bool _loopWorker;                   // The core 1 worker is only started once a single thread sensor is added
+    uint32_t _stackFree;                // Least stack any worker has had left, in bytes
+    Hal::Timer _timer;
+    Hal::Queue *_queue;                 // Read by the core 0 workers
+    Hal::Queue *_loopQueue;             // Read by the core 1 worker, for sensors that must not run on core 0
+    Hal::Spinlock _mux;
+};
+
+extern SensorSchedulerClass SensorScheduler;
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef BASESETTINGSSTORE_H
+#define BASESETTINGSSTORE_H
+
+#include <Arduino.h>
+
+#define SETTINGS_NAME_SIZE 16      // NVS namespaces and keys are limited to 15 characters
+
+class BaseSettingsStore
+{
+public:
+    /**
+     * Virtual open the store
+     *
+     * @return True if the store can be used
+     */
+    virtual bool begin() = 0;
+
+    /**
+     * Virtual is the store kept over a restart
+     *
+     * @return True if the values are kept
+     */
+    virtual bool isPersistent() = 0;
+
+    /**
+     * Virtual get a number
+     *
+     * @param section The section (namespace) the key is in
+     * @param key The key
+     * @param value Set to the value if there is one
+     * @return True if the key has a value
+     */
+    virtual bool getUInt(const char *section, const char *key, uint32_t *value) = 0;
+
+    /**
+     * Virtual set a number
+     *
+     * @param section The section (namespace) the key is in
+     * @param key The key
+     * @param value The value
+     * @return True if the value was stored
+     */
+    virtual bool setUInt(const char *section, const char *key, uint32_t value) = 0;
+
+    /**
+     * Virtual get a string
+     *
+     * @param section The section (namespace) the key is in
+     * @param key The key
+     * @param value Where the value is copied to
+     * @param size The size of the buffer
+     * @return True if the key has a value that fits the buffer
+     */
+    virtual bool getString(const char *section, const char *key, char *value, size_t size) = 0;
+
+    /**
+     * Virtual set a string
+     *
+     * @param section The section (namespace) the key is in
+     * @param key The key
+     * @param value The value
+     * @return True if the value was stored
+     */
+    virtual bool setString(const char *section, const char *key, const char *value) = 0;
+
+    /**
+     * Virtual remove every key in the section
+     *
+     * @param section The section (namespace)
+     */
+    virtual void clear(const char *section) = 0;
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "Settings.h"
+#include "SettingsStores.h"
+#include "LogInfo.h"
+#include "Hal.h"
+
+/**
+ * Choose the store the settings are kept in
+ *
+ * @param store The store, NULL for NVS (or memory if NVS cannot be used)
+ */
+void SettingsClass::begin(BaseSettingsStore *store)
+{
+#ifdef ESP32
+    if (store == NULL)
+    {
+        store = &NvsSettingsStore;
+    }
+#endif
+    if (store == NULL || !store->begin())
+    {
+        LogInfo.log(LM_CONFIG, LOG_WARNING, F("Settings cannot be stored, keeping them in memory"));
+        store = &MemorySettingsStore;
+        store->begin();
+    }
+    this->_store = store;
+}
+
+/**
+ * Are the settings kept over a restart
+ *
+ * @return True if the store is persistent
+ */
+bool SettingsClass::isPersistent()
+{
+    return this->_store != NULL && this->_store->isPersistent();
+}
+
+/**
+ * Get a number
+ *
+ * @param section The section (config section name) the key is in
+ * @param key The key
+ * @param value Set to the value if there is one
+ * @return True if the key has a value
+ */
+bool SettingsClass::getUInt(const char *section, const char *key, uint32_t *value)
+{
+    return this->_store != NULL && this->_store->getUInt(section, key, value);
+}
+
+/**
+ * Set a number, nothing is written if it already has the value
+ *
+ * @param section The section (config section name) the key is in
+ * @param key The key
+ * @param value The value
+ * @return True if the value is stored
+ */
+bool SettingsClass::setUInt(const char *section, const char *key, uint32_t value)
+{
+    uint32_t current;
+    if (this->getUInt(section, key, &current) && current == value)
+    {
+        return true;
+    }
+    int64_t start = Hal::micros();
+    if (this->_store == NULL || !this->_store->setUInt(section, key, value))
+    {
+        return false;
+    }
+    this->written(key, SETTINGS_ENTRY_SIZE, start);
+    return true;
+}
+
+/**
+ * Get a string
+ *
+ * @param section The section (config section name) the key is in
+ * @param key The key
+ * @param value Where the value is copied to
+ * @param size The size of the buffer
+ * @return True if the key has a value that fits the buffer
+ */
+bool SettingsClass::getString(const char *section, const char *key, char *value, size_t size)
+{
+    return this->_store != NULL && this->_store->getString(section, key, value, size);
+}
+
+/**
+ * Set a string, nothing is written if it already has the value
+ *
+ * @param section The section (config section name) the key is in
+ * @param key The key
+ * @param value The value
+ * @return True if the value is stored
+ */
+bool SettingsClass::setString(const char *section, const char *key, const char *value)
+{
+    size_t length = strlen(value) + 1;
+    char current[length];
+    if (this->getString(section, key, current, length) && strcmp(current, value) == 0)
+    {
+        return true;
+    }
+    int64_t start = Hal::micros();
+    if (this->_store == NULL || !this->_store->setString(section, key, value))
+    {
+        return false;
+    }
+    // A header entry and then the string in whole entries
+    this->written(key, SETTINGS_ENTRY_SIZE * (1 + (length + SETTINGS_ENTRY_SIZE - 1) / SETTINGS_ENTRY_SIZE), start);
+    return true;
+}
+
+/**
+ * Remove every stored setting in the section, so the configuration file values are used again
+ *
+ * @param section The section (config section name)
+ */
+void SettingsClass::clear(const char *section)
+{
+    if (this->_store != NULL)
+    {
+        this->_store->clear(section);
+    }
+}
+
+/**
+ * Get the number of settings written since power on
+ *
+ * @return The number of writes
+ */
+uint32_t SettingsClass::getWrites()
+{
+    return this->_writes;
+}
+
+/**
+ * Get the flash bytes written by settings since power on, counted in NVS entries
+ *
+ * @return The number of bytes
+ */
+uint32_t SettingsClass::getBytesWritten()
+{
+    return this->_bytesWritten;
+}
+
+/**
+ * Get how long the last setting took to write and commit
+ *
+ * @return The time in microseconds
+ */
+uint32_t SettingsClass::getLastWriteUs()
+{
+    return this->_lastWriteUs;
+}
+
+/**
+ * Count a setting that has been written
+ *
+ * @param key The key written
+ * @param bytes The flash bytes used
+ * @param start When the write started
+ */
+void SettingsClass::written(const char *key, size_t bytes, int64_t start)
+{
+    this->_lastWriteUs = Hal::micros() - start;
+    this->_writes++;
+    this->_bytesWritten += bytes;
+    LogInfo.log(LM_CONFIG, LOG_VERBOSE, "Setting %s written (%u bytes in %u us)", key, bytes, this->_lastWriteUs);
+}
+
+SettingsClass Settings;
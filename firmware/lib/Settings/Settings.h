@@ -0,0 +1,33 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "BaseSettingsStore.h"
+
+#define SETTINGS_ENTRY_SIZE 32      // NVS writes in 32 byte entries, a number is one entry
+
+class SettingsClass
+{
+public:
+    SettingsClass() : _store(NULL), _writes(0), _bytesWritten(0), _lastWriteUs(0) {}
+    void begin(BaseSettingsStore *store = NULL);
+    bool isPersistent();
+    bool getUInt(const char *section, const char *key, uint32_t *value);
+    bool setUInt(const char *section, const char *key, uint32_t value);
+    bool getString(const char *section, const char *key, char *value, size_t size);
+    bool setString(const char *section, const char *key, const char *value);
+    void clear(const char *section);
+    uint32_t getWrites();
+    uint32_t getBytesWritten();
+    uint32_t getLastWriteUs();
+
+private:
+    void written(const char *key, size_t bytes, int64_t start);
+    BaseSettingsStore *_store;
+    uint32_t _writes;
+    uint32_t _bytesWritten;
+    uint32_t _lastWriteUs;
+};
+
+extern SettingsClass Settings;
+
+#endif
@@ -0,0 +1,281 @@
+#include "SettingsStores.h"
+#ifdef ESP32
+#include <nvs_flash.h>
+#include <nvs.h>
+
+/**
+ * Initialise the NVS partition, it is erased if it is full or from a newer NVS version
+ *
+ * @return True if NVS can be used
+ */
+bool NvsSettingsStoreClass::begin()
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+    return err == ESP_OK;
+}
+
+/**
+ * NVS is kept over a restart
+ *
+ * @return True
+ */
+bool NvsSettingsStoreClass::isPersistent()
+{
+    return true;
+}
+
+/**
+ * Get a number from the section's namespace
+ *
+ * @param section The namespace
+ * @param key The key
+ * @param value Set to the value if there is one
+ * @return True if the key has a value
+ */
+bool NvsSettingsStoreClass::getUInt(const char *section, const char *key, uint32_t *value)
+{
+    nvs_handle handle;
+    if (nvs_open(section, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+    bool found = nvs_get_u32(handle, key, value) == ESP_OK;
+    nvs_close(handle);
+    return found;
+}
+
+/**
+ * Set a number in the section's namespace and commit it
+ *
+ * @param section The namespace
+ * @param key The key
+ * @param value The value
+ * @return True if the value was stored
+ */
+bool NvsSettingsStoreClass::setUInt(const char *section, const char *key, uint32_t value)
+{
+    nvs_handle handle;
+    if (nvs_open(section, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return false;
+    }
+    bool stored = nvs_set_u32(handle, key, value) == ESP_OK && nvs_commit(handle) == ESP_OK;
+    nvs_close(handle);
+    return stored;
+}
+
+/**
+ * Get a string from the section's namespace
+ *
+ * @param section The namespace
+ * @param key The key
+ * @param value Where the value is copied to
+ * @param size The size of the buffer
+ * @return True if the key has a value that fits the buffer
+ */
+bool NvsSettingsStoreClass::getString(const char *section, const char *key, char *value, size_t size)
+{
+    nvs_handle handle;
+    if (nvs_open(section, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+    bool found = nvs_get_str(handle, key, value, &size) == ESP_OK;
+    nvs_close(handle);
+    return found;
+}
+
+/**
+ * Set a string in the section's namespace and commit it
+ *
+ * @param section The namespace
+ * @param key The key
+ * @param value The value
+ * @return True if the value was stored
+ */
+bool NvsSettingsStoreClass::setString(const char *section, const char *key, const char *value)
+{
+    nvs_handle handle;
+    if (nvs_open(section, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return false;
+    }
+    bool stored = nvs_set_str(handle, key, value) == ESP_OK && nvs_commit(handle) == ESP_OK;
+    nvs_close(handle);
+    return stored;
+}
+
+/**
+ * Remove every key in the section's namespace
+ *
+ * @param section The namespace
+ */
+void NvsSettingsStoreClass::clear(const char *section)
+{
+    nvs_handle handle;
+    if (nvs_open(section, NVS_READWRITE, &handle) == ESP_OK)
+    {
+        nvs_erase_all(handle);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+NvsSettingsStoreClass NvsSettingsStore;
+#endif
+
+/**
+ * Start with no settings
+ *
+ * @return True
+ */
+bool MemorySettingsStoreClass::begin()
+{
+    this->_total = 0;
+    return true;
+}
+
+/**
+ * Memory is not kept over a restart
+ *
+ * @return False
+ */
+bool MemorySettingsStoreClass::isPersistent()
+{
+    return false;
+}
+
+/**
+ * Get a number
+ *
+ * @param section The section the key is in
+ * @param key The key
+ * @param value Set to the value if there is one
+ * @return True if the key has a number
+ */
+bool MemorySettingsStoreClass::getUInt(const char *section, const char *key, uint32_t *value)
+{
+    SettingsEntry *entry = this->find(section, key, false);
+    if (entry == NULL || entry->isString)
+    {
+        return false;
+    }
+    *value = entry->number;
+    return true;
+}
+
+/**
+ * Set a number
+ *
+ * @param section The section the key is in
+ * @param key The key
+ * @param value The value
+ * @return True if there was room for the key
+ */
+bool MemorySettingsStoreClass::setUInt(const char *section, const char *key, uint32_t value)
+{
+    SettingsEntry *entry = this->find(section, key, true);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    entry->isString = false;
+    entry->number = value;
+    return true;
+}
+
+/**
+ * Get a string
+ *
+ * @param section The section the key is in
+ * @param key The key
+ * @param value Where the value is copied to
+ * @param size The size of the buffer
+ * @return True if the key has a string that fits the buffer
+ */
+bool MemorySettingsStoreClass::getString(const char *section, const char *key, char *value, size_t size)
+{
+    SettingsEntry *entry = this->find(section, key, false);
+    if (entry == NULL || !entry->isString || strlen(entry->text) >= size)
+    {
+        return false;
+    }
+    strcpy(value, entry->text);
+    return true;
+}
+
+/**
+ * Set a string
+ *
+ * @param section The section the key is in
+ * @param key The key
+ * @param value The value
+ * @return True if there was room for the key and the string fits
+ */
+bool MemorySettingsStoreClass::setString(const char *section, const char *key, const char *value)
+{
+    if (strlen(value) >= SETTINGS_MEMORY_STRING)
+    {
+        return false;
+    }
+    SettingsEntry *entry = this->find(section, key, true);
+    if (entry == NULL)
+    {
+        return false;
+    }
+    entry->isString = true;
+    strcpy(entry->text, value);
+    return true;
+}
+
+/**
+ * Remove every key in the section
+ *
+ * @param section The section
+ */
+void MemorySettingsStoreClass::clear(const char *section)
+{
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        if (strcmp(this->_entries[i].section, section) != 0)
+        {
+            this->_entries[kept++] = this->_entries[i];
+        }
+    }
+    this->_total = kept;
+}
+
+/**
+ * Find the entry for the key
+ *
+ * @param section The section the key is in
+ * @param key The key
+ * @param create True if a new entry is added when the key is not found
+ * @return The entry, NULL if it was not found (or there is no room for it)
+ */
+SettingsEntry *MemorySettingsStoreClass::find(const char *section, const char *key, bool create)
+{
+    for (uint8_t i = 0; i < this->_total; i++)
+    {
+        if (strcmp(this->_entries[i].section, section) == 0 && strcmp(this->_entries[i].key, key) == 0)
+        {
+            return &this->_entries[i];
+        }
+    }
+    if (!create || this->_total == SETTINGS_MEMORY_ENTRIES)
+    {
+        return NULL;
+    }
+    SettingsEntry *entry = &this->_entries[this->_total++];
+    strlcpy(entry->section, section, sizeof(entry->section));
+    strlcpy(entry->key, key, sizeof(entry->key));
+    return entry;
+}
+
+MemorySettingsStoreClass MemorySettingsStore;
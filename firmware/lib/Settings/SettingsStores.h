@@ -0,0 +1,57 @@
+#ifndef SETTINGSSTORES_H
+#define SETTINGSSTORES_H
+
+#include "BaseSettingsStore.h"
+
+#define SETTINGS_MEMORY_ENTRIES 16      // Keys the memory store can hold
+#define SETTINGS_MEMORY_STRING 64       // Longest string the memory store can hold, including the terminator
+
+#ifdef ESP32
+class NvsSettingsStoreClass : public BaseSettingsStore
+{
+public:
+    bool begin() override;
+    bool isPersistent() override;
+    bool getUInt(const char *section, const char *key, uint32_t *value) override;
+    bool setUInt(const char *section, const char *key, uint32_t value) override;
+    bool getString(const char *section, const char *key, char *value, size_t size) override;
+    bool setString(const char *section, const char *key, const char *value) override;
+    void clear(const char *section) override;
+};
+#endif
+
+typedef struct settingsEntryStruct
+{
+    char section[SETTINGS_NAME_SIZE];
+    char key[SETTINGS_NAME_SIZE];
+    bool isString;
+    uint32_t number;
+    char text[SETTINGS_MEMORY_STRING];
+} SettingsEntry;
+
+/**
+ * Settings kept in memory, used on the host and when NVS cannot be opened.  Nothing is kept over a restart.
+ */
+class MemorySettingsStoreClass : public BaseSettingsStore
+{
+public:
+    bool begin() override;
+    bool isPersistent() override;
+    bool getUInt(const char *section, const char *key, uint32_t *value) override;
+    bool setUInt(const char *section, const char *key, uint32_t value) override;
+    bool getString(const char *section, const char *key, char *value, size_t size) override;
+    bool setString(const char *section, const char *key, const char *value) override;
+    void clear(const char *section) override;
+
+private:
+    SettingsEntry *find(const char *section, const char *key, bool create);
+    SettingsEntry _entries[SETTINGS_MEMORY_ENTRIES];
+    uint8_t _total;
+};
+
+#ifdef ESP32
+extern NvsSettingsStoreClass NvsSettingsStore;
+#endif
+extern MemorySettingsStoreClass MemorySettingsStore;
+
+#endif
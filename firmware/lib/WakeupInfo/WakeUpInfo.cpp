@@ -1,9 +1,10 @@
 #include "WakeUpInfo.h"
 #include "LogInfo.h"
 #include "Config.h"
+#include "Hal.h"
 
-RTC_DATA_ATTR int _bootCount = 0;
-RTC_DATA_ATTR unsigned long _bootTime = 0;
+HAL_RTC_DATA int _bootCount = 0;
+HAL_RTC_DATA unsigned long _bootTime = 0;
 
 /**
  * Begin the initialization of the wakeup and sleep system
@@ -11,37 +12,37 @@ RTC_DATA_ATTR unsigned long _bootTime = 0;
 void WakeUpInfoClass::begin()
 {
     this->_isPowerReset = false;
-    esp_sleep_wakeup_cause_t wakeup_reason;
-    wakeup_reason = esp_sleep_get_wakeup_cause();
+    HalWakeupCause wakeup_reason;
+    wakeup_reason = Hal::wakeupCause();
     this->_manualWakeup = false;
     this->_flag = 0;
     switch (wakeup_reason)
     {
-    case ESP_SLEEP_WAKEUP_EXT0:
-        LogInfo.log(LOG_VERBOSE, F("Wakeup caused by external signal using RTC_IO"));
+    case HAL_WAKEUP_EXT0:
+        LogInfo.log(LM_WAKEUP, LOG_VERBOSE, F("Wakeup caused by external signal using RTC_IO"));
         this->_manualWakeup = true;
         strcpy(this->_wakeupReason, "ESP_SLEEP_WAKEUP_EXT0");
         break;
-    case ESP_SLEEP_WAKEUP_EXT1:
-        LogInfo.log(LOG_VERBOSE, F("Wakeup caused by external signal using RTC_CNTL"));
+    case HAL_WAKEUP_EXT1:
+        LogInfo.log(LM_WAKEUP, LOG_VERBOSE, F("Wakeup caused by external signal using RTC_CNTL"));
         this->_manualWakeup = true;
         strcpy(this->_wakeupReason, "ESP_SLEEP_WAKEUP_EXT1");
         break;
-    case ESP_SLEEP_WAKEUP_TIMER:
-        LogInfo.log(LOG_VERBOSE, F("Wakeup caused by timer"));
+    case HAL_WAKEUP_TIMER:
+        LogInfo.log(LM_WAKEUP, LOG_VERBOSE, F("Wakeup caused by timer"));
         strcpy(this->_wakeupReason, "ESP_SLEEP_WAKEUP_TIMER");
         break;
-    case ESP_SLEEP_WAKEUP_TOUCHPAD:
-        LogInfo.log(LOG_VERBOSE, F("Wakeup caused by touchpad"));
+    case HAL_WAKEUP_TOUCHPAD:
+        LogInfo.log(LM_WAKEUP, LOG_VERBOSE, F("Wakeup caused by touchpad"));
         strcpy(this->_wakeupReason, "ESP_SLEEP_WAKEUP_TOUCHPAD");
         this->_manualWakeup = true;
         break;
-    case ESP_SLEEP_WAKEUP_ULP:
-        LogInfo.log(LOG_VERBOSE, F("Wakeup caused by ULP program"));
+    case HAL_WAKEUP_ULP:
+        LogInfo.log(LM_WAKEUP, LOG_VERBOSE, F("Wakeup caused by ULP program"));
         strcpy(this->_wakeupReason, "ESP_SLEEP_WAKEUP_ULP");
         break;
     default:
-        LogInfo.log(LOG_INFO, F("Waked up because of power on or manual reset!"));
+        LogInfo.log(LM_WAKEUP, LOG_INFO, F("Waked up because of power on or manual reset!"));
         strcpy(this->_wakeupReason, "ESP_SLEEP_WAKEUP_UNDEFINED");
         _bootTime = 0;
         this->_manualWakeup = true;
@@ -59,8 +60,7 @@ void WakeUpInfoClass::begin()
 void WakeUpInfoClass::setTimerWakeUp(uint32_t wakeupIn)
 {
     this->_wakeupIn = wakeupIn;
-    esp_sleep_enable_timer_wakeup(wakeupIn * uS_TO_S_FACTOR);
-    LogInfo.log(LOG_VERBOSE, "Setup ESP32 to wake up after %i Seconds", wakeupIn);
+    LogInfo.log(LM_WAKEUP, LOG_VERBOSE, "Setup ESP32 to wake up after %i Seconds", wakeupIn);
 }
 
 /**
@@ -81,7 +81,7 @@ uint32_t WakeUpInfoClass::getWakeupInterval()
 void WakeUpInfoClass::setSleepTime(uint32_t sleepIn)
 {
     this->_sleepIn = sleepIn;
-    LogInfo.log(LOG_VERBOSE, "Setup ESP32 to sleep in %i Seconds", sleepIn);
+    LogInfo.log(LM_WAKEUP, LOG_VERBOSE, "Setup ESP32 to sleep in %i Seconds", sleepIn);
 }
 
 /**
@@ -142,10 +142,11 @@ void WakeUpInfoClass::tick()
             }
             if (this->_flag == 0)
             {
-                LogInfo.log(LOG_INFO, "Going to sleep now for %i seconds", this->_wakeupIn);
+                LogInfo.log(LM_WAKEUP, LOG_INFO, "Going to sleep now for %i seconds", this->_wakeupIn);
                 _bootTime += millis();
-                LogInfo.log(LOG_VERBOSE, "Been alive for %lu seconds", _bootTime / 1000);
-                esp_deep_sleep_start();
+                LogInfo.log(LM_WAKEUP, LOG_VERBOSE, "Been alive for %lu seconds", _bootTime / 1000);
+                LogInfo.flush();
+                Hal::deepSleep((uint64_t)this->_wakeupIn * uS_TO_S_FACTOR);
             }
         }
     }
@@ -1,6 +1,8 @@
 #ifndef WAKEUPINFO_H
 #define WAKEUPINFO_H
 
+#include <Arduino.h>
+
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
 
@@ -1,19 +1,16 @@
 
-#include "esp_wps.h"
 #include "WiFiInfo.h"
 #include "LogInfo.h"
 #include "DeviceInfo.h"
 #include "LedInfo.h"
 #include "NTPInfo.h"
 
-static esp_wps_config_t config;
-
 /**
  * Begin the initialization of the WiFi configuration
  */
 void WiFiInfoClass::begin()
 {
-    WiFi.begin();
+    Hal::networkBegin();
 }
 
 /**
@@ -25,45 +22,34 @@ void WiFiInfoClass::begin()
  * @param y The vertical position on the OLED screen
  * @return True if connected or not 
  */
-bool WiFiInfoClass::connect(u8g2_uint_t x, u8g2_uint_t y)
+bool WiFiInfoClass::connect(uint16_t x, uint16_t y)
 {
-    LogInfo.log(LOG_VERBOSE, F("Initialising WiFi...."));
+    LogInfo.log(LM_WIFI, LOG_VERBOSE, F("Initialising WiFi...."));
     LedInfo.blinkOn(LED_WIFI);
-    while (WiFi.status() != WL_CONNECTED)
+    while (!Hal::networkUp())
     {
         if (this->previousMillisWiFi < this->intervalWiFi)
         {
             previousMillisWiFi = millis();
-            delay(500);
+            Hal::delay(500);
         }
         else
             break;
     }
 
-    if (WiFi.status() != WL_CONNECTED)
+    if (!Hal::networkUp())
     {
         OledDisplay.displayLine(x, y, "WiF: %s", "waiting for WPA");
-        LogInfo.log(LOG_VERBOSE, F("Not Connected so switching to STA Mode...."));
-        WiFi.onEvent(WiFiInfoClass::WiFiEvent);
-        WiFi.mode(WIFI_MODE_STA);
-        WiFiInfoClass::wpsInitConfig();
-        esp_wifi_wps_enable(&config);
-        if (esp_wifi_wps_start(10) == ESP_OK)
+        LogInfo.log(LM_WIFI, LOG_VERBOSE, F("Not Connected so switching to STA Mode...."));
+        Hal::networkEvents(WiFiInfoClass::networkEvent);
+        if (WiFiInfoClass::startWps())
         {
             uint16_t count = 0;
-            while (WiFi.status() != WL_CONNECTED)
+            while (!Hal::networkUp())
             {
-                if (WiFi.status() == WL_CONNECTED)
+                if (Hal::networkUp())
                 {
-                    strcpy(this->_ssid, WiFi.SSID().c_str());
-                    LogInfo.log(LOG_INFO, "Connected to        : %s", this->getSSID());
-                    LogInfo.log(LOG_INFO, "Got IP              : %s", WiFi.localIP().toString().c_str());
-                    OledDisplay.displayLine(x, y, "WiF: %s ", this->getSSID());
-                    this->_connected = true;
-                    LedInfo.blinkOff(LED_WIFI);
-                    vTaskDelay(200);
-                    LedInfo.switchOn(LED_WIFI);
-                    NTPInfo.tick();
+                    this->showConnected(x, y);
                     break;
                 }
                 if (millis() - this->previousMillisWiFi >= 1000)
@@ -77,19 +63,32 @@ bool WiFiInfoClass::connect(u8g2_uint_t x, u8g2_uint_t y)
     }
     else
     {
-        strcpy(this->_ssid, WiFi.SSID().c_str());
-        LogInfo.log(LOG_INFO, "Connected to        : %s", WiFi.SSID().c_str());
-        LogInfo.log(LOG_INFO, "Got IP              : %s", WiFi.localIP().toString().c_str());
-        OledDisplay.displayLine(x, y, "WiF: %s ", this->getSSID());
-        this->_connected = true;
-        LedInfo.blinkOff(LED_WIFI);
-        vTaskDelay(200);
-        LedInfo.switchOn(LED_WIFI);
-        NTPInfo.tick();
+        this->showConnected(x, y);
     }
     return this->getIsConnected();
 }
 
+/**
+ * Record the SSID, show it and switch the WiFi LED on now the network is up
+ * 
+ * @param x The horizontal position on the OLED screen
+ * @param y The vertical position on the OLED screen
+ */
+void WiFiInfoClass::showConnected(uint16_t x, uint16_t y)
+{
+    char address[16];
+    Hal::networkName(this->_ssid, sizeof(this->_ssid));
+    Hal::networkAddress(address, sizeof(address));
+    LogInfo.log(LM_WIFI, LOG_INFO, "Connected to        : %s", this->getSSID());
+    LogInfo.log(LM_WIFI, LOG_INFO, "Got IP              : %s", address);
+    OledDisplay.displayLine(x, y, "WiF: %s ", this->getSSID());
+    this->_connected = true;
+    LedInfo.blinkOff(LED_WIFI);
+    Hal::delay(200);
+    LedInfo.switchOn(LED_WIFI);
+    NTPInfo.tick();
+}
+
 /**
  * Is the WiFi connected flag
  * 
@@ -109,7 +108,7 @@ void WiFiInfoClass::toJson(JsonObject ob)
 {
     auto json = ob.createNestedObject("WiFi");
     json["ssid"] = this->getSSID();
-    json["strength"] = WiFi.RSSI();
+    json["strength"] = Hal::networkSignal();
 }
 
 /**
@@ -123,82 +122,63 @@ const char *WiFiInfoClass::getSSID()
 }
 
 /**
- * Initialize the WPS configuration
+ * Start WPS in push button mode, with this device's details
+ * 
+ * @return True if WPS was started
  */
-void WiFiInfoClass::wpsInitConfig()
+bool WiFiInfoClass::startWps()
 {
-    config.crypto_funcs = &g_wifi_default_wps_crypto_funcs;
-    config.wps_type = WPS_TYPE_PBC;
-    strcpy_P(config.factory_info.manufacturer, PSTR("LUXOFT"));
-    strcpy_P(config.factory_info.model_number, PSTR(DeviceInfo.getDeviceId()));
-    strcpy_P(config.factory_info.model_name, PSTR("OT-1000-IOT"));
-    strcpy(config.factory_info.device_name, DeviceInfo.getDeviceId());
+    return Hal::wpsStart("LUXOFT", DeviceInfo.getDeviceId(), "OT-1000-IOT", DeviceInfo.getDeviceId());
 }
 
 /**
- * Handle the WiFi events generated when in WPS mode
+ * Handle the network events, reconnecting when the station drops and restarting WPS when it fails
  * 
  * @param event The event been raised
- * @param info The information related to the event
+ * @param detail The SSID when connected or the WPS pin
  */
-void WiFiInfoClass::WiFiEvent(WiFiEvent_t event, system_event_info_t info)
+void WiFiInfoClass::networkEvent(HalNetworkEvent event, const char *detail)
 {
+    char address[16];
     switch (event)
     {
-    case SYSTEM_EVENT_STA_START:
-        LogInfo.log(LOG_INFO, F("Station Mode Started"));
+    case HAL_NETWORK_STARTED:
+        LogInfo.log(LM_WIFI, LOG_INFO, F("Station Mode Started"));
         break;
-    case SYSTEM_EVENT_STA_GOT_IP:
-        LogInfo.log(LOG_INFO, "Connected to        : %s", WiFi.SSID().c_str());
-        LogInfo.log(LOG_INFO, "Got IP              : %s", WiFi.localIP().toString());
+    case HAL_NETWORK_CONNECTED:
+        Hal::networkAddress(address, sizeof(address));
+        LogInfo.log(LM_WIFI, LOG_INFO, "Connected to        : %s", detail);
+        LogInfo.log(LM_WIFI, LOG_INFO, "Got IP              : %s", address);
         break;
-    case SYSTEM_EVENT_STA_DISCONNECTED:
-        LogInfo.log(LOG_WARNING, F("Disconnected from station, attempting reconnection"));
-        WiFi.reconnect();
+    case HAL_NETWORK_DISCONNECTED:
+        LogInfo.log(LM_WIFI, LOG_WARNING, F("Disconnected from station, attempting reconnection"));
+        Hal::networkReconnect();
         break;
-    case SYSTEM_EVENT_STA_WPS_ER_SUCCESS:
-        LogInfo.log(LOG_INFO, "WPS Successfull, stopping WPS and connecting to: %s", WiFi.SSID().c_str());
-        esp_wifi_wps_disable();
-        delay(10);
-        WiFi.begin();
+    case HAL_NETWORK_WPS_SUCCESS:
+        LogInfo.log(LM_WIFI, LOG_INFO, "WPS Successfull, stopping WPS and connecting to: %s", detail);
+        Hal::wpsStop();
+        Hal::delay(10);
+        Hal::networkBegin();
         LedInfo.blinkOff(LED_WIFI);
-        vTaskDelay(200);
+        Hal::delay(200);
         LedInfo.switchOn(LED_WIFI);
         break;
-    case SYSTEM_EVENT_STA_WPS_ER_FAILED:
-        LogInfo.log(LOG_WARNING, F("WPS Failed, retrying"));
-        esp_wifi_wps_disable();
-        esp_wifi_wps_enable(&config);
-        esp_wifi_wps_start(0);
+    case HAL_NETWORK_WPS_FAILED:
+        LogInfo.log(LM_WIFI, LOG_WARNING, F("WPS Failed, retrying"));
+        Hal::wpsStop();
+        WiFiInfoClass::startWps();
         break;
-    case SYSTEM_EVENT_STA_WPS_ER_TIMEOUT:
-        LogInfo.log(LOG_WARNING, F("WPS Timedout, retrying"));
-        esp_wifi_wps_disable();
-        esp_wifi_wps_enable(&config);
-        esp_wifi_wps_start(0);
+    case HAL_NETWORK_WPS_TIMEOUT:
+        LogInfo.log(LM_WIFI, LOG_WARNING, F("WPS Timedout, retrying"));
+        Hal::wpsStop();
+        WiFiInfoClass::startWps();
         break;
-    case SYSTEM_EVENT_STA_WPS_ER_PIN:
-        LogInfo.log(LOG_VERBOSE, "WPS_PIN: %s", WiFiInfoClass::numbersToString(info.sta_er_pin.pin_code));
+    case HAL_NETWORK_WPS_PIN:
+        LogInfo.log(LM_WIFI, LOG_VERBOSE, "WPS_PIN: %s", detail);
         break;
     default:
         break;
     }
 }
 
-/**
- * Convert the number array to a string
- * 
- * @return The WPS pin
- */
-String WiFiInfoClass::numbersToString(uint8_t a[])
-{
-    char wps_pin[9];
-    for (int i = 0; i < 8; i++)
-    {
-        wps_pin[i] = a[i];
-    }
-    wps_pin[8] = '\0';
-    return (String)wps_pin;
-}
-
 WiFiInfoClass WiFiInfo;
\ No newline at end of file
@@ -3,8 +3,8 @@
 
 #define ARDUINOJSON_USE_LONG_LONG 1
 #include <ArduinoJson.h>
-#include <WiFi.h>
 #include "Display.h"
+#include "Hal.h"
 
 class WiFiInfoClass
 {
@@ -12,15 +12,15 @@ public:
     void begin();
     void toJson(JsonObject obj);    
     const char* getSSID();
-    bool connect(u8g2_uint_t x, u8g2_uint_t y);
+    bool connect(uint16_t x, uint16_t y);
     const bool getIsConnected();
 
 private:
-    void wpsInitConfig();
-    static void WiFiEvent(WiFiEvent_t event, system_event_info_t info);
-    static String numbersToString(uint8_t a[]);
+    void showConnected(uint16_t x, uint16_t y);
+    static bool startWps();
+    static void networkEvent(HalNetworkEvent event, const char *detail);
     unsigned long previousMillisWiFi;
-    const long intervalWiFi = 6000;
+    const unsigned long intervalWiFi = 6000;
     bool _connected;
     char _ssid[32];
 };
@@ -1,18 +1,23 @@
 #include <Arduino.h>
 
-#include <SPIFFS.h>
-
+#include "Hal.h"
 #include "LogInfo.h"
 #include "Display.h"
 #include "DeviceInfo.h"
 #include "WiFiInfo.h"
 #include "NTPInfo.h"
-#include "GpsInfo.h"
 #include "LedInfo.h"
+// The sensor types built in, each registers itself with the sensor registry
+#include "GpsInfo.h"
 #include "EnvSensor.h"
 #include "CloudInfo.h"
+#include "Settings.h"
+#include "SensorScheduler.h"
+#include "SensorRegistry.h"
+#include "ResourceLock.h"
+#include "History.h"
 
-SemaphoreHandle_t xSemaphore;
+#define DISPLAY_SENSOR_LINES 2    // Sensors shown on the display, the rest are only sent to the cloud
 
 /**
  * Build the data object that will be sent to the cloud
@@ -25,16 +30,18 @@ void buildDataObject(JsonObject payload, bool isDeviceTwin)
     payload.clear();
     WiFiInfo.toJson(payload);
     LedInfo.toJson(payload);
-    EnvSensor.toJson(payload);
     // Currently Azure Device Twin object cannot accept JSON array object which GeoJSON format uses, therefore
-    // we send GeoJSON to the telemetry topic but a none array object to Device Twin topic
+    // the sensors can send something else (e.g. GeoJSON) to the telemetry topic than to the Device Twin topic
     if (isDeviceTwin)
     {
-        GpsSensor.toJson(payload);
+        SensorRegistry.toJson(payload);
+        SensorScheduler.toJson(payload);
+        ResourceLock::allToJson(payload);
+        History.toJson(payload);
     }
     else
     {
-        GpsSensor.toGeoJson(payload);
+        SensorRegistry.toTelemetry(payload);
     }
 }
 
@@ -45,34 +52,30 @@ void buildDataObject(JsonObject payload, bool isDeviceTwin)
  */
 void updateConfig(JsonObject payload)
 {
-    auto doc = DynamicJsonDocument(200);
-    if (payload.containsKey("device"))
+    auto doc = DynamicJsonDocument(512);
+    // Every section with a field table is applied in one go, the components re-apply what changed
+    if (Configuration.apply(payload, doc.to<JsonObject>()) > 0)
     {
-        if (payload["device"].containsKey("location"))
-        {
-            LogInfo.log(LOG_VERBOSE, F("Found Location Change"));
-            if (DeviceInfo.setLocation(payload["device"]["location"].as<char *>()))
-            {
-                auto loc = doc.createNestedObject("device");
-                loc["location"] = payload["device"]["location"].as<char *>();
-                CloudInfo.getProvider()->updateProperty(doc.as<JsonObjectConst>());
-            }
-        }
-    }       
-    if (payload.containsKey("ledInfo"))
+        CloudInfo.getProvider()->updateProperty(doc.as<JsonObjectConst>());
+    }
+    if (payload.containsKey("history"))
+    {
+        CloudInfo.getProvider()->sendHistory(payload["history"].as<JsonObjectConst>());
+    }
+    if (payload.containsKey("LogInfo"))
     {
-        if (payload["ledInfo"].containsKey("brightness"))
+        if (payload["LogInfo"].containsKey("modules"))
         {
-            LogInfo.log(LOG_VERBOSE, F("Found Brightness Change"));
-            if (LedInfo.setBrightness(payload["ledInfo"]["brightness"].as<int>()))
+            LogInfo.log(LM_CORE, LOG_VERBOSE, F("Found Log Module Change"));
+            if (LogInfo.setModuleLevels(payload["LogInfo"]["modules"].as<JsonObjectConst>()))
             {
                 doc.clear();
-                auto bright = doc.createNestedObject("ledInfo");
-                bright["brightness"] = payload["ledInfo"]["brightness"].as<int>();
+                auto modules = doc.createNestedObject("LogInfo").createNestedObject("modules");
+                LogInfo.modulesToJson(modules);
                 CloudInfo.getProvider()->updateProperty(doc.as<JsonObjectConst>());
             }
         }
-    }      
+    }
 }
 
 /**
@@ -80,33 +83,32 @@ void updateConfig(JsonObject payload)
  */
 void setup()
 {
-    Serial.begin(115200);
-    xSemaphore = xSemaphoreCreateMutex();
+    Hal::consoleBegin(115200);
     LogInfo.begin();
     OledDisplay.begin();
     DeviceInfo.begin();
     WiFiInfo.begin();
-    EnvSensor.begin(xSemaphore);
-    GpsSensor.begin(xSemaphore);
     LedInfo.begin();
-    CloudInfo.begin(xSemaphore);
+    CloudInfo.begin(&MqttLock);
 
-    if (!SPIFFS.begin(true))
+    if (!Hal::storageBegin())
     {
         OledDisplay.displayExit(F("An Error has occurred while mounting SPIFFS"));
     }
 
+    Settings.begin();
+    History.begin();
     Configuration.begin("/config.json");
+    // The sensors array is loaded first, each sensor in it adds its own section
+    Configuration.add(&SensorRegistry);
     Configuration.add(&LogInfo);
     Configuration.add(&LedInfo);
     Configuration.add(&DeviceInfo);
-    Configuration.add(&EnvSensor);
-    Configuration.add(&GpsSensor);
     Configuration.add(&CloudInfo);
     Configuration.load();
-    if (heap_caps_check_integrity_all(true) == false)
+    if (!Hal::heapCheck())
     {
-        LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -Setup -1"));
+        LogInfo.log(LM_CORE, LOG_ERROR, F("Heap Corruption detected! -Setup -1"));
         OledDisplay.displayExit(F("Heap Corruption detected! Rebooting"), 5);
     }
     LedInfo.switchOn(LED_POWER);
@@ -114,36 +116,39 @@ void setup()
     OledDisplay.clear();
     OledDisplay.displayLine(0, 10, "ID : %s", DeviceInfo.getDeviceId());
     OledDisplay.displayLine(0, 20, "Loc: %s", DeviceInfo.getLocation());
-    LogInfo.log(LOG_VERBOSE, "Connecting to sensors");
-    EnvSensor.connect();
-    GpsSensor.connect();
+    LogInfo.log(LM_CORE, LOG_VERBOSE, "Connecting to sensors");
+    SensorRegistry.connect();
+    SensorScheduler.begin();
 
     WiFiInfo.connect(0, 30);
 
     if (WiFiInfo.getIsConnected())
     {
-        OledDisplay.displayLine(0, 40, "Tim: %s", NTPInfo.getFormattedTime());
-        OledDisplay.displayLine(0, 50, "Env: %s", EnvSensor.toString());
-        OledDisplay.displayLine(0, 60, "GPS: %s", GpsSensor.toString());
+        OledDisplay.displayLine(0, 40, "Tim: %s", NTPInfo.getFormattedTime().c_str());
+        for (uint8_t i = 0; i < SensorRegistry.getCount() && i < DISPLAY_SENSOR_LINES; i++)
+        {
+            auto sensor = SensorRegistry.get(i);
+            OledDisplay.displayLine(0, 50 + i * 10, "%.3s: %s", sensor->getName(), sensor->toString());
+        }
         // if (CloudInfo.connect(buildDataObject, updateConfig) == false)
         // {
         //     OledDisplay.displayExit(F("Not Connected to the cloud so rebooting to try again!"), 20);
         // }
-        if (heap_caps_check_integrity_all(true) == false)
+        if (!Hal::heapCheck())
         {
-            LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -setup -5"));
+            LogInfo.log(LM_CORE, LOG_ERROR, F("Heap Corruption detected! -setup -5"));
             OledDisplay.displayExit(F("Heap Corruption detected! Rebooting"), 5);
         }        
-        LogInfo.log(LOG_VERBOSE, "Startup Completed at %s", NTPInfo.getISO8601Formatted().c_str());
+        LogInfo.log(LM_CORE, LOG_VERBOSE, "Startup Completed at %s", NTPInfo.getISO8601Formatted().c_str());
     }
     else
     {
         OledDisplay.displayExit(F("Not Connected to WiFi so rebooting as it pointless continuing!"), 30);
     }
     LedInfo.blinkOff(LED_POWER);
-    if (heap_caps_check_integrity_all(true) == false)
+    if (!Hal::heapCheck())
     {
-        LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -setup -end"));
+        LogInfo.log(LM_CORE, LOG_ERROR, F("Heap Corruption detected! -setup -end"));
         OledDisplay.displayExit(F("Heap Corruption detected! Rebooting"), 5);
     }
 }
@@ -155,20 +160,22 @@ void loop()
 {
     if (WiFiInfo.getIsConnected())
     {
-        if (heap_caps_check_integrity_all(true) == false)
+        if (!Hal::heapCheck())
         {
-            LogInfo.log(LOG_ERROR, F("Heap Corruption detected! -1"));
+            LogInfo.log(LM_CORE, LOG_ERROR, F("Heap Corruption detected! -1"));
             OledDisplay.displayExit(F("Heap Corruption detected! Rebooting"), 5);
         }
-        OledDisplay.displayLine(30, 50, "%s", NTPInfo.getFormattedTime());
-        // EnvSensor.tick();
-        // GpsSensor.tick();
+        OledDisplay.displayLine(30, 50, "%s", NTPInfo.getFormattedTime().c_str());
         delay(500);
         NTPInfo.tick();
+        Configuration.tick();
+        History.tick();
         // CloudInfo.tick();
         // WakeUp.tick();
-        OledDisplay.displayLine(30, 40, "%s", EnvSensor.toString());
-        OledDisplay.displayLine(30, 60, "%s", GpsSensor.toString());
+        for (uint8_t i = 0; i < SensorRegistry.getCount() && i < DISPLAY_SENSOR_LINES; i++)
+        {
+            OledDisplay.displayLine(30, i == 0 ? 40 : 60, "%s", SensorRegistry.get(i)->toString());
+        }
         delay(500);
     }
     else
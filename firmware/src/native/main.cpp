@@ -0,0 +1,21 @@
+#include <Arduino.h>
+
+/**
+ * Run the firmware on the host with the POSIX backend of the Hal, so it can be profiled with perf, valgrind or
+ * gprof.  The files are kept in HAL_ROOT and a GPS capture is the file or serial device named by HAL_UART2, e.g.
+ *
+ *     HAL_ROOT=sim HAL_UART2=ubx.bin .pio/build/native/program
+ *
+ * This is the Arduino core's main task, setup is called once and then loop for ever.
+ *
+ * @return Only returns if Hal::restart or Hal::deepSleep ends the program
+ */
+int main()
+{
+    setup();
+    for (;;)
+    {
+        loop();
+    }
+    return 0;
+}
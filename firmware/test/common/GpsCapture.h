@@ -0,0 +1,200 @@
+#ifndef GPSCAPTURE_H
+#define GPSCAPTURE_H
+
+#include <stdio.h>
+#include <string.h>
+#include "Hal.h"
+#include "UbxParser.h"
+
+#define GPS_CAPTURE_LATITUDE 51.7443    // Where the drive starts
+#define GPS_CAPTURE_LONGITUDE 0.4844
+#define GPS_CAPTURE_STEP 0.0001         // Degrees of latitude moved each second, about 40 km/h north
+#define GPS_CAPTURE_ALTITUDE 100.0      // Metres above sea level the drive starts at, it climbs a metre a second
+#define GPS_CAPTURE_EPOCH 1000          // Most bytes of one epoch, NMEA or UBX
+#define GPS_CAPTURE_NMEA 0              // The receiver's default NMEA sentences
+#define GPS_CAPTURE_UBX 1               // UBX NAV-PVT only
+
+/**
+ * Captures of a receiver driving north at a steady speed, one epoch a second, made in the tests since there is
+ * no sky view on the host.  The position moves GPS_CAPTURE_STEP each second and the altitude a metre, so the
+ * epoch a fix came from can be worked out from its latitude and from its altitude.  Each epoch starts with a
+ * sentence or frame with the position (RMC or NAV-PVT).
+ */
+
+/**
+ * Get the altitude of an epoch of the drive
+ *
+ * @param second The seconds since the start of the drive
+ * @return Metres above sea level
+ */
+static inline double gpsCaptureAltitude(uint32_t second)
+{
+    return GPS_CAPTURE_ALTITUDE + second;
+}
+
+/**
+ * Add the checksum and line end to a sentence
+ *
+ * @param sentence The sentence from the '$', with room for 5 more characters
+ * @param length The length of the sentence
+ * @return The length with the checksum
+ */
+static inline size_t gpsCaptureChecksum(char *sentence, size_t length)
+{
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < length; i++)
+    {
+        checksum ^= (uint8_t)sentence[i];
+    }
+    return length + sprintf(&sentence[length], "*%02X\r\n", checksum);
+}
+
+/**
+ * Make the NMEA sentences a NEO-6 sends in one epoch: RMC, VTG, GGA, GSA, three GSV and GLL, about 480 bytes.
+ * Without a fix the position fields are empty and the status says so.
+ *
+ * @param second The seconds since the start of the drive
+ * @param fix True if the receiver has a fix
+ * @param out Where the sentences are written, at least GPS_CAPTURE_EPOCH bytes
+ * @return The bytes written
+ */
+static inline size_t gpsCaptureNmea(uint32_t second, bool fix, char *out)
+{
+    double latitude = GPS_CAPTURE_LATITUDE + second * GPS_CAPTURE_STEP;
+    char time[12];
+    char altitude[12] = "";
+    char lat[16] = "";
+    char lng[16] = "";
+    snprintf(time, sizeof(time), "%02u%02u%02u.00", 12 + second / 3600 % 12, second / 60 % 60, second % 60);
+    if (fix)
+    {
+        snprintf(altitude, sizeof(altitude), "%.1f", gpsCaptureAltitude(second));
+        snprintf(lat, sizeof(lat), "%02d%08.5f,N", (int)latitude, (latitude - (int)latitude) * 60);
+        snprintf(lng, sizeof(lng), "%03d%08.5f,E", (int)GPS_CAPTURE_LONGITUDE,
+                 (GPS_CAPTURE_LONGITUDE - (int)GPS_CAPTURE_LONGITUDE) * 60);
+    }
+    else
+    {
+        strcpy(lat, ",");
+        strcpy(lng, ",");
+    }
+    size_t length = 0;
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length], "$GPRMC,%s,%c,%s,%s,%s,%s,191026,,,%c", time,
+                                                       fix ? 'A' : 'V', lat, lng, fix ? "21.594" : "",
+                                                       fix ? "0.00" : "", fix ? 'A' : 'N'));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length], "$GPVTG,%s,T,,M,%s,N,%s,K,%c",
+                                                       fix ? "0.00" : "", fix ? "21.594" : "",
+                                                       fix ? "39.992" : "", fix ? 'A' : 'N'));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length], "$GPGGA,%s,%s,%s,%u,%02u,%s,%s,M,%s,M,,",
+                                                       time, lat, lng, fix ? 1 : 0, fix ? 8 : 0, fix ? "1.01" : "",
+                                                       altitude, fix ? "45.9" : ""));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length], "$GPGSA,A,%u,%s,,,,,%s",
+                                                       fix ? 3 : 1, fix ? "04,05,09,12,17,20,25,29" : ",,,,,,,",
+                                                       fix ? "1.85,1.01,1.55" : "99.99,99.99,99.99"));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length],
+                                                       "$GPGSV,3,1,11,04,15,045,31,05,32,103,38,09,58,275,42,12,08,321,29"));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length],
+                                                       "$GPGSV,3,2,11,17,47,198,40,20,22,068,35,25,71,134,44,29,12,244,30"));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length],
+                                                       "$GPGSV,3,3,11,02,05,012,,13,03,350,,31,02,160,"));
+    length += gpsCaptureChecksum(&out[length], sprintf(&out[length], "$GPGLL,%s,%s,%s,%c,%c", lat, lng, time,
+                                                       fix ? 'A' : 'V', fix ? 'A' : 'N'));
+    return length;
+}
+
+/**
+ * Make the UBX NAV-PVT frame a receiver in UBX mode sends in one epoch, 100 bytes
+ *
+ * @param second The seconds since the start of the drive
+ * @param fix True if the receiver has a 3D fix
+ * @param out Where the frame is written, at least GPS_CAPTURE_EPOCH bytes
+ * @return The bytes written
+ */
+static inline size_t gpsCaptureUbx(uint32_t second, bool fix, uint8_t *out)
+{
+    uint8_t payload[92];
+    memset(payload, 0, sizeof(payload));
+    int32_t fields[][2] = {
+        {0, (int32_t)((43200 + second) * 1000)},                                              // iTOW
+        {24, (int32_t)(GPS_CAPTURE_LONGITUDE * 1e7)},                                         // lon
+        {28, (int32_t)((GPS_CAPTURE_LATITUDE + second * GPS_CAPTURE_STEP) * 1e7 + 0.5)},      // lat
+        {32, (int32_t)((gpsCaptureAltitude(second) + 45.9) * 1000)},                          // height
+        {36, (int32_t)(gpsCaptureAltitude(second) * 1000)},                                   // hMSL
+        {40, 2500},                                                                           // hAcc
+        {60, 11109},                                                                          // gSpeed mm/s
+        {64, 0},                                                                              // headMot
+    };
+    for (size_t i = 0; fix && i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        memcpy(&payload[fields[i][0]], &fields[i][1], sizeof(int32_t));
+    }
+    payload[4] = 2026 & 0xFF;
+    payload[5] = 2026 >> 8;
+    payload[6] = 10;
+    payload[7] = 19;
+    payload[8] = 12 + second / 3600 % 12;
+    payload[9] = second / 60 % 60;
+    payload[10] = second % 60;
+    payload[20] = fix ? 3 : 0;      // fixType
+    payload[21] = fix ? 0x01 : 0;   // gnssFixOK
+    payload[23] = fix ? 8 : 0;      // numSV
+    return UbxParser::build(UBX_CLASS_NAV, UBX_NAV_PVT, payload, sizeof(payload), out);
+}
+
+/**
+ * Make one epoch of the drive
+ *
+ * @param protocol GPS_CAPTURE_NMEA or GPS_CAPTURE_UBX
+ * @param second The seconds since the start of the drive
+ * @param fix True if the receiver has a fix
+ * @param out Where the epoch is written, at least GPS_CAPTURE_EPOCH bytes
+ * @return The bytes written
+ */
+static inline size_t gpsCaptureEpoch(uint8_t protocol, uint32_t second, bool fix, uint8_t *out)
+{
+    return protocol == GPS_CAPTURE_UBX ? gpsCaptureUbx(second, fix, out) : gpsCaptureNmea(second, fix, (char *)out);
+}
+
+/**
+ * Write a capture of the drive.  A replay sends the file back to back at the baud rate, so to keep one epoch a
+ * second each is padded to a second of the line with zero bytes, which both parsers skip, in place of the idle
+ * line.
+ *
+ * @param path The file, under HAL_ROOT
+ * @param protocol GPS_CAPTURE_NMEA or GPS_CAPTURE_UBX
+ * @param seconds The epochs in the capture
+ * @param noFix The epochs at the start without a fix
+ * @param baud The baud rate it will be replayed at, 0 for no padding
+ * @return The bytes written
+ */
+static inline size_t gpsCaptureWrite(const char *path, uint8_t protocol, uint32_t seconds, uint32_t noFix, uint32_t baud)
+{
+    uint8_t epoch[GPS_CAPTURE_EPOCH * 4];
+    size_t total = 0;
+    Hal::removeFile(path);
+    for (uint32_t second = 0; second < seconds; second++)
+    {
+        size_t length = gpsCaptureEpoch(protocol, second, second >= noFix, epoch);
+        size_t padded = baud / 10 > length && baud / 10 <= sizeof(epoch) ? baud / 10 : length;
+        memset(&epoch[length], 0, padded - length);
+        if (!Hal::writeFile(path, epoch, padded, true))
+        {
+            return 0;
+        }
+        total += padded;
+    }
+    return total;
+}
+
+/**
+ * Get the second of the drive a fix came from
+ *
+ * @param latitude The latitude of the fix
+ * @return The seconds since the start of the drive
+ */
+static inline uint32_t gpsCaptureSecond(float latitude)
+{
+    return (uint32_t)((latitude - GPS_CAPTURE_LATITUDE) / GPS_CAPTURE_STEP + 0.5);
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "DeviceInfo.h"
+#include "WiFiInfo.h"
+#include "LedInfo.h"
+#include "GpsInfo.h"
+#include "EnvSensor.h"
+#include "CloudInfo.h"
+#include "Settings.h"
+#include "SensorScheduler.h"
+#include "SensorRegistry.h"
+#include "ResourceLock.h"
+#include "History.h"
+
+#define TEST_ROOT ".pio/test-cloud-payload"       // HAL_ROOT for the configuration file
+#define TEST_CONFIG "firmware/data/config.json"   // The shipped configuration, pio test runs in the project directory
+
+/**
+ * Count the members and elements of a JSON value, each takes one slot of the document
+ *
+ * @param variant The value
+ * @return The slots it takes
+ */
+static uint32_t slots(JsonVariantConst variant)
+{
+    uint32_t count = 0;
+    if (variant.is<JsonObjectConst>())
+    {
+        for (JsonPairConst member : variant.as<JsonObjectConst>())
+        {
+            count += 1 + slots(member.value());
+        }
+    }
+    else if (variant.is<JsonArrayConst>())
+    {
+        for (JsonVariantConst element : variant.as<JsonArrayConst>())
+        {
+            count += 1 + slots(element);
+        }
+    }
+    return count;
+}
+
+/**
+ * Check a payload fits in CLOUD_PAYLOAD_SIZE and in the slots and string bytes it is made of
+ *
+ * @param name What the payload is
+ * @param doc The document it was built in
+ */
+static void check(const char *name, const JsonDocument &doc)
+{
+    uint32_t used = slots(doc.as<JsonVariantConst>());
+    size_t strings = doc.memoryUsage() - JSON_OBJECT_SIZE(used);
+    char message[200];
+    snprintf(message, sizeof(message), "%s: %u slots and %u string bytes, %u of %u bytes used, %u bytes of JSON",
+             name, used, (unsigned)strings, (unsigned)doc.memoryUsage(), (unsigned)CLOUD_PAYLOAD_SIZE,
+             (unsigned)measureJson(doc));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_FALSE_MESSAGE(doc.overflowed(), name);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(CLOUD_PAYLOAD_SLOTS, used);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(CLOUD_PAYLOAD_STRINGS, strings);
+}
+
+/**
+ * Build the payload as buildDataObject in main.cpp does
+ *
+ * @param payload The object the payload is built in
+ * @param isDeviceTwin True for the device twin, false for the telemetry
+ */
+static void buildDataObject(JsonObject payload, bool isDeviceTwin)
+{
+    payload.clear();
+    WiFiInfo.toJson(payload);
+    LedInfo.toJson(payload);
+    if (isDeviceTwin)
+    {
+        SensorRegistry.toJson(payload);
+        SensorScheduler.toJson(payload);
+        ResourceLock::allToJson(payload);
+        History.toJson(payload);
+    }
+    else
+    {
+        SensorRegistry.toTelemetry(payload);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * The device twin sendData builds with the shipped configuration fits its document
+ */
+void test_device_twin()
+{
+    DynamicJsonDocument payload(CLOUD_PAYLOAD_SIZE);
+    buildDataObject(payload.to<JsonObject>(), true);
+    check("device twin", payload);
+}
+
+/**
+ * The telemetry, with the device and the time sendTelemetry adds, fits its document
+ */
+void test_telemetry()
+{
+    // sendData builds the telemetry in the document the device twin was built in
+    DynamicJsonDocument payload(CLOUD_PAYLOAD_SIZE);
+    buildDataObject(payload.to<JsonObject>(), true);
+    buildDataObject(payload.to<JsonObject>(), false);
+    check("telemetry payload", payload);
+    DynamicJsonDocument doc(CLOUD_PAYLOAD_SIZE);
+    doc.set(payload.as<JsonObject>());
+    DeviceInfo.toJson(doc.as<JsonObject>());
+    doc["time_epoch"] = NTPInfo.getEpoch();
+    check("telemetry", doc);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    LogInfo.begin();
+    // Unity cannot fail a test before UNITY_BEGIN
+    static uint8_t config[8192];
+    size_t length = 0;
+    FILE *file = fopen(TEST_CONFIG, "rb");
+    if (file != NULL)
+    {
+        length = fread(config, 1, sizeof(config), file);
+        fclose(file);
+    }
+    if (length == 0 || !Hal::writeFile("/config.json", config, length))
+    {
+        return 1;
+    }
+
+    // Set up as main.cpp does, without the display and the network
+    DeviceInfo.begin();
+    LedInfo.begin();
+    CloudInfo.begin(&MqttLock);
+    Settings.begin();
+    History.begin();
+    Configuration.begin("/config.json");
+    Configuration.add(&SensorRegistry);
+    Configuration.add(&LogInfo);
+    Configuration.add(&LedInfo);
+    Configuration.add(&DeviceInfo);
+    Configuration.add(&CloudInfo);
+    Configuration.load();
+    SensorRegistry.connect();
+    UNITY_BEGIN();
+    RUN_TEST(test_device_twin);
+    RUN_TEST(test_telemetry);
+    return UNITY_END();
+}
@@ -0,0 +1,312 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Hal.h"
+#include "Config.h"
+#include "Settings.h"
+#include "LedInfo.h"
+#include "DeviceInfo.h"
+#include "GpsInfo.h"
+#include "EnvSensor.h"
+
+#define TEST_ROOT ".pio/test-config-roundtrip" // HAL_ROOT for the configuration file
+#define TEST_DOC_SIZE 4096
+
+// Every field of each section changed from its default, a field added to a table must be added here too
+static const char *const _ledChanged =
+    "{\"brightness\": 40, \"power\": 2, \"wifi\": 4, \"cloud\": 5}";
+static const char *const _deviceChanged =
+    "{\"prefix\": \"RC\", \"location\": \"Lab 2\", \"wakeup\": 1200, \"sleep\": 60}";
+static const char *const _gpsChanged =
+    "{\"enabled\": false, \"baud\": 115200, \"rx\": 16, \"tx\": 17, \"sampleRate\": 5000, \"protocol\": 1,"
+    " \"ubxBaud\": 115200, \"navRate\": 200, \"adaptive\": true, \"moveSpeed\": 12, \"radius\": 50,"
+    " \"maxInterval\": 600000, \"powerSave\": 0,"
+    " \"filters\": {\"latitude\": [{\"type\": \"kalman\", \"q\": 2e-9, \"r\": 4e-9}],"
+    " \"altitude\": [{\"type\": \"outlier\", \"maxRate\": 5, \"limit\": 3}, {\"type\": \"median\", \"size\": 5}]}}";
+static const char *const _envChanged =
+    "{\"scale\": 2, \"data\": 27, \"enabled\": true, \"sampleRate\": 20000,"
+    " \"filters\": {\"humidity\": [{\"type\": \"ema\", \"alpha\": 0.25}]}}";
+
+/**
+ * Are the two elements the same, numbers are compared as the floats the filters keep them as
+ *
+ * @param expected The element that was loaded
+ * @param actual The element that was saved
+ * @return True if they have the same keys, items and values
+ */
+static bool same(JsonVariantConst expected, JsonVariantConst actual)
+{
+    if (expected.is<JsonObjectConst>())
+    {
+        JsonObjectConst a = expected.as<JsonObjectConst>();
+        JsonObjectConst b = actual.as<JsonObjectConst>();
+        if (!actual.is<JsonObjectConst>() || a.size() != b.size())
+        {
+            return false;
+        }
+        for (JsonPairConst kv : a)
+        {
+            if (!b.containsKey(kv.key().c_str()) || !same(kv.value(), b[kv.key().c_str()]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (expected.is<JsonArrayConst>())
+    {
+        JsonArrayConst a = expected.as<JsonArrayConst>();
+        JsonArrayConst b = actual.as<JsonArrayConst>();
+        if (!actual.is<JsonArrayConst>() || a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (!same(a[i], b[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (expected.is<bool>())
+    {
+        return actual.is<bool>() && expected.as<bool>() == actual.as<bool>();
+    }
+    if (expected.is<const char *>())
+    {
+        return actual.is<const char *>() && strcmp(expected.as<const char *>(), actual.as<const char *>()) == 0;
+    }
+    if (expected.is<float>())
+    {
+        float a = expected.as<float>();
+        return actual.is<float>() && fabsf(a - actual.as<float>()) <= fabsf(a) * 1e-6f;
+    }
+    return false;
+}
+
+/**
+ * Check every field the section saves is in the changed element with a different value, so a field added to a
+ * table without being added to the test fails
+ *
+ * @param defaults The section saved after loading an empty element
+ * @param changed The changed element
+ */
+static void checkAllChanged(JsonObjectConst defaults, JsonObjectConst changed)
+{
+    for (JsonPairConst kv : defaults)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(changed.containsKey(kv.key().c_str()), kv.key().c_str());
+        TEST_ASSERT_FALSE_MESSAGE(same(kv.value(), changed[kv.key().c_str()]), kv.key().c_str());
+    }
+}
+
+/**
+ * Load the changed element into the section and save it again, everything loaded must be saved as it was.  Then
+ * load an empty element and check every field is back to its default.
+ *
+ * @param config The section
+ * @param json The changed element
+ */
+static void roundTrip(BaseConfigInfoClass *config, const char *json)
+{
+    DynamicJsonDocument changed(TEST_DOC_SIZE);
+    DynamicJsonDocument saved(TEST_DOC_SIZE);
+    DynamicJsonDocument defaults(TEST_DOC_SIZE);
+    StaticJsonDocument<16> empty;
+    TEST_ASSERT_FALSE(deserializeJson(changed, json));
+
+    config->load(empty.to<JsonObject>());
+    config->save(defaults.to<JsonObject>());
+    JsonObjectConst defaultSection = defaults[config->getSectionName()].as<JsonObjectConst>();
+    TEST_ASSERT_GREATER_THAN(0, defaultSection.size());
+    checkAllChanged(defaultSection, changed.as<JsonObjectConst>());
+
+    config->load(changed.as<JsonObjectConst>());
+    config->save(saved.to<JsonObject>());
+    TEST_ASSERT_TRUE(same(changed.as<JsonVariantConst>(), saved[config->getSectionName()]));
+
+    config->load(empty.to<JsonObject>());
+    config->save(saved.to<JsonObject>());
+    TEST_ASSERT_TRUE(same(defaults.as<JsonVariantConst>(), saved.as<JsonVariantConst>()));
+}
+
+static uint8_t _notified;          // Changes given to the listener
+static uint8_t _sectionsNotified;  // Times the listener was called
+
+/**
+ * Count the changes each section is notified of
+ *
+ * @param changes The changes to one section
+ * @param count The number of changes
+ */
+static void countChanges(const ConfigChange *changes, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_EQUAL_STRING(changes[0].section, changes[i].section);
+    }
+    _notified += count;
+    _sectionsNotified++;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * Every field of the LEDs section round-trips
+ */
+void test_led_roundtrip()
+{
+    roundTrip(&LedInfo, _ledChanged);
+}
+
+/**
+ * Every field of the device section round-trips
+ */
+void test_device_roundtrip()
+{
+    roundTrip(&DeviceInfo, _deviceChanged);
+}
+
+/**
+ * Every field of the GPS, with its filters section round-trips
+ */
+void test_gps_roundtrip()
+{
+    GpsInfoClass gps("gpsSensor", 0);
+    roundTrip(&gps, _gpsChanged);
+}
+
+/**
+ * Every field of the DHT-22, with its filters section round-trips
+ */
+void test_env_roundtrip()
+{
+    EnvSensorClass env("envSensor", 0);
+    roundTrip(&env, _envChanged);
+}
+
+/**
+ * Out of range and mistyped values are not loaded, the field keeps its default
+ */
+void test_invalid_values_use_defaults()
+{
+    DynamicJsonDocument doc(TEST_DOC_SIZE);
+    DynamicJsonDocument saved(TEST_DOC_SIZE);
+    GpsInfoClass gps("gpsSensor", 0);
+    TEST_ASSERT_FALSE(deserializeJson(doc, "{\"baud\": 100, \"rx\": 40, \"sampleRate\": \"fast\", \"enabled\": 3,"
+                                           " \"maxInterval\": 99999999999}"));
+    gps.load(doc.as<JsonObjectConst>());
+    gps.save(saved.to<JsonObject>());
+    JsonObjectConst section = saved["gpsSensor"].as<JsonObjectConst>();
+    TEST_ASSERT_EQUAL(9600, section["baud"].as<long>());
+    TEST_ASSERT_EQUAL(22, section["rx"].as<long>());
+    TEST_ASSERT_EQUAL(1000, section["sampleRate"].as<long>());
+    TEST_ASSERT_TRUE(section["enabled"].as<bool>());
+    TEST_ASSERT_EQUAL(300000, section["maxInterval"].as<long>());
+
+    TEST_ASSERT_FALSE(deserializeJson(doc, "{\"prefix\": \"A prefix much too long for the buffer it is loaded into\"}"));
+    DeviceInfo.load(doc.as<JsonObjectConst>());
+    DeviceInfo.save(saved.to<JsonObject>());
+    TEST_ASSERT_EQUAL_STRING("DEVTMP", saved["device"]["prefix"].as<const char *>());
+}
+
+/**
+ * The sections written to the configuration file, loaded by Configuration and saved again come back the same
+ */
+void test_file_roundtrip()
+{
+    const char *const sections[] = {"ledInfo", "device", "gpsSensor", "envSensor"};
+    const char *const changes[] = {_ledChanged, _deviceChanged, _gpsChanged, _envChanged};
+    DynamicJsonDocument file(TEST_DOC_SIZE);
+    DynamicJsonDocument section(TEST_DOC_SIZE);
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_FALSE(deserializeJson(section, changes[i]));
+        file[sections[i]] = section.as<JsonObjectConst>();
+    }
+    static char json[TEST_DOC_SIZE];
+    size_t length = serializeJson(file, json, sizeof(json));
+    TEST_ASSERT_TRUE(Hal::writeFile("/config.json", (const uint8_t *)json, length));
+
+    GpsInfoClass gps("gpsSensor", 0);
+    EnvSensorClass env("envSensor", 0);
+    ConfigClass config;
+    config.begin("/config.json");
+    config.add(&LedInfo);
+    config.add(&DeviceInfo);
+    config.add(&gps);
+    config.add(&env);
+    TEST_ASSERT_TRUE(config.load());
+    TEST_ASSERT_TRUE(config.save());
+
+    static uint8_t data[TEST_DOC_SIZE];
+    size_t size = Hal::readFile("/config.json", data, sizeof(data));
+    TEST_ASSERT_GREATER_THAN(0, size);
+    DynamicJsonDocument reread(TEST_DOC_SIZE);
+    TEST_ASSERT_FALSE(deserializeJson(reread, (const char *)data, size));
+    TEST_ASSERT_TRUE(same(file.as<JsonVariantConst>(), reread.as<JsonVariantConst>()));
+}
+
+/**
+ * Every field of every section changed by one apply, more than CONFIG_MAX_CHANGES in all, is applied, reported and
+ * notified to the section's listener
+ */
+void test_apply_every_section()
+{
+    const char *const sections[] = {"ledInfo", "device", "gpsSensor", "envSensor"};
+    const char *const changes[] = {_ledChanged, _deviceChanged, _gpsChanged, _envChanged};
+    GpsInfoClass gps("gpsSensor", 0);
+    EnvSensorClass env("envSensor", 0);
+    BaseConfigInfoClass *configs[] = {&LedInfo, &DeviceInfo, &gps, &env};
+    ConfigClass config;
+    config.begin("/config.json");
+    DynamicJsonDocument desired(TEST_DOC_SIZE);
+    DynamicJsonDocument section(TEST_DOC_SIZE);
+    StaticJsonDocument<16> empty;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        configs[i]->load(empty.to<JsonObject>());
+        config.add(configs[i]);
+        TEST_ASSERT_TRUE(config.subscribe(sections[i], NULL, countChanges));
+        TEST_ASSERT_FALSE(deserializeJson(section, changes[i]));
+        desired[sections[i]] = section.as<JsonObjectConst>();
+    }
+
+    DynamicJsonDocument reported(TEST_DOC_SIZE);
+    _notified = 0;
+    _sectionsNotified = 0;
+    uint8_t total = config.apply(desired.as<JsonObjectConst>(), reported.to<JsonObject>());
+    TEST_ASSERT_GREATER_THAN(CONFIG_MAX_CHANGES, total);
+    TEST_ASSERT_EQUAL_UINT8(total, _notified);
+    TEST_ASSERT_EQUAL_UINT8(4, _sectionsNotified);
+    size_t values = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        values += reported[sections[i]].size();
+    }
+    TEST_ASSERT_EQUAL_UINT32(total, values);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    Settings.begin();
+    UNITY_BEGIN();
+    RUN_TEST(test_led_roundtrip);
+    RUN_TEST(test_device_roundtrip);
+    RUN_TEST(test_gps_roundtrip);
+    RUN_TEST(test_env_roundtrip);
+    RUN_TEST(test_invalid_values_use_defaults);
+    RUN_TEST(test_file_roundtrip);
+    RUN_TEST(test_apply_every_section);
+    return UNITY_END();
+}
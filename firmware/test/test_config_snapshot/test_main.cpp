@@ -0,0 +1,154 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "DeviceInfo.h"
+#include "WiFiInfo.h"
+#include "LedInfo.h"
+#include "GpsInfo.h"
+#include "EnvSensor.h"
+#include "CloudInfo.h"
+#include "Settings.h"
+#include "SensorScheduler.h"
+#include "SensorRegistry.h"
+#include "ResourceLock.h"
+#include "History.h"
+
+#define TEST_ROOT ".pio/test-config-snapshot"     // HAL_ROOT for the configuration file
+#define TEST_CONFIG "firmware/data/config.json"   // The shipped configuration, pio test runs in the project directory
+#define TEST_LOADS 200                            // Times each path is timed, the mean is kept
+
+typedef struct testWakeStruct
+{
+    double loadUs;          // Mean time in load()
+    double payloadUs;       // Mean time from the start of load() to the telemetry serialized
+    size_t length;          // Bytes of JSON in the telemetry
+} TestWake;
+
+static TestWake _file;
+
+/**
+ * Time load() and the first telemetry payload after it, as a wake up runs them before the first publish
+ *
+ * @param timer True to wake as if from a timer sleep, so the snapshot is used
+ * @return The mean times
+ */
+static TestWake wake(bool timer)
+{
+    TestWake result;
+    memset(&result, 0, sizeof(result));
+    if (timer)
+    {
+        setenv("HAL_WAKEUP", "timer", 1);
+    }
+    else
+    {
+        unsetenv("HAL_WAKEUP");
+    }
+    static char json[4096];
+    DynamicJsonDocument payload(CLOUD_PAYLOAD_SIZE);
+    double loadUs = 0;
+    int64_t start = Hal::micros();
+    for (uint16_t i = 0; i < TEST_LOADS; i++)
+    {
+        int64_t begin = Hal::micros();
+        TEST_ASSERT_TRUE(Configuration.load());
+        loadUs += Hal::micros() - begin;
+        // The payload buildDataObject in main.cpp sends as the telemetry
+        JsonObject root = payload.to<JsonObject>();
+        WiFiInfo.toJson(root);
+        LedInfo.toJson(root);
+        SensorRegistry.toTelemetry(root);
+        result.length = serializeJson(payload, json, sizeof(json));
+    }
+    result.payloadUs = (double)(Hal::micros() - start) / TEST_LOADS;
+    result.loadUs = loadUs / TEST_LOADS;
+    unsetenv("HAL_WAKEUP");
+    return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * A power on, reset or other wake up parses the configuration file
+ */
+void test_file_load()
+{
+    _file = wake(false);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, _file.length);
+    char message[160];
+    snprintf(message, sizeof(message), "configuration file: load %.0f us, to the first telemetry %.0f us",
+             _file.loadUs, _file.payloadUs);
+    TEST_MESSAGE(message);
+}
+
+/**
+ * A timer wake up loads the sections from the snapshot without the file, and they are the same as from the file
+ */
+void test_snapshot_load()
+{
+    // The snapshot is used even if the file cannot be read
+    TEST_ASSERT_TRUE(Hal::renameFile("/config.json", "/config.json.moved"));
+    TestWake snapshot = wake(true);
+    TEST_ASSERT_TRUE(Hal::renameFile("/config.json.moved", "/config.json"));
+    TEST_ASSERT_EQUAL_UINT32(_file.length, snapshot.length);
+    // The sections save the configuration the file holds, so nothing is written
+    uint32_t written = Configuration.getBytesWritten();
+    TEST_ASSERT_TRUE(Configuration.save());
+    TEST_ASSERT_EQUAL_UINT32(written, Configuration.getBytesWritten());
+
+    char message[200];
+    snprintf(message, sizeof(message), "snapshot: load %.0f us (%.1f times faster), to the first telemetry %.0f us"
+             " (%.0f us less)", snapshot.loadUs, _file.loadUs / snapshot.loadUs, snapshot.payloadUs,
+             _file.payloadUs - snapshot.payloadUs);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    unsetenv("HAL_WAKEUP");
+    Hal::storageBegin();
+    LogInfo.begin();
+    // Unity cannot fail a test before UNITY_BEGIN
+    static uint8_t config[8192];
+    size_t length = 0;
+    FILE *file = fopen(TEST_CONFIG, "rb");
+    if (file != NULL)
+    {
+        length = fread(config, 1, sizeof(config), file);
+        fclose(file);
+    }
+    Hal::removeFile("/config.json.bak");
+    if (length == 0 || !Hal::writeFile("/config.json", config, length))
+    {
+        return 1;
+    }
+
+    // Set up as main.cpp does, without the display and the network
+    DeviceInfo.begin();
+    LedInfo.begin();
+    CloudInfo.begin(&MqttLock);
+    Settings.begin();
+    History.begin();
+    Configuration.begin("/config.json");
+    Configuration.add(&SensorRegistry);
+    Configuration.add(&LogInfo);
+    Configuration.add(&LedInfo);
+    Configuration.add(&DeviceInfo);
+    Configuration.add(&CloudInfo);
+    Configuration.load();
+    // Written as the firmware writes it, so a save that finds nothing changed writes nothing
+    Configuration.save();
+    SensorRegistry.connect();
+    UNITY_BEGIN();
+    RUN_TEST(test_file_load);
+    RUN_TEST(test_snapshot_load);
+    return UNITY_END();
+}
@@ -0,0 +1,318 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "ResourceLock.h"
+#include "GpsInfo.h"
+#include "../common/GpsCapture.h"
+
+#define TEST_ROOT ".pio/test-gps-reader" // HAL_ROOT for the captures
+#define TEST_SECONDS 12                  // Seconds of the drive replayed for each design
+#define TEST_NO_FIX 2                    // Seconds at the start of the drive without a fix
+#define TEST_SAMPLE_MS 1000              // The sensor's sampleRate, the scheduler reads it this often
+#define TEST_NMEA_BAUD 9600
+#define TEST_UBX_BAUD 38400
+#define TEST_OLD_BUFFER 256              // Receive buffer of the HardwareSerial the polling design read
+#define TEST_OLD_POLL_MS 30              // The polling design's pause between emptying the buffer
+#define TEST_OLD_FIX_MS 100              // Its pause after a fix
+#define TEST_OLD_WARN_MS 5000            // Its time without a fix before a retry
+#define TEST_OLD_RETRIES 10              // Its retries before it gave up
+
+typedef struct testResultStruct
+{
+    uint32_t reads;         // Reads by the scheduler
+    uint32_t fixes;         // Reads that had a fix
+    double cpuUs;           // Microseconds a second spent reading the UART and parsing
+    double readUs;          // Mean time taskToRun held the scheduler
+    double maxReadUs;
+    double latencyMs;       // Mean time from the epoch starting to arrive to its fix being readable
+    double maxLatencyMs;
+    uint32_t readerMaxLatencyUs;    // The reader's own maxLatencyUs, from the UART event with the start of a sentence
+} TestResult;
+
+static int64_t _opened;         // Hal::micros() the replay was opened
+static uint32_t _baud;
+static size_t _epochBytes;      // Bytes of each second of the capture
+
+/**
+ * Write the capture for the protocol and point the GPS UART at it
+ *
+ * @param protocol GPS_CAPTURE_NMEA or GPS_CAPTURE_UBX
+ * @param baud The baud rate it is replayed at
+ */
+static void capture(uint8_t protocol, uint32_t baud)
+{
+    const char *path = protocol == GPS_CAPTURE_UBX ? "/gps-ubx.bin" : "/gps-nmea.bin";
+    TEST_ASSERT_GREATER_THAN(0, gpsCaptureWrite(path, protocol, TEST_SECONDS, TEST_NO_FIX, baud));
+    char file[64];
+    snprintf(file, sizeof(file), TEST_ROOT "%s", path);
+    setenv("HAL_UART2", file, 1);
+    _baud = baud;
+    _epochBytes = baud / 10;
+}
+
+/**
+ * Add a fix to the results
+ *
+ * @param result The results
+ * @param latitude The latitude of the fix
+ * @param readable The Hal::micros() the fix could first be read
+ */
+static void addFix(TestResult *result, float latitude, int64_t readable)
+{
+    uint32_t second = gpsCaptureSecond(latitude);
+    TEST_ASSERT_TRUE(second >= TEST_NO_FIX && second < TEST_SECONDS);
+    // The replay sends the capture at the baud rate from when it was opened
+    int64_t arrived = _opened + (int64_t)second * _epochBytes * 10000000 / _baud;
+    double latency = (readable - arrived) / 1000.0;
+    result->latencyMs += latency;
+    result->maxLatencyMs = max(result->maxLatencyMs, latency);
+    result->fixes++;
+}
+
+/**
+ * Add a read by the scheduler to the results
+ *
+ * @param result The results
+ * @param took The microseconds taskToRun took
+ */
+static void addRead(TestResult *result, int64_t took)
+{
+    result->readUs += took;
+    result->maxReadUs = max(result->maxReadUs, (double)took);
+    result->reads++;
+}
+
+/**
+ * Work out the means and report the results
+ *
+ * @param name The design and protocol
+ * @param result The results
+ */
+static void report(const char *name, TestResult *result)
+{
+    result->readUs /= result->reads;
+    result->latencyMs /= result->fixes;
+    char message[240];
+    snprintf(message, sizeof(message),
+             "%s: %.0f us/s CPU, taskToRun %.1f us (max %.0f us), %u of %u reads with a fix,"
+             " fix latency %.1f ms (max %.1f ms)",
+             name, result->cpuUs, result->readUs, result->maxReadUs, result->fixes, result->reads,
+             result->latencyMs, result->maxLatencyMs);
+    TEST_MESSAGE(message);
+}
+
+/**
+ * Run the event driven reader on the capture, reading the sensor every TEST_SAMPLE_MS as the scheduler does,
+ * half way between epochs
+ *
+ * @param protocol GPS_NMEA or GPS_UBX
+ * @param baud The baud rate of the capture
+ * @return The results
+ */
+static TestResult eventReader(uint8_t protocol, uint32_t baud)
+{
+    TestResult result;
+    memset(&result, 0, sizeof(result));
+    capture(protocol, baud);
+    char json[160];
+    snprintf(json, sizeof(json), "{\"baud\": %u, \"protocol\": %u, \"ubxBaud\": %u, \"powerSave\": 0}", baud,
+             protocol, baud);
+    StaticJsonDocument<256> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, json));
+    GpsInfoClass *gps = new GpsInfoClass("gpsSensor", 0);
+    gps->load(doc.as<JsonObjectConst>());
+    gps->begin(&UartLock);
+    _opened = Hal::micros();
+    TEST_ASSERT_TRUE(gps->connect());
+
+    uint32_t cpuSamples = 0;
+    for (uint32_t i = TEST_NO_FIX; i < TEST_SECONDS; i++)
+    {
+        int64_t due = _opened + i * TEST_SAMPLE_MS * 1000LL + TEST_SAMPLE_MS * 500LL;
+        Hal::delay((uint32_t)max((int64_t)0, (due - Hal::micros()) / 1000));
+        int64_t start = Hal::micros();
+        bool fix = gps->taskToRun();
+        addRead(&result, Hal::micros() - start);
+        GpsReading reading;
+        gps->getReading(&reading);
+        if (fix)
+        {
+            addFix(&result, reading.latitude, reading.lastRead * 1000LL);
+        }
+        DynamicJsonDocument stats(1024);
+        gps->toJson(stats.to<JsonObject>());
+        // The first window started before the first fix
+        if (i > TEST_NO_FIX)
+        {
+            result.cpuUs += stats["GPSSensor"]["reader"]["cpuUs"].as<uint32_t>();
+            cpuSamples++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, stats["GPSSensor"]["reader"]["failed"].as<uint32_t>());
+        TEST_ASSERT_EQUAL_UINT32(0, stats["GPSSensor"]["reader"]["overflows"].as<uint32_t>());
+    }
+    result.cpuUs /= cpuSamples;
+    DynamicJsonDocument stats(1024);
+    gps->toJson(stats.to<JsonObject>());
+    result.readerMaxLatencyUs = stats["GPSSensor"]["reader"]["maxLatencyUs"].as<uint32_t>();
+    char message[240] = "reader element: ";
+    serializeJson(stats["GPSSensor"]["reader"], &message[strlen(message)], sizeof(message) - strlen(message));
+    TEST_MESSAGE(message);
+    // The reader runs on until the program ends, the replay has ended so it only waits
+    return result;
+}
+
+/**
+ * The taskToRun of the polling design the reader replaced, it made a new parser for each read and emptied the
+ * HardwareSerial buffer every TEST_OLD_POLL_MS until the parser had a position, holding up the scheduler.  Only
+ * the time outside the pauses is busy.
+ *
+ * @param uart The UART, opened without an event queue
+ * @param reading Set to the fix
+ * @param busyUs Has the busy microseconds added
+ * @return True if there is a fix
+ */
+static bool pollingTaskToRun(Hal::Uart *uart, GpsReading *reading, int64_t *busyUs)
+{
+    int retries = 0;
+    uint32_t now = Hal::millis();
+    reading->isValid = false;
+    TinyGPSPlus gps = TinyGPSPlus();
+    int64_t busy = Hal::micros();
+    while (true)
+    {
+        size_t size;
+        HalUartEvent event;
+        while ((event = uart->wait(&size, 0)) == HAL_UART_DATA || event == HAL_UART_OVERFLOW)
+        {
+            uint8_t data[TEST_OLD_BUFFER];
+            int length = event == HAL_UART_DATA ? uart->read(data, min(size, sizeof(data)), 0) : 0;
+            for (int i = 0; i < length; i++)
+            {
+                gps.encode(data[i]);
+            }
+        }
+        *busyUs += Hal::micros() - busy;
+        Hal::delay(TEST_OLD_POLL_MS);
+        busy = Hal::micros();
+        if ((Hal::millis() - now) > TEST_OLD_WARN_MS)
+        {
+            retries++;
+            now = Hal::millis();
+            *busyUs += Hal::micros() - busy;
+            Hal::delay(TEST_OLD_FIX_MS);
+            busy = Hal::micros();
+            if (retries > TEST_OLD_RETRIES)
+            {
+                break;
+            }
+        }
+        if (gps.location.isValid())
+        {
+            reading->longitude = gps.location.lng();
+            reading->latitude = gps.location.lat();
+            reading->isValid = true;
+            *busyUs += Hal::micros() - busy;
+            Hal::delay(TEST_OLD_FIX_MS);
+            return true;
+        }
+    }
+    *busyUs += Hal::micros() - busy;
+    return false;
+}
+
+/**
+ * Run the polling design on the NMEA capture, reading every TEST_SAMPLE_MS half way between epochs or straight
+ * after the last read if that took longer
+ *
+ * @return The results
+ */
+static TestResult pollingReader()
+{
+    TestResult result;
+    memset(&result, 0, sizeof(result));
+    capture(GPS_CAPTURE_NMEA, TEST_NMEA_BAUD);
+    Hal::Uart uart(GPS_UART);
+    _opened = Hal::micros();
+    TEST_ASSERT_TRUE(uart.open(TEST_NMEA_BAUD, -1, -1, TEST_OLD_BUFFER, 0));
+    int64_t busyUs = 0;
+    int64_t due = _opened + TEST_NO_FIX * TEST_SAMPLE_MS * 1000LL + TEST_SAMPLE_MS * 500LL;
+    int64_t end = _opened + TEST_SECONDS * TEST_SAMPLE_MS * 1000LL;
+    Hal::delay((uint32_t)((due - Hal::micros()) / 1000));
+    int64_t first = Hal::micros();
+    while (Hal::micros() + TEST_SAMPLE_MS * 1000LL < end)
+    {
+        int64_t start = Hal::micros();
+        GpsReading reading;
+        bool fix = pollingTaskToRun(&uart, &reading, &busyUs);
+        int64_t returned = Hal::micros();
+        addRead(&result, returned - start);
+        if (fix)
+        {
+            addFix(&result, reading.latitude, returned);
+        }
+        due += TEST_SAMPLE_MS * 1000LL;
+        if (due > returned)
+        {
+            Hal::delay((uint32_t)((due - returned) / 1000));
+        }
+    }
+    result.cpuUs = busyUs * 1e6 / (Hal::micros() - first);
+    uart.close();
+    return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * The event driven reader publishes each NMEA fix as the epoch's GGA sentence ends, so a read by the
+ * scheduler only copies the fix.  The polling design it replaced held the scheduler until the next epoch had
+ * arrived.  The times depend on the host and how busy it is, so they are reported and only
+ * the fixes are checked.
+ */
+void test_nmea_reader_against_polling()
+{
+    TestResult reader = eventReader(GPS_NMEA, TEST_NMEA_BAUD);
+    TEST_ASSERT_EQUAL_UINT32(TEST_SECONDS - TEST_NO_FIX, reader.fixes);
+    TEST_ASSERT_TRUE(reader.readerMaxLatencyUs <= reader.maxLatencyMs * 1000);
+    TestResult polling = pollingReader();
+    TEST_ASSERT_GREATER_THAN_UINT32(0, polling.fixes);
+    report("NMEA, event reader", &reader);
+    report("NMEA, polling", &polling);
+}
+
+/**
+ * In UBX mode the reader publishes each fix as the NAV-PVT frame ends, and times it from the frame's sync rather
+ * than the idle bytes before it
+ */
+void test_ubx_reader()
+{
+    TestResult reader = eventReader(GPS_UBX, TEST_UBX_BAUD);
+    TEST_ASSERT_EQUAL_UINT32(TEST_SECONDS - TEST_NO_FIX, reader.fixes);
+    TEST_ASSERT_TRUE(reader.readerMaxLatencyUs <= reader.maxLatencyMs * 1000);
+    report("UBX, event reader", &reader);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    LogInfo.begin();
+    StaticJsonDocument<256> doc;
+    // Unity cannot fail a test before UNITY_BEGIN
+    if (deserializeJson(doc, "{\"level\": \"ERROR\"}"))
+    {
+        return 1;
+    }
+    LogInfo.load(doc.as<JsonObjectConst>());
+    UNITY_BEGIN();
+    RUN_TEST(test_nmea_reader_against_polling);
+    RUN_TEST(test_ubx_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,254 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "ResourceLock.h"
+#include "GpsInfo.h"
+#include "../common/GpsCapture.h"
+
+#define TEST_ROOT ".pio/test-gps-replay" // HAL_ROOT for the captures
+#define TEST_SECONDS 60                  // Seconds of the generated drive
+#define TEST_NO_FIX 3                    // Seconds at the start of the drive without a fix, a cold start
+#define TEST_SPEED 10                    // Times faster than the line the capture is replayed, unless HAL_UART_SPEED is set
+#define TEST_BAUD 9600                   // Line rate of the generated captures, UBX too so a sped up replay stays in the buffer
+#define TEST_CORRUPT "0.0005"            // Chance of a bit flip in each byte, unless HAL_UART_CORRUPT is set
+#define TEST_UBX_BYTES 5                 // NMEA bytes for each UBX byte of an epoch, the UBX chance is this many times more
+#define TEST_DROP "0.1"                  // Chance in each second of a dropout, unless HAL_UART_DROP is set
+#define TEST_DROP_MS "2000"              // Length of each dropout, unless HAL_UART_DROP_MS is set
+#define TEST_POLL_MS 5                   // How often the reading is checked for the first fix
+
+typedef struct testReplayStruct
+{
+    double seconds;         // Seconds of the capture at the line rate
+    uint32_t sentences;     // Sentences or frames with a good checksum
+    uint32_t failed;        // Sentences or frames with a bad checksum
+    uint32_t fixes;
+    uint32_t overflows;
+    double timeToFix;       // Seconds of the capture to the first fix
+    uint32_t checked;       // Fixes of a generated drive read back and checked
+    uint32_t mixed;         // Of those, fixes with the altitude of another epoch than the position
+    double cpuUs;           // Reader microseconds for each second of the capture
+} TestReplay;
+
+static double _speed;
+static char _corrupt[16];
+static char _ubxCorrupt[16];
+static char _drop[16];
+static char _dropMs[16];
+
+/**
+ * Set an environment variable unless it was already set when the test started
+ *
+ * @param name The variable
+ * @param value Set to the value it has
+ * @param size The size of value
+ * @param fallback The value if it was not set
+ */
+static void option(const char *name, char *value, size_t size, const char *fallback)
+{
+    const char *set = getenv(name);
+    snprintf(value, size, "%s", set != NULL ? set : fallback);
+}
+
+/**
+ * Replay a capture into a GpsInfoClass reader and measure what it made of it.  The reader is left running when
+ * the capture has ended, it only waits.
+ *
+ * @param path The capture, its full path
+ * @param protocol GPS_NMEA or GPS_UBX
+ * @param baud The line rate of the capture
+ * @param corrupt The HAL_UART_CORRUPT chance, "0" for none
+ * @param drop The HAL_UART_DROP chance, "0" for none
+ * @param drive True if the capture is the generated drive, so the epoch of each fix read can be checked
+ * @return The results
+ */
+static TestReplay replay(const char *path, uint8_t protocol, uint32_t baud, const char *corrupt, const char *drop,
+                         bool drive)
+{
+    TestReplay result;
+    memset(&result, 0, sizeof(result));
+    setenv("HAL_UART2", path, 1);
+    setenv("HAL_UART_CORRUPT", corrupt, 1);
+    setenv("HAL_UART_DROP", drop, 1);
+    setenv("HAL_UART_DROP_MS", _dropMs, 1);
+    FILE *file = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(file, path);
+    fseek(file, 0, SEEK_END);
+    result.seconds = ftell(file) * 10.0 / baud;
+    fclose(file);
+
+    char json[160];
+    snprintf(json, sizeof(json), "{\"baud\": %u, \"protocol\": %u, \"ubxBaud\": %u, \"powerSave\": 0}", baud,
+             protocol, baud);
+    StaticJsonDocument<256> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, json));
+    GpsInfoClass *gps = new GpsInfoClass("gpsSensor", 0);
+    gps->load(doc.as<JsonObjectConst>());
+    gps->begin(&UartLock);
+    int64_t opened = Hal::micros();
+    gps->connect();
+
+    // The reader's CPU is kept for each second, add up the windows the capture was playing in
+    int64_t end = opened + (int64_t)(result.seconds * 1000000 / _speed);
+    int64_t window = Hal::micros();
+    double busyUs = 0;
+    int64_t firstFix = 0;
+    uint32_t last = 0;
+    DynamicJsonDocument stats(1024);
+    while (Hal::micros() < end)
+    {
+        Hal::delay(TEST_POLL_MS);
+        GpsReading reading;
+        uint32_t sequence = gps->getReading(&reading);
+        if (firstFix == 0 && reading.isValid)
+        {
+            firstFix = reading.lastRead * 1000LL;
+        }
+        if (drive && reading.isValid && sequence != last)
+        {
+            // The drive climbs a metre each second, so the altitude gives the epoch as well as the latitude
+            last = sequence;
+            result.checked++;
+            if (gpsCaptureSecond(reading.latitude) != (uint32_t)(reading.altitude - GPS_CAPTURE_ALTITUDE + 0.5))
+            {
+                result.mixed++;
+            }
+        }
+        if (Hal::micros() - window >= 1000000)
+        {
+            window += 1000000;
+            gps->toJson(stats.to<JsonObject>());
+            busyUs += stats["GPSSensor"]["reader"]["cpuUs"].as<uint32_t>();
+        }
+    }
+    // Let the last bytes be read
+    Hal::delay(GPS_READER_WAIT_MS);
+    gps->toJson(stats.to<JsonObject>());
+    JsonObjectConst reader = stats["GPSSensor"]["reader"].as<JsonObjectConst>();
+    result.sentences = reader["passed"].as<uint32_t>();
+    result.failed = reader["failed"].as<uint32_t>();
+    result.fixes = reader["fixes"].as<uint32_t>();
+    result.overflows = reader["overflows"].as<uint32_t>();
+    result.timeToFix = firstFix > 0 ? (firstFix - opened) * _speed / 1e6 : -1;
+    result.cpuUs = busyUs / (result.seconds / _speed) / _speed;
+
+    char message[240];
+    snprintf(message, sizeof(message),
+             "%s, %s corrupt, %s drop: %.0f s, %.1f sentences/s, %u failed, %u fixes, time to fix %.1f s,"
+             " %u overflows, %.0f us/s CPU, %.1f us a fix, %u of %u fixes read mixed epochs",
+             protocol == GPS_UBX ? "UBX" : "NMEA", corrupt, drop, result.seconds, result.sentences / result.seconds,
+             result.failed, result.fixes, result.timeToFix, result.overflows, result.cpuUs,
+             result.fixes > 0 ? result.cpuUs * result.seconds / result.fixes : 0, result.mixed, result.checked);
+    TEST_MESSAGE(message);
+    return result;
+}
+
+/**
+ * Replay the drive clean, with bit errors and with dropouts.  Every epoch with a fix gives one fix when the line
+ * is clean, bit errors fail sentences and lose some fixes, and a dropout loses the epochs it covers.  Only the bytes
+ * received can be hit, so the UBX drive is given TEST_UBX_BYTES times the chance to see as many errors a second.  Whatever is
+ * lost, the altitude of a fix read is always from the same epoch as its position.
+ *
+ * @param protocol GPS_NMEA or GPS_UBX
+ * @param baud The line rate of the capture
+ */
+static void replayDrive(uint8_t protocol, uint32_t baud)
+{
+    const char *file = protocol == GPS_UBX ? "/drive-ubx.bin" : "/drive-nmea.bin";
+    TEST_ASSERT_GREATER_THAN(0, gpsCaptureWrite(file, protocol, TEST_SECONDS, TEST_NO_FIX, baud));
+    char path[64];
+    snprintf(path, sizeof(path), TEST_ROOT "%s", file);
+
+    TestReplay clean = replay(path, protocol, baud, "0", "0", true);
+    TEST_ASSERT_EQUAL_UINT32(TEST_SECONDS - TEST_NO_FIX, clean.fixes);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, clean.checked);
+    TEST_ASSERT_EQUAL_UINT32(0, clean.mixed);
+    TEST_ASSERT_EQUAL_UINT32(0, clean.failed);
+    TEST_ASSERT_EQUAL_UINT32(0, clean.overflows);
+    TEST_ASSERT_TRUE(clean.timeToFix >= TEST_NO_FIX && clean.timeToFix < TEST_NO_FIX + 1);
+
+    TestReplay corrupted = replay(path, protocol, baud, protocol == GPS_UBX ? _ubxCorrupt : _corrupt, "0", true);
+    TEST_ASSERT_EQUAL_UINT32(0, corrupted.mixed);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, corrupted.failed);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(clean.fixes, corrupted.fixes);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, corrupted.fixes);
+
+    TestReplay dropped = replay(path, protocol, baud, "0", _drop, true);
+    TEST_ASSERT_EQUAL_UINT32(0, dropped.mixed);
+    TEST_ASSERT_LESS_THAN_UINT32(clean.fixes, dropped.fixes);
+    TEST_ASSERT_LESS_THAN_UINT32(clean.sentences, dropped.sentences);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * The reader on the NMEA sentences of a NEO-6
+ */
+void test_nmea_replay()
+{
+    replayDrive(GPS_NMEA, TEST_BAUD);
+}
+
+/**
+ * The reader in UBX mode on NAV-PVT frames
+ */
+void test_ubx_replay()
+{
+    replayDrive(GPS_UBX, TEST_BAUD);
+}
+
+/**
+ * A recording made with tools/gpsreplay.py --capture, named in GPS_CAPTURE with its GPS_CAPTURE_BAUD (9600 if
+ * not set) and GPS_CAPTURE_PROTOCOL (0 for NMEA, 1 for UBX), replayed clean, corrupted and with dropouts
+ */
+void test_recorded_replay()
+{
+    const char *path = getenv("GPS_CAPTURE");
+    if (path == NULL)
+    {
+        TEST_IGNORE_MESSAGE("Set GPS_CAPTURE to replay a recording");
+    }
+    const char *baud = getenv("GPS_CAPTURE_BAUD");
+    const char *protocol = getenv("GPS_CAPTURE_PROTOCOL");
+    uint32_t rate = baud != NULL ? strtoul(baud, NULL, 10) : TEST_BAUD;
+    uint8_t mode = protocol != NULL && atoi(protocol) == GPS_UBX ? GPS_UBX : GPS_NMEA;
+    TestReplay clean = replay(path, mode, rate, "0", "0", false);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, clean.sentences);
+    replay(path, mode, rate, _corrupt, "0", false);
+    replay(path, mode, rate, "0", _drop, false);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    LogInfo.begin();
+    StaticJsonDocument<256> doc;
+    // Unity cannot fail a test before UNITY_BEGIN
+    if (deserializeJson(doc, "{\"level\": \"ERROR\"}"))
+    {
+        return 1;
+    }
+    LogInfo.load(doc.as<JsonObjectConst>());
+    char speed[16];
+    option("HAL_UART_SPEED", speed, sizeof(speed), "");
+    _speed = atof(speed);
+    _speed = _speed > 0 ? _speed : TEST_SPEED;
+    snprintf(speed, sizeof(speed), "%g", _speed);
+    setenv("HAL_UART_SPEED", speed, 1);
+    option("HAL_UART_CORRUPT", _corrupt, sizeof(_corrupt), TEST_CORRUPT);
+    snprintf(_ubxCorrupt, sizeof(_ubxCorrupt), "%g", atof(_corrupt) * TEST_UBX_BYTES);
+    option("HAL_UART_DROP", _drop, sizeof(_drop), TEST_DROP);
+    option("HAL_UART_DROP_MS", _dropMs, sizeof(_dropMs), TEST_DROP_MS);
+    UNITY_BEGIN();
+    RUN_TEST(test_nmea_replay);
+    RUN_TEST(test_ubx_replay);
+    RUN_TEST(test_recorded_replay);
+    return UNITY_END();
+}
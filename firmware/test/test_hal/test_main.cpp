@@ -0,0 +1,308 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+
+#define TEST_ROOT ".pio/test-hal"       // HAL_ROOT for the files, partitions and UART captures of the tests
+#define TEST_RING_SIZE 256
+#define TEST_CAPTURE_SIZE 4000
+
+static Hal::Signal _taskSignal;
+static Hal::Signal _timerSignal;
+
+/**
+ * Give the signal passed in, the task and timer callback of the tests
+ *
+ * @param arg The Hal::Signal
+ */
+static void giveSignal(void *arg)
+{
+    ((Hal::Signal *)arg)->give();
+}
+
+/**
+ * Write a capture for the UART tests and point HAL_UART2 at it
+ *
+ * @param data Set to the bytes written
+ */
+static void writeCapture(uint8_t *data)
+{
+    for (size_t i = 0; i < TEST_CAPTURE_SIZE; i++)
+    {
+        data[i] = (uint8_t)(i * 7 + i / 256);
+    }
+    Hal::writeFile("/uart2.bin", data, TEST_CAPTURE_SIZE);
+    setenv("HAL_UART2", TEST_ROOT "/uart2.bin", 1);
+}
+
+/**
+ * Replay the capture on HAL_UART2 until it ends
+ *
+ * @param data Set to the bytes received
+ * @param size The size of data
+ * @return The bytes received
+ */
+static size_t readCapture(uint8_t *data, size_t size)
+{
+    Hal::Uart uart(2);
+    TEST_ASSERT_TRUE(uart.open(9600, -1, -1, 1024, 20));
+    size_t total = 0;
+    size_t waiting;
+    HalUartEvent event;
+    while ((event = uart.wait(&waiting, 1000)) != HAL_UART_END)
+    {
+        TEST_ASSERT_EQUAL(HAL_UART_DATA, event);
+        TEST_ASSERT_LESS_OR_EQUAL(HAL_UART_EVENT_SIZE, waiting);
+        int length = uart.read(data + total, size - total < waiting ? size - total : waiting, 0);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, length);
+        total += length;
+    }
+    uart.close();
+    return total;
+}
+
+void setUp()
+{
+    unsetenv("HAL_UART_SPEED");
+    unsetenv("HAL_UART_CORRUPT");
+    unsetenv("HAL_UART_DROP");
+}
+
+void tearDown()
+{
+}
+
+/**
+ * The CRCs are the ESP32 ROM's, reflected and inverted on the way in and out, so the host and the device
+ * agree on the files and records they check
+ */
+void test_crc_matches_rom()
+{
+    const uint8_t check[] = "123456789";
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, Hal::crc32(0, check, 9));
+    TEST_ASSERT_EQUAL_HEX16(0x906E, Hal::crc16(0, check, 9));
+    TEST_ASSERT_EQUAL_HEX8(0xF4, Hal::crc8(0, check, 9));
+    // Carrying the CRC over is the same as one call
+    TEST_ASSERT_EQUAL_HEX32(Hal::crc32(0, check, 9), Hal::crc32(Hal::crc32(0, check, 4), check + 4, 5));
+}
+
+/**
+ * A task runs its function and a signal given before the take is kept
+ */
+void test_task_and_signal()
+{
+    Hal::Task handle = NULL;
+    TEST_ASSERT_TRUE(Hal::startTask(giveSignal, "test", 4096, &_taskSignal, 1, HAL_ANY_CORE, &handle));
+    TEST_ASSERT_NOT_NULL(handle);
+    TEST_ASSERT_TRUE(_taskSignal.take(1000));
+    TEST_ASSERT_FALSE(_taskSignal.take(10));
+    _taskSignal.give();
+    TEST_ASSERT_TRUE(_taskSignal.take(0));
+    TEST_ASSERT_LESS_THAN(HAL_CORES, Hal::coreId());
+}
+
+/**
+ * A queue keeps the order, refuses items when full and times out when empty
+ */
+void test_queue()
+{
+    Hal::Queue queue(sizeof(uint32_t), 4);
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(queue.send(&i, 0));
+    }
+    uint32_t item = 99;
+    TEST_ASSERT_FALSE(queue.send(&item, 10));
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(queue.receive(&item, 0));
+        TEST_ASSERT_EQUAL_UINT32(i, item);
+    }
+    int64_t start = Hal::micros();
+    TEST_ASSERT_FALSE(queue.receive(&item, 20));
+    TEST_ASSERT_GREATER_OR_EQUAL(20000, Hal::micros() - start);
+    queue.send(&item, 0);
+    queue.reset();
+    TEST_ASSERT_FALSE(queue.receive(&item, 0));
+}
+
+/**
+ * Items of every size go round the ring buffer many times and come out whole and in order
+ */
+void test_ring_buffer_wraps()
+{
+    Hal::RingBuffer ring(TEST_RING_SIZE);
+    uint8_t item[64];
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    for (uint32_t round = 0; round < 500; round++)
+    {
+        size_t size = 1 + round % sizeof(item);
+        memset(item, (uint8_t)sent, size);
+        if (ring.send(item, size, 0))
+        {
+            sent++;
+        }
+        // Leave items waiting some of the time, so the buffer fills and the writes wrap past unread items
+        while (ring.waiting() > round % 3)
+        {
+            size_t length;
+            uint8_t *got = (uint8_t *)ring.receive(&length, 0);
+            TEST_ASSERT_NOT_NULL(got);
+            for (size_t i = 0; i < length; i++)
+            {
+                TEST_ASSERT_EQUAL_UINT8((uint8_t)received, got[i]);
+            }
+            ring.returnItem(got);
+            received++;
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(400, sent);
+    TEST_ASSERT_LESS_OR_EQUAL(2, sent - received);
+    // A full buffer refuses an item rather than overwrite one
+    Hal::RingBuffer full(TEST_RING_SIZE);
+    while (full.send(item, sizeof(item), 0))
+    {
+    }
+    size_t length;
+    TEST_ASSERT_NOT_NULL(full.receive(&length, 0));
+    TEST_ASSERT_EQUAL(sizeof(item), length);
+}
+
+/**
+ * The one shot timer fires once after the delay, and not at all once stopped
+ */
+void test_timer()
+{
+    Hal::Timer timer;
+    TEST_ASSERT_TRUE(timer.begin(giveSignal, &_timerSignal, "test"));
+    int64_t start = Hal::micros();
+    timer.startOnce(5000);
+    TEST_ASSERT_TRUE(_timerSignal.take(1000));
+    TEST_ASSERT_GREATER_OR_EQUAL(5000, Hal::micros() - start);
+    TEST_ASSERT_FALSE(_timerSignal.take(50));
+    timer.startOnce(20000);
+    timer.stop();
+    TEST_ASSERT_FALSE(_timerSignal.take(50));
+}
+
+/**
+ * A file reads back what was written, in pieces and after a seek
+ */
+void test_file()
+{
+    Hal::File file;
+    TEST_ASSERT_TRUE(file.open("/test.txt", "w"));
+    TEST_ASSERT_EQUAL(11, file.write((const uint8_t *)"hello world", 11));
+    file.close();
+    TEST_ASSERT_TRUE(Hal::fileExists("/test.txt"));
+    TEST_ASSERT_EQUAL(11, Hal::fileSize("/test.txt"));
+    TEST_ASSERT_TRUE(file.open("/test.txt", "r"));
+    TEST_ASSERT_EQUAL(11, file.size());
+    TEST_ASSERT_EQUAL('h', file.peek());
+    TEST_ASSERT_EQUAL('h', file.read());
+    TEST_ASSERT_EQUAL(10, file.available());
+    TEST_ASSERT_TRUE(file.seek(6));
+    uint8_t word[5];
+    TEST_ASSERT_EQUAL(5, file.read(word, sizeof(word)));
+    TEST_ASSERT_EQUAL_MEMORY("world", word, 5);
+    TEST_ASSERT_EQUAL(-1, file.read());
+    file.close();
+    TEST_ASSERT_TRUE(Hal::renameFile("/test.txt", "/moved.txt"));
+    TEST_ASSERT_FALSE(Hal::fileExists("/test.txt"));
+    TEST_ASSERT_TRUE(Hal::removeFile("/moved.txt"));
+}
+
+/**
+ * Like flash a partition write only clears bits, so writing without an erase is caught on the host
+ */
+void test_partition_is_flash()
+{
+    Hal::Partition partition;
+    TEST_ASSERT_TRUE(partition.open("test"));
+    TEST_ASSERT_TRUE(partition.erase(0, HAL_FLASH_SECTOR_SIZE));
+    uint8_t value = 0x0F;
+    TEST_ASSERT_TRUE(partition.write(10, &value, 1));
+    value = 0xF0;
+    TEST_ASSERT_TRUE(partition.write(10, &value, 1));
+    TEST_ASSERT_TRUE(partition.read(10, &value, 1));
+    TEST_ASSERT_EQUAL_HEX8(0x00, value);
+    TEST_ASSERT_TRUE(partition.read(11, &value, 1));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, value);
+    TEST_ASSERT_TRUE(partition.erase(0, HAL_FLASH_SECTOR_SIZE));
+    TEST_ASSERT_TRUE(partition.read(10, &value, 1));
+    TEST_ASSERT_EQUAL_HEX8(0xFF, value);
+}
+
+/**
+ * A capture replayed as fast as it is read comes out whole, then the UART reports the end
+ */
+void test_uart_replay()
+{
+    static uint8_t data[TEST_CAPTURE_SIZE];
+    static uint8_t received[TEST_CAPTURE_SIZE];
+    writeCapture(data);
+    setenv("HAL_UART_SPEED", "0", 1);
+    TEST_ASSERT_EQUAL(TEST_CAPTURE_SIZE, readCapture(received, sizeof(received)));
+    TEST_ASSERT_EQUAL_MEMORY(data, received, TEST_CAPTURE_SIZE);
+}
+
+/**
+ * A replay is paced at the baud rate times HAL_UART_SPEED, so it takes as long as the bytes would on the wire
+ */
+void test_uart_replay_paced()
+{
+    static uint8_t data[TEST_CAPTURE_SIZE];
+    static uint8_t received[TEST_CAPTURE_SIZE];
+    writeCapture(data);
+    setenv("HAL_UART_SPEED", "10", 1);
+    int64_t start = Hal::micros();
+    TEST_ASSERT_EQUAL(TEST_CAPTURE_SIZE, readCapture(received, sizeof(received)));
+    // 9600 baud 10 times faster is 96000, 4000 bytes take 417 ms
+    int64_t took = Hal::micros() - start;
+    TEST_ASSERT_GREATER_OR_EQUAL(380000, took);
+    TEST_ASSERT_LESS_THAN(800000, took);
+}
+
+/**
+ * Corruption flips a bit in the bytes it hits and a dropout loses the bytes, both repeatable with the seed
+ */
+void test_uart_replay_faults()
+{
+    static uint8_t data[TEST_CAPTURE_SIZE];
+    static uint8_t received[TEST_CAPTURE_SIZE];
+    writeCapture(data);
+    setenv("HAL_UART_SPEED", "0", 1);
+    setenv("HAL_UART_CORRUPT", "1", 1);
+    TEST_ASSERT_EQUAL(TEST_CAPTURE_SIZE, readCapture(received, sizeof(received)));
+    for (size_t i = 0; i < TEST_CAPTURE_SIZE; i++)
+    {
+        uint8_t flipped = data[i] ^ received[i];
+        TEST_ASSERT_TRUE(flipped != 0 && (flipped & (flipped - 1)) == 0);
+    }
+    unsetenv("HAL_UART_CORRUPT");
+    // At 9600 baud the capture is about 4 seconds of the stream, a dropout in every second loses 100 ms each
+    setenv("HAL_UART_DROP", "1000", 1);
+    setenv("HAL_UART_DROP_MS", "100", 1);
+    size_t kept = readCapture(received, sizeof(received));
+    TEST_ASSERT_LESS_THAN(TEST_CAPTURE_SIZE, kept);
+    TEST_ASSERT_EQUAL(kept, readCapture(received, sizeof(received)));
+    unsetenv("HAL_UART_DROP_MS");
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    UNITY_BEGIN();
+    RUN_TEST(test_crc_matches_rom);
+    RUN_TEST(test_task_and_signal);
+    RUN_TEST(test_queue);
+    RUN_TEST(test_ring_buffer_wraps);
+    RUN_TEST(test_timer);
+    RUN_TEST(test_file);
+    RUN_TEST(test_partition_is_flash);
+    RUN_TEST(test_uart_replay);
+    RUN_TEST(test_uart_replay_paced);
+    RUN_TEST(test_uart_replay_faults);
+    return UNITY_END();
+}
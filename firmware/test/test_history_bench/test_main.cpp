@@ -0,0 +1,270 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "History.h"
+
+#define TEST_ROOT ".pio/test-history-bench" // HAL_ROOT for the history partition
+#define TEST_DAY 86400                      // Seconds in the day of samples added
+#define TEST_SERIES 6                       // The series of the default sensors
+#define TEST_GPS_SERIES 4                   // Of those, the gps series, kept at the same rate
+#define TEST_QUERIES 20                     // Times each query is timed, the mean is kept
+
+typedef struct testSeriesStruct
+{
+    const char *sensor;
+    const char *value;
+    uint32_t rateMs;        // Milliseconds between samples
+} TestSeries;
+
+// The values the env and gps sensors add to the history, at their default sample rates
+static const TestSeries _series[TEST_SERIES] = {
+    {"gps", "latitude", 1000},
+    {"gps", "longitude", 1000},
+    {"gps", "altitude", 1000},
+    {"gps", "speed", 1000},
+    {"env", "temperature", 2500},
+    {"env", "humidity", 2500},
+};
+
+typedef struct testDayStruct
+{
+    uint32_t written[HL_COUNT];     // Records written to each level
+    uint32_t sectors[HL_COUNT];     // Sectors erased and started in each level
+    uint32_t dropped;
+    uint32_t samples;
+    double addUs;                   // Time in add for all the samples
+    double tickUs;                  // Time in tick writing them to flash
+} TestDay;
+
+static uint32_t _end;               // The epoch the day of samples ends at, now so the queries keep them
+
+// The minutes and hours being built, kept over a deep sleep and cleared by a power on
+extern HistorySeries _historySeries[HISTORY_SERIES];
+extern uint8_t _historySeriesCount;
+
+/**
+ * Get a History on an erased partition, as on a new device
+ *
+ * @return The history, never freed as its lock is on the list of locks
+ */
+static HistoryClass *erased()
+{
+    Hal::removeFile("/" HISTORY_PARTITION ".bin");
+    memset(_historySeries, 0, sizeof(_historySeries));
+    _historySeriesCount = 0;
+    HistoryClass *history = new HistoryClass();
+    TEST_ASSERT_TRUE(history->begin());
+    return history;
+}
+
+/**
+ * Get the records written and sectors started for each level
+ *
+ * @param history The history
+ * @param day Set to the counts
+ */
+static void counts(HistoryClass *history, TestDay *day)
+{
+    DynamicJsonDocument doc(1024);
+    history->toJson(doc.to<JsonObject>());
+    const char *levels[HL_COUNT] = {"raw", "minute", "hour"};
+    for (uint8_t level = 0; level < HL_COUNT; level++)
+    {
+        day->written[level] = doc["History"][levels[level]]["written"].as<uint32_t>();
+        day->sectors[level] = doc["History"][levels[level]]["sequence"].as<uint32_t>();
+    }
+    day->dropped = doc["History"]["dropped"].as<uint32_t>();
+}
+
+/**
+ * Add a day of samples of the series, calling tick every second as the main loop does.  The samples follow a
+ * slow sine so the rollups have a spread.
+ *
+ * @param history The history
+ * @param series The series to add
+ * @param count The number of series
+ * @return The records written and the time taken
+ */
+static TestDay addDay(HistoryClass *history, const TestSeries *series, uint8_t count)
+{
+    TestDay day;
+    memset(&day, 0, sizeof(day));
+    uint32_t start = _end - TEST_DAY;
+    for (uint32_t second = 0; second < TEST_DAY; second++)
+    {
+        int64_t begin = Hal::micros();
+        for (uint8_t i = 0; i < count; i++)
+        {
+            // A sample falls in this second if one of the series' sample times does
+            uint32_t rate = series[i].rateMs;
+            if ((second * 1000 + rate - 1) / rate < ((second + 1) * 1000 + rate - 1) / rate)
+            {
+                history->add(series[i].sensor, series[i].value, 20.0f + 5.0f * sinf(second / 3600.0f) + i, start + second);
+                day.samples++;
+            }
+        }
+        int64_t added = Hal::micros();
+        history->tick();
+        day.addUs += added - begin;
+        day.tickUs += Hal::micros() - added;
+    }
+    counts(history, &day);
+    TEST_ASSERT_EQUAL_UINT32(0, day.dropped);
+    return day;
+}
+
+/**
+ * Time a query of a whole level of a series, in pages of HISTORY_REPLY_RECORDS as the cloud asks for it
+ *
+ * @param history The history
+ * @param series The series
+ * @param level The level
+ * @param records Set to the records read
+ * @param pages Set to the pages it took
+ * @return The mean microseconds for the whole range
+ */
+static double queryLevel(HistoryClass *history, const TestSeries *series, HistoryLevel level, uint32_t *records,
+                         uint32_t *pages)
+{
+    static HistoryRecord page[HISTORY_REPLY_RECORDS];
+    int64_t start = Hal::micros();
+    for (uint8_t i = 0; i < TEST_QUERIES; i++)
+    {
+        uint32_t from = 0;
+        uint16_t skip = 0;
+        *records = 0;
+        *pages = 0;
+        for (;;)
+        {
+            uint16_t got = history->query(series->sensor, series->value, level, from, UINT32_MAX, skip, page,
+                                          HISTORY_REPLY_RECORDS);
+            *records += got;
+            (*pages)++;
+            if (got < HISTORY_REPLY_RECORDS)
+            {
+                break;
+            }
+            // Carry on from the last time, skipping the records at that time already read
+            uint32_t last = page[got - 1].time;
+            uint16_t sent = 0;
+            while (sent < got && page[got - 1 - sent].time == last)
+            {
+                sent++;
+            }
+            skip = sent + (last == from ? skip : 0);
+            from = last;
+        }
+    }
+    return (double)(Hal::micros() - start) / TEST_QUERIES;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * The flash one series writes in a day at the GPS and Env sample rates, and how long each level's ring takes
+ * to go round
+ */
+void test_series_day()
+{
+    const uint16_t sectors[HL_COUNT] = {HISTORY_RAW_SECTORS, HISTORY_MINUTE_SECTORS, HISTORY_HOUR_SECTORS};
+    const char *levels[HL_COUNT] = {"raw", "minute", "hour"};
+    for (uint8_t rate = 0; rate < TEST_SERIES; rate += TEST_GPS_SERIES)
+    {
+        HistoryClass *history = erased();
+        TestDay day = addDay(history, &_series[rate], 1);
+        TEST_ASSERT_EQUAL_UINT32(day.samples, day.written[HL_RAW]);
+        // A minute or hour is written when the first sample after it arrives, the last is still being built
+        uint32_t start = _end - TEST_DAY;
+        TEST_ASSERT_EQUAL_UINT32((_end - 1) / 60 - start / 60, day.written[HL_MINUTE]);
+        TEST_ASSERT_EQUAL_UINT32((_end - 1) / 3600 - start / 3600, day.written[HL_HOUR]);
+        for (uint8_t level = 0; level < HL_COUNT; level++)
+        {
+            // Each sector started is erased and given a header, a partly filled one is counted by its records
+            TEST_ASSERT_EQUAL_UINT32((day.written[level] + HISTORY_SECTOR_RECORDS - 1) / HISTORY_SECTOR_RECORDS,
+                                     day.sectors[level]);
+            double erased = (double)day.written[level] / HISTORY_SECTOR_RECORDS;
+            char message[200];
+            snprintf(message, sizeof(message),
+                     "one series every %.1f s, %s: %u records, %.0f bytes written, %.2f sectors erased a day,"
+                     " ring of %u sectors laps every %.1f h",
+                     _series[rate].rateMs / 1000.0, levels[level], day.written[level],
+                     day.written[level] * sizeof(HistoryRecord) + erased * HISTORY_HEADER_SIZE, erased,
+                     sectors[level], 24.0 * sectors[level] / erased);
+            TEST_MESSAGE(message);
+        }
+    }
+}
+
+/**
+ * The default sensors' day: the rate samples are added and written, the time to read back each level of a series
+ * and to build the index again after a restart
+ */
+void test_default_day()
+{
+    HistoryClass *history = erased();
+    TestDay day = addDay(history, _series, TEST_SERIES);
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%u series for a day: %u samples, %.2f us a sample in add, %.0f samples/s, %.2f us a record in tick,"
+             " %.0f records/s written, %u raw, %u minute and %u hour records",
+             TEST_SERIES, day.samples, day.addUs / day.samples, day.samples * 1e6 / day.addUs,
+             day.tickUs / (day.written[HL_RAW] + day.written[HL_MINUTE] + day.written[HL_HOUR]),
+             (day.written[HL_RAW] + day.written[HL_MINUTE] + day.written[HL_HOUR]) * 1e6 / day.tickUs,
+             day.written[HL_RAW], day.written[HL_MINUTE], day.written[HL_HOUR]);
+    TEST_MESSAGE(message);
+    snprintf(message, sizeof(message), "raw ring of %u records keeps %.1f h, a sector erased every %.0f s",
+             (unsigned)(HISTORY_RAW_SECTORS * HISTORY_SECTOR_RECORDS),
+             HISTORY_RAW_SECTORS * HISTORY_SECTOR_RECORDS * 24.0 / day.written[HL_RAW],
+             (double)TEST_DAY * HISTORY_SECTOR_RECORDS / day.written[HL_RAW]);
+    TEST_MESSAGE(message);
+
+    const HistoryLevel levels[HL_COUNT] = {HL_RAW, HL_MINUTE, HL_HOUR};
+    const char *names[HL_COUNT] = {"raw", "minute", "hour"};
+    for (uint8_t i = 0; i < TEST_SERIES; i += TEST_GPS_SERIES)
+    {
+        for (uint8_t level = 0; level < HL_COUNT; level++)
+        {
+            uint32_t records;
+            uint32_t pages;
+            double us = queryLevel(history, &_series[i], levels[level], &records, &pages);
+            TEST_ASSERT_GREATER_THAN_UINT32(0, records);
+            snprintf(message, sizeof(message), "query %s/%s %s: %u records in %u pages, %.0f us, %.0f us a page",
+                     _series[i].sensor, _series[i].value, names[level], records, pages, us, us / pages);
+            TEST_MESSAGE(message);
+        }
+    }
+
+    // A restart finds the same records from the sector headers and a binary search of each sector
+    int64_t start = Hal::micros();
+    HistoryClass *restarted = new HistoryClass();
+    TEST_ASSERT_TRUE(restarted->begin());
+    double scanUs = Hal::micros() - start;
+    uint32_t before;
+    uint32_t after;
+    uint32_t pages;
+    queryLevel(history, &_series[0], HL_MINUTE, &before, &pages);
+    queryLevel(restarted, &_series[0], HL_MINUTE, &after, &pages);
+    TEST_ASSERT_EQUAL_UINT32(before, after);
+    snprintf(message, sizeof(message), "index of %u sectors built in %.0f us",
+             (unsigned)(HISTORY_RAW_SECTORS + HISTORY_MINUTE_SECTORS + HISTORY_HOUR_SECTORS), scanUs);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    LogInfo.begin();
+    _end = Hal::epoch();
+    UNITY_BEGIN();
+    RUN_TEST(test_series_day);
+    RUN_TEST(test_default_day);
+    return UNITY_END();
+}
@@ -0,0 +1,308 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "BaseLogSink.h"
+
+#define TEST_ROOT ".pio/test-log-stress" // HAL_ROOT for the crash log file
+#define TEST_TASKS 8                     // Tasks logging at the same time
+#define TEST_RECORDS 5000                // Records logged by each task
+#define TEST_PAYLOAD 24                  // Length of the string each record carries
+#define TEST_PACE 4                      // Records each paced task logs between 1 ms pauses
+#define TEST_LIMIT_BURST 5               // Messages each call site may log back to back in the rate limit test
+#define TEST_LIMIT_CALLS 100             // Messages each call site tries to log in the rate limit test
+
+/**
+ * A sink that checks every record it is given.  A record must come from a known task, carry that task's payload
+ * whole, have a higher sequence number than the task's last record and be no older than the record before it.
+ * Records dropped because a buffer was full are counted from the log task's notices.
+ */
+class CheckingSink : public BaseLogSink
+{
+public:
+    CheckingSink() : BaseLogSink("checking", LOG_INFO) {}
+
+    void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) override
+    {
+        char text[LOG_RECORD_DATA];
+        unsigned task;
+        unsigned sequence;
+        unsigned dropped;
+        char payload[TEST_PAYLOAD + 2];
+        snprintf(text, sizeof(text), "%.*s", (int)length, message);
+        if (sscanf(text, "Log buffer full, dropped %u records", &dropped) == 1)
+        {
+            this->dropped += dropped;
+        }
+        else if (sscanf(text, "Task %u record %u payload %25s", &task, &sequence, payload) == 3)
+        {
+            this->check(record, task, sequence, payload, strlen(payload));
+        }
+        else
+        {
+            this->errors++;
+        }
+    }
+
+    void writeFrame(const LogRecord *record, const uint8_t *frame, size_t length) override
+    {
+        uint32_t task = UINT32_MAX;
+        uint32_t sequence = 0;
+        const uint8_t *args = &frame[LOG_BINARY_HEADER_SIZE];
+        if (length >= LOG_BINARY_HEADER_SIZE + 2 * sizeof(uint32_t) + 1)
+        {
+            memcpy(&task, &args[0], sizeof(task));
+            memcpy(&sequence, &args[4], sizeof(sequence));
+        }
+        size_t payload = length - LOG_BINARY_HEADER_SIZE - 2 * sizeof(uint32_t) - 1;
+        this->check(record, task, sequence, (const char *)&args[9], args[8] == payload ? payload : 0);
+    }
+
+    void reset()
+    {
+        memset(this->next, 0, sizeof(this->next));
+        this->records = 0;
+        this->dropped = 0;
+        this->errors = 0;
+        this->last = 0;
+    }
+
+    uint32_t next[TEST_TASKS];  // The lowest sequence number the next record of each task can have
+    uint32_t records;
+    uint32_t dropped;
+    uint32_t errors;
+    int64_t last;               // Timestamp of the last record
+
+private:
+    void check(const LogRecord *record, uint32_t task, uint32_t sequence, const char *payload, size_t length)
+    {
+        bool valid = task < TEST_TASKS && sequence >= this->next[task] && length == TEST_PAYLOAD &&
+                     record->timestamp >= this->last;
+        for (size_t i = 0; valid && i < length; i++)
+        {
+            valid = payload[i] == (char)('a' + task);
+        }
+        if (valid)
+        {
+            this->next[task] = sequence + 1;
+            this->last = record->timestamp;
+        }
+        this->errors += valid ? 0 : 1;
+        this->records++;
+    }
+};
+
+static CheckingSink _sink;
+static LogRingRecord _ring[LOG_RING_RECORDS];
+static Hal::Queue *_done;
+static uint32_t _pace;          // Records logged between 1 ms pauses, 0 to log as fast as possible
+
+/**
+ * Log TEST_RECORDS records, pausing every _pace records, then say it has finished
+ *
+ * @param parameters The task number
+ */
+static void logTask(void *parameters)
+{
+    uint8_t task = (uint8_t)(uintptr_t)parameters;
+    char payload[TEST_PAYLOAD + 1];
+    memset(payload, 'a' + task, TEST_PAYLOAD);
+    payload[TEST_PAYLOAD] = '\0';
+    for (uint32_t i = 0; i < TEST_RECORDS; i++)
+    {
+        LogInfo.log(LM_SENSOR, LOG_INFO, "Task %u record %u payload %s", (unsigned)task, (unsigned)i, payload);
+        if (_pace > 0 && (i + 1) % _pace == 0)
+        {
+            Hal::delay(1);
+        }
+    }
+    _done->send(&task, HAL_WAIT_FOREVER);
+}
+
+/**
+ * Load the logging configuration, every sink but the checking one is off and nothing is rate limited or
+ * suppressed, so every record is either written or counted as dropped
+ *
+ * @param format The format the records are captured and written in
+ */
+static void loadConfig(const char *format)
+{
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"level\": \"INFO\", \"format\": \"%s\", \"ringLevel\": \"INFO\", \"suppressRepeats\": false,"
+             " \"rateLimit\": {\"burst\": 5, \"perSecond\": 0},"
+             " \"sinks\": {\"serial\": {\"enabled\": false}, \"file\": {\"enabled\": false},"
+             " \"syslog\": {\"enabled\": false}, \"mqtt\": {\"enabled\": false},"
+             " \"checking\": {\"enabled\": true, \"level\": \"INFO\", \"format\": \"%s\"}}}",
+             format, format);
+    DynamicJsonDocument doc(2048);
+    TEST_ASSERT_FALSE(deserializeJson(doc, json));
+    LogInfo.load(doc.as<JsonObjectConst>());
+    LogInfo.flush();
+    _sink.reset();
+}
+
+/**
+ * Check the crash log ring the tasks added to on their own cores without a lock.  Every record left with a good
+ * CRC must carry one task's message whole, and the slices are merged oldest first.
+ *
+ * @param binary True if the records are binary frames
+ * @return The records with a good CRC
+ */
+static uint8_t checkRing(bool binary)
+{
+    uint8_t count = LogRing.getRecords(_ring);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const LogRingRecord *record = &_ring[i];
+        TEST_ASSERT_TRUE(i == 0 || _ring[i - 1].timestamp <= record->timestamp);
+        if (record->level != LOG_INFO)
+        {
+            // The log task's notices of the records dropped are kept as well
+            continue;
+        }
+        unsigned task = TEST_TASKS;
+        unsigned sequence;
+        char payload[TEST_PAYLOAD + 2] = "";
+        if (binary)
+        {
+            const uint8_t *args = (const uint8_t *)&record->data[LOG_BINARY_HEADER_SIZE];
+            TEST_ASSERT_EQUAL_UINT8(LOG_RING_BINARY, record->flags);
+            TEST_ASSERT_EQUAL_UINT8(LOG_BINARY_HEADER_SIZE + 2 * sizeof(uint32_t) + 1 + TEST_PAYLOAD, record->length);
+            memcpy(&task, &args[0], sizeof(uint32_t));
+            TEST_ASSERT_EQUAL_UINT8(TEST_PAYLOAD, args[8]);
+            memcpy(payload, &args[9], TEST_PAYLOAD);
+            payload[TEST_PAYLOAD] = '\0';
+        }
+        else
+        {
+            char text[LOG_RING_DATA + 1];
+            snprintf(text, sizeof(text), "%.*s", record->length, record->data);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(3, sscanf(text, "Task %u record %u payload %25s", &task, &sequence, payload),
+                                          text);
+        }
+        TEST_ASSERT_LESS_THAN_UINT32(TEST_TASKS, task);
+        TEST_ASSERT_EQUAL_UINT32(TEST_PAYLOAD, strlen(payload));
+        for (uint8_t j = 0; j < TEST_PAYLOAD; j++)
+        {
+            TEST_ASSERT_EQUAL_UINT8('a' + task, payload[j]);
+        }
+    }
+    return count;
+}
+
+/**
+ * Start TEST_TASKS tasks logging at once, wait for them and the log task to finish, then check every record
+ * was written whole and in order or counted as dropped
+ *
+ * @param format The format the records are captured and written in
+ * @param pace Records each task logs between 1 ms pauses, 0 to log as fast as possible
+ * @return The records dropped
+ */
+static uint32_t stress(const char *format, uint32_t pace)
+{
+    loadConfig(format);
+    _pace = pace;
+    int64_t start = Hal::micros();
+    for (uint8_t i = 0; i < TEST_TASKS; i++)
+    {
+        TEST_ASSERT_TRUE(Hal::startTask(logTask, "logStress", 4096, (void *)(uintptr_t)i, 1, HAL_ANY_CORE, NULL));
+    }
+    uint8_t task;
+    for (uint8_t i = 0; i < TEST_TASKS; i++)
+    {
+        TEST_ASSERT_TRUE(_done->receive(&task, 60000));
+    }
+    int64_t logged = Hal::micros() - start;
+    LogInfo.flush(5000);
+    int64_t took = Hal::micros() - start;
+    TEST_ASSERT_EQUAL_UINT32(0, _sink.errors);
+    TEST_ASSERT_EQUAL_UINT32(TEST_TASKS * TEST_RECORDS, _sink.records + _sink.dropped);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, _sink.records);
+    uint8_t kept = checkRing(strcmp(format, "binary") == 0);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, kept);
+
+    char message[240];
+    snprintf(message, sizeof(message),
+             "%s, %s: %u tasks logged %u records in %.0f ms (%.0f records/s), %u written in %.0f ms (%.0f records/s), %u dropped (%.1f%%), %u of %u ring records whole",
+             format, pace > 0 ? "paced" : "flat out", TEST_TASKS, TEST_TASKS * TEST_RECORDS, logged / 1000.0,
+             TEST_TASKS * TEST_RECORDS * 1e6 / logged,
+             _sink.records, took / 1000.0, _sink.records * 1e6 / took, _sink.dropped,
+             100.0 * _sink.dropped / (TEST_TASKS * TEST_RECORDS), kept, LOG_RING_RECORDS);
+    TEST_MESSAGE(message);
+    return _sink.dropped;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * Text records formatted by many tasks at once are never mixed up, when the tasks log faster than the log task
+ * can write the records the extra records are dropped and counted
+ */
+void test_text_stress()
+{
+    stress("text", 0);
+}
+
+/**
+ * Binary records captured by many tasks at once are never mixed up
+ */
+void test_binary_stress()
+{
+    stress("binary", 0);
+}
+
+/**
+ * Tasks that leave the log task time to write are not dropped
+ */
+void test_paced_stress()
+{
+    TEST_ASSERT_EQUAL_UINT32(0, stress("text", TEST_PACE));
+    TEST_ASSERT_EQUAL_UINT32(0, stress("binary", TEST_PACE));
+}
+
+/**
+ * Call sites whose formats are LOG_LIMIT_SLOTS words apart, which all took the same slot when the table was direct
+ * mapped, are each limited to their burst and none is replaced, however they fall in the sets
+ */
+void test_rate_limit_call_sites()
+{
+    static char formats[LOG_LIMIT_WAYS][LOG_LIMIT_SLOTS * 4];
+    LogLimiterClass limiter;
+    limiter.setRate(TEST_LIMIT_BURST, 1);
+    uint32_t allowed[LOG_LIMIT_WAYS];
+    memset(allowed, 0, sizeof(allowed));
+    for (uint16_t i = 0; i < TEST_LIMIT_CALLS; i++)
+    {
+        for (uint8_t site = 0; site < LOG_LIMIT_WAYS; site++)
+        {
+            allowed[site] += limiter.allow(formats[site], LOG_INFO, LM_CORE) ? 1 : 0;
+        }
+    }
+    for (uint8_t site = 0; site < LOG_LIMIT_WAYS; site++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(TEST_LIMIT_BURST, allowed[site]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, limiter.takeEvicted());
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    LogInfo.begin();
+    LogInfo.addSink(&_sink);
+    _done = new Hal::Queue(sizeof(uint8_t), TEST_TASKS);
+    UNITY_BEGIN();
+    RUN_TEST(test_text_stress);
+    RUN_TEST(test_binary_stress);
+    RUN_TEST(test_paced_stress);
+    RUN_TEST(test_rate_limit_call_sites);
+    return UNITY_END();
+}
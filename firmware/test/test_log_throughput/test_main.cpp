@@ -0,0 +1,172 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "BaseLogSink.h"
+
+#define TEST_ROOT ".pio/test-log-throughput" // HAL_ROOT for the crash log file
+#define TEST_RECORDS 20000                   // Records logged for each format
+#define TEST_BURST 32                        // Records logged before waiting for the log task, fits LOG_BUFFER_SIZE
+
+/**
+ * A sink that counts what it is given and checks the records arrive whole and in order, each record carries its
+ * sequence number as the first argument
+ */
+class CountingSink : public BaseLogSink
+{
+public:
+    CountingSink() : BaseLogSink("counting", LOG_INFO) {}
+
+    void write(const LogRecord *record, uint32_t timestamp, const char *message, size_t length) override
+    {
+        const char *number = strstr(message, "Record ");
+        this->check(number != NULL ? strtoul(number + 7, NULL, 10) : UINT32_MAX, length);
+    }
+
+    void writeFrame(const LogRecord *record, const uint8_t *frame, size_t length) override
+    {
+        uint32_t sequence = UINT32_MAX;
+        if (frame[0] == LOG_BINARY_SYNC && (size_t)frame[1] + 2 == length && length >= LOG_BINARY_HEADER_SIZE + sizeof(sequence))
+        {
+            memcpy(&sequence, &frame[LOG_BINARY_HEADER_SIZE], sizeof(sequence));
+        }
+        this->check(sequence, length);
+    }
+
+    void reset()
+    {
+        this->records = 0;
+        this->bytes = 0;
+        this->errors = 0;
+    }
+
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t errors;
+    int64_t last;       // Hal::micros() of the last record written
+
+private:
+    void check(uint32_t sequence, size_t length)
+    {
+        this->errors += sequence != this->records;
+        this->records++;
+        this->bytes += length;
+        this->last = Hal::micros();
+    }
+};
+
+static CountingSink _sink;
+
+/**
+ * Load the logging configuration, every sink but the counting one is off and nothing is rate limited or
+ * suppressed, so every record logged should be written
+ *
+ * @param format The format the records are captured in
+ * @param sinkFormat The format the counting sink writes
+ */
+static void loadConfig(const char *format, const char *sinkFormat)
+{
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"level\": \"INFO\", \"format\": \"%s\", \"ringLevel\": \"ERROR\", \"suppressRepeats\": false,"
+             " \"rateLimit\": {\"burst\": 5, \"perSecond\": 0},"
+             " \"sinks\": {\"serial\": {\"enabled\": false}, \"file\": {\"enabled\": false},"
+             " \"syslog\": {\"enabled\": false}, \"mqtt\": {\"enabled\": false},"
+             " \"counting\": {\"enabled\": true, \"level\": \"INFO\", \"format\": \"%s\"}}}",
+             format, sinkFormat);
+    DynamicJsonDocument doc(2048);
+    TEST_ASSERT_FALSE(deserializeJson(doc, json));
+    LogInfo.load(doc.as<JsonObjectConst>());
+    LogInfo.flush();
+    _sink.reset();
+}
+
+/**
+ * Log TEST_RECORDS records in bursts, waiting for the log task to write each burst so none are dropped.  The
+ * time in log() is what the logging task pays, the time until the sink has the last record of the burst is what
+ * the log task adds on top.
+ *
+ * @param format The format the records are captured in
+ * @param sinkFormat The format the counting sink writes
+ * @return The records a second through log()
+ */
+static double logRecords(const char *format, const char *sinkFormat)
+{
+    loadConfig(format, sinkFormat);
+    int64_t caller = 0;
+    int64_t written = 0;
+    for (uint32_t i = 0; i < TEST_RECORDS; i += TEST_BURST)
+    {
+        int64_t start = Hal::micros();
+        for (uint32_t j = i; j < i + TEST_BURST && j < TEST_RECORDS; j++)
+        {
+            LogInfo.log(LM_SENSOR, LOG_INFO, "Record %u sensor %s temperature %.1f humidity %.1f after %lu ms",
+                        j, "env0", 21.5 + (j % 10), 40.0 + (j % 20), (unsigned long)(j * 3));
+        }
+        caller += Hal::micros() - start;
+        LogInfo.flush();
+        written += _sink.last - start;
+    }
+    TEST_ASSERT_EQUAL_UINT32(TEST_RECORDS, _sink.records);
+    TEST_ASSERT_EQUAL_UINT32(0, _sink.errors);
+
+    char message[160];
+    double rate = TEST_RECORDS * 1e6 / caller;
+    snprintf(message, sizeof(message), "%s captured, %s sink: %.0f records/s in log(), %.0f records/s written, %.1f bytes/record",
+             format, sinkFormat, rate, TEST_RECORDS * 1e6 / written, (double)_sink.bytes / _sink.records);
+    TEST_MESSAGE(message);
+    return rate;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * Text records are formatted with vsnprintf in log() and written as they are
+ */
+void test_text_throughput()
+{
+    logRecords("text", "text");
+}
+
+/**
+ * Binary records only copy the arguments in log(), and the frames written are smaller than the text.  The times
+ * depend on the host and how busy it is, so only the bytes are checked and the speed up is reported.
+ */
+void test_binary_throughput()
+{
+    double text = logRecords("text", "text");
+    uint32_t textBytes = _sink.bytes;
+    double binary = logRecords("binary", "binary");
+    TEST_ASSERT_LESS_THAN_UINT32(textBytes, _sink.bytes);
+    char message[80];
+    snprintf(message, sizeof(message), "binary log() %.1f times the records/s of text", binary / text);
+    TEST_MESSAGE(message);
+}
+
+/**
+ * Binary records written to a text sink are rebuilt as text by the log task, so the caller still only copies
+ * the arguments
+ */
+void test_binary_to_text_throughput()
+{
+    logRecords("binary", "text");
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    LogInfo.begin();
+    LogInfo.addSink(&_sink);
+    UNITY_BEGIN();
+    RUN_TEST(test_text_throughput);
+    RUN_TEST(test_binary_throughput);
+    RUN_TEST(test_binary_to_text_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,216 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "GpsInfo.h"
+#include "UbxParser.h"
+#include "../common/GpsCapture.h"
+
+#define TEST_ROOT ".pio/test-parser-bench" // HAL_ROOT for the captures
+#define TEST_SECONDS 3600                  // Epochs in each capture, an hour at 1 Hz
+#define TEST_NO_FIX 30                     // Epochs at the start without a fix
+#define TEST_PASSES 5                      // Times each capture is parsed, the fastest is kept
+#define TEST_MAX_CAPTURE (TEST_SECONDS * GPS_CAPTURE_EPOCH)
+
+typedef struct testResultStruct
+{
+    size_t bytes;           // Bytes in the capture
+    uint32_t fixes;         // Fixes read out of it
+    double us;              // Fastest time to parse it
+} TestResult;
+
+static uint8_t _capture[TEST_MAX_CAPTURE];
+static volatile float _sink;    // Keeps the fields read from being optimised away
+
+/**
+ * Load the capture to parse.  A recording made with tools/gpsreplay.py --capture can be named in the variable,
+ * otherwise the drive is generated without padding, as a receiver sends it.
+ *
+ * @param protocol GPS_CAPTURE_NMEA or GPS_CAPTURE_UBX
+ * @param variable The environment variable that can name a recording
+ * @return The bytes loaded
+ */
+static size_t load(uint8_t protocol, const char *variable)
+{
+    const char *path = getenv(variable);
+    if (path == NULL)
+    {
+        path = protocol == GPS_CAPTURE_UBX ? "/bench-ubx.bin" : "/bench-nmea.bin";
+        TEST_ASSERT_GREATER_THAN(0, gpsCaptureWrite(path, protocol, TEST_SECONDS, TEST_NO_FIX, 0));
+    }
+    size_t size = Hal::readFile(path, _capture, sizeof(_capture));
+    TEST_ASSERT_GREATER_THAN_MESSAGE(0, size, path);
+    return size;
+}
+
+/**
+ * Parse the NMEA capture with TinyGPSPlus the way the reader does, reading the fix out once both the GGA and the
+ * RMC of an epoch, with the same UTC time, have arrived
+ *
+ * @param size The bytes in the capture
+ * @return The fixes
+ */
+static uint32_t parseNmea(size_t size)
+{
+    TinyGPSPlus gps;
+    uint8_t seen = 0;
+    uint8_t epochSeen = 0;
+    uint8_t epochFix = 0;
+    uint32_t epochTime = 0;
+    uint32_t fixes = 0;
+    float fix = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (!gps.encode(_capture[i]))
+        {
+            continue;
+        }
+        uint8_t sentence = (gps.satellites.isUpdated() ? GPS_SENTENCE_GGA : 0) |
+                           (gps.date.isUpdated() ? GPS_SENTENCE_RMC : 0);
+        if (sentence == 0)
+        {
+            continue;
+        }
+        uint32_t time = gps.time.value();
+        if (time != epochTime)
+        {
+            seen |= epochSeen;
+            epochSeen = 0;
+            epochFix = 0;
+            epochTime = time;
+        }
+        epochSeen |= sentence;
+        fix += gps.date.value() + gps.satellites.value();
+        if (gps.altitude.isUpdated())
+        {
+            fix += gps.altitude.meters();
+            epochFix |= GPS_SENTENCE_GGA;
+        }
+        if (gps.speed.isUpdated())
+        {
+            fix += gps.speed.value() + gps.course.value();
+            epochFix |= GPS_SENTENCE_RMC;
+        }
+        if (gps.location.isUpdated())
+        {
+            fix += gps.location.lat() + gps.location.lng();
+        }
+        if (seen != 0 && (epochFix & (seen | GPS_SENTENCE_PUBLISHED)) == seen)
+        {
+            epochFix |= GPS_SENTENCE_PUBLISHED;
+            _sink = fix;
+            fixes++;
+        }
+    }
+    return fixes;
+}
+
+/**
+ * Parse the UBX capture with UbxParser the way the reader does, reading the fields out of each NAV-PVT frame
+ * with a fix
+ *
+ * @param size The bytes in the capture
+ * @return The fixes
+ */
+static uint32_t parseUbx(size_t size)
+{
+    UbxParser ubx;
+    uint32_t fixes = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (ubx.encode(_capture[i]) && ubx.getClass() == UBX_CLASS_NAV && ubx.getId() == UBX_NAV_PVT &&
+            ubx.getLength() == UBX_NAV_PVT_LENGTH && (ubx.getU1(21) & 0x01) != 0 && ubx.getU1(20) >= 2 &&
+            ubx.getU1(20) <= 4)
+        {
+            _sink = ubx.getI4(24) * 1e-7f + ubx.getI4(28) * 1e-7f + ubx.getI4(36) / 1000.0f + ubx.getU1(23) +
+                    (uint32_t)ubx.getI4(60) * 100 / 514 + ubx.getI4(64) / 1000;
+            fixes++;
+        }
+    }
+    return fixes;
+}
+
+/**
+ * Parse the capture TEST_PASSES times and report the fastest
+ *
+ * @param protocol GPS_CAPTURE_NMEA or GPS_CAPTURE_UBX
+ * @param variable The environment variable that can name a recording
+ * @return The results
+ */
+static TestResult bench(uint8_t protocol, const char *variable)
+{
+    TestResult result;
+    result.bytes = load(protocol, variable);
+    result.us = 0;
+    for (uint8_t pass = 0; pass < TEST_PASSES; pass++)
+    {
+        int64_t start = Hal::micros();
+        result.fixes = protocol == GPS_CAPTURE_UBX ? parseUbx(result.bytes) : parseNmea(result.bytes);
+        double took = Hal::micros() - start;
+        result.us = pass == 0 || took < result.us ? took : result.us;
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(0, result.fixes);
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%s: %u bytes, %u fixes in %.0f us, %.1f MB/s, %.1f ns/byte, %.0f bytes and %.2f us a fix",
+             protocol == GPS_CAPTURE_UBX ? "UBX" : "NMEA", (unsigned)result.bytes, result.fixes, result.us,
+             result.bytes / result.us, result.us * 1000 / result.bytes, (double)result.bytes / result.fixes,
+             result.us / result.fixes);
+    TEST_MESSAGE(message);
+    return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * The NMEA sentences of a fix are several times the bytes of its NAV-PVT frame and each byte costs more to parse,
+ * so a UBX fix is far cheaper.  The times depend on the host and how busy it is, so only the bytes are checked
+ * and the times are reported.
+ */
+void test_ubx_against_nmea()
+{
+    TestResult nmea = bench(GPS_CAPTURE_NMEA, "GPS_NMEA_CAPTURE");
+    TestResult ubx = bench(GPS_CAPTURE_UBX, "GPS_UBX_CAPTURE");
+    if (getenv("GPS_NMEA_CAPTURE") == NULL && getenv("GPS_UBX_CAPTURE") == NULL)
+    {
+        TEST_ASSERT_EQUAL_UINT32(TEST_SECONDS - TEST_NO_FIX, nmea.fixes);
+        TEST_ASSERT_EQUAL_UINT32(TEST_SECONDS - TEST_NO_FIX, ubx.fixes);
+    }
+    TEST_ASSERT_TRUE((double)ubx.bytes / ubx.fixes < (double)nmea.bytes / nmea.fixes);
+    char message[120];
+    snprintf(message, sizeof(message), "UBX: %.1f times fewer bytes and %.1f times less time a fix",
+             ((double)nmea.bytes / nmea.fixes) / ((double)ubx.bytes / ubx.fixes),
+             (nmea.us / nmea.fixes) / (ubx.us / ubx.fixes));
+    TEST_MESSAGE(message);
+}
+
+/**
+ * A frame with a bad checksum is counted and gives no fix
+ */
+void test_ubx_bad_checksum()
+{
+    size_t size = gpsCaptureUbx(100, true, _capture);
+    _capture[40] ^= 0x10;
+    UbxParser ubx;
+    for (size_t i = 0; i < size; i++)
+    {
+        TEST_ASSERT_FALSE(ubx.encode(_capture[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, ubx.failedChecksum());
+    TEST_ASSERT_EQUAL_UINT32(0, ubx.passedChecksum());
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    UNITY_BEGIN();
+    RUN_TEST(test_ubx_against_nmea);
+    RUN_TEST(test_ubx_bad_checksum);
+    return UNITY_END();
+}
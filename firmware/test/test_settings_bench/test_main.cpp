@@ -0,0 +1,167 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "Hal.h"
+#include "LogInfo.h"
+#include "Config.h"
+#include "Settings.h"
+#include "SettingsStores.h"
+#include "LedInfo.h"
+#include "DeviceInfo.h"
+#include "GpsInfo.h"
+#include "EnvSensor.h"
+
+#define TEST_ROOT ".pio/test-settings-bench" // HAL_ROOT for the configuration file
+#define TEST_CHANGES 200                      // Changes made for each measurement
+
+/**
+ * The memory store standing in for NVS, it says it is persistent so the sections store their settings in it
+ */
+class PersistentMemoryStore : public MemorySettingsStoreClass
+{
+public:
+    bool isPersistent() override
+    {
+        return true;
+    }
+};
+
+static PersistentMemoryStore _store;
+static GpsInfoClass _gps("gpsSensor", 0);
+static EnvSensorClass _env("envSensor", 0);
+static uint32_t _fileSize;
+
+typedef struct testCostStruct
+{
+    double latencyUs;       // Mean time for a change
+    double bytes;           // Mean bytes written for a change
+} TestCost;
+
+/**
+ * Make TEST_CHANGES changes to the LED brightness or the device location, saving the configuration file after
+ * each change if the section has to be saved
+ *
+ * @param location True to change the location, false the brightness
+ * @return What a change cost
+ */
+static TestCost change(bool location)
+{
+    uint32_t settingsBytes = Settings.getBytesWritten();
+    uint32_t fileBytes = Configuration.getBytesWritten();
+    int64_t start = Hal::micros();
+    for (uint32_t i = 0; i < TEST_CHANGES; i++)
+    {
+        if (location)
+        {
+            char name[24];
+            snprintf(name, sizeof(name), "Building 4, room %u", i);
+            TEST_ASSERT_TRUE(DeviceInfo.setLocation(name));
+        }
+        else
+        {
+            TEST_ASSERT_TRUE(LedInfo.setBrightness(i % 2 == 0 ? 40 : 60));
+        }
+        if (Configuration.shouldSave())
+        {
+            TEST_ASSERT_TRUE(Configuration.save());
+        }
+    }
+    TestCost cost;
+    cost.latencyUs = (double)(Hal::micros() - start) / TEST_CHANGES;
+    cost.bytes = (double)(Settings.getBytesWritten() - settingsBytes + Configuration.getBytesWritten() - fileBytes) /
+                 TEST_CHANGES;
+    return cost;
+}
+
+/**
+ * Report the costs of a change stored as a setting and as a file rewrite
+ *
+ * @param name The value changed
+ * @param setting The cost as a setting
+ * @param file The cost as a file rewrite
+ */
+static void report(const char *name, TestCost setting, TestCost file)
+{
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%s: setting %.2f us and %.0f bytes a change, %u byte file rewrite %.1f us and %.0f bytes a change"
+             " (%.0f times the bytes)",
+             name, setting.latencyUs, setting.bytes, _fileSize, file.latencyUs, file.bytes, file.bytes / setting.bytes);
+    TEST_MESSAGE(message);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+/**
+ * A brightness change is one NVS entry, a file rewrite writes every section
+ */
+void test_brightness_change()
+{
+    Settings.begin(&_store);
+    TestCost setting = change(false);
+    TEST_ASSERT_EQUAL_FLOAT(SETTINGS_ENTRY_SIZE, setting.bytes);
+
+    Settings.begin(&MemorySettingsStore);
+    TestCost file = change(false);
+    TEST_ASSERT_GREATER_THAN(20 * SETTINGS_ENTRY_SIZE, file.bytes);
+    report("brightness", setting, file);
+}
+
+/**
+ * A location change is a header entry and the string in whole entries
+ */
+void test_location_change()
+{
+    Settings.begin(&_store);
+    TestCost setting = change(true);
+    TEST_ASSERT_LESS_OR_EQUAL(3 * SETTINGS_ENTRY_SIZE, setting.bytes);
+
+    Settings.begin(&MemorySettingsStore);
+    TestCost file = change(true);
+    TEST_ASSERT_GREATER_THAN(10 * setting.bytes, file.bytes);
+    report("location", setting, file);
+}
+
+int main(int argc, char **argv)
+{
+    setenv("HAL_ROOT", TEST_ROOT, 1);
+    Hal::storageBegin();
+    Hal::removeFile("/config.json");
+    LogInfo.begin();
+    Settings.begin(&_store);
+
+    // The sections the firmware saves, other than the cloud and the sensor list
+    StaticJsonDocument<128> doc;
+    // Unity cannot fail a test before UNITY_BEGIN
+    if (deserializeJson(doc, "{\"level\": \"WARNING\"}"))
+    {
+        return 1;
+    }
+    LogInfo.load(doc.as<JsonObjectConst>());
+    doc.clear();
+    LedInfo.load(doc.to<JsonObject>());
+    DeviceInfo.load(doc.as<JsonObjectConst>());
+    _gps.load(doc.as<JsonObjectConst>());
+    _env.load(doc.as<JsonObjectConst>());
+    Configuration.begin("/config.json");
+    Configuration.add(&LogInfo);
+    Configuration.add(&LedInfo);
+    Configuration.add(&DeviceInfo);
+    Configuration.add(&_gps);
+    Configuration.add(&_env);
+    if (!Configuration.save())
+    {
+        return 1;
+    }
+    _fileSize = Configuration.getBytesWritten();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_brightness_change);
+    RUN_TEST(test_location_change);
+    return UNITY_END();
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Record the GPS receiver's output (NMEA text, UBX binary or both), or play a recording to a serial port wired to
+the GPS RX pin of the device in place of the receiver, so GPS changes can be tried without a sky view.  The
+capture is cut into 10 ms chunks at the line rate and can be corrupted and given dropouts on the way.
+
+The capture is parsed by the firmware, not here.  To measure it on the host, replay it into GpsInfoClass with the
+native test, which reports the sentences per second, fixes, time to first fix and reader CPU cost, clean, with
+bit errors and with dropouts:
+
+    GPS_CAPTURE=$PWD/nmea.bin GPS_CAPTURE_BAUD=9600 pio test -e native -f test_gps_replay -v
+
+When playing to a device its own cost and latency are in the "GPSSensor.reader" element of its device twin.
+
+Usage:
+    python tools/gpsreplay.py --port /dev/cu.usbserial-0001 --baud 9600 --capture new.bin --seconds 120
+    python tools/gpsreplay.py --port /dev/cu.usbserial-0001 --baud 9600 --speed 1 --loop nmea.bin
+    python tools/gpsreplay.py --port /dev/cu.usbserial-0001 --corrupt 0.0005 --drop 0.05 --drop-ms 2000 --seed 1 nmea.bin
+"""
+import argparse
+import random
+import time
+
+CHUNK_SECONDS = 0.01
+BITS_PER_BYTE = 10  # 8N1
+
+
+class Impairment:
+    """Corrupt bytes and drop stretches of the stream, seeded so a run can be repeated"""
+
+    def __init__(self, corrupt, drop, drop_ms, seed):
+        self._random = random.Random(seed)
+        self._corrupt = corrupt
+        self._drop = drop * CHUNK_SECONDS
+        self._drop_chunks = int(drop_ms / 1000.0 / CHUNK_SECONDS)
+        self._dropping = 0
+        self.corrupted = 0
+        self.dropped = 0
+
+    def apply(self, chunk):
+        if self._dropping == 0 and self._drop and self._random.random() < self._drop:
+            self._dropping = self._drop_chunks
+        if self._dropping > 0:
+            self._dropping -= 1
+            self.dropped += len(chunk)
+            return b""
+        if not self._corrupt:
+            return chunk
+        out = bytearray(chunk)
+        for i in range(len(out)):
+            if self._random.random() < self._corrupt:
+                out[i] ^= 1 << self._random.randrange(8)
+                self.corrupted += 1
+        return bytes(out)
+
+
+def chunks(data, baud, loop):
+    size = max(1, int(baud / BITS_PER_BYTE * CHUNK_SECONDS))
+    while True:
+        for start in range(0, len(data), size):
+            yield data[start:start + size]
+        if not loop:
+            return
+
+
+def replay(data, args, port):
+    """Play one capture to the port at the line rate times the speed"""
+    impairment = Impairment(args.corrupt, args.drop, args.drop_ms, args.seed)
+    sent = 0
+    stream_seconds = 0.0
+    start = time.monotonic()
+    for chunk in chunks(data, args.baud, args.loop):
+        chunk = impairment.apply(chunk)
+        if chunk:
+            port.write(chunk)
+        sent += len(chunk)
+        stream_seconds += CHUNK_SECONDS
+        if args.speed > 0:
+            # Keep to the line rate times the speed, without drifting
+            delay = start + stream_seconds / args.speed - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+    print("%u bytes sent in %.1f s of the line, %u corrupted, %u dropped" % (
+        sent, stream_seconds, impairment.corrupted, impairment.dropped))
+
+
+def capture(port, filename, seconds):
+    deadline = time.monotonic() + seconds
+    with open(filename, "wb") as f:
+        while time.monotonic() < deadline:
+            f.write(port.read(256))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Record GPS receiver output or play it to a device")
+    parser.add_argument("input", nargs="?", help="Captured receiver output to play, NMEA, UBX or both")
+    parser.add_argument("--port", required=True, help="Serial port of the receiver, or wired to the device's GPS RX pin (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=9600, help="Line rate of the port and the capture")
+    parser.add_argument("--speed", type=float, default=1.0, help="Replay speed, 2 is twice the line rate, 0 is as fast as possible")
+    parser.add_argument("--loop", action="store_true", help="Repeat the capture until stopped")
+    parser.add_argument("--corrupt", type=float, default=0.0, help="Chance of a bit flip in each byte")
+    parser.add_argument("--drop", type=float, default=0.0, help="Chance per second of a dropout starting")
+    parser.add_argument("--drop-ms", type=int, default=1000, help="Length of each dropout")
+    parser.add_argument("--seed", type=int, default=0, help="Seed for the corruption and dropouts")
+    parser.add_argument("--capture", help="Record the receiver on --port to this file instead of playing")
+    parser.add_argument("--seconds", type=int, default=60, help="Length of the capture")
+    args = parser.parse_args()
+
+    import serial
+
+    port = serial.Serial(args.port, args.baud, timeout=0.1)
+    if args.capture:
+        capture(port, args.capture, args.seconds)
+        return
+    if not args.input:
+        parser.error("a capture file is required")
+    with open(args.input, "rb") as f:
+        data = f.read()
+    replay(data, args, port)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""
+Decode the binary log frames written by LogInfo when the "LogInfo" config section has "format": "binary".
+
+Each frame carries the address of the format string instead of the text.  The strings are looked up in the
+firmware ELF file (needs pyelftools) or in a JSON id table ({"0x3f400120": "Temp = %s @ %s", ...}).  Bytes that
+are not part of a frame (boot messages, JSON dumps) are passed straight through.
+
+Usage:
+    python tools/logdecode.py --elf .pio/build/heltec-wifi-esp32/firmware.elf < capture.bin
+    python tools/logdecode.py --elf firmware.elf --port /dev/cu.SLAB_USBtoUART --baud 115200
+    python tools/logdecode.py --table ids.json capture.bin
+    python tools/logdecode.py --elf firmware.elf --hex crash.json
+
+With --hex the input is the "logs" array of an uploaded crash report (or one record per line), where binary records
+are written as "millis:level:core:<frame in hex>".
+"""
+import argparse
+import json
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+HEADER_SIZE = 9  # format id (4), timestamp (4), level + core
+LEVELS = {0: "OFF", 1: "ERR", 2: "WRN", 3: "INF", 4: "VRB", 5: "ALL"}
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|L|q|j|z|t)?([diouxXcfFeEgGaAsp%])")
+
+
+class FormatTable:
+    """Look up format strings by address, from an ELF file or an id table"""
+
+    def __init__(self):
+        self._sections = []
+        self._table = {}
+        self._cache = {}
+
+    def load_elf(self, filename):
+        from elftools.elf.elffile import ELFFile
+
+        with open(filename, "rb") as f:
+            elf = ELFFile(f)
+            for section in elf.iter_sections():
+                if section["sh_type"] == "SHT_PROGBITS" and section["sh_size"] > 0:
+                    self._sections.append((section["sh_addr"], section.data()))
+
+    def load_table(self, filename):
+        with open(filename) as f:
+            for key, value in json.load(f).items():
+                self._table[int(key, 0)] = value
+
+    def lookup(self, address):
+        if address in self._cache:
+            return self._cache[address]
+        text = self._table.get(address)
+        if text is None:
+            for start, data in self._sections:
+                if start <= address < start + len(data):
+                    offset = address - start
+                    end = data.find(b"\0", offset)
+                    text = data[offset:end if end >= 0 else len(data)].decode("utf-8", "replace")
+                    break
+        self._cache[address] = text
+        return text
+
+
+def render(fmt, args):
+    """Expand the format string using the raw argument bytes captured on the device"""
+    out = []
+    pos = 0
+    last = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, precision, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        try:
+            if width == "*":
+                (width,) = struct.unpack_from("<i", args, pos)
+                pos += 4
+            if precision == "*":
+                (precision,) = struct.unpack_from("<i", args, pos)
+                pos += 4
+            spec = "%" + flags + (str(width) if width is not None else "")
+            spec += ("." + str(precision)) if precision is not None else ""
+            if conv in "diouxXc":
+                if length in ("ll", "q", "L", "j"):
+                    (value,) = struct.unpack_from("<q", args, pos)
+                    pos += 8
+                else:
+                    (value,) = struct.unpack_from("<i", args, pos)
+                    pos += 4
+                if conv in "ouxX" and value < 0:
+                    value &= 0xFFFFFFFFFFFFFFFF if length in ("ll", "q", "L", "j") else 0xFFFFFFFF
+                out.append((spec + conv) % (chr(value & 0xFF) if conv == "c" else value))
+            elif conv in "fFeEgGaA":
+                (value,) = struct.unpack_from("<d", args, pos)
+                pos += 8
+                out.append((spec + ("f" if conv in "aA" else conv)) % value)
+            elif conv == "s":
+                size = args[pos]
+                value = args[pos + 1:pos + 1 + size].decode("utf-8", "replace")
+                pos += 1 + size
+                out.append((spec + "s") % value)
+            elif conv == "p":
+                (value,) = struct.unpack_from("<I", args, pos)
+                pos += 4
+                out.append("0x%08x" % value)
+        except (struct.error, IndexError):
+            # Argument was dropped on the device because the frame was full
+            out.append(m.group(0))
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def decode(stream, table, output, follow=False):
+    """Split the byte stream into frames and plain text"""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            if follow:
+                continue
+            break
+        buffer += chunk
+        while buffer:
+            start = buffer.find(bytes([SYNC]))
+            if start < 0:
+                output.write(buffer.decode("utf-8", "replace"))
+                buffer.clear()
+                break
+            if start > 0:
+                output.write(buffer[:start].decode("utf-8", "replace"))
+                del buffer[:start]
+            if len(buffer) < 2:
+                break
+            length = buffer[1]
+            if length < HEADER_SIZE:
+                # Not a frame, just a stray sync byte
+                output.write(buffer[:1].decode("latin-1"))
+                del buffer[:1]
+                continue
+            if len(buffer) < 2 + length:
+                break
+            frame = bytes(buffer[2:2 + length])
+            del buffer[:2 + length]
+            address, timestamp, meta = struct.unpack_from("<IIB", frame)
+            fmt = table.lookup(address)
+            text = render(fmt, frame[HEADER_SIZE:]) if fmt is not None else "<unknown id 0x%08x>" % address
+            output.write("%10u:%s:%i:%s\n" % (timestamp, LEVELS.get(meta & 0x0F, "UNK"), meta >> 4, text))
+        output.flush()
+
+
+def decode_hex(lines, table, output):
+    """Decode the hex encoded frames of a crash report, text records are passed straight through"""
+    for line in lines:
+        line = line.strip()
+        parts = line.split(":", 3)
+        try:
+            frame = bytes.fromhex(parts[3]) if len(parts) == 4 else b""
+        except ValueError:
+            frame = b""
+        if len(frame) < 2 + HEADER_SIZE or frame[0] != SYNC:
+            output.write(line + "\n")
+            continue
+        decode(ByteStream(frame), table, output)
+
+
+class ByteStream:
+    """Minimal stream over a bytes object"""
+
+    def __init__(self, data):
+        self._data = data
+
+    def read(self, size):
+        chunk, self._data = self._data[:size], self._data[size:]
+        return chunk
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode LogInfo binary log frames")
+    parser.add_argument("input", nargs="?", help="Captured log file (default stdin)")
+    parser.add_argument("--elf", help="Firmware ELF file used to resolve the format ids")
+    parser.add_argument("--table", help="JSON file mapping format ids to format strings")
+    parser.add_argument("--port", help="Read directly from a serial port (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--hex", action="store_true", help="Input is a crash report with hex encoded frames")
+    args = parser.parse_args()
+
+    table = FormatTable()
+    if args.elf:
+        table.load_elf(args.elf)
+    if args.table:
+        table.load_table(args.table)
+    if not args.elf and not args.table:
+        parser.error("--elf or --table is required")
+
+    if args.port:
+        import serial
+
+        stream = serial.Serial(args.port, args.baud, timeout=1)
+        decode(stream, table, sys.stdout, follow=True)
+        return
+    if args.hex:
+        text = open(args.input).read() if args.input else sys.stdin.read()
+        try:
+            report = json.loads(text)
+            lines = report.get("crash", report).get("logs", [])
+        except ValueError:
+            lines = text.splitlines()
+        decode_hex(lines, table, sys.stdout)
+        return
+    if args.input:
+        stream = open(args.input, "rb")
+    else:
+        stream = sys.stdin.buffer
+    decode(stream, table, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()